@@ -35,6 +35,8 @@ class MainPage extends StatefulWidget {
 class _MainPageState extends State<MainPage> with WidgetsBindingObserver {
   Carlink? _carlink;
   int? _textureId;
+  // Linux: the native album cover texture, while there is a cover.
+  int? _albumCoverTextureId;
 
   final DongleConfig _dongleConfig = DEFAULT_CONFIG;
 
@@ -113,7 +115,12 @@ class _MainPageState extends State<MainPage> with WidgetsBindingObserver {
       onMediaInfoChanged: (mediaInfo) {
         try {
           Logger.log(
-              "[MEDIA] Now playing: ${mediaInfo.songTitle} by ${mediaInfo.songArtist}, Album: ${mediaInfo.albumName}, App: ${mediaInfo.appName}, Cover: ${mediaInfo.albumCoverImageData?.length ?? 0} bytes");
+              "[MEDIA] Now playing: ${mediaInfo.songTitle} by ${mediaInfo.songArtist}, Album: ${mediaInfo.albumName}, App: ${mediaInfo.appName}, Cover: ${mediaInfo.albumCoverImageData?.length ?? 0} bytes, cover texture: ${mediaInfo.albumCoverTextureId}");
+          if (mediaInfo.albumCoverTextureId != _albumCoverTextureId) {
+            setState(() {
+              _albumCoverTextureId = mediaInfo.albumCoverTextureId;
+            });
+          }
           _setInfoAndCover(
             mediaInfo.songTitle,
             mediaInfo.songArtist,
@@ -434,6 +441,14 @@ class _MainPageState extends State<MainPage> with WidgetsBindingObserver {
                   ),
                 ),
                 if (loading) Positioned.fill(child: _buildLoadingOverlay()),
+                if (loading && _albumCoverTextureId != null)
+                  Positioned(
+                    left: 24,
+                    bottom: 24,
+                    width: 160,
+                    height: 160,
+                    child: Texture(textureId: _albumCoverTextureId!),
+                  ),
                 if (loading)
                   Positioned(
                     top: 24,
@@ -120,6 +120,9 @@ class AdapterStatusInfo {
   /// Whether audio packets have been detected recently
   final bool hasRecentAudioData;
   
+  /// Native pipeline counters from getStats (Linux only)
+  final Map<String, dynamic>? nativeStats;
+  
   /// Timestamp of last status update
   final DateTime lastUpdated;
   
@@ -131,6 +134,7 @@ class AdapterStatusInfo {
     this.boxSettings,
     this.networkInfo,
     this.hasRecentAudioData = false,
+    this.nativeStats,
     required this.lastUpdated,
   });
   
@@ -143,6 +147,7 @@ class AdapterStatusInfo {
     Map<String, dynamic>? boxSettings,
     Map<String, dynamic>? networkInfo,
     bool? hasRecentAudioData,
+    Map<String, dynamic>? nativeStats,
     DateTime? lastUpdated,
   }) {
     return AdapterStatusInfo(
@@ -153,6 +158,7 @@ class AdapterStatusInfo {
       boxSettings: boxSettings ?? this.boxSettings,
       networkInfo: networkInfo ?? this.networkInfo,
       hasRecentAudioData: hasRecentAudioData ?? this.hasRecentAudioData,
+      nativeStats: nativeStats ?? this.nativeStats,
       lastUpdated: lastUpdated ?? DateTime.now(),
     );
   }
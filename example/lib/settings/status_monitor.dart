@@ -1,6 +1,7 @@
 import 'dart:async';
 import 'package:flutter/foundation.dart';
 import 'package:carlink/carlink.dart';
+import 'package:carlink/carlink_platform_interface.dart';
 import 'package:carlink/driver/readable.dart';
 import 'settings_enums.dart';
 import '../logger.dart';
@@ -34,6 +35,9 @@ class AdapterStatusMonitor extends ChangeNotifier {
   /// Polling interval for status updates (in milliseconds)
   static const int _pollingIntervalMs = 500;
   
+  /// Whether a getStats call is still outstanding
+  bool _statsRequestPending = false;
+  
   /// Current status information
   AdapterStatusInfo get currentStatus => _currentStatus;
   
@@ -118,6 +122,11 @@ class AdapterStatusMonitor extends ChangeNotifier {
         _updateStatus(updatedStatus);
       }
       
+      // Native pipeline counters are only exposed by the Linux plugin
+      if (defaultTargetPlatform == TargetPlatform.linux) {
+        _refreshNativeStats();
+      }
+      
       // Note: Additional status messages (0x02, 0xCC, 0x14, 0x19) would be
       // processed here when the Carlink class provides access to them.
       // For now, we derive what we can from the available CarlinkState.
@@ -127,6 +136,26 @@ class AdapterStatusMonitor extends ChangeNotifier {
     }
   }
   
+  /// Fetches one snapshot of the native counters, skipping a poll while
+  /// the previous request is still in flight
+  Future<void> _refreshNativeStats() async {
+    if (_statsRequestPending) return;
+    _statsRequestPending = true;
+    try {
+      final stats = await CarlinkPlatform.instance.getStats();
+      if (_isMonitoring && stats.isNotEmpty) {
+        _updateStatus(_currentStatus.copyWith(
+          nativeStats: stats,
+          lastUpdated: DateTime.now(),
+        ));
+      }
+    } catch (e) {
+      Logger.log('[STATUS_MONITOR] Error reading native stats: $e');
+    } finally {
+      _statsRequestPending = false;
+    }
+  }
+  
   /// Maps CarlinkState to AdapterPhase
   AdapterPhase _mapCarlinkStateToPhase(CarlinkState carlinkState) {
     switch (carlinkState) {
@@ -164,6 +164,8 @@ class _StatusTabContentState extends SettingsTabContentState<StatusTabContent>
               isDeviceAvailable,
               status,
             ),
+            if (status.nativeStats != null)
+              _buildNativeStatsCard('Native Pipeline', status.nativeStats!),
             if (status.manufacturerInfo != null)
               _buildManufacturerInfoCard('Manufacturer Info', status.manufacturerInfo!),
             if (status.boxSettings != null)
@@ -331,6 +333,42 @@ class _StatusTabContentState extends SettingsTabContentState<StatusTabContent>
     );
   }
 
+  /// Builds a status card from the native getStats snapshot (Linux only)
+  Widget _buildNativeStatsCard(String title, Map<String, dynamic> stats) {
+    Map<String, dynamic> group(String name) =>
+        Map<String, dynamic>.from(stats[name] as Map? ?? const {});
+    final decoder = group('decoder');
+    final audio = group('audio');
+    final bitstream = group('bitstream');
+    final videoQueue = Map<String, dynamic>.from(
+        group('queues')['video'] as Map? ?? const {});
+    final latency = Map<String, dynamic>.from(
+        group('frameLatency')['total'] as Map? ?? const {});
+
+    final dropped = decoder['framesDropped'] ?? 0;
+    final errors = decoder['decodeErrors'] ?? 0;
+    final underruns = audio['underruns'] ?? 0;
+    final gaps = bitstream['frameNumGaps'] ?? 0;
+    final healthy =
+        dropped == 0 && errors == 0 && underruns == 0 && gaps == 0;
+    final p99 = (latency['p99Ms'] as num?)?.toStringAsFixed(1) ?? '-';
+    final mbps =
+        ((bitstream['bitrateBps'] as num? ?? 0) / 1e6).toStringAsFixed(1);
+
+    return _buildStatusCard(
+      title,
+      '${decoder['framesDecoded'] ?? 0} / ${decoder['framesReceived'] ?? 0} frames',
+      healthy ? Colors.green : Colors.orange,
+      Icons.memory,
+      'Dropped $dropped, errors $errors, underruns $underruns\n'
+          'Queue ${videoQueue['depth'] ?? 0}/${videoQueue['capacity'] ?? 0}, '
+          'p99 latency $p99 ms\n'
+          '${bitstream['width'] ?? 0}x${bitstream['height'] ?? 0} '
+          '$mbps Mbit/s, GOP ${bitstream['gopLength'] ?? 0}, '
+          'frame_num gaps $gaps',
+    );
+  }
+
   /// Builds a specialized card for Carlink State with Video/Audio status
   Widget _buildCarlinkStateCard(String title, CarlinkState? state, bool isDeviceAvailable, AdapterStatusInfo status) {
     final stateColor = _getStateColor(state);
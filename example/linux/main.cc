@@ -1,6 +1,21 @@
+#include <carlink/carlink_plugin.h>
+
+#include <stdio.h>
+
 #include "my_application.h"
 
 int main(int argc, char** argv) {
+  // CARLINK_CONNECT_EARLY=1, or =WIDTHxHEIGHT@FPS to match the Dart config:
+  // connect to the dongle while the engine boots.
+  const gchar* connect_early = g_getenv("CARLINK_CONNECT_EARLY");
+  if (connect_early != nullptr && g_strcmp0(connect_early, "0") != 0) {
+    int width = 0;
+    int height = 0;
+    int fps = 0;
+    sscanf(connect_early, "%dx%d@%d", &width, &height, &fps);
+    carlink_plugin_connect_early(width, height, fps, 0);
+  }
+
   g_autoptr(MyApplication) app = my_application_new();
   return g_application_run(G_APPLICATION(app), argc, argv);
 }
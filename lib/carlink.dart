@@ -11,6 +11,8 @@ import 'common.dart';
 
 // ignore: constant_identifier_names
 const USB_WAIT_PERIOD_MS = 3000;
+// ignore: constant_identifier_names
+const ALBUM_COVER_SIZE = 512;
 
 enum CarlinkState {
   disconnected,
@@ -25,13 +27,17 @@ class CarlinkMediaInfo {
   final String? albumName;
   final String? appName;
   final Uint8List? albumCoverImageData;
+  // On Linux the cover is decoded natively and shown on this texture
+  // instead of arriving in albumCoverImageData.
+  final int? albumCoverTextureId;
 
   CarlinkMediaInfo(
       {required this.songTitle,
       required this.songArtist,
       required this.albumName,
       required this.appName,
-      required this.albumCoverImageData});
+      required this.albumCoverImageData,
+      this.albumCoverTextureId});
 }
 
 class Carlink {
@@ -76,6 +82,13 @@ class Carlink {
     CarlinkPlatform.instance
         .createTexture(_config.width, _config.height)
         .then(_textureHandler);
+
+    if (defaultTargetPlatform == TargetPlatform.linux) {
+      CarlinkPlatform.setAlbumCoverHandler(_handleAlbumCover);
+      CarlinkPlatform.instance
+          .createAlbumCoverTexture(ALBUM_COVER_SIZE, ALBUM_COVER_SIZE)
+          .then((textureId) => _albumCoverTextureId = textureId);
+    }
   }
 
   Future<UsbDeviceWrapper> _findDevice() async {
@@ -126,6 +139,19 @@ class Carlink {
 
     _connectedOverWifi = false;
 
+    // A session the native side started while the engine booted: opened,
+    // past the handshake and already decoding, so no reset of either.
+    final session = await CarlinkPlatform.instance
+        .attachSession(SendOpen(_config).serialise());
+    if (session != null) {
+      _log('Attached to the session started at launch');
+      _dongleDriver = Dongle(UsbDeviceWrapper.attached(session),
+          _handleDongleMessage, _handleDongleError, _log, _config);
+      await _dongleDriver?.start(handshakeSent: true);
+      _startPairTimeout();
+      return;
+    }
+
     await CarlinkPlatform.instance.resetH264Renderer();
 
     // Find device to "reset" first
@@ -151,10 +177,7 @@ class Carlink {
     await device.open();
     await _dongleDriver?.start();
 
-    _clearPairTimeout();
-    _pairTimeout = Timer(const Duration(seconds: 15), () async {
-      await _dongleDriver?.send(SendCommand(CommandMapping.wifiPair));
-    });
+    _startPairTimeout();
   }
 
   restart() async {
@@ -272,6 +295,16 @@ class Carlink {
     _clearPairTimeout();
     _clearFrameInterval();
 
+    // The Linux plugin dumps its flight recorder on native errors itself;
+    // the heartbeat watchdog runs here.
+    if (error == 'HeartbeatTimeout' &&
+        defaultTargetPlatform == TargetPlatform.linux) {
+      final path = await CarlinkPlatform.instance.dumpFlightRecorder(error!);
+      if (path != null) {
+        _log('Flight recorder written to $path');
+      }
+    }
+
     // Enhanced error handling based on Flutter platform channel best practices
     try {
       // Attempt graceful recovery first
@@ -341,6 +374,13 @@ class Carlink {
     return false;
   }
 
+  _startPairTimeout() {
+    _clearPairTimeout();
+    _pairTimeout = Timer(const Duration(seconds: 15), () async {
+      await _dongleDriver?.send(SendCommand(CommandMapping.wifiPair));
+    });
+  }
+
   _clearPairTimeout() {
     _pairTimeout?.cancel();
     _pairTimeout = null;
@@ -359,6 +399,14 @@ class Carlink {
   String? _lastMediaAlbumName;
   String? _lastMediaAPPName;
   Uint8List? _lastAlbumCover;
+  int? _albumCoverTextureId;
+  // Cache ID of the cover on the album cover texture, if there is one.
+  int? _lastAlbumCoverId;
+
+  _handleAlbumCover(int coverId) {
+    _lastAlbumCoverId = coverId;
+    _notifyMediaInfo();
+  }
 
   _processMediaMetadata(Map<String, dynamic> metadata) {
     // final mdata = metadata;
@@ -384,6 +432,7 @@ class Carlink {
         _lastMediaAlbumName = null;
 
         _lastAlbumCover = null;
+        _lastAlbumCoverId = null;
       }
 
       if (mediaAPPName != null && mediaAPPName.isNotEmpty) {
@@ -405,17 +454,23 @@ class Carlink {
         _lastAlbumCover = albumCover;
       }
 
-      if (_metadataHandler != null) {
-        _metadataHandler(
-          CarlinkMediaInfo(
-            songTitle: (_lastMediaLyrics ?? _lastMediaSongName) ?? " ",
-            songArtist: _lastMediaArtistName ?? " ",
-            albumName: _lastMediaAlbumName,
-            appName: _lastMediaAPPName,
-            albumCoverImageData: _lastAlbumCover,
-          ),
-        );
-      }
+      _notifyMediaInfo();
+    }
+  }
+
+  _notifyMediaInfo() {
+    if (_metadataHandler != null) {
+      _metadataHandler(
+        CarlinkMediaInfo(
+          songTitle: (_lastMediaLyrics ?? _lastMediaSongName) ?? " ",
+          songArtist: _lastMediaArtistName ?? " ",
+          albumName: _lastMediaAlbumName,
+          appName: _lastMediaAPPName,
+          albumCoverImageData: _lastAlbumCover,
+          albumCoverTextureId:
+              _lastAlbumCoverId != null ? _albumCoverTextureId : null,
+        ),
+      );
     }
   }
 }
@@ -13,11 +13,17 @@ class MethodChannelCarlink extends CarlinkPlatform {
   Function(String)? _logHandler;
   Function(int, Uint8List?)? _readingLoopMessageHandler;
   Function(String)? _readingLoopErrorHandler;
+  Function(int)? _albumCoverHandler;
 
   MethodChannelCarlink() {
     methodChannel.setMethodCallHandler((call) async {
       if (call.method == "onLogMessage") {
         _logHandler?.call(call.arguments);
+      } else if (call.method == "onLogMessages") {
+        // Linux delivers native log lines in batches.
+        for (final line in call.arguments) {
+          _logHandler?.call(line);
+        }
       } else if (call.method == "onReadingLoopMessage") {
         final type = call.arguments["type"];
         final data = Uint8List.fromList(call.arguments["data"]);
@@ -27,6 +33,9 @@ class MethodChannelCarlink extends CarlinkPlatform {
         }
       } else if (call.method == "onReadingLoopError") {
         _readingLoopErrorHandler?.call(call.arguments);
+      } else if (call.method == "onAlbumCover") {
+        // Linux decodes album covers natively and sends only the cache ID.
+        _albumCoverHandler?.call(call.arguments);
       }
     });
   }
@@ -35,6 +44,23 @@ class MethodChannelCarlink extends CarlinkPlatform {
     _logHandler = logHandler;
   }
 
+  setAlbumCoverHandler(Function(int)? albumCoverHandler) {
+    _albumCoverHandler = albumCoverHandler;
+  }
+
+  @override
+  Future<UsbAttachedSession?> attachSession(Uint8List openMessage) async {
+    try {
+      final map = await methodChannel.invokeMethod('attachSession', {
+        'open': openMessage,
+      });
+      return map == null ? null : UsbAttachedSession.fromMap(map);
+    } on MissingPluginException {
+      // Only the Linux plugin starts a session before Dart.
+      return null;
+    }
+  }
+
   @override
   Future<void> startReadingLoop(
     UsbEndpoint endpoint,
@@ -82,6 +108,93 @@ class MethodChannelCarlink extends CarlinkPlatform {
     await methodChannel.invokeMethod<void>('resetH264Renderer');
   }
 
+  /// Records every message to and from the dongle to a capture file at
+  /// [path] until [stopRecording]. Returns false if it cannot be created.
+  @override
+  Future<bool> startRecording(String path) async {
+    final started =
+        await methodChannel.invokeMethod<bool>('startRecording', {"path": path});
+    return started ?? false;
+  }
+
+  @override
+  Future<void> stopRecording() async {
+    await methodChannel.invokeMethod<void>('stopRecording');
+  }
+
+  /// One consistent snapshot of the native counters, grouped as
+  /// `transport`, `demux`, `queues` (`video`, `audio`), `decoder`, `audio`,
+  /// `input`, `pools` (`buffers`) and `log`, each a map of counter names to
+  /// ints. `bitstream` describes what the phone sends: SPS size, profile
+  /// and level, frame type counts, GOP length, bitrate, frame size
+  /// percentiles and `frameNumGaps` (access units lost upstream, each of
+  /// which asks the phone for a keyframe). `frameLatency` has, per stage (demux, queue, decode, convert,
+  /// publish, present, total), a map of `count`, `p50Ms`, `p99Ms`, `p999Ms`
+  /// and `maxMs`, from USB arrival to the frame being picked up for the
+  /// screen. `threads` lists every native thread (pipeline threads are
+  /// named `carlink-*`) with `tid`, `name`, `cpuMs`, `cpuPercent` since the
+  /// previous call, `runDelayMs` waiting for a CPU, and `voluntarySwitches`
+  /// and `involuntarySwitches`. The top-level `framesReceived`,
+  /// `framesDecoded`, `framesDropped`, `decodeErrors`, `framesPublished` and
+  /// `logDropped` are kept for existing callers.
+  @override
+  Future<Map<String, dynamic>> getStats() async {
+    final stats =
+        await methodChannel.invokeMapMethod<String, dynamic>('getStats');
+    return stats ?? {};
+  }
+
+  /// Writes the native flight recorder, the last 30 s of message headers,
+  /// transfers, queue depths and counters, to a file under the user cache
+  /// directory and returns its path. The plugin dumps on its own on a read
+  /// loop or decoder error; call this for failures detected in Dart, such as
+  /// HeartbeatTimeout. Returns null when rate limited.
+  @override
+  Future<String?> dumpFlightRecorder(String reason) async {
+    return await methodChannel
+        .invokeMethod<String>('dumpFlightRecorder', {"reason": reason});
+  }
+
+  /// Starts recording native pipeline events: USB transfers, demuxing,
+  /// decoding, conversion and audio playout, per thread.
+  @override
+  Future<void> startTracing() async {
+    await methodChannel.invokeMethod<void>('startTracing');
+  }
+
+  /// Stops tracing and writes the events to [path] as Chrome trace JSON, for
+  /// chrome://tracing or ui.perfetto.dev. Returns false if it cannot be
+  /// written.
+  @override
+  Future<bool> stopTracing(String path) async {
+    final written =
+        await methodChannel.invokeMethod<bool>('stopTracing', {"path": path});
+    return written ?? false;
+  }
+
+  /// Creates a texture that presents the latest album cover, from the dongle
+  /// or passed to [processAlbumCover], decoded natively and scaled to fit
+  /// [width] x [height].
+  @override
+  Future<int> createAlbumCoverTexture(int width, int height) async {
+    final textureId = await methodChannel.invokeMethod<int>(
+        'createAlbumCoverTexture', {"width": width, "height": height});
+    return textureId!;
+  }
+
+  /// Returns the cache ID of the cover. Covers already in the native cache
+  /// are presented without being decoded again.
+  @override
+  Future<int> processAlbumCover(Uint8List data) async {
+    final id = await methodChannel.invokeMethod<int>('processAlbumCover', data);
+    return id!;
+  }
+
+  @override
+  Future<void> removeAlbumCoverTexture() async {
+    await methodChannel.invokeMethod<void>('removeAlbumCoverTexture');
+  }
+
   @override
   Future<List<UsbDevice>> getDeviceList() async {
     List<Map<dynamic, dynamic>> devices =
@@ -31,6 +31,20 @@ abstract class CarlinkPlatform extends PlatformInterface {
     (_instance as MethodChannelCarlink).setLogHandler(logHandler);
   }
 
+  /// Called with the cache ID of each album cover the native side shows on
+  /// the album cover texture.
+  static setAlbumCoverHandler(Function(int)? albumCoverHandler) {
+    (_instance as MethodChannelCarlink)
+        .setAlbumCoverHandler(albumCoverHandler);
+  }
+
+  /// Attaches to the session the native side started before the engine
+  /// booted, once its handshake is sent, provided it sent [openMessage].
+  /// Null when there is none to attach to.
+  Future<UsbAttachedSession?> attachSession(Uint8List openMessage) async {
+    throw UnimplementedError('attachSession() has not been implemented.');
+  }
+
   Future<void> startReadingLoop(
     UsbEndpoint endpoint,
     int timeout, {
@@ -60,6 +74,44 @@ abstract class CarlinkPlatform extends PlatformInterface {
     throw UnimplementedError('platformVersion() has not been implemented.');
   }
 
+  Future<bool> startRecording(String path) async {
+    throw UnimplementedError('startRecording() has not been implemented.');
+  }
+
+  Future<void> stopRecording() async {
+    throw UnimplementedError('stopRecording() has not been implemented.');
+  }
+
+  Future<Map<String, dynamic>> getStats() async {
+    throw UnimplementedError('getStats() has not been implemented.');
+  }
+
+  Future<String?> dumpFlightRecorder(String reason) async {
+    throw UnimplementedError('dumpFlightRecorder() has not been implemented.');
+  }
+
+  Future<void> startTracing() async {
+    throw UnimplementedError('startTracing() has not been implemented.');
+  }
+
+  Future<bool> stopTracing(String path) async {
+    throw UnimplementedError('stopTracing() has not been implemented.');
+  }
+
+  Future<int> createAlbumCoverTexture(int width, int height) async {
+    throw UnimplementedError(
+        'createAlbumCoverTexture() has not been implemented.');
+  }
+
+  Future<int> processAlbumCover(Uint8List data) async {
+    throw UnimplementedError('processAlbumCover() has not been implemented.');
+  }
+
+  Future<void> removeAlbumCoverTexture() async {
+    throw UnimplementedError(
+        'removeAlbumCoverTexture() has not been implemented.');
+  }
+
   Future<void> processData(Uint8List data) async {
     throw UnimplementedError('platformVersion() has not been implemented.');
   }
@@ -37,7 +37,9 @@ class Dongle {
     _writeTimeout = writeTimeout;
   }
 
-  start() async {
+  /// [handshakeSent] when the native side already sent the init messages,
+  /// for a session it started before Dart did.
+  start({bool handshakeSent = false}) async {
     _logHandler('Dongle initializing');
 
     if (!_usbDevice.isOpened) {
@@ -73,8 +75,10 @@ class Dongle {
         SendBoolean(config.androidWorkMode!, FileAddress.ANDROID_WORK_MODE),
     ];
 
-    for (final message in initMessages) {
-      await send(message);
+    if (!handshakeSent) {
+      for (final message in initMessages) {
+        await send(message);
+      }
     }
 
     // Start tight heartbeat watchdog (2s interval, 6s grace)
@@ -33,6 +33,12 @@ class UsbDeviceWrapper {
 
   UsbDeviceWrapper(this._usbDevice);
 
+  /// The device of a session the native side already opened.
+  UsbDeviceWrapper.attached(UsbAttachedSession session)
+      : _usbDevice = session.device {
+    _useInterface(session.configuration.interfaces.first);
+  }
+
   open() async {
     await CarlinkPlatform.instance.requestPermission(_usbDevice);
 
@@ -45,6 +51,10 @@ class UsbDeviceWrapper {
     var interface = conf.interfaces.first;
     await CarlinkPlatform.instance.claimInterface(interface);
 
+    _useInterface(interface);
+  }
+
+  _useInterface(UsbInterface interface) {
     _endpointIn = interface.endpoints
         .firstWhere((e) => e.direction == UsbEndpoint.DIRECTION_IN);
 
@@ -154,6 +164,10 @@ class UsbDeviceWrapper {
         if (e.code == "USBWriteError" && e.message?.contains("actualLength=-1") == true) {
           throw StateError("USB device disconnected during write");
         }
+        if (e.code == "USBWriteError" && e.message?.contains("not resent") == true) {
+          // Part of the message went out; resending it would corrupt the stream.
+          throw StateError("USB write interrupted: ${e.message}");
+        }
         
         // If this is the last attempt, throw the exception
         if (attempt == retryCount) break;
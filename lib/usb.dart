@@ -180,3 +180,29 @@ class UsbDeviceDescription {
   @override
   String toString() => toMap().toString();
 }
+
+/// A dongle the native side connected to before Dart started: opened, with
+/// [configuration] set and its first interface claimed.
+class UsbAttachedSession {
+  final UsbDevice device;
+  final UsbConfiguration configuration;
+
+  UsbAttachedSession({required this.device, required this.configuration});
+
+  factory UsbAttachedSession.fromMap(Map<dynamic, dynamic> map) {
+    return UsbAttachedSession(
+      device: UsbDevice.fromMap(map['device']),
+      configuration: UsbConfiguration.fromMap(map['configuration']),
+    );
+  }
+
+  Map<String, dynamic> toMap() {
+    return {
+      'device': device.toMap(),
+      'configuration': configuration.toMap(),
+    };
+  }
+
+  @override
+  String toString() => toMap().toString();
+}
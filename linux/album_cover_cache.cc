@@ -0,0 +1,210 @@
+#include "album_cover_cache.h"
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace carlink {
+
+struct AlbumCoverCache::DecodeJob {
+  AlbumCoverCache* cache;
+  std::shared_ptr<Token> token;
+  uint64_t generation;
+  uint64_t id;
+  uint32_t max_width;
+  uint32_t max_height;
+  std::vector<uint8_t> encoded;
+  std::shared_ptr<AlbumCover> cover;
+};
+
+AlbumCoverCache::AlbumCoverCache(size_t capacity, ReadyCallback on_ready,
+                                 WorkerPool* pool)
+    : capacity_(std::max<size_t>(capacity, 1)),
+      on_ready_(std::move(on_ready)),
+      pool_(pool),
+      token_(std::make_shared<Token>()) {}
+
+AlbumCoverCache::~AlbumCoverCache() {
+  token_->alive = false;
+}
+
+void AlbumCoverCache::SetDisplaySize(uint32_t width, uint32_t height) {
+  if (width == display_width_ && height == display_height_) {
+    return;
+  }
+  display_width_ = width;
+  display_height_ = height;
+  token_->generation++;
+  entries_.clear();
+  lru_.clear();
+}
+
+uint64_t AlbumCoverCache::Hash(const uint8_t* data, size_t length) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= data[i];
+    hash *= 0x100000001b3ULL;
+  }
+  hash ^= static_cast<uint64_t>(length);
+  hash *= 0x100000001b3ULL;
+  // Dart ints are signed 64-bit, keep IDs positive.
+  return hash & 0x7fffffffffffffffULL;
+}
+
+uint64_t AlbumCoverCache::Submit(const uint8_t* data, size_t length) {
+  const uint64_t id = Hash(data, length);
+
+  auto it = entries_.find(id);
+  if (it != entries_.end()) {
+    Touch(it->second, id);
+    return id;
+  }
+
+  lru_.push_front(id);
+  entries_[id] = Entry{nullptr, lru_.begin()};
+  EvictIfNeeded();
+
+  auto* job = new DecodeJob{this,
+                            token_,
+                            token_->generation,
+                            id,
+                            display_width_,
+                            display_height_,
+                            std::vector<uint8_t>(data, data + length),
+                            nullptr};
+  decode_count_++;
+
+  if (pool_ != nullptr) {
+    pool_->Post(WorkerPool::kBackground, [job] {
+      Decode(job);
+      g_main_context_invoke_full(
+          nullptr, G_PRIORITY_DEFAULT,
+          [](gpointer data) -> gboolean {
+            Finish(static_cast<DecodeJob*>(data));
+            return G_SOURCE_REMOVE;
+          },
+          job, [](gpointer data) { delete static_cast<DecodeJob*>(data); });
+    });
+    return id;
+  }
+  GTask* task = g_task_new(nullptr, nullptr, DecodeDone, nullptr);
+  g_task_set_task_data(task, job, [](gpointer data) {
+    delete static_cast<DecodeJob*>(data);
+  });
+  g_task_run_in_thread(task, DecodeThread);
+  g_object_unref(task);
+
+  return id;
+}
+
+std::shared_ptr<const AlbumCover> AlbumCoverCache::Lookup(uint64_t id) {
+  auto it = entries_.find(id);
+  if (it == entries_.end()) {
+    return nullptr;
+  }
+  Touch(it->second, id);
+  return it->second.cover;
+}
+
+void AlbumCoverCache::Touch(Entry& entry, uint64_t id) {
+  lru_.erase(entry.lru_position);
+  lru_.push_front(id);
+  entry.lru_position = lru_.begin();
+}
+
+void AlbumCoverCache::EvictIfNeeded() {
+  while (entries_.size() > capacity_) {
+    entries_.erase(lru_.back());
+    lru_.pop_back();
+  }
+}
+
+// Runs on a GLib worker thread.
+void AlbumCoverCache::DecodeThread(GTask* task, gpointer source_object,
+                                   gpointer task_data,
+                                   GCancellable* cancellable) {
+  auto* job = static_cast<DecodeJob*>(task_data);
+  Decode(job);
+  g_task_return_boolean(task, job->cover != nullptr);
+}
+
+// Only touches the job.
+void AlbumCoverCache::Decode(DecodeJob* job) {
+  g_autoptr(GdkPixbufLoader) loader = gdk_pixbuf_loader_new();
+  gboolean loaded = gdk_pixbuf_loader_write(loader, job->encoded.data(),
+                                            job->encoded.size(), nullptr);
+  loaded = gdk_pixbuf_loader_close(loader, nullptr) && loaded;
+  GdkPixbuf* decoded = loaded ? gdk_pixbuf_loader_get_pixbuf(loader) : nullptr;
+  if (decoded == nullptr) {
+    return;
+  }
+
+  g_autoptr(GdkPixbuf) oriented =
+      gdk_pixbuf_apply_embedded_orientation(decoded);
+  const int src_width = gdk_pixbuf_get_width(oriented);
+  const int src_height = gdk_pixbuf_get_height(oriented);
+
+  // Fit inside the display size, never upscale.
+  double scale = 1.0;
+  if (job->max_width > 0 && job->max_height > 0) {
+    scale = std::min({1.0, static_cast<double>(job->max_width) / src_width,
+                      static_cast<double>(job->max_height) / src_height});
+  }
+  const int width = std::max(1, static_cast<int>(src_width * scale + 0.5));
+  const int height = std::max(1, static_cast<int>(src_height * scale + 0.5));
+
+  g_autoptr(GdkPixbuf) scaled =
+      (width == src_width && height == src_height)
+          ? GDK_PIXBUF(g_object_ref(oriented))
+          : gdk_pixbuf_scale_simple(oriented, width, height,
+                                    GDK_INTERP_BILINEAR);
+  g_autoptr(GdkPixbuf) rgba = gdk_pixbuf_add_alpha(scaled, FALSE, 0, 0, 0);
+
+  auto cover = std::make_shared<AlbumCover>();
+  cover->id = job->id;
+  cover->width = width;
+  cover->height = height;
+  cover->rgba.resize(static_cast<size_t>(width) * height * 4);
+
+  const int stride = gdk_pixbuf_get_rowstride(rgba);
+  const guchar* pixels = gdk_pixbuf_read_pixels(rgba);
+  for (int y = 0; y < height; y++) {
+    memcpy(cover->rgba.data() + static_cast<size_t>(y) * width * 4,
+           pixels + static_cast<size_t>(y) * stride, width * 4);
+  }
+
+  job->cover = std::move(cover);
+}
+
+// Runs on the main thread once the worker is done.
+void AlbumCoverCache::DecodeDone(GObject* source_object, GAsyncResult* result,
+                                 gpointer user_data) {
+  Finish(static_cast<DecodeJob*>(g_task_get_task_data(G_TASK(result))));
+}
+
+void AlbumCoverCache::Finish(DecodeJob* job) {
+  if (!job->token->alive || job->token->generation != job->generation) {
+    return;
+  }
+  job->cache->Complete(job);
+}
+
+void AlbumCoverCache::Complete(DecodeJob* job) {
+  auto it = entries_.find(job->id);
+  if (it == entries_.end()) {
+    // Evicted while decoding.
+    return;
+  }
+  if (!job->cover) {
+    lru_.erase(it->second.lru_position);
+    entries_.erase(it);
+    return;
+  }
+  it->second.cover = job->cover;
+  if (on_ready_) {
+    on_ready_(it->second.cover);
+  }
+}
+
+}  // namespace carlink
@@ -0,0 +1,112 @@
+#ifndef FLUTTER_PLUGIN_CARLINK_ALBUM_COVER_CACHE_H_
+#define FLUTTER_PLUGIN_CARLINK_ALBUM_COVER_CACHE_H_
+
+#include <gio/gio.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "core/worker_pool.h"
+
+namespace carlink {
+
+// A decoded album cover, scaled to fit the display size and stored as
+// tightly packed RGBA.
+struct AlbumCover {
+  uint64_t id = 0;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  std::vector<uint8_t> rgba;
+};
+
+// Small LRU cache of decoded album covers keyed by a hash of the encoded
+// blob sent in MediaData/AlbumCover messages.
+//
+// Covers that are not cached yet are decoded and scaled in the background
+// lane of the plugin's WorkerPool, or on a GLib worker thread without one.
+// All public methods, and the ready callback, run on the main thread, so
+// the cache itself needs no locking.
+class AlbumCoverCache {
+ public:
+  using ReadyCallback =
+      std::function<void(std::shared_ptr<const AlbumCover> cover)>;
+
+  static constexpr size_t kDefaultCapacity = 8;
+
+  // |pool| is not owned; queued decodes may outlive the cache.
+  AlbumCoverCache(size_t capacity, ReadyCallback on_ready,
+                  WorkerPool* pool = nullptr);
+  ~AlbumCoverCache();
+
+  AlbumCoverCache(const AlbumCoverCache&) = delete;
+  AlbumCoverCache& operator=(const AlbumCoverCache&) = delete;
+
+  // Sets the size covers are scaled down to. Changing it drops every cached
+  // cover, since they were scaled for the old size.
+  void SetDisplaySize(uint32_t width, uint32_t height);
+
+  // Returns the cache ID of |data|, scheduling a decode if the cover is not
+  // cached or already being decoded.
+  uint64_t Submit(const uint8_t* data, size_t length);
+
+  // Returns the decoded cover for |id|, or nullptr while it is still being
+  // decoded or after it was evicted.
+  std::shared_ptr<const AlbumCover> Lookup(uint64_t id);
+
+  size_t size() const { return entries_.size(); }
+
+  // Number of decodes started since construction.
+  uint64_t decode_count() const { return decode_count_; }
+
+  // 64-bit FNV-1a over the encoded blob, mixed with its length.
+  static uint64_t Hash(const uint8_t* data, size_t length);
+
+ private:
+  struct Entry {
+    std::shared_ptr<const AlbumCover> cover;
+    std::list<uint64_t>::iterator lru_position;
+  };
+
+  // Shared with in-flight decode jobs so completions arriving after the
+  // cache is destroyed, or after the display size changed, are dropped.
+  struct Token {
+    bool alive = true;
+    uint64_t generation = 0;
+  };
+
+  struct DecodeJob;
+
+  // Any thread. Sets the job's cover, or leaves it null if undecodable.
+  static void Decode(DecodeJob* job);
+  static void DecodeThread(GTask* task, gpointer source_object,
+                           gpointer task_data, GCancellable* cancellable);
+  static void DecodeDone(GObject* source_object, GAsyncResult* result,
+                         gpointer user_data);
+  // Main thread, once |job| was decoded.
+  static void Finish(DecodeJob* job);
+
+  void Complete(DecodeJob* job);
+  void Touch(Entry& entry, uint64_t id);
+  void EvictIfNeeded();
+
+  size_t capacity_;
+  ReadyCallback on_ready_;
+  WorkerPool* const pool_;
+  uint32_t display_width_ = 0;
+  uint32_t display_height_ = 0;
+  uint64_t decode_count_ = 0;
+  std::shared_ptr<Token> token_;
+
+  // Most recently used at the front.
+  std::list<uint64_t> lru_;
+  std::unordered_map<uint64_t, Entry> entries_;
+};
+
+}  // namespace carlink
+
+#endif  // FLUTTER_PLUGIN_CARLINK_ALBUM_COVER_CACHE_H_
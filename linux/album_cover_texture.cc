@@ -0,0 +1,70 @@
+#include "album_cover_texture.h"
+
+#include <mutex>
+
+struct CoverSlot {
+  std::mutex mutex;
+  // Set from the main thread.
+  std::shared_ptr<const carlink::AlbumCover> pending;
+  // Owned by the raster thread; keeps the buffer handed to the engine alive
+  // until the next copy_pixels call.
+  std::shared_ptr<const carlink::AlbumCover> presented;
+};
+
+struct _CarlinkAlbumCoverTexture {
+  FlPixelBufferTexture parent_instance;
+  CoverSlot* slot;
+};
+
+G_DEFINE_TYPE(CarlinkAlbumCoverTexture, carlink_album_cover_texture,
+              fl_pixel_buffer_texture_get_type())
+
+static gboolean carlink_album_cover_texture_copy_pixels(
+    FlPixelBufferTexture* texture,
+    const uint8_t** out_buffer,
+    uint32_t* width,
+    uint32_t* height,
+    GError** error) {
+  CarlinkAlbumCoverTexture* self = CARLINK_ALBUM_COVER_TEXTURE(texture);
+  std::lock_guard<std::mutex> lock(self->slot->mutex);
+  self->slot->presented = self->slot->pending;
+  const carlink::AlbumCover* cover = self->slot->presented.get();
+  if (cover == nullptr) {
+    g_set_error(error, g_quark_from_static_string("carlink"), 0,
+                "no album cover");
+    return FALSE;
+  }
+  *out_buffer = cover->rgba.data();
+  *width = cover->width;
+  *height = cover->height;
+  return TRUE;
+}
+
+static void carlink_album_cover_texture_finalize(GObject* object) {
+  CarlinkAlbumCoverTexture* self = CARLINK_ALBUM_COVER_TEXTURE(object);
+  delete self->slot;
+  G_OBJECT_CLASS(carlink_album_cover_texture_parent_class)->finalize(object);
+}
+
+static void carlink_album_cover_texture_class_init(
+    CarlinkAlbumCoverTextureClass* klass) {
+  G_OBJECT_CLASS(klass)->finalize = carlink_album_cover_texture_finalize;
+  FL_PIXEL_BUFFER_TEXTURE_CLASS(klass)->copy_pixels =
+      carlink_album_cover_texture_copy_pixels;
+}
+
+static void carlink_album_cover_texture_init(CarlinkAlbumCoverTexture* self) {
+  self->slot = new CoverSlot();
+}
+
+CarlinkAlbumCoverTexture* carlink_album_cover_texture_new() {
+  return CARLINK_ALBUM_COVER_TEXTURE(
+      g_object_new(carlink_album_cover_texture_get_type(), nullptr));
+}
+
+void carlink_album_cover_texture_set_cover(
+    CarlinkAlbumCoverTexture* self,
+    std::shared_ptr<const carlink::AlbumCover> cover) {
+  std::lock_guard<std::mutex> lock(self->slot->mutex);
+  self->slot->pending = std::move(cover);
+}
@@ -0,0 +1,22 @@
+#ifndef FLUTTER_PLUGIN_CARLINK_ALBUM_COVER_TEXTURE_H_
+#define FLUTTER_PLUGIN_CARLINK_ALBUM_COVER_TEXTURE_H_
+
+#include <flutter_linux/flutter_linux.h>
+
+#include <memory>
+
+#include "album_cover_cache.h"
+
+G_DECLARE_FINAL_TYPE(CarlinkAlbumCoverTexture, carlink_album_cover_texture,
+                     CARLINK, ALBUM_COVER_TEXTURE, FlPixelBufferTexture)
+
+// Pixel buffer texture presenting the current album cover.
+CarlinkAlbumCoverTexture* carlink_album_cover_texture_new();
+
+// Replaces the presented cover. Safe to call while the raster thread is
+// copying the previous one; the caller marks the frame available.
+void carlink_album_cover_texture_set_cover(
+    CarlinkAlbumCoverTexture* texture,
+    std::shared_ptr<const carlink::AlbumCover> cover);
+
+#endif  // FLUTTER_PLUGIN_CARLINK_ALBUM_COVER_TEXTURE_H_
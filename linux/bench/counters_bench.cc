@@ -0,0 +1,43 @@
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+
+#include "core/sharded_counters.h"
+
+namespace carlink {
+namespace {
+
+// Shared by the benchmark threads, as the pipeline's counters are shared
+// by the USB, decoder and main threads.
+ShardedCounters g_sharded(4);
+std::atomic<uint64_t> g_atomic{0};
+
+// A per-thread copy: no locked instruction, no shared cache line.
+void BM_ShardedCounterAdd(benchmark::State& state) {
+  for (auto _ : state) {
+    g_sharded.Add(1);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ShardedCounterAdd)->Threads(1)->Threads(4);
+
+// What the counters were before: one fetch_add on a shared atomic.
+void BM_AtomicCounterAdd(benchmark::State& state) {
+  for (auto _ : state) {
+    g_atomic.fetch_add(1, std::memory_order_relaxed);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_AtomicCounterAdd)->Threads(1)->Threads(4);
+
+void BM_ShardedCounterSnapshot(benchmark::State& state) {
+  uint64_t values[4];
+  for (auto _ : state) {
+    g_sharded.Snapshot(values);
+    benchmark::DoNotOptimize(values);
+  }
+}
+BENCHMARK(BM_ShardedCounterSnapshot);
+
+}  // namespace
+}  // namespace carlink
@@ -0,0 +1,102 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "core/audio.h"
+#include "core/demuxer.h"
+
+namespace carlink {
+namespace {
+
+// About a second of a 60 fps session: 30 KB video frames with a 150 KB
+// keyframe every 60, and 20 ms 48 kHz stereo audio packets in between.
+std::vector<uint8_t> MakeSessionStream(size_t* messages) {
+  std::vector<uint8_t> stream;
+  *messages = 0;
+  auto append = [&](MessageType type, size_t size, uint8_t fill) {
+    const std::vector<uint8_t> payload(size, fill);
+    const EncodedMessage message =
+        EncodeMessage(type, payload.data(), payload.size());
+    stream.insert(stream.end(), message.begin(), message.end());
+    (*messages)++;
+  };
+  for (int frame = 0; frame < 60; frame++) {
+    append(MessageType::kVideoData,
+           kVideoDataHeaderSize + (frame == 0 ? 150000 : 30000), 0x42);
+    if (frame % 6 < 5) {
+      append(MessageType::kAudioData, kAudioDataHeaderSize + 960 * 4, 0x11);
+    }
+  }
+  return stream;
+}
+
+// Argument: transfer size, i.e. how many bytes each Feed() call gets.
+void BM_DemuxSession(benchmark::State& state) {
+  size_t messages_per_pass;
+  const std::vector<uint8_t> stream = MakeSessionStream(&messages_per_pass);
+  const size_t transfer = state.range(0);
+  uint64_t messages = 0;
+  // Messages go straight back to the pool, like a consumer keeping up.
+  Demuxer demuxer(BufferPool::Create(),
+                  [&messages](Message message) { messages++; });
+  for (auto _ : state) {
+    for (size_t offset = 0; offset < stream.size(); offset += transfer) {
+      demuxer.Feed(stream.data() + offset,
+                   std::min(transfer, stream.size() - offset), 0);
+    }
+  }
+  if (messages != messages_per_pass * state.iterations()) {
+    state.SkipWithError("demuxer lost messages");
+  }
+  state.SetItemsProcessed(messages);
+  state.SetBytesProcessed(stream.size() * state.iterations());
+}
+BENCHMARK(BM_DemuxSession)->Arg(16384)->Arg(512 * 1024);
+
+// The magic scanner over bytes that never contain it, as after a corrupt
+// header in the middle of a large video payload.
+void BM_FindMagic(benchmark::State& state) {
+  std::vector<uint8_t> data(state.range(0));
+  for (size_t i = 0; i < data.size(); i++) {
+    // Plenty of 0xaa and 0x55 to trip a naive byte-by-byte match.
+    data[i] = i % 3 == 0 ? 0xaa : static_cast<uint8_t>(i * 131 + 0x55);
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(FindMagic(data.data(), data.size()));
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(data.size() * state.iterations());
+}
+BENCHMARK(BM_FindMagic)->Arg(4096)->Arg(1 << 20);
+
+// A stream where every message is followed by garbage, so each one costs a
+// rejected header and a resync.
+void BM_DemuxResync(benchmark::State& state) {
+  std::vector<uint8_t> stream;
+  size_t messages_per_pass = 0;
+  const std::vector<uint8_t> payload(4096, 0x42);
+  const EncodedMessage message = EncodeMessage(
+      MessageType::kVideoData, payload.data(), payload.size());
+  for (int i = 0; i < 64; i++) {
+    stream.insert(stream.end(), message.begin(), message.end());
+    messages_per_pass++;
+    for (int j = 0; j < 1024; j++) {
+      stream.push_back(static_cast<uint8_t>(j * 7 + 1));
+    }
+  }
+  uint64_t messages = 0;
+  Demuxer demuxer(BufferPool::Create(),
+                  [&messages](Message message) { messages++; });
+  for (auto _ : state) {
+    demuxer.Feed(stream.data(), stream.size(), 0);
+  }
+  state.counters["resyncs"] = benchmark::Counter(
+      demuxer.stats().resyncs, benchmark::Counter::kAvgIterations);
+  state.SetItemsProcessed(messages);
+  state.SetBytesProcessed(stream.size() * state.iterations());
+}
+BENCHMARK(BM_DemuxResync);
+
+}  // namespace
+}  // namespace carlink
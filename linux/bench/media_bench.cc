@@ -0,0 +1,144 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <vector>
+
+#include "core/audio.h"
+#include "core/nal_scanner.h"
+#include "core/yuv.h"
+
+namespace carlink {
+namespace {
+
+std::vector<uint8_t> ReadSampleVideo() {
+  std::vector<uint8_t> contents;
+  FILE* file = fopen(CARLINK_BENCH_VIDEO, "rb");
+  if (file == nullptr) {
+    return contents;
+  }
+  uint8_t chunk[65536];
+  size_t read;
+  while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    contents.insert(contents.end(), chunk, chunk + read);
+  }
+  fclose(file);
+  return contents;
+}
+
+const std::vector<uint8_t>& SampleVideo() {
+  static const std::vector<uint8_t> video = ReadSampleVideo();
+  return video;
+}
+
+void BM_NalScanner(benchmark::State& state) {
+  const std::vector<uint8_t>& video = SampleVideo();
+  if (video.empty()) {
+    state.SkipWithError("sample video missing");
+    return;
+  }
+  uint64_t units = 0;
+  for (auto _ : state) {
+    NalScanner scanner(video.data(), video.size());
+    NalUnit unit;
+    while (scanner.Next(&unit)) {
+      units++;
+    }
+    benchmark::DoNotOptimize(unit);
+  }
+  state.SetItemsProcessed(units);
+  state.SetBytesProcessed(video.size() * state.iterations());
+}
+BENCHMARK(BM_NalScanner);
+
+void BM_SplitAccessUnits(benchmark::State& state) {
+  const std::vector<uint8_t>& video = SampleVideo();
+  if (video.empty()) {
+    state.SkipWithError("sample video missing");
+    return;
+  }
+  uint64_t units = 0;
+  for (auto _ : state) {
+    const std::vector<AccessUnitRange> ranges =
+        SplitAccessUnits(video.data(), video.size());
+    units += ranges.size();
+  }
+  state.SetItemsProcessed(units);
+  state.SetBytesProcessed(video.size() * state.iterations());
+}
+BENCHMARK(BM_SplitAccessUnits);
+
+// Arguments: width, height.
+void BM_I420ToRgba(benchmark::State& state) {
+  const int width = state.range(0);
+  const int height = state.range(1);
+  std::vector<uint8_t> y(width * height);
+  std::vector<uint8_t> u(width / 2 * (height / 2));
+  std::vector<uint8_t> v(u.size());
+  for (size_t i = 0; i < y.size(); i++) {
+    y[i] = static_cast<uint8_t>(i * 7);
+  }
+  for (size_t i = 0; i < u.size(); i++) {
+    u[i] = static_cast<uint8_t>(i * 3);
+    v[i] = static_cast<uint8_t>(i * 5);
+  }
+  VideoFrame frame;
+  frame.width = width;
+  frame.height = height;
+  frame.y = y.data();
+  frame.u = u.data();
+  frame.v = v.data();
+  frame.y_stride = width;
+  frame.uv_stride = width / 2;
+  std::vector<uint8_t> rgba(static_cast<size_t>(width) * height * 4);
+  for (auto _ : state) {
+    I420ToRgba(frame, rgba.data(), width * 4);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(rgba.size() * state.iterations());
+}
+BENCHMARK(BM_I420ToRgba)->Args({800, 480})->Args({1920, 720});
+
+// Arguments: input rate, channels. One 20 ms packet per iteration, to the
+// 48 kHz stereo output.
+void BM_Resample(benchmark::State& state) {
+  AudioFormat format;
+  format.sample_rate = state.range(0);
+  format.channels = state.range(1);
+  const size_t frames = format.sample_rate / 50;
+  std::vector<int16_t> samples(frames * format.channels);
+  for (size_t i = 0; i < samples.size(); i++) {
+    samples[i] = static_cast<int16_t>(i * 331);
+  }
+  Resampler resampler;
+  resampler.Configure(format);
+  std::vector<int16_t> out;
+  for (auto _ : state) {
+    out.clear();
+    resampler.Process(samples.data(), frames, &out);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(frames * state.iterations());
+  state.SetBytesProcessed(samples.size() * sizeof(int16_t) *
+                          state.iterations());
+}
+BENCHMARK(BM_Resample)->Args({44100, 2})->Args({48000, 2})->Args({16000, 1});
+
+// Argument: samples, 960 * 2 being one 20 ms stereo period.
+void BM_MixSamples(benchmark::State& state) {
+  std::vector<int16_t> dst(state.range(0));
+  std::vector<int16_t> src(dst.size());
+  for (size_t i = 0; i < src.size(); i++) {
+    src[i] = static_cast<int16_t>(i * 977);
+  }
+  for (auto _ : state) {
+    MixSamples(dst.data(), src.data(), src.size(), 192);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(src.size() * state.iterations());
+  state.SetBytesProcessed(src.size() * sizeof(int16_t) * state.iterations());
+}
+BENCHMARK(BM_MixSamples)->Arg(960 * 2)->Arg(65536);
+
+}  // namespace
+}  // namespace carlink
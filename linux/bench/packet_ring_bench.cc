@@ -0,0 +1,63 @@
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <thread>
+
+#include "core/demuxer.h"
+#include "core/packet_ring.h"
+
+namespace carlink {
+namespace {
+
+// Push and pop on one thread: the cost of the ring itself.
+void BM_PacketRingPushPop(benchmark::State& state) {
+  PacketRing<Message> ring(64);
+  const std::shared_ptr<BufferPool> pool = BufferPool::Create();
+  Message message;
+  Message popped;
+  for (auto _ : state) {
+    message.payload = pool->Acquire(1024);
+    ring.TryPush(message);
+    ring.TryPop(&popped);
+    benchmark::DoNotOptimize(popped.payload.data());
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * 1024);
+}
+BENCHMARK(BM_PacketRingPushPop);
+
+// The USB thread pushing and a consumer thread popping, as between the read
+// loop and the video pipeline. Argument: ring capacity.
+void BM_PacketRingSpsc(benchmark::State& state) {
+  constexpr uint64_t kBatch = 1 << 16;
+  PacketRing<uint64_t> ring(state.range(0));
+  std::atomic<bool> running(true);
+  std::thread consumer([&] {
+    uint64_t value;
+    while (running.load(std::memory_order_relaxed)) {
+      while (ring.TryPop(&value)) {
+        benchmark::DoNotOptimize(value);
+      }
+      // Spinning without yielding starves the producer on a single core.
+      std::this_thread::yield();
+    }
+    while (ring.TryPop(&value)) {
+    }
+  });
+  for (auto _ : state) {
+    for (uint64_t i = 0; i < kBatch; i++) {
+      uint64_t value = i;
+      while (!ring.TryPush(value)) {
+        std::this_thread::yield();
+      }
+    }
+  }
+  running.store(false);
+  consumer.join();
+  state.SetItemsProcessed(kBatch * state.iterations());
+  state.SetBytesProcessed(kBatch * sizeof(uint64_t) * state.iterations());
+}
+BENCHMARK(BM_PacketRingSpsc)->Arg(64)->Arg(1024)->UseRealTime();
+
+}  // namespace
+}  // namespace carlink
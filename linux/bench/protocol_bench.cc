@@ -0,0 +1,112 @@
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "core/input.h"
+#include "core/protocol.h"
+
+namespace carlink {
+namespace {
+
+void BM_EncodeHeader(benchmark::State& state) {
+  uint8_t header[kHeaderSize];
+  uint32_t length = 0;
+  for (auto _ : state) {
+    EncodeHeader(static_cast<uint32_t>(MessageType::kVideoData), length++,
+                 header);
+    benchmark::DoNotOptimize(header);
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * kHeaderSize);
+}
+BENCHMARK(BM_EncodeHeader);
+
+void BM_DecodeHeader(benchmark::State& state) {
+  // A spread of types so the type check is not always the same branch.
+  const MessageType types[] = {MessageType::kVideoData,
+                               MessageType::kAudioData,
+                               MessageType::kHeartBeat, MessageType::kCommand};
+  std::vector<uint8_t> headers(kHeaderSize * 4);
+  for (size_t i = 0; i < 4; i++) {
+    EncodeHeader(static_cast<uint32_t>(types[i]), 1000 * i,
+                 headers.data() + kHeaderSize * i);
+  }
+  MessageHeader header;
+  size_t i = 0;
+  for (auto _ : state) {
+    const HeaderStatus status =
+        DecodeHeader(headers.data() + kHeaderSize * (i++ & 3), &header);
+    benchmark::DoNotOptimize(status);
+    benchmark::DoNotOptimize(header);
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * kHeaderSize);
+}
+BENCHMARK(BM_DecodeHeader);
+
+void BM_EncodeHeartBeat(benchmark::State& state) {
+  size_t bytes = 0;
+  for (auto _ : state) {
+    EncodedMessage message = EncodeHeartBeat();
+    bytes += message.size();
+    benchmark::DoNotOptimize(message.data());
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(bytes);
+}
+BENCHMARK(BM_EncodeHeartBeat);
+
+void BM_EncodeTouch(benchmark::State& state) {
+  float x = 0;
+  size_t bytes = 0;
+  for (auto _ : state) {
+    EncodedMessage message = EncodeTouch(TouchAction::kMove, x, 0.5f);
+    x = x < 1 ? x + 0.001f : 0;
+    bytes += message.size();
+    benchmark::DoNotOptimize(message.data());
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(bytes);
+}
+BENCHMARK(BM_EncodeTouch);
+
+// Argument: touch points per message.
+void BM_EncodeMultiTouch(benchmark::State& state) {
+  std::vector<TouchPoint> touches(state.range(0));
+  for (size_t i = 0; i < touches.size(); i++) {
+    touches[i].x = 0.1f * i;
+    touches[i].y = 0.5f;
+    touches[i].action = MultiTouchAction::kMove;
+    touches[i].id = i;
+  }
+  size_t bytes = 0;
+  for (auto _ : state) {
+    EncodedMessage message = EncodeMultiTouch(touches);
+    bytes += message.size();
+    benchmark::DoNotOptimize(message.data());
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(bytes);
+}
+BENCHMARK(BM_EncodeMultiTouch)->Arg(1)->Arg(5);
+
+// Argument: samples per message; 320 is 20 ms at 16 kHz mono.
+void BM_EncodeMicrophoneAudio(benchmark::State& state) {
+  std::vector<int16_t> samples(state.range(0));
+  for (size_t i = 0; i < samples.size(); i++) {
+    samples[i] = static_cast<int16_t>(i * 97);
+  }
+  size_t bytes = 0;
+  for (auto _ : state) {
+    EncodedMessage message =
+        EncodeMicrophoneAudio(samples.data(), samples.size());
+    bytes += message.size();
+    benchmark::DoNotOptimize(message.data());
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(bytes);
+}
+BENCHMARK(BM_EncodeMicrophoneAudio)->Arg(320)->Arg(1600);
+
+}  // namespace
+}  // namespace carlink
@@ -0,0 +1,77 @@
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "core/glass_to_glass.h"
+#include "core/pcm_h264.h"
+#include "core/session.h"
+#include "core/simulated_dongle.h"
+#include "core/video_decoder.h"
+#include "core/worker_pool.h"
+
+namespace carlink {
+namespace {
+
+// Arguments: sessions, decode threads. Simulated dongles at full rate, all
+// decoding on one pool; decode_fps is what they decode together, so it
+// should grow with threads until the cores run out. Decodes the sample
+// video with FFmpeg, else the counter pattern with the PCM decoder.
+void BM_Sessions(benchmark::State& state) {
+  const int count = state.range(0);
+  WorkerPool pool(state.range(1));
+  uint64_t decoded = 0;
+  double seconds = 0;
+  for (auto _ : state) {
+    std::vector<std::unique_ptr<CounterPatternSource>> sources;
+    std::vector<std::unique_ptr<Session>> sessions;
+    for (int i = 0; i < count; i++) {
+      SimulatedDongle::Options dongle_options;
+#ifdef CARLINK_HAVE_FFMPEG
+      dongle_options.video_path = CARLINK_BENCH_VIDEO;
+      std::unique_ptr<VideoDecoder> decoder = CreateVideoDecoder();
+#else
+      sources.push_back(std::make_unique<CounterPatternSource>(800, 480));
+      dongle_options.video_source = sources.back().get();
+      std::unique_ptr<VideoDecoder> decoder = CreatePcmH264Decoder();
+#endif
+      dongle_options.real_time = false;
+      dongle_options.audio = false;
+      SessionOptions options;
+      options.worker_pool = &pool;
+      sessions.push_back(std::make_unique<Session>(
+          std::make_unique<SimulatedDongle>(dongle_options), options,
+          std::move(decoder), nullptr, nullptr, nullptr));
+    }
+    const auto start = std::chrono::steady_clock::now();
+    for (std::unique_ptr<Session>& session : sessions) {
+      session->Start();
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    for (std::unique_ptr<Session>& session : sessions) {
+      session->Stop();
+      decoded += session->stats().video.frames_decoded;
+    }
+    seconds += std::chrono::duration<double>(
+                   std::chrono::steady_clock::now() - start)
+                   .count();
+  }
+  state.counters["decode_fps"] = decoded / seconds;
+}
+BENCHMARK(BM_Sessions)
+    ->ArgNames({"sessions", "threads"})
+    ->Args({1, 1})
+    ->Args({2, 1})
+    ->Args({2, 2})
+    ->Args({4, 1})
+    ->Args({4, 2})
+    ->Args({4, 4})
+    ->Args({8, 4})
+    ->Iterations(1)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace
+}  // namespace carlink
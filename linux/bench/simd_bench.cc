@@ -0,0 +1,129 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "core/simd.h"
+
+namespace carlink {
+namespace {
+
+// Every kernel at every level, to see what each instruction set buys on
+// this machine. The argument is the SimdLevel; levels the CPU or build
+// lacks are skipped.
+const SimdKernels* KernelsFor(benchmark::State& state) {
+  const SimdLevel level = static_cast<SimdLevel>(state.range(0));
+  const std::vector<SimdLevel> supported = SupportedSimdLevels();
+  if (std::find(supported.begin(), supported.end(), level) ==
+      supported.end()) {
+    state.SkipWithError("not supported here");
+    return nullptr;
+  }
+  state.SetLabel(SimdLevelName(level));
+  return GetSimdKernels(level);
+}
+
+void Levels(benchmark::internal::Benchmark* benchmark) {
+  benchmark->DenseRange(static_cast<int>(SimdLevel::kScalar),
+                        static_cast<int>(SimdLevel::kNeon));
+}
+
+// Slice data: start codes are rare and zeros are not.
+std::vector<uint8_t> SliceLikeBytes(size_t size) {
+  std::vector<uint8_t> bytes(size);
+  for (size_t i = 0; i < size; i++) {
+    bytes[i] = i % 5 == 0 ? 0 : static_cast<uint8_t>(i * 131 + 7);
+  }
+  return bytes;
+}
+
+void BM_SimdFindStartCode(benchmark::State& state) {
+  const SimdKernels* kernels = KernelsFor(state);
+  if (kernels == nullptr) {
+    return;
+  }
+  const std::vector<uint8_t> data = SliceLikeBytes(1 << 16);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        kernels->find_start_code(data.data(), data.size()));
+  }
+  state.SetBytesProcessed(data.size() * state.iterations());
+}
+BENCHMARK(BM_SimdFindStartCode)->Apply(Levels);
+
+void BM_SimdFindMagic(benchmark::State& state) {
+  const SimdKernels* kernels = KernelsFor(state);
+  if (kernels == nullptr) {
+    return;
+  }
+  const std::vector<uint8_t> data = SliceLikeBytes(1 << 16);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(kernels->find_magic(data.data(), data.size()));
+  }
+  state.SetBytesProcessed(data.size() * state.iterations());
+}
+BENCHMARK(BM_SimdFindMagic)->Apply(Levels);
+
+// One 1920 pixel row.
+void BM_SimdI420ToRgbaRow(benchmark::State& state) {
+  const SimdKernels* kernels = KernelsFor(state);
+  if (kernels == nullptr) {
+    return;
+  }
+  const int width = 1920;
+  const std::vector<uint8_t> y = SliceLikeBytes(width);
+  const std::vector<uint8_t> u = SliceLikeBytes(width / 2);
+  std::vector<uint8_t> rgba(width * 4);
+  for (auto _ : state) {
+    kernels->i420_to_rgba_row(y.data(), u.data(), u.data(), rgba.data(),
+                              width);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(width * state.iterations());
+}
+BENCHMARK(BM_SimdI420ToRgbaRow)->Apply(Levels);
+
+// A 20 ms packet of 44.1 kHz stereo to 48 kHz.
+void BM_SimdResampleStereo(benchmark::State& state) {
+  const SimdKernels* kernels = KernelsFor(state);
+  if (kernels == nullptr) {
+    return;
+  }
+  const size_t count = 883;
+  std::vector<int16_t> frames(count * 2);
+  for (size_t i = 0; i < frames.size(); i++) {
+    frames[i] = static_cast<int16_t>(i * 331);
+  }
+  std::vector<int16_t> out(count * 4);
+  size_t written = 0;
+  for (auto _ : state) {
+    written = kernels->resample_stereo(frames.data(), count, 0, 0xeb33,
+                                       out.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(written * state.iterations());
+}
+BENCHMARK(BM_SimdResampleStereo)->Apply(Levels);
+
+// 20 ms of 48 kHz stereo.
+void BM_SimdMixSamples(benchmark::State& state) {
+  const SimdKernels* kernels = KernelsFor(state);
+  if (kernels == nullptr) {
+    return;
+  }
+  const size_t count = 960 * 2;
+  std::vector<int16_t> src(count), dst(count);
+  for (size_t i = 0; i < count; i++) {
+    src[i] = static_cast<int16_t>(i * 97);
+    dst[i] = static_cast<int16_t>(i * 31);
+  }
+  for (auto _ : state) {
+    kernels->mix_samples(dst.data(), src.data(), count, 128);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(count * state.iterations());
+}
+BENCHMARK(BM_SimdMixSamples)->Apply(Levels);
+
+}  // namespace
+}  // namespace carlink
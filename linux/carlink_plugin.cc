@@ -4,20 +4,170 @@
 #include <gtk/gtk.h>
 #include <sys/utsname.h>
 
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
 #include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
+#include "album_cover_cache.h"
+#include "album_cover_texture.h"
 #include "carlink_plugin_private.h"
+#include "core/log.h"
+#include "core/log_ring.h"
+#include "core/protocol.h"
+#include "core/thread_stats.h"
+#include "core/trace.h"
+#include "core/worker_pool.h"
+#include "usb_bridge.h"
+#include "video_texture.h"
 
 #define CARLINK_PLUGIN(obj) \
   (G_TYPE_CHECK_INSTANCE_CAST((obj), carlink_plugin_get_type(), \
                               CarlinkPlugin))
 
+// Where the decoder thread reports new frames. Guarded so removing the
+// texture never races a frame being marked available.
+struct VideoTextureTarget {
+  std::mutex mutex;
+  FlTextureRegistrar* registrar = nullptr;
+  FlTexture* texture = nullptr;
+};
+
+// Where the bridge's messages and errors go, on the main thread. They are
+// held until Dart starts its reading loop: a session started early has them
+// before there is a channel, or a Dart side listening on it.
+struct MessageSink {
+  ~MessageSink() {
+    for (const auto& call : pending) {
+      fl_value_unref(call.second);
+    }
+    g_clear_object(&channel);
+  }
+
+  FlMethodChannel* channel = nullptr;
+  bool forwarding = false;
+  // Method name and arguments of the calls held back.
+  std::vector<std::pair<const char*, FlValue*>> pending;
+  // Where album covers go; null until a plugin owns the bridge.
+  CarlinkPlugin* plugin = nullptr;
+  // The latest album cover that arrived before there was a texture for it.
+  std::shared_ptr<std::vector<uint8_t>> album_cover;
+};
+
+struct EarlySession;
+struct BulkTransferJob;
+
+// bulkTransferOut calls, one on the wire at a time, so a retry never lands
+// behind a newer message. Main thread.
+struct OutTransferQueue {
+  // The call submitted or waiting to be retried, or null.
+  BulkTransferJob* active = nullptr;
+  // Submitted in call order, each once the one before is answered.
+  std::deque<BulkTransferJob*> waiting;
+};
+
 struct _CarlinkPlugin {
   GObject parent_instance;
+
+  FlTextureRegistrar* texture_registrar;
+  FlMethodChannel* channel;
+
+  carlink::UsbBridge* usb;
+  // Owned by the bridge's callbacks.
+  MessageSink* sink;
+  // The session carlink_plugin_connect_early() started, if any.
+  EarlySession* early_session;
+  // Dart attached to the early session; its startReadingLoop takes over the
+  // read loop already running.
+  gboolean reading_attached;
+  // The thread budget for parallel media work: frame conversion bands and
+  // album covers.
+  carlink::WorkerPool* workers;
+  // Batches native log lines for Dart.
+  carlink::LogRing* log_ring;
+  // CPU shares between getStats calls.
+  carlink::ThreadStatsSampler* thread_stats;
+  OutTransferQueue* out_transfers;
+  CarlinkVideoTexture* video_texture;
+  VideoTextureTarget* video_target;
+
+  carlink::AlbumCoverCache* album_covers;
+  CarlinkAlbumCoverTexture* album_cover_texture;
+  // Cache ID of the most recently submitted cover, the one to present.
+  uint64_t album_cover_id;
 };
 
 G_DEFINE_TYPE(CarlinkPlugin, carlink_plugin, g_object_get_type())
 
+// A session carlink_plugin_connect_early() starts before there is a plugin:
+// the bridge and the thread connecting it, for the process's plugin to
+// adopt. Lives as long as the process.
+struct EarlySession {
+  carlink::DongleConfig config;
+  std::thread thread;
+  // Handed to the plugin that adopts the session.
+  carlink::WorkerPool* workers = nullptr;
+  VideoTextureTarget* video_target = nullptr;
+  carlink::UsbBridge* usb = nullptr;
+  MessageSink* sink = nullptr;
+
+  // Written by |thread|; read on the main thread once |finished|, the
+  // handshake sent.
+  bool connected = false;
+  carlink::UsbBridge::Connection connection;
+
+  // Set to end the heartbeats |thread| sends until Dart takes over.
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool handed_over = false;
+
+  // Main thread.
+  bool adopted = false;
+  CarlinkPlugin* plugin = nullptr;
+  bool finished = false;
+  // An attachSession call waiting for the handshake.
+  FlMethodCall* waiting = nullptr;
+  // attachSession was answered: the session is Dart's, or closed.
+  bool answered = false;
+  // Calls into the bridge made before |finished|, handled once it is.
+  std::vector<FlMethodCall*> deferred;
+};
+
+// Dart's default read timeout and heartbeat interval.
+constexpr int kEarlySessionReadTimeoutMs = 30000;
+constexpr int kEarlySessionHeartbeatMs = 2000;
+
+static EarlySession* g_early_session = nullptr;
+
+static void early_session_join(EarlySession* session);
+
+// Methods that read or change what the early session's thread sets up in
+// the bridge: the device, configuration, read loop and pipelines.
+static bool uses_bridge(const gchar* method) {
+  static const char* const kMethods[] = {
+      "openDevice",        "closeDevice",      "resetDevice",
+      "getConfiguration",  "setConfiguration", "claimInterface",
+      "releaseInterface",  "startReadingLoop", "stopReadingLoop",
+      "bulkTransferIn",    "bulkTransferOut",  "resetH264Renderer",
+      "startRecording",    "stopRecording",    "getStats",
+      "dumpFlightRecorder",
+  };
+  for (const char* name : kMethods) {
+    if (strcmp(method, name) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
 // Called when a method call is received from Flutter.
 static void carlink_plugin_handle_method_call(
     CarlinkPlugin* self,
@@ -26,8 +176,95 @@ static void carlink_plugin_handle_method_call(
 
   const gchar* method = fl_method_call_get_name(method_call);
 
+  FlValue* args = fl_method_call_get_args(method_call);
+
+  EarlySession* session = self->early_session;
+  if (session != nullptr && uses_bridge(method)) {
+    if (!session->finished) {
+      // The connect thread is still writing the bridge; wait for it, as
+      // attachSession does.
+      session->deferred.push_back(FL_METHOD_CALL(g_object_ref(method_call)));
+      return;
+    }
+    if (!session->answered &&
+        (strcmp(method, "openDevice") == 0 ||
+         strcmp(method, "closeDevice") == 0 ||
+         strcmp(method, "resetDevice") == 0)) {
+      // Dart takes the device without attaching; the heartbeats writing to
+      // it stop first.
+      early_session_join(session);
+      session->answered = true;
+    }
+  }
+
   if (strcmp(method, "getPlatformVersion") == 0) {
     response = get_platform_version();
+  } else if (strcmp(method, "getDeviceList") == 0) {
+    response = get_device_list();
+  } else if (strcmp(method, "hasPermission") == 0 ||
+             strcmp(method, "requestPermission") == 0) {
+    // Access is governed by udev rules on Linux, there is nothing to ask.
+    g_autoptr(FlValue) result = fl_value_new_bool(TRUE);
+    response = FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+  } else if (strcmp(method, "openDevice") == 0) {
+    response = open_device(self, args);
+  } else if (strcmp(method, "closeDevice") == 0) {
+    self->usb->Close();
+    response = FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+  } else if (strcmp(method, "resetDevice") == 0) {
+    g_autoptr(FlValue) result = fl_value_new_bool(self->usb->Reset());
+    response = FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+  } else if (strcmp(method, "getConfiguration") == 0) {
+    response = get_configuration(self, args);
+  } else if (strcmp(method, "setConfiguration") == 0) {
+    response = set_configuration(self, args);
+  } else if (strcmp(method, "claimInterface") == 0) {
+    response = claim_interface(self, args, TRUE);
+  } else if (strcmp(method, "releaseInterface") == 0) {
+    response = claim_interface(self, args, FALSE);
+  } else if (strcmp(method, "startReadingLoop") == 0) {
+    response = start_reading_loop(self, args);
+  } else if (strcmp(method, "stopReadingLoop") == 0) {
+    self->usb->StopReadingLoop();
+    response = FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+  } else if (strcmp(method, "attachSession") == 0) {
+    // Responds once the early session's handshake is through.
+    attach_session(self, method_call);
+    return;
+  } else if (strcmp(method, "bulkTransferIn") == 0 ||
+             strcmp(method, "bulkTransferOut") == 0) {
+    // Responds from the worker's completion callback.
+    bulk_transfer(self, method_call);
+    return;
+  } else if (strcmp(method, "createTexture") == 0) {
+    response = create_texture(self);
+  } else if (strcmp(method, "removeTexture") == 0) {
+    response = remove_texture(self);
+  } else if (strcmp(method, "resetH264Renderer") == 0) {
+    self->usb->ResetVideo();
+    response = FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+  } else if (strcmp(method, "startRecording") == 0) {
+    response = start_recording(self, args);
+  } else if (strcmp(method, "stopRecording") == 0) {
+    self->usb->StopRecording();
+    response = FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+  } else if (strcmp(method, "getStats") == 0) {
+    response = get_stats(self);
+  } else if (strcmp(method, "dumpFlightRecorder") == 0) {
+    // Responds once the dump is written.
+    dump_flight_recorder(self, method_call);
+    return;
+  } else if (strcmp(method, "startTracing") == 0) {
+    carlink::StartTracing();
+    response = FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+  } else if (strcmp(method, "stopTracing") == 0) {
+    response = stop_tracing(args);
+  } else if (strcmp(method, "createAlbumCoverTexture") == 0) {
+    response = create_album_cover_texture(self, args);
+  } else if (strcmp(method, "processAlbumCover") == 0) {
+    response = process_album_cover(self, args);
+  } else if (strcmp(method, "removeAlbumCoverTexture") == 0) {
+    response = remove_album_cover_texture(self);
   } else {
     response = FL_METHOD_RESPONSE(fl_method_not_implemented_response_new());
   }
@@ -43,7 +280,933 @@ FlMethodResponse* get_platform_version() {
   return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
 }
 
+// Runs |callback| on the main thread.
+static void invoke_on_main_thread(std::function<void()> callback) {
+  g_main_context_invoke_full(
+      nullptr, G_PRIORITY_DEFAULT,
+      [](gpointer data) -> gboolean {
+        (*static_cast<std::function<void()>*>(data))();
+        return G_SOURCE_REMOVE;
+      },
+      new std::function<void()>(std::move(callback)),
+      [](gpointer data) { delete static_cast<std::function<void()>*>(data); });
+}
+
+// Control messages only; VideoData and PCM never reach the sink.
+constexpr size_t kMaxHeldCalls = 256;
+
+// Main thread. Invokes |method| with |args| on the channel, or holds it.
+static void sink_deliver(MessageSink* sink, const char* method,
+                         FlValue* args) {
+  if (sink->forwarding && sink->channel != nullptr) {
+    fl_method_channel_invoke_method(sink->channel, method, args, nullptr,
+                                    nullptr, nullptr);
+    return;
+  }
+  if (sink->pending.size() >= kMaxHeldCalls) {
+    carlink::Log(carlink::LogLevel::kWarning,
+                 "[USB] dropped %s: Dart has not attached", method);
+    return;
+  }
+  sink->pending.emplace_back(method, fl_value_ref(args));
+}
+
+// Main thread. Invokes the calls held so far and forwards from now on.
+static void sink_forward(MessageSink* sink) {
+  sink->forwarding = true;
+  for (const auto& call : sink->pending) {
+    fl_method_channel_invoke_method(sink->channel, call.first, call.second,
+                                    nullptr, nullptr, nullptr);
+    fl_value_unref(call.second);
+  }
+  sink->pending.clear();
+}
+
+// Main thread. Drops the calls held so far, e.g. from a closed session.
+static void sink_drop(MessageSink* sink) {
+  for (const auto& call : sink->pending) {
+    fl_value_unref(call.second);
+  }
+  sink->pending.clear();
+}
+
+static FlMethodResponse* illegal_argument(const char* message) {
+  return FL_METHOD_RESPONSE(
+      fl_method_error_response_new("IllegalArgument", message, nullptr));
+}
+
+static FlMethodResponse* illegal_state(const char* message) {
+  return FL_METHOD_RESPONSE(
+      fl_method_error_response_new("IllegalState", message, nullptr));
+}
+
+static bool lookup_int(FlValue* map, const char* key, int64_t* value) {
+  if (map == nullptr || fl_value_get_type(map) != FL_VALUE_TYPE_MAP) {
+    return false;
+  }
+  FlValue* entry = fl_value_lookup_string(map, key);
+  if (entry == nullptr || fl_value_get_type(entry) != FL_VALUE_TYPE_INT) {
+    return false;
+  }
+  *value = fl_value_get_int(entry);
+  return true;
+}
+
+// Reads the UsbEndpoint map under "endpoint" as an endpoint address.
+static bool lookup_endpoint(FlValue* args, uint8_t* address) {
+  if (args == nullptr || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
+    return false;
+  }
+  FlValue* endpoint = fl_value_lookup_string(args, "endpoint");
+  int64_t number = 0;
+  int64_t direction = 0;
+  if (!lookup_int(endpoint, "endpointNumber", &number) ||
+      !lookup_int(endpoint, "direction", &direction)) {
+    return false;
+  }
+  *address = static_cast<uint8_t>((number & 0x0f) | (direction & 0x80));
+  return true;
+}
+
+// A UsbDevice map.
+static FlValue* device_value(const carlink::UsbDeviceInfo& info) {
+  FlValue* device = fl_value_new_map();
+  fl_value_set_string_take(device, "identifier",
+                           fl_value_new_string(info.identifier.c_str()));
+  fl_value_set_string_take(device, "vendorId",
+                           fl_value_new_int(info.vendor_id));
+  fl_value_set_string_take(device, "productId",
+                           fl_value_new_int(info.product_id));
+  fl_value_set_string_take(device, "configurationCount",
+                           fl_value_new_int(info.configuration_count));
+  return device;
+}
+
+// A UsbConfiguration map.
+static FlValue* configuration_value(
+    const carlink::UsbConfigurationInfo& configuration) {
+  FlValue* result = fl_value_new_map();
+  fl_value_set_string_take(result, "id", fl_value_new_int(configuration.id));
+  fl_value_set_string_take(result, "index",
+                           fl_value_new_int(configuration.index));
+  FlValue* interfaces = fl_value_new_list();
+  for (const carlink::UsbInterfaceInfo& info : configuration.interfaces) {
+    FlValue* interface = fl_value_new_map();
+    fl_value_set_string_take(interface, "id", fl_value_new_int(info.id));
+    fl_value_set_string_take(interface, "alternateSetting",
+                             fl_value_new_int(info.alternate_setting));
+    FlValue* endpoints = fl_value_new_list();
+    for (const carlink::UsbEndpointInfo& endpoint_info : info.endpoints) {
+      FlValue* endpoint = fl_value_new_map();
+      fl_value_set_string_take(endpoint, "endpointNumber",
+                               fl_value_new_int(endpoint_info.number));
+      fl_value_set_string_take(endpoint, "direction",
+                               fl_value_new_int(endpoint_info.direction));
+      fl_value_set_string_take(endpoint, "maxPacketSize",
+                               fl_value_new_int(endpoint_info.max_packet_size));
+      fl_value_append_take(endpoints, endpoint);
+    }
+    fl_value_set_string_take(interface, "endpoints", endpoints);
+    fl_value_append_take(interfaces, interface);
+  }
+  fl_value_set_string_take(result, "interfaces", interfaces);
+  return result;
+}
+
+FlMethodResponse* get_device_list() {
+  g_autoptr(FlValue) result = fl_value_new_list();
+  for (const carlink::UsbDeviceInfo& info : carlink::UsbDevice::List()) {
+    fl_value_append_take(result, device_value(info));
+  }
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+FlMethodResponse* open_device(CarlinkPlugin* self, FlValue* args) {
+  FlValue* identifier = args != nullptr &&
+                                fl_value_get_type(args) == FL_VALUE_TYPE_MAP
+                            ? fl_value_lookup_string(args, "identifier")
+                            : nullptr;
+  if (identifier == nullptr ||
+      fl_value_get_type(identifier) != FL_VALUE_TYPE_STRING) {
+    return illegal_argument("identifier is required");
+  }
+  carlink::Log(carlink::LogLevel::kInfo, "[USB] Opening device: %s",
+               fl_value_get_string(identifier));
+  const bool success = self->usb->Open(fl_value_get_string(identifier));
+  carlink::Log(carlink::LogLevel::kInfo, "[USB] Device open result: %s",
+               success ? "true" : "false");
+  g_autoptr(FlValue) result = fl_value_new_bool(success);
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+FlMethodResponse* get_configuration(CarlinkPlugin* self, FlValue* args) {
+  int64_t index = 0;
+  if (!lookup_int(args, "index", &index)) {
+    return illegal_argument("index is required");
+  }
+  carlink::UsbConfigurationInfo configuration;
+  if (!self->usb->GetConfiguration(index, &configuration)) {
+    return illegal_state("usbDevice null");
+  }
+
+  g_autoptr(FlValue) result = configuration_value(configuration);
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+FlMethodResponse* set_configuration(CarlinkPlugin* self, FlValue* args) {
+  int64_t id = 0;
+  if (!lookup_int(args, "id", &id)) {
+    return illegal_argument("id is required");
+  }
+  carlink::Log(carlink::LogLevel::kInfo, "[USB] Setting configuration %d",
+               static_cast<int>(id));
+  g_autoptr(FlValue) result = fl_value_new_bool(self->usb->SetConfiguration(id));
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+FlMethodResponse* claim_interface(CarlinkPlugin* self, FlValue* args,
+                                  gboolean claim) {
+  int64_t id = 0;
+  int64_t alternate_setting = 0;
+  if (!lookup_int(args, "id", &id) ||
+      !lookup_int(args, "alternateSetting", &alternate_setting) || id < 0 ||
+      alternate_setting < 0) {
+    return illegal_argument("interface id and alternateSetting are required");
+  }
+  const bool success = claim
+                           ? self->usb->ClaimInterface(id, alternate_setting)
+                           : self->usb->ReleaseInterface(id);
+  carlink::Log(carlink::LogLevel::kInfo, "[USB] Interface %s result: %s",
+               claim ? "claim" : "release", success ? "true" : "false");
+  if (claim && !success) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "USBError", "failed to claim interface exclusively", nullptr));
+  }
+  g_autoptr(FlValue) result = fl_value_new_bool(success);
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+FlMethodResponse* start_reading_loop(CarlinkPlugin* self, FlValue* args) {
+  uint8_t endpoint = 0;
+  int64_t timeout = 0;
+  if (!lookup_endpoint(args, &endpoint) ||
+      !lookup_int(args, "timeout", &timeout)) {
+    return illegal_argument("endpoint and timeout are required");
+  }
+  if (self->usb->device() == nullptr) {
+    return illegal_state("usbDevice null");
+  }
+  if (self->reading_attached && self->usb->reading()) {
+    // The early session's loop, reading since before Dart started.
+    carlink::Log(carlink::LogLevel::kInfo,
+                 "[USB] Reading loop attached, %zu messages held",
+                 self->sink->pending.size());
+  } else if (!self->usb->StartReadingLoop(endpoint, timeout)) {
+    return illegal_state("readingLoop running");
+  }
+  self->reading_attached = FALSE;
+  sink_forward(self->sink);
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+}
+
+// Main thread. Stops the early session's heartbeats and joins its thread.
+static void early_session_join(EarlySession* session) {
+  {
+    std::lock_guard<std::mutex> lock(session->mutex);
+    session->handed_over = true;
+  }
+  session->cv.notify_one();
+  if (session->thread.joinable()) {
+    session->thread.join();
+  }
+}
+
+// Answers |method_call| once the early session's handshake is sent: the device
+// and configuration if it connected with the Open message Dart would send,
+// otherwise null, with the device closed for Dart to start over.
+static void attach_session_respond(CarlinkPlugin* self,
+                                   FlMethodCall* method_call) {
+  EarlySession* session = self->early_session;
+  early_session_join(session);
+  session->answered = true;
+
+  FlValue* args = fl_method_call_get_args(method_call);
+  FlValue* open = args != nullptr &&
+                          fl_value_get_type(args) == FL_VALUE_TYPE_MAP
+                      ? fl_value_lookup_string(args, "open")
+                      : nullptr;
+  const carlink::EncodedMessage& sent = session->connection.open;
+  const bool matches =
+      session->connected && open != nullptr &&
+      fl_value_get_type(open) == FL_VALUE_TYPE_UINT8_LIST &&
+      fl_value_get_length(open) == sent.size() &&
+      memcmp(fl_value_get_uint8_list(open), sent.data(), sent.size()) == 0;
+  if (!matches) {
+    if (session->connected) {
+      carlink::Log(carlink::LogLevel::kWarning,
+                   "[USB] Early session does not match Dart's config, "
+                   "closing it");
+      self->usb->Close();
+      sink_drop(self->sink);
+    }
+    g_autoptr(FlMethodResponse) response =
+        FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+    fl_method_call_respond(method_call, response, nullptr);
+    return;
+  }
+
+  self->reading_attached = TRUE;
+  g_autoptr(FlValue) result = fl_value_new_map();
+  fl_value_set_string_take(result, "device",
+                           device_value(session->connection.device));
+  fl_value_set_string_take(
+      result, "configuration",
+      configuration_value(session->connection.configuration));
+  g_autoptr(FlMethodResponse) response =
+      FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+  fl_method_call_respond(method_call, response, nullptr);
+}
+
+void attach_session(CarlinkPlugin* self, FlMethodCall* method_call) {
+  EarlySession* session = self->early_session;
+  if (session == nullptr || session->answered ||
+      session->waiting != nullptr) {
+    g_autoptr(FlMethodResponse) response =
+        FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+    fl_method_call_respond(method_call, response, nullptr);
+    return;
+  }
+  if (!session->finished) {
+    session->waiting = FL_METHOD_CALL(g_object_ref(method_call));
+    return;
+  }
+  attach_session_respond(self, method_call);
+}
+
+FlMethodResponse* start_recording(CarlinkPlugin* self, FlValue* args) {
+  FlValue* path = args != nullptr &&
+                          fl_value_get_type(args) == FL_VALUE_TYPE_MAP
+                      ? fl_value_lookup_string(args, "path")
+                      : nullptr;
+  if (path == nullptr || fl_value_get_type(path) != FL_VALUE_TYPE_STRING) {
+    return illegal_argument("path is required");
+  }
+  g_autoptr(FlValue) result =
+      fl_value_new_bool(self->usb->StartRecording(fl_value_get_string(path)));
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+// One dumpFlightRecorder call, written on a GIO worker thread. The task
+// holds the plugin, so the bridge and its recorder outlive it.
+struct FlightRecorderDump {
+  carlink::FlightRecorder* recorder;
+  std::string reason;
+  std::string path;
+};
+
+static void flight_recorder_dump_free(gpointer data) {
+  delete static_cast<FlightRecorderDump*>(data);
+}
+
+static void flight_recorder_dump_thread(GTask* task, gpointer source,
+                                        gpointer data,
+                                        GCancellable* cancellable) {
+  FlightRecorderDump* dump = static_cast<FlightRecorderDump*>(data);
+  dump->path = dump->recorder->Dump(dump->reason);
+  g_task_return_boolean(task, TRUE);
+}
+
+static void flight_recorder_dump_done(GObject* source, GAsyncResult* result,
+                                      gpointer user_data) {
+  g_autoptr(FlMethodCall) method_call = FL_METHOD_CALL(user_data);
+  const FlightRecorderDump* dump = static_cast<const FlightRecorderDump*>(
+      g_task_get_task_data(G_TASK(result)));
+  g_autoptr(FlValue) value = dump->path.empty()
+                                 ? fl_value_new_null()
+                                 : fl_value_new_string(dump->path.c_str());
+  g_autoptr(FlMethodResponse) response =
+      FL_METHOD_RESPONSE(fl_method_success_response_new(value));
+  fl_method_call_respond(method_call, response, nullptr);
+}
+
+void dump_flight_recorder(CarlinkPlugin* self, FlMethodCall* method_call) {
+  FlValue* args = fl_method_call_get_args(method_call);
+  FlValue* reason = args != nullptr &&
+                            fl_value_get_type(args) == FL_VALUE_TYPE_MAP
+                        ? fl_value_lookup_string(args, "reason")
+                        : nullptr;
+  if (reason == nullptr || fl_value_get_type(reason) != FL_VALUE_TYPE_STRING) {
+    g_autoptr(FlMethodResponse) response =
+        illegal_argument("reason is required");
+    fl_method_call_respond(method_call, response, nullptr);
+    return;
+  }
+  // The counters are read here, on the thread that owns the read loop; only
+  // the file is written off it.
+  FlightRecorderDump* dump = new FlightRecorderDump{
+      self->usb->PrepareFlightRecorderDump(), fl_value_get_string(reason),
+      std::string()};
+  g_autoptr(GTask) task = g_task_new(self, nullptr, flight_recorder_dump_done,
+                                     g_object_ref(method_call));
+  g_task_set_task_data(task, dump, flight_recorder_dump_free);
+  g_task_run_in_thread(task, flight_recorder_dump_thread);
+}
+
+FlMethodResponse* stop_tracing(FlValue* args) {
+  FlValue* path = args != nullptr &&
+                          fl_value_get_type(args) == FL_VALUE_TYPE_MAP
+                      ? fl_value_lookup_string(args, "path")
+                      : nullptr;
+  if (path == nullptr || fl_value_get_type(path) != FL_VALUE_TYPE_STRING) {
+    return illegal_argument("path is required");
+  }
+  carlink::StopTracing();
+  g_autoptr(FlValue) result =
+      fl_value_new_bool(carlink::WriteChromeTrace(fl_value_get_string(path)));
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+static void set_int(FlValue* map, const char* key, uint64_t value) {
+  fl_value_set_string_take(map, key,
+                           fl_value_new_int(static_cast<int64_t>(value)));
+}
+
+FlMethodResponse* get_stats(CarlinkPlugin* self) {
+  // One read of every counter, so the groups below agree with each other.
+  const carlink::UsbBridge::Stats stats = self->usb->stats();
+  const carlink::VideoPipeline::Stats& video = stats.video;
+  const carlink::LogRing::Stats log = self->log_ring->stats();
+
+  g_autoptr(FlValue) latency = fl_value_new_map();
+  for (int i = 0; i < carlink::FrameLatency::kStageCount; i++) {
+    const carlink::FrameLatency::StageStats& stage =
+        video.frame_latency.stages[i];
+    FlValue* entry = fl_value_new_map();
+    set_int(entry, "count", stage.count);
+    fl_value_set_string_take(entry, "p50Ms",
+                             fl_value_new_float(stage.p50_ns / 1e6));
+    fl_value_set_string_take(entry, "p99Ms",
+                             fl_value_new_float(stage.p99_ns / 1e6));
+    fl_value_set_string_take(entry, "p999Ms",
+                             fl_value_new_float(stage.p999_ns / 1e6));
+    fl_value_set_string_take(entry, "maxMs",
+                             fl_value_new_float(stage.max_ns / 1e6));
+    fl_value_set_string_take(
+        latency,
+        carlink::FrameLatency::StageName(
+            static_cast<carlink::FrameLatency::Stage>(i)),
+        entry);
+  }
+
+  FlValue* transport = fl_value_new_map();
+  set_int(transport, "transfersIn", stats.read.transfers);
+  set_int(transport, "bytesIn", stats.read.bytes);
+  set_int(transport, "transfersOut", stats.transfers_out);
+  set_int(transport, "bytesOut", stats.bytes_out);
+  set_int(transport, "writeFailures", stats.write_failures);
+
+  FlValue* demux = fl_value_new_map();
+  set_int(demux, "messages", stats.read.messages);
+  set_int(demux, "resyncs", stats.read.resyncs);
+  set_int(demux, "skippedBytes", stats.read.skipped_bytes);
+
+  FlValue* queues = fl_value_new_map();
+  FlValue* video_queue = fl_value_new_map();
+  set_int(video_queue, "depth", video.queue_depth);
+  set_int(video_queue, "capacity", video.queue_capacity);
+  fl_value_set_string_take(queues, "video", video_queue);
+  FlValue* audio_queue = fl_value_new_map();
+  set_int(audio_queue, "activeStreams", stats.audio.active_streams);
+  set_int(audio_queue, "overflowFrames", stats.audio.overflow_frames);
+  fl_value_set_string_take(queues, "audio", audio_queue);
+
+  FlValue* decoder = fl_value_new_map();
+  set_int(decoder, "framesReceived", video.frames_received);
+  set_int(decoder, "framesDecoded", video.frames_decoded);
+  set_int(decoder, "framesDropped", video.frames_dropped);
+  set_int(decoder, "decodeErrors", video.decode_errors);
+  set_int(decoder, "decoderResets", video.decoder_resets);
+  set_int(decoder, "keyframeRequests", video.keyframe_requests);
+  set_int(decoder, "bytesReceived", video.bytes_received);
+  set_int(decoder, "framesPublished", stats.frames_published);
+
+  const carlink::BitstreamAnalyzer::Stats& bits = video.bitstream;
+  FlValue* bitstream = fl_value_new_map();
+  set_int(bitstream, "width", bits.width);
+  set_int(bitstream, "height", bits.height);
+  set_int(bitstream, "profile", bits.profile);
+  set_int(bitstream, "level", bits.level);
+  set_int(bitstream, "accessUnits", bits.access_units);
+  set_int(bitstream, "idrFrames", bits.idr_frames);
+  set_int(bitstream, "iFrames", bits.i_frames);
+  set_int(bitstream, "pFrames", bits.p_frames);
+  set_int(bitstream, "bFrames", bits.b_frames);
+  set_int(bitstream, "unparsed", bits.unparsed);
+  set_int(bitstream, "gopLength", bits.gop_length);
+  set_int(bitstream, "gopLengthMax", bits.gop_length_max);
+  set_int(bitstream, "framesSinceIdr", bits.frames_since_idr);
+  set_int(bitstream, "bitrateBps", bits.bitrate_bps);
+  set_int(bitstream, "bitratePeakBps", bits.bitrate_peak_bps);
+  set_int(bitstream, "idrSizeP50", bits.idr_size_p50);
+  set_int(bitstream, "idrSizeMax", bits.idr_size_max);
+  set_int(bitstream, "frameSizeP50", bits.frame_size_p50);
+  set_int(bitstream, "frameSizeP99", bits.frame_size_p99);
+  set_int(bitstream, "frameSizeMax", bits.frame_size_max);
+  set_int(bitstream, "frameNumGaps", bits.frame_num_gaps);
+  set_int(bitstream, "framesMissing", bits.frames_missing);
+
+  FlValue* audio = fl_value_new_map();
+  set_int(audio, "packets", stats.audio.packets);
+  set_int(audio, "commands", stats.audio.commands);
+  set_int(audio, "framesIn", stats.audio.frames_in);
+  set_int(audio, "framesPlayed", stats.audio.frames_played);
+  set_int(audio, "underruns", stats.audio.underruns);
+  set_int(audio, "formatChanges", stats.audio.format_changes);
+
+  FlValue* input = fl_value_new_map();
+  set_int(input, "touch", stats.touch_events);
+  set_int(input, "multiTouch", stats.multi_touch_events);
+  set_int(input, "microphone", stats.microphone_packets);
+
+  FlValue* pools = fl_value_new_map();
+  FlValue* buffers = fl_value_new_map();
+  set_int(buffers, "acquired", stats.pool.acquired);
+  set_int(buffers, "reused", stats.pool.reused);
+  set_int(buffers, "allocated", stats.pool.allocated);
+  set_int(buffers, "outstanding", stats.pool.outstanding);
+  set_int(buffers, "cachedBytes", stats.pool.cached_bytes);
+  fl_value_set_string_take(pools, "buffers", buffers);
+
+  // Per lane, so background work crowding out video shows.
+  const carlink::WorkerPool::Stats work = self->workers->stats();
+  FlValue* task_pool = fl_value_new_map();
+  set_int(task_pool, "threads", work.threads);
+  for (int i = 0; i < carlink::WorkerPool::kLaneCount; i++) {
+    const carlink::WorkerPool::LaneStats& lane = work.lanes[i];
+    FlValue* entry = fl_value_new_map();
+    set_int(entry, "tasksPosted", lane.tasks_posted);
+    set_int(entry, "tasksRun", lane.tasks_run);
+    set_int(entry, "tasksStolen", lane.tasks_stolen);
+    set_int(entry, "queueDepth", lane.queue_depth);
+    fl_value_set_string_take(entry, "busyMs",
+                             fl_value_new_float(lane.busy_ns / 1e6));
+    fl_value_set_string_take(
+        entry, "waitAvgMs",
+        fl_value_new_float(lane.tasks_run > 0
+                               ? lane.wait_ns / 1e6 / lane.tasks_run
+                               : 0.0));
+    fl_value_set_string_take(entry, "waitMaxMs",
+                             fl_value_new_float(lane.wait_max_ns / 1e6));
+    fl_value_set_string_take(entry, "utilization",
+                             fl_value_new_float(lane.utilization));
+    fl_value_set_string_take(
+        task_pool,
+        carlink::WorkerPool::LaneName(
+            static_cast<carlink::WorkerPool::Lane>(i)),
+        entry);
+  }
+
+  FlValue* logging = fl_value_new_map();
+  set_int(logging, "records", log.records);
+  set_int(logging, "batches", log.batches);
+  set_int(logging, "droppedFull", log.dropped_full);
+  set_int(logging, "droppedRateLimited", log.dropped_rate_limited);
+
+  // Every thread of the process, Flutter's included, so a busy raster
+  // thread shows up next to the pipeline's.
+  FlValue* threads = fl_value_new_list();
+  for (const carlink::ThreadStats& thread : self->thread_stats->Sample()) {
+    FlValue* entry = fl_value_new_map();
+    set_int(entry, "tid", thread.tid);
+    fl_value_set_string_take(entry, "name",
+                             fl_value_new_string(thread.name.c_str()));
+    fl_value_set_string_take(entry, "cpuMs",
+                             fl_value_new_float(thread.cpu_ns / 1e6));
+    fl_value_set_string_take(entry, "cpuPercent",
+                             fl_value_new_float(thread.cpu_percent));
+    fl_value_set_string_take(entry, "runDelayMs",
+                             fl_value_new_float(thread.run_delay_ns / 1e6));
+    set_int(entry, "voluntarySwitches", thread.voluntary_switches);
+    set_int(entry, "involuntarySwitches", thread.involuntary_switches);
+    fl_value_append_take(threads, entry);
+  }
+
+  g_autoptr(FlValue) result = fl_value_new_map();
+  set_int(result, "framesReceived", video.frames_received);
+  set_int(result, "framesDecoded", video.frames_decoded);
+  set_int(result, "framesDropped", video.frames_dropped);
+  set_int(result, "decodeErrors", video.decode_errors);
+  set_int(result, "framesPublished", stats.frames_published);
+  fl_value_set_string(result, "frameLatency", latency);
+  set_int(result, "logDropped", log.dropped_full + log.dropped_rate_limited);
+  fl_value_set_string_take(result, "transport", transport);
+  fl_value_set_string_take(result, "demux", demux);
+  fl_value_set_string_take(result, "queues", queues);
+  fl_value_set_string_take(result, "decoder", decoder);
+  fl_value_set_string_take(result, "bitstream", bitstream);
+  fl_value_set_string_take(result, "audio", audio);
+  fl_value_set_string_take(result, "input", input);
+  fl_value_set_string_take(result, "pools", pools);
+  fl_value_set_string_take(result, "taskPool", task_pool);
+  fl_value_set_string_take(result, "log", logging);
+  fl_value_set_string_take(result, "threads", threads);
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+// Attempts per bulk transfer after a transient error, as on Android; the
+// retries wait 200 ms, then 400 ms. An OUT transfer is retried only if none
+// of it went out.
+constexpr int kBulkTransferAttempts = 3;
+constexpr guint kBulkTransferRetryMs = 200;
+
+// One bulkTransferIn/bulkTransferOut call. Submitted without blocking any
+// thread, so IN calls overlap and OUT calls queue in the plugin; completes
+// on the device's event thread and is answered or retried on the main
+// thread.
+struct BulkTransferJob {
+  CarlinkPlugin* self;
+  FlMethodCall* method_call;
+  std::shared_ptr<carlink::UsbDevice> device;
+  bool in;
+  uint8_t endpoint;
+  unsigned int timeout_ms;
+  // The payload for OUT, the receive buffer for IN.
+  std::vector<uint8_t> data;
+  int result;
+  int attempts;
+};
+
+static void bulk_transfer_free(BulkTransferJob* job) {
+  g_object_unref(job->method_call);
+  g_object_unref(job->self);
+  delete job;
+}
+
+static void bulk_transfer_respond(BulkTransferJob* job) {
+  g_autoptr(FlMethodResponse) response = nullptr;
+  if (!job->in && job->result >= 0 &&
+      job->result < static_cast<int>(job->data.size())) {
+    g_autofree gchar* message = g_strdup_printf(
+        "bulkTransferOut sent %d of %zu bytes, not resent", job->result,
+        job->data.size());
+    response = FL_METHOD_RESPONSE(
+        fl_method_error_response_new("USBWriteError", message, nullptr));
+  } else if (job->result < 0) {
+    g_autofree gchar* message = g_strdup_printf(
+        "bulkTransfer%s error, actualLength=%d", job->in ? "In" : "Out",
+        job->result);
+    response = FL_METHOD_RESPONSE(fl_method_error_response_new(
+        job->in ? "USBReadError" : "USBWriteError", message, nullptr));
+  } else if (job->in) {
+    g_autoptr(FlValue) value =
+        fl_value_new_uint8_list(job->data.data(), job->result);
+    response = FL_METHOD_RESPONSE(fl_method_success_response_new(value));
+  } else {
+    g_autoptr(FlValue) value = fl_value_new_int(job->result);
+    response = FL_METHOD_RESPONSE(fl_method_success_response_new(value));
+  }
+  fl_method_call_respond(job->method_call, response, nullptr);
+  bulk_transfer_free(job);
+}
+
+static void bulk_transfer_submit(BulkTransferJob* job);
+
+// Main thread: answers |job|, then submits the OUT call that waited for it.
+static void bulk_transfer_finish(BulkTransferJob* job) {
+  OutTransferQueue* out = job->self->out_transfers;
+  if (job != out->active) {
+    bulk_transfer_respond(job);
+    return;
+  }
+  // A waiting call holds the plugin, so |out| outlives the answer.
+  BulkTransferJob* next = nullptr;
+  if (!out->waiting.empty()) {
+    next = out->waiting.front();
+    out->waiting.pop_front();
+  }
+  out->active = next;
+  bulk_transfer_respond(job);
+  if (next != nullptr) {
+    bulk_transfer_submit(next);
+  }
+}
+
+// Main thread: retries a transient failure on a timer, answers otherwise.
+static gboolean bulk_transfer_completed(gpointer data) {
+  auto* job = static_cast<BulkTransferJob*>(data);
+  if (carlink::IsTransientUsbError(job->result) &&
+      job->attempts < kBulkTransferAttempts) {
+    // An OUT call stays active meanwhile, so later ones keep waiting.
+    carlink::Log(carlink::LogLevel::kWarning,
+                 "[USB] bulkTransfer%s attempt %d failed (%d), retrying",
+                 job->in ? "In" : "Out", job->attempts, job->result);
+    g_timeout_add(kBulkTransferRetryMs * job->attempts,
+                  [](gpointer data) -> gboolean {
+                    bulk_transfer_submit(static_cast<BulkTransferJob*>(data));
+                    return G_SOURCE_REMOVE;
+                  },
+                  job);
+    return G_SOURCE_REMOVE;
+  }
+  bulk_transfer_finish(job);
+  return G_SOURCE_REMOVE;
+}
+
+// The device's event thread.
+static void bulk_transfer_done(void* context, int result) {
+  auto* job = static_cast<BulkTransferJob*>(context);
+  job->result = result;
+  g_main_context_invoke(nullptr, bulk_transfer_completed, job);
+}
+
+// Main thread.
+static void bulk_transfer_submit(BulkTransferJob* job) {
+  job->attempts++;
+  const int length = static_cast<int>(job->data.size());
+  const bool submitted =
+      job->in ? job->device->SubmitBulkTransfer(
+                    job->endpoint, job->data.data(), length, job->timeout_ms,
+                    bulk_transfer_done, job)
+              : job->self->usb->WriteAsync(
+                    job->device, job->endpoint, job->data.data(), length,
+                    job->timeout_ms, bulk_transfer_done, job);
+  if (!submitted) {
+    job->result = -1;
+    bulk_transfer_finish(job);
+  }
+}
+
+void bulk_transfer(CarlinkPlugin* self, FlMethodCall* method_call) {
+  FlValue* args = fl_method_call_get_args(method_call);
+  const bool in = strcmp(fl_method_call_get_name(method_call),
+                         "bulkTransferIn") == 0;
+
+  uint8_t endpoint = 0;
+  int64_t timeout = 0;
+  int64_t max_length = 0;
+  FlValue* data = nullptr;
+  g_autoptr(FlMethodResponse) error = nullptr;
+  if (!lookup_endpoint(args, &endpoint) ||
+      !lookup_int(args, "timeout", &timeout) || timeout <= 0) {
+    error = illegal_argument("endpoint and a positive timeout are required");
+  } else if (in && (!lookup_int(args, "maxLength", &max_length) ||
+                    max_length <= 0)) {
+    error = illegal_argument("maxLength must be positive");
+  } else if (!in &&
+             ((data = fl_value_lookup_string(args, "data")) == nullptr ||
+              fl_value_get_type(data) != FL_VALUE_TYPE_UINT8_LIST ||
+              fl_value_get_length(data) == 0)) {
+    error = illegal_argument("data cannot be empty");
+  } else if (self->usb->device() == nullptr) {
+    error = illegal_state("usbDevice null");
+  }
+  if (error != nullptr) {
+    fl_method_call_respond(method_call, error, nullptr);
+    return;
+  }
+
+  // Holds the plugin, and with it the bridge, until answered.
+  auto* job = new BulkTransferJob{
+      CARLINK_PLUGIN(g_object_ref(self)),
+      FL_METHOD_CALL(g_object_ref(method_call)),
+      self->usb->device(),
+      in,
+      endpoint,
+      static_cast<unsigned int>(timeout),
+      in ? std::vector<uint8_t>(max_length)
+         : std::vector<uint8_t>(
+               fl_value_get_uint8_list(data),
+               fl_value_get_uint8_list(data) + fl_value_get_length(data)),
+      0,
+      0};
+  if (!in) {
+    OutTransferQueue* out = self->out_transfers;
+    if (out->active != nullptr) {
+      out->waiting.push_back(job);
+      return;
+    }
+    out->active = job;
+  }
+  bulk_transfer_submit(job);
+}
+
+FlMethodResponse* create_texture(CarlinkPlugin* self) {
+  if (self->video_texture == nullptr) {
+    self->video_texture = carlink_video_texture_new(self->usb->frames());
+    fl_texture_registrar_register_texture(self->texture_registrar,
+                                          FL_TEXTURE(self->video_texture));
+    std::lock_guard<std::mutex> lock(self->video_target->mutex);
+    self->video_target->texture = FL_TEXTURE(self->video_texture);
+  }
+  g_autoptr(FlValue) result =
+      fl_value_new_int(fl_texture_get_id(FL_TEXTURE(self->video_texture)));
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+FlMethodResponse* remove_texture(CarlinkPlugin* self) {
+  if (self->video_texture != nullptr) {
+    {
+      std::lock_guard<std::mutex> lock(self->video_target->mutex);
+      self->video_target->texture = nullptr;
+    }
+    carlink_video_texture_detach(self->video_texture);
+    fl_texture_registrar_unregister_texture(self->texture_registrar,
+                                            FL_TEXTURE(self->video_texture));
+    g_clear_object(&self->video_texture);
+  }
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+}
+
+static void present_album_cover(
+    CarlinkPlugin* self,
+    std::shared_ptr<const carlink::AlbumCover> cover) {
+  if (self->album_cover_texture == nullptr || !cover ||
+      cover->id != self->album_cover_id) {
+    return;
+  }
+  carlink_album_cover_texture_set_cover(self->album_cover_texture,
+                                        std::move(cover));
+  fl_texture_registrar_mark_texture_frame_available(
+      self->texture_registrar, FL_TEXTURE(self->album_cover_texture));
+}
+
+// Main thread. Submits an encoded cover for decoding and makes it the one
+// to present. Returns its cache ID.
+static uint64_t show_album_cover(CarlinkPlugin* self, const uint8_t* data,
+                                 size_t length) {
+  const uint64_t id = self->album_covers->Submit(data, length);
+  self->album_cover_id = id;
+  present_album_cover(self, self->album_covers->Lookup(id));
+  return id;
+}
+
+// Main thread. An album cover from the dongle: shown on the texture, with
+// only its cache ID going to Dart through onAlbumCover.
+static void receive_album_cover(MessageSink* sink,
+                                std::shared_ptr<std::vector<uint8_t>> image) {
+  CarlinkPlugin* self = sink->plugin;
+  if (self == nullptr || self->album_covers == nullptr) {
+    // Shown once the texture is created.
+    sink->album_cover = std::move(image);
+    return;
+  }
+  const uint64_t id = show_album_cover(self, image->data(), image->size());
+  g_autoptr(FlValue) args = fl_value_new_int(static_cast<int64_t>(id));
+  sink_deliver(sink, "onAlbumCover", args);
+}
+
+FlMethodResponse* create_album_cover_texture(CarlinkPlugin* self,
+                                             FlValue* args) {
+  if (args == nullptr || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "IllegalArgument", "expected a map", nullptr));
+  }
+  FlValue* width = fl_value_lookup_string(args, "width");
+  FlValue* height = fl_value_lookup_string(args, "height");
+  if (width == nullptr || height == nullptr ||
+      fl_value_get_type(width) != FL_VALUE_TYPE_INT ||
+      fl_value_get_type(height) != FL_VALUE_TYPE_INT) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "IllegalArgument", "width and height are required", nullptr));
+  }
+
+  if (self->album_covers == nullptr) {
+    self->album_covers = new carlink::AlbumCoverCache(
+        carlink::AlbumCoverCache::kDefaultCapacity,
+        [self](std::shared_ptr<const carlink::AlbumCover> cover) {
+          present_album_cover(self, std::move(cover));
+        },
+        self->workers);
+  }
+  self->album_covers->SetDisplaySize(fl_value_get_int(width),
+                                     fl_value_get_int(height));
+
+  if (self->album_cover_texture == nullptr) {
+    self->album_cover_texture = carlink_album_cover_texture_new();
+    fl_texture_registrar_register_texture(
+        self->texture_registrar, FL_TEXTURE(self->album_cover_texture));
+  }
+  if (self->sink->album_cover != nullptr) {
+    receive_album_cover(self->sink, std::move(self->sink->album_cover));
+  }
+
+  g_autoptr(FlValue) result = fl_value_new_int(
+      fl_texture_get_id(FL_TEXTURE(self->album_cover_texture)));
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+FlMethodResponse* process_album_cover(CarlinkPlugin* self, FlValue* args) {
+  if (self->album_covers == nullptr) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "IllegalState", "album cover texture not created", nullptr));
+  }
+  if (args == nullptr || fl_value_get_type(args) != FL_VALUE_TYPE_UINT8_LIST) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "IllegalArgument", "expected Uint8List", nullptr));
+  }
+
+  const uint64_t id = show_album_cover(self, fl_value_get_uint8_list(args),
+                                       fl_value_get_length(args));
+
+  g_autoptr(FlValue) result = fl_value_new_int(static_cast<int64_t>(id));
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+FlMethodResponse* remove_album_cover_texture(CarlinkPlugin* self) {
+  if (self->album_cover_texture != nullptr) {
+    fl_texture_registrar_unregister_texture(
+        self->texture_registrar, FL_TEXTURE(self->album_cover_texture));
+    g_clear_object(&self->album_cover_texture);
+  }
+  delete self->album_covers;
+  self->album_covers = nullptr;
+  self->album_cover_id = 0;
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+}
+
 static void carlink_plugin_dispose(GObject* object) {
+  CarlinkPlugin* self = CARLINK_PLUGIN(object);
+  EarlySession* session = self->early_session;
+  if (session != nullptr) {
+    // The connect thread may still be using the bridge.
+    early_session_join(session);
+    g_clear_object(&session->waiting);
+    for (FlMethodCall* call : session->deferred) {
+      g_object_unref(call);
+    }
+    session->deferred.clear();
+    session->plugin = nullptr;
+    session->answered = true;
+    self->early_session = nullptr;
+  }
+  // The texture's frames point into the bridge's video pipeline, so it stops
+  // presenting first. Then the bridge stops the decoder thread before the
+  // target it reports to goes away, and every pipeline thread before the
+  // log ring they write to.
+  g_autoptr(FlMethodResponse) video_response = remove_texture(self);
+  if (self->sink != nullptr) {
+    self->sink->plugin = nullptr;
+  }
+  delete self->usb;
+  self->usb = nullptr;
+  self->sink = nullptr;
+  // Runs the album covers still queued; their results are dropped.
+  delete self->workers;
+  self->workers = nullptr;
+  carlink::SetLogRing(nullptr);
+  delete self->log_ring;
+  self->log_ring = nullptr;
+  delete self->thread_stats;
+  self->thread_stats = nullptr;
+  // Empty: every transfer holds the plugin until answered.
+  delete self->out_transfers;
+  self->out_transfers = nullptr;
+  delete self->video_target;
+  self->video_target = nullptr;
+  g_autoptr(FlMethodResponse) response = remove_album_cover_texture(self);
+  g_clear_object(&self->channel);
+  g_clear_object(&self->texture_registrar);
+
   G_OBJECT_CLASS(carlink_plugin_parent_class)->dispose(object);
 }
 
@@ -51,7 +1214,182 @@ static void carlink_plugin_class_init(CarlinkPluginClass* klass) {
   G_OBJECT_CLASS(klass)->dispose = carlink_plugin_dispose;
 }
 
-static void carlink_plugin_init(CarlinkPlugin* self) {}
+static void carlink_plugin_init(CarlinkPlugin* self) {
+  self->out_transfers = new OutTransferQueue();
+}
+
+// Fixed for the life of the process: CARLINK_THREADS, or one per CPU.
+static carlink::WorkerPool* new_worker_pool() {
+  const gchar* threads = g_getenv("CARLINK_THREADS");
+  return new carlink::WorkerPool(threads != nullptr ? atoi(threads) : 0);
+}
+
+// A bridge reporting messages and errors to |sink| and frames to |target|.
+static carlink::UsbBridge* new_bridge(std::shared_ptr<MessageSink> sink,
+                                      VideoTextureTarget* target,
+                                      carlink::WorkerPool* workers) {
+  carlink::UsbBridge* usb = new carlink::UsbBridge(
+      [sink](uint32_t type, std::vector<uint8_t> data) {
+        auto payload =
+            std::make_shared<std::vector<uint8_t>>(std::move(data));
+        invoke_on_main_thread([sink, type, payload] {
+          g_autoptr(FlValue) args = fl_value_new_map();
+          fl_value_set_string_take(args, "type", fl_value_new_int(type));
+          fl_value_set_string_take(
+              args, "data",
+              fl_value_new_uint8_list(payload->data(), payload->size()));
+          sink_deliver(sink.get(), "onReadingLoopMessage", args);
+        });
+      },
+      [sink](const std::string& error) {
+        invoke_on_main_thread([sink, error] {
+          g_autoptr(FlValue) args = fl_value_new_string(error.c_str());
+          sink_deliver(sink.get(), "onReadingLoopError", args);
+        });
+      },
+      [target] {
+        std::lock_guard<std::mutex> lock(target->mutex);
+        if (target->texture != nullptr) {
+          fl_texture_registrar_mark_texture_frame_available(target->registrar,
+                                                            target->texture);
+        }
+      },
+      workers);
+  usb->set_album_cover_handler([sink](std::vector<uint8_t> image) {
+    auto encoded = std::make_shared<std::vector<uint8_t>>(std::move(image));
+    invoke_on_main_thread([sink, encoded] {
+      receive_album_cover(sink.get(), encoded);
+    });
+  });
+  g_autofree gchar* flight_dir =
+      g_build_filename(g_get_user_cache_dir(), "carlink", nullptr);
+  usb->set_flight_recorder_dir(flight_dir);
+  return usb;
+}
+
+// Main thread, once the early session's handshake is sent or there was no
+// dongle.
+static void early_session_finished(EarlySession* session) {
+  session->finished = true;
+  if (session->waiting != nullptr) {
+    g_autoptr(FlMethodCall) method_call = session->waiting;
+    session->waiting = nullptr;
+    attach_session_respond(session->plugin, method_call);
+  }
+  std::vector<FlMethodCall*> deferred;
+  deferred.swap(session->deferred);
+  for (FlMethodCall* call : deferred) {
+    g_autoptr(FlMethodCall) method_call = call;
+    carlink_plugin_handle_method_call(session->plugin, method_call);
+  }
+}
+
+void carlink_plugin_connect_early(int width, int height, int fps, int dpi) {
+  if (g_early_session != nullptr) {
+    return;
+  }
+  EarlySession* session = new EarlySession();
+  if (width > 0 && height > 0) {
+    session->config.width = width;
+    session->config.height = height;
+  }
+  if (fps > 0) {
+    session->config.fps = fps;
+  }
+  if (dpi > 0) {
+    session->config.dpi = dpi;
+  }
+  session->workers = new_worker_pool();
+  session->video_target = new VideoTextureTarget();
+  auto sink = std::make_shared<MessageSink>();
+  session->sink = sink.get();
+  session->usb =
+      new_bridge(std::move(sink), session->video_target, session->workers);
+  g_early_session = session;
+
+  session->thread = std::thread([session] {
+    carlink::SetCurrentThreadName("carlink-connect");
+    session->connected = session->usb->ConnectDongle(
+        session->config, kEarlySessionReadTimeoutMs, &session->connection);
+    if (!session->connected) {
+      carlink::Log(carlink::LogLevel::kInfo,
+                   "[USB] No dongle to connect early, Dart will look again");
+    }
+    invoke_on_main_thread([session] { early_session_finished(session); });
+    if (!session->connected) {
+      return;
+    }
+
+    // Keeps the dongle from timing out the link until Dart's own heartbeat
+    // takes over.
+    const carlink::EncodedMessage heartbeat = carlink::EncodeHeartBeat();
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(session->mutex);
+        if (session->cv.wait_for(
+                lock, std::chrono::milliseconds(kEarlySessionHeartbeatMs),
+                [session] { return session->handed_over; })) {
+          return;
+        }
+      }
+      session->usb->Write(session->usb->device(),
+                          session->connection.endpoint_out, heartbeat.data(),
+                          static_cast<int>(heartbeat.size()),
+                          kEarlySessionHeartbeatMs);
+    }
+  });
+}
+
+// Wires the core library to the method channel. Core callbacks arrive on
+// pipeline threads and are forwarded to Dart on the main thread.
+static void carlink_plugin_start_bridge(CarlinkPlugin* self) {
+  std::shared_ptr<FlMethodChannel> channel(
+      FL_METHOD_CHANNEL(g_object_ref(self->channel)), g_object_unref);
+
+  // One main-thread post and channel call per batch rather than per line.
+  self->log_ring = new carlink::LogRing(
+      [channel](const std::vector<carlink::LogRecord>& batch) {
+        auto lines = std::make_shared<std::vector<std::string>>();
+        lines->reserve(batch.size());
+        for (const carlink::LogRecord& record : batch) {
+          lines->push_back(record.line);
+        }
+        invoke_on_main_thread([channel, lines] {
+          g_autoptr(FlValue) args = fl_value_new_list();
+          for (const std::string& line : *lines) {
+            fl_value_append_take(args, fl_value_new_string(line.c_str()));
+          }
+          fl_method_channel_invoke_method(channel.get(), "onLogMessages",
+                                          args, nullptr, nullptr, nullptr);
+        });
+      });
+  self->log_ring->Start();
+  carlink::SetLogRing(self->log_ring);
+  self->thread_stats = new carlink::ThreadStatsSampler();
+
+  EarlySession* session = g_early_session;
+  if (session != nullptr && !session->adopted) {
+    session->adopted = true;
+    session->plugin = self;
+    self->early_session = session;
+    self->workers = session->workers;
+    self->video_target = session->video_target;
+    self->usb = session->usb;
+    self->sink = session->sink;
+    std::lock_guard<std::mutex> lock(self->video_target->mutex);
+    self->video_target->registrar = self->texture_registrar;
+  } else {
+    self->workers = new_worker_pool();
+    VideoTextureTarget* target = new VideoTextureTarget();
+    target->registrar = self->texture_registrar;
+    self->video_target = target;
+    auto sink = std::make_shared<MessageSink>();
+    self->sink = sink.get();
+    self->usb = new_bridge(std::move(sink), target, self->workers);
+  }
+  self->sink->channel = FL_METHOD_CHANNEL(g_object_ref(self->channel));
+  self->sink->plugin = self;
+}
 
 static void method_call_cb(FlMethodChannel* channel, FlMethodCall* method_call,
                            gpointer user_data) {
@@ -62,6 +1400,8 @@ static void method_call_cb(FlMethodChannel* channel, FlMethodCall* method_call,
 void carlink_plugin_register_with_registrar(FlPluginRegistrar* registrar) {
   CarlinkPlugin* plugin = CARLINK_PLUGIN(
       g_object_new(carlink_plugin_get_type(), nullptr));
+  plugin->texture_registrar = FL_TEXTURE_REGISTRAR(
+      g_object_ref(fl_plugin_registrar_get_texture_registrar(registrar)));
 
   g_autoptr(FlStandardMethodCodec) codec = fl_standard_method_codec_new();
   g_autoptr(FlMethodChannel) channel =
@@ -71,6 +1411,8 @@ void carlink_plugin_register_with_registrar(FlPluginRegistrar* registrar) {
   fl_method_channel_set_method_call_handler(channel, method_call_cb,
                                             g_object_ref(plugin),
                                             g_object_unref);
+  plugin->channel = FL_METHOD_CHANNEL(g_object_ref(channel));
+  carlink_plugin_start_bridge(plugin);
 
   g_object_unref(plugin);
 }
@@ -8,3 +8,80 @@
 
 // Handles the getPlatformVersion method call.
 FlMethodResponse *get_platform_version();
+
+// Handles the getDeviceList method call, listing every USB device as a
+// UsbDevice map.
+FlMethodResponse *get_device_list();
+
+// Handles the openDevice method call with a UsbDevice map.
+FlMethodResponse *open_device(CarlinkPlugin *self, FlValue *args);
+
+// Handles the getConfiguration method call, returning a UsbConfiguration map.
+FlMethodResponse *get_configuration(CarlinkPlugin *self, FlValue *args);
+
+// Handles the setConfiguration method call with a UsbConfiguration map.
+FlMethodResponse *set_configuration(CarlinkPlugin *self, FlValue *args);
+
+// Handles the claimInterface and releaseInterface method calls with a
+// UsbInterface map.
+FlMethodResponse *claim_interface(CarlinkPlugin *self, FlValue *args,
+                                  gboolean claim);
+
+// Handles the startReadingLoop method call. Inbound messages are delivered
+// through onReadingLoopMessage; VideoData and PCM AudioData are decoded and
+// played natively.
+FlMethodResponse *start_reading_loop(CarlinkPlugin *self, FlValue *args);
+
+// Handles the attachSession method call with {open}, the Open message Dart
+// would send. Once the session carlink_plugin_connect_early() started has
+// done its handshake, responds with {device, configuration} if it used the
+// same Open message, or null for Dart to connect by itself.
+void attach_session(CarlinkPlugin *self, FlMethodCall *method_call);
+
+// Handles the bulkTransferIn and bulkTransferOut method calls on a worker
+// thread, responding to |method_call| once the transfer completes.
+void bulk_transfer(CarlinkPlugin *self, FlMethodCall *method_call);
+
+// Handles the startRecording method call with {path}. Returns false if the
+// capture file could not be created.
+FlMethodResponse *start_recording(CarlinkPlugin *self, FlValue *args);
+
+// Handles the dumpFlightRecorder method call with {reason}: writes the last
+// seconds of message headers, transfers and counters under the user cache
+// directory on a GIO worker thread. Responds to |method_call| with the file's
+// path, or null if nothing was written.
+void dump_flight_recorder(CarlinkPlugin *self, FlMethodCall *method_call);
+
+// Handles the stopTracing method call with {path}: writes the events since
+// startTracing as Chrome trace JSON. Returns false if the file could not be
+// written.
+FlMethodResponse *stop_tracing(FlValue *args);
+
+// Handles the getStats method call: one snapshot of the transport, demux,
+// queue, decoder, audio, input, buffer pool and log counters, per-stage
+// frame latency percentiles in milliseconds, from USB arrival to
+// copy_pixels, and per-thread CPU and scheduling stats.
+FlMethodResponse *get_stats(CarlinkPlugin *self);
+
+// Handles the createTexture method call. Returns the ID of the texture
+// presenting decoded video.
+FlMethodResponse *create_texture(CarlinkPlugin *self);
+
+// Handles the removeTexture method call.
+FlMethodResponse *remove_texture(CarlinkPlugin *self);
+
+// Handles the createAlbumCoverTexture method call. Creates the album cover
+// cache and the texture presenting the current cover, scaled to fit
+// {width, height}. Album covers from the dongle are presented on it and
+// announced with onAlbumCover {cache ID}, without their bytes crossing the
+// channel. Returns the texture ID.
+FlMethodResponse *create_album_cover_texture(CarlinkPlugin *self,
+                                             FlValue *args);
+
+// Handles the processAlbumCover method call with the encoded cover blob of a
+// MediaData/AlbumCover message. Returns the cache ID; covers seen before are
+// presented without decoding again.
+FlMethodResponse *process_album_cover(CarlinkPlugin *self, FlValue *args);
+
+// Handles the removeAlbumCoverTexture method call.
+FlMethodResponse *remove_album_cover_texture(CarlinkPlugin *self);
@@ -0,0 +1,205 @@
+#include "core/async.h"
+
+#include <algorithm>
+#include <new>
+#include <vector>
+
+namespace carlink {
+
+namespace {
+
+// Frames are rounded up to 64 bytes; larger than the biggest class go
+// straight to the heap.
+constexpr size_t kFrameGranule = 64;
+constexpr size_t kFrameClasses = 32;
+
+struct FreeFrame {
+  FreeFrame* next;
+};
+
+struct Arena {
+  std::mutex mutex;
+  FreeFrame* free[kFrameClasses] = {};
+  FrameArena::Stats stats;
+};
+
+Arena& GetArena() {
+  // Never destroyed: frames may be freed during static destruction.
+  static Arena* arena = new Arena();
+  return *arena;
+}
+
+size_t ClassOf(size_t size) {
+  return (size + kFrameGranule - 1) / kFrameGranule - 1;
+}
+
+}  // namespace
+
+void* FrameArena::Allocate(size_t size) {
+  Arena& arena = GetArena();
+  const size_t index = ClassOf(size);
+  {
+    std::lock_guard<std::mutex> lock(arena.mutex);
+    arena.stats.allocations++;
+    arena.stats.in_use++;
+    if (index < kFrameClasses && arena.free[index] != nullptr) {
+      FreeFrame* frame = arena.free[index];
+      arena.free[index] = frame->next;
+      return frame;
+    }
+    arena.stats.heap_allocations++;
+  }
+  return ::operator new(index < kFrameClasses ? (index + 1) * kFrameGranule
+                                              : size);
+}
+
+void FrameArena::Free(void* frame, size_t size) {
+  Arena& arena = GetArena();
+  const size_t index = ClassOf(size);
+  std::lock_guard<std::mutex> lock(arena.mutex);
+  arena.stats.in_use--;
+  if (index >= kFrameClasses) {
+    ::operator delete(frame);
+    return;
+  }
+  FreeFrame* free_frame = static_cast<FreeFrame*>(frame);
+  free_frame->next = arena.free[index];
+  arena.free[index] = free_frame;
+}
+
+FrameArena::Stats FrameArena::stats() {
+  Arena& arena = GetArena();
+  std::lock_guard<std::mutex> lock(arena.mutex);
+  return arena.stats;
+}
+
+Inbox::Inbox(EventLoop* loop, std::function<void(const Message&)> on_message)
+    : loop_(loop), on_message_(std::move(on_message)) {
+  drain_.run = &Inbox::OnDrain;
+  drain_.inbox = this;
+}
+
+Inbox::~Inbox() {
+  loop_->Cancel(&drain_);
+}
+
+void Inbox::Push(Message message) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    incoming_.push_back(std::move(message));
+  }
+  loop_->Post(&drain_);
+}
+
+void Inbox::Fail(const std::string& error) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (incoming_failed_) {
+      return;
+    }
+    incoming_failed_ = true;
+    incoming_error_ = error;
+  }
+  loop_->Post(&drain_);
+}
+
+void Inbox::OnDrain(EventLoop::Event* event) {
+  static_cast<DrainEvent*>(event)->inbox->Drain();
+}
+
+void Inbox::Drain() {
+  while (true) {
+    Message message;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (incoming_.empty()) {
+        if (incoming_failed_ && !failed_) {
+          failed_ = true;
+          error_ = incoming_error_;
+          break;
+        }
+        return;
+      }
+      message = std::move(incoming_.front());
+      incoming_.pop_front();
+    }
+    last_inbound_ns_ = message.arrival_ns;
+    on_message_(message);
+    const MessageType type = static_cast<MessageType>(message.header.type);
+    if (waiter_ != nullptr && waiter_->type_ == type) {
+      waiter_->Complete(std::move(message));
+      continue;
+    }
+    if (type != MessageType::kVideoData && type != MessageType::kAudioData) {
+      if (kept_.size() == kBacklog) {
+        kept_.pop_front();
+      }
+      kept_.push_back(std::move(message));
+    }
+  }
+  if (waiter_ != nullptr) {
+    waiter_->Complete(std::nullopt);
+  }
+}
+
+void Inbox::Forget(MessageType type) {
+  kept_.erase(std::remove_if(kept_.begin(), kept_.end(),
+                             [type](const Message& message) {
+                               return static_cast<MessageType>(
+                                          message.header.type) == type;
+                             }),
+              kept_.end());
+}
+
+bool Inbox::TakeKept(MessageType type, Message* message) {
+  for (auto it = kept_.begin(); it != kept_.end(); ++it) {
+    if (static_cast<MessageType>(it->header.type) == type) {
+      *message = std::move(*it);
+      kept_.erase(it);
+      return true;
+    }
+  }
+  return false;
+}
+
+Inbox::Next::~Next() {
+  if (inbox_->waiter_ == this) {
+    inbox_->waiter_ = nullptr;
+  }
+  inbox_->loop_->Cancel(&timeout_);
+  inbox_->loop_->Cancel(&resume_);
+}
+
+bool Inbox::Next::await_ready() {
+  Message message;
+  if (inbox_->TakeKept(type_, &message)) {
+    result_ = std::move(message);
+    return true;
+  }
+  return inbox_->failed_;
+}
+
+void Inbox::Next::await_suspend(std::coroutine_handle<> handle) {
+  resume_.handle = handle;
+  inbox_->waiter_ = this;
+  if (timeout_ms_ >= 0) {
+    inbox_->loop_->PostAt(
+        &timeout_, MonotonicNanos() + int64_t{timeout_ms_} * 1000000);
+  }
+}
+
+void Inbox::Next::OnTimeout(EventLoop::Event* event) {
+  static_cast<TimeoutEvent*>(event)->next_awaiter->Complete(std::nullopt);
+}
+
+void Inbox::Next::Complete(std::optional<Message> message) {
+  inbox_->waiter_ = nullptr;
+  inbox_->loop_->Cancel(&timeout_);
+  result_ = std::move(message);
+  // Through the loop rather than inline, so a waiter that goes on to tear
+  // the inbox down never does so under Drain(). What arrives meanwhile is
+  // kept for its next Next().
+  inbox_->loop_->Post(&resume_);
+}
+
+}  // namespace carlink
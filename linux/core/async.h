@@ -0,0 +1,334 @@
+#ifndef CARLINK_CORE_ASYNC_H_
+#define CARLINK_CORE_ASYNC_H_
+
+// C++20 coroutines over the event loop: Task<T>, and awaitables for a
+// timer, a transport write and the next inbound message of a type. Only
+// the carlink_async library (CARLINK_COROUTINES=ON) is built as C++20; the
+// core and the plugin stay C++14 and never include this.
+#if __cplusplus < 202002L || !defined(__cpp_impl_coroutine)
+#error "core/async.h needs C++20 coroutines: build with CARLINK_COROUTINES"
+#endif
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "core/clock.h"
+#include "core/demuxer.h"
+#include "core/event_loop.h"
+#include "core/protocol.h"
+#include "core/transport.h"
+
+namespace carlink {
+
+// Where coroutine frames come from. A frame is allocated once per call of
+// a coroutine, never per co_await, and freed frames are kept in free lists
+// by size class, so a reconnect loop that keeps calling the same
+// coroutines stops touching the heap after its first round.
+class FrameArena {
+ public:
+  struct Stats {
+    uint64_t allocations = 0;
+    // Allocations no free list could serve.
+    uint64_t heap_allocations = 0;
+    uint64_t in_use = 0;
+  };
+
+  static void* Allocate(size_t size);
+  static void Free(void* frame, size_t size);
+  static Stats stats();
+};
+
+template <typename T>
+class Task;
+
+namespace internal {
+
+struct PromiseBase {
+  struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(
+        std::coroutine_handle<Promise> handle) noexcept {
+      std::coroutine_handle<> continuation = handle.promise().continuation;
+      return continuation ? continuation : std::noop_coroutine();
+    }
+    void await_resume() noexcept {}
+  };
+
+  static void* operator new(size_t size) {
+    return FrameArena::Allocate(size);
+  }
+  static void operator delete(void* frame, size_t size) {
+    FrameArena::Free(frame, size);
+  }
+
+  std::suspend_always initial_suspend() noexcept { return {}; }
+  FinalAwaiter final_suspend() noexcept { return {}; }
+  // The core is built without exception handling in mind.
+  void unhandled_exception() { std::terminate(); }
+
+  std::coroutine_handle<> continuation;
+};
+
+template <typename T>
+struct Promise : PromiseBase {
+  Task<T> get_return_object();
+  template <typename U>
+  void return_value(U&& value) {
+    result.emplace(std::forward<U>(value));
+  }
+  T take() { return std::move(*result); }
+
+  std::optional<T> result;
+};
+
+template <>
+struct Promise<void> : PromiseBase {
+  Task<void> get_return_object();
+  void return_void() {}
+  void take() {}
+};
+
+}  // namespace internal
+
+// A lazily started coroutine returning T. co_await runs it to completion
+// and resumes the awaiting coroutine straight from its final suspend, so
+// chains of tasks take no trip through the loop. The frame lives as long
+// as the Task; destroying a suspended task destroys the coroutines it is
+// awaiting too, whose awaitables then unregister themselves.
+template <typename T>
+class Task {
+ public:
+  using promise_type = internal::Promise<T>;
+
+  Task() = default;
+  explicit Task(std::coroutine_handle<promise_type> handle)
+      : handle_(handle) {}
+  Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+  Task& operator=(Task&& other) noexcept {
+    if (this != &other) {
+      reset();
+      handle_ = std::exchange(other.handle_, {});
+    }
+    return *this;
+  }
+  ~Task() { reset(); }
+
+  Task(const Task&) = delete;
+  Task& operator=(const Task&) = delete;
+
+  // Runs a top-level task until its first suspension. Call on the loop
+  // thread it awaits on.
+  void Start() { handle_.resume(); }
+  bool done() const { return !handle_ || handle_.done(); }
+  void reset() {
+    if (handle_) {
+      handle_.destroy();
+      handle_ = {};
+    }
+  }
+
+  bool await_ready() const noexcept { return false; }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) {
+    handle_.promise().continuation = awaiting;
+    return handle_;
+  }
+  T await_resume() { return handle_.promise().take(); }
+
+ private:
+  std::coroutine_handle<promise_type> handle_;
+};
+
+namespace internal {
+
+template <typename T>
+Task<T> Promise<T>::get_return_object() {
+  return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> Promise<void>::get_return_object() {
+  return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+// An event that resumes a coroutine on the loop. Lives in the awaitable,
+// and so in the suspended frame: resuming allocates nothing.
+struct ResumeEvent : EventLoop::Event {
+  ResumeEvent() { run = &Resume; }
+  static void Resume(EventLoop::Event* event) {
+    static_cast<ResumeEvent*>(event)->handle.resume();
+  }
+  std::coroutine_handle<> handle;
+};
+
+}  // namespace internal
+
+// co_await SleepFor(loop, ns): resumes on the loop thread |ns| later.
+class SleepFor {
+ public:
+  SleepFor(EventLoop* loop, int64_t ns) : loop_(loop), ns_(ns) {}
+  ~SleepFor() { loop_->Cancel(&resume_); }
+
+  bool await_ready() const noexcept { return ns_ <= 0; }
+  void await_suspend(std::coroutine_handle<> handle) {
+    resume_.handle = handle;
+    loop_->PostAt(&resume_, MonotonicNanos() + ns_);
+  }
+  void await_resume() const noexcept {}
+
+ private:
+  EventLoop* loop_;
+  int64_t ns_;
+  internal::ResumeEvent resume_;
+};
+
+// co_await AsyncWrite(loop, transport, message, timeout_ms): what
+// Transport::Write() would return. Does not suspend when the transport
+// completes inline. The transport must complete or cancel the write before
+// the awaiting frame is destroyed; UsbTransport::Close() does.
+class AsyncWrite {
+ public:
+  AsyncWrite(EventLoop* loop, Transport* transport,
+             const EncodedMessage& message, int timeout_ms)
+      : loop_(loop),
+        transport_(transport),
+        message_(message),
+        timeout_ms_(timeout_ms) {}
+  ~AsyncWrite() { loop_->Cancel(&resume_); }
+
+  bool await_ready() const noexcept { return false; }
+  bool await_suspend(std::coroutine_handle<> handle) {
+    resume_.handle = handle;
+    transport_->WriteAsync(message_.data(), message_.size(), timeout_ms_,
+                           &AsyncWrite::OnDone, this);
+    int expected = kWriting;
+    // Lost the race against OnDone(): the result is there already.
+    return state_.compare_exchange_strong(expected, kSuspended,
+                                          std::memory_order_acq_rel);
+  }
+  int await_resume() const noexcept { return result_; }
+
+ private:
+  enum State { kWriting, kSuspended, kDone };
+
+  static void OnDone(void* context, int result) {
+    AsyncWrite* self = static_cast<AsyncWrite*>(context);
+    self->result_ = result;
+    if (self->state_.exchange(kDone, std::memory_order_acq_rel) ==
+        kSuspended) {
+      self->loop_->Post(&self->resume_);
+    }
+  }
+
+  EventLoop* loop_;
+  Transport* transport_;
+  const EncodedMessage& message_;
+  int timeout_ms_;
+  int result_ = -1;
+  std::atomic<int> state_{kWriting};
+  internal::ResumeEvent resume_;
+};
+
+// Inbound messages handed from the read thread to coroutines on the loop.
+// Each goes to |on_message| on the loop thread, then to the coroutine
+// waiting for its type with Next(), one at a time. Control messages nobody
+// waited for are kept, a few at a time, for a Next() that comes late, e.g.
+// an answer overtaking the completion of the write that asked for it.
+class Inbox {
+ public:
+  class Next;
+
+  // |loop| must outlive the inbox, which must outlive its waiters.
+  Inbox(EventLoop* loop, std::function<void(const Message&)> on_message);
+  ~Inbox();
+
+  Inbox(const Inbox&) = delete;
+  Inbox& operator=(const Inbox&) = delete;
+
+  // Any thread.
+  void Push(Message message);
+  // Any thread. Wakes the waiter; Next() from then on returns nothing.
+  void Fail(const std::string& error);
+
+  // Loop thread.
+  bool failed() const { return failed_; }
+  const std::string& error() const { return error_; }
+  // Arrival time of the newest message, 0 before the first.
+  int64_t last_inbound_ns() const { return last_inbound_ns_; }
+  // Drops the kept messages of |type|, e.g. ones a later event made stale.
+  void Forget(MessageType type);
+
+ private:
+  // Control messages kept for a late Next().
+  static constexpr size_t kBacklog = 16;
+
+  static void OnDrain(EventLoop::Event* event);
+  void Drain();
+  // Loop thread. Takes a kept message of |type|, if any.
+  bool TakeKept(MessageType type, Message* message);
+
+  EventLoop* loop_;
+  std::function<void(const Message&)> on_message_;
+
+  std::mutex mutex_;
+  std::deque<Message> incoming_;
+  bool incoming_failed_ = false;
+  std::string incoming_error_;
+  struct DrainEvent : EventLoop::Event {
+    Inbox* inbox = nullptr;
+  } drain_;
+
+  // Loop thread.
+  Next* waiter_ = nullptr;
+  std::deque<Message> kept_;
+  bool failed_ = false;
+  std::string error_;
+  int64_t last_inbound_ns_ = 0;
+};
+
+// co_await Inbox::Next(&inbox, type, timeout_ms): the next message of
+// |type|, or nothing on timeout or once the inbox failed. A negative
+// |timeout_ms| waits for as long as it takes.
+class Inbox::Next {
+ public:
+  Next(Inbox* inbox, MessageType type, int timeout_ms)
+      : inbox_(inbox), type_(type), timeout_ms_(timeout_ms) {
+    timeout_.run = &OnTimeout;
+    timeout_.next_awaiter = this;
+  }
+  ~Next();
+
+  bool await_ready();
+  void await_suspend(std::coroutine_handle<> handle);
+  std::optional<Message> await_resume() { return std::move(result_); }
+
+ private:
+  friend class Inbox;
+
+  struct TimeoutEvent : EventLoop::Event {
+    Next* next_awaiter = nullptr;
+  };
+
+  static void OnTimeout(EventLoop::Event* event);
+  // Loop thread: hands over |message|, or nothing.
+  void Complete(std::optional<Message> message);
+
+  Inbox* inbox_;
+  MessageType type_;
+  int timeout_ms_;
+  std::optional<Message> result_;
+  TimeoutEvent timeout_;
+  internal::ResumeEvent resume_;
+};
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_ASYNC_H_
@@ -0,0 +1,248 @@
+#include "core/async_connection.h"
+
+#include <time.h>
+
+#include <algorithm>
+#include <optional>
+#include <vector>
+
+#include "core/buffer_pool.h"
+#include "core/clock.h"
+#include "core/log.h"
+#include "core/read_loop.h"
+
+namespace carlink {
+
+// One opened transport, its read thread and the inbox that thread fills.
+struct AsyncConnection::Link {
+  std::unique_ptr<Transport> transport;
+  std::unique_ptr<Inbox> inbox;
+  std::unique_ptr<ReadLoop> read_loop;
+};
+
+const char* AsyncConnection::StateName(State state) {
+  switch (state) {
+    case State::kStopped:
+      return "stopped";
+    case State::kConnecting:
+      return "connecting";
+    case State::kHandshaking:
+      return "handshaking";
+    case State::kWaitingForPhone:
+      return "waiting for phone";
+    case State::kPlugged:
+      return "plugged";
+    case State::kBackoff:
+      return "backoff";
+  }
+  return "?";
+}
+
+AsyncConnection::AsyncConnection(EventLoop* loop,
+                                 const AsyncConnectionOptions& options,
+                                 StateCallback on_state,
+                                 MessageCallback on_message)
+    : loop_(loop),
+      options_(options),
+      on_state_(std::move(on_state)),
+      on_message_(std::move(on_message)) {}
+
+AsyncConnection::~AsyncConnection() {
+  Stop();
+}
+
+void AsyncConnection::Start() {
+  loop_->Post([this] {
+    if (!task_.done()) {
+      return;
+    }
+    task_ = Run();
+    task_.Start();
+  });
+}
+
+void AsyncConnection::Stop() {
+  if (loop_->InLoopThread()) {
+    StopOnLoop();
+    return;
+  }
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool stopped = false;
+  loop_->Post([this, &mutex, &cv, &stopped] {
+    StopOnLoop();
+    std::lock_guard<std::mutex> lock(mutex);
+    stopped = true;
+    cv.notify_one();
+  });
+  std::unique_lock<std::mutex> lock(mutex);
+  cv.wait(lock, [&stopped] { return stopped; });
+}
+
+void AsyncConnection::StopOnLoop() {
+  // Completes the write a coroutine may be suspended on before its frame
+  // goes away, and keeps the inbox it may be waiting on until after.
+  ShutDownLink();
+  task_.reset();
+  link_.reset();
+  if (state() != State::kStopped) {
+    SetState(State::kStopped);
+  }
+}
+
+AsyncConnection::State AsyncConnection::state() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return state_;
+}
+
+AsyncConnection::Stats AsyncConnection::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void AsyncConnection::SetState(State state) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    state_ = state;
+  }
+  Log(LogLevel::kDebug, "[LINK] %s", StateName(state));
+  if (on_state_) {
+    on_state_(state);
+  }
+}
+
+void AsyncConnection::Count(uint64_t Stats::*counter) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_.*counter += 1;
+}
+
+Task<void> AsyncConnection::Run() {
+  int64_t backoff_ms = options_.backoff_initial_ms;
+  while (true) {
+    SetState(State::kConnecting);
+    Count(&Stats::attempts);
+    link_ = OpenLink();
+    if (link_ != nullptr) {
+      SetState(State::kHandshaking);
+      if (co_await Handshake(link_.get())) {
+        Count(&Stats::handshakes);
+        backoff_ms = options_.backoff_initial_ms;
+        std::string error;
+        co_await StayConnected(link_.get(), &error);
+        Count(&Stats::link_failures);
+        Log(LogLevel::kWarning, "[LINK] lost the dongle: %s", error.c_str());
+      } else {
+        Count(&Stats::handshake_failures);
+      }
+      CloseLink();
+    }
+    SetState(State::kBackoff);
+    co_await SleepFor(loop_, backoff_ms * 1000000);
+    backoff_ms = std::min<int64_t>(backoff_ms * 2, options_.backoff_max_ms);
+  }
+}
+
+Task<bool> AsyncConnection::Handshake(Link* link) {
+  const std::vector<EncodedMessage> messages =
+      BuildInitMessages(options_.config, time(nullptr));
+  for (const EncodedMessage& message : messages) {
+    if (!co_await Send(link, message)) {
+      Log(LogLevel::kWarning, "[LINK] init message failed");
+      co_return false;
+    }
+  }
+  std::optional<Message> opened = co_await Inbox::Next(
+      link->inbox.get(), MessageType::kOpen, options_.handshake_timeout_ms);
+  if (!opened) {
+    Log(LogLevel::kWarning, "[LINK] no Opened within %d ms",
+        options_.handshake_timeout_ms);
+    co_return false;
+  }
+  co_return true;
+}
+
+Task<void> AsyncConnection::StayConnected(Link* link, std::string* error) {
+  const EncodedMessage heartbeat = EncodeHeartBeat();
+  const int64_t interval_ns =
+      int64_t{options_.heartbeat_interval_ms} * 1000000;
+  const int64_t grace_ns = int64_t{options_.heartbeat_grace_ms} * 1000000;
+  SetState(State::kWaitingForPhone);
+  while (true) {
+    if (state() != State::kPlugged) {
+      std::optional<Message> plugged =
+          co_await Inbox::Next(link->inbox.get(), MessageType::kPlugged,
+                               options_.heartbeat_interval_ms);
+      if (plugged) {
+        SetState(State::kPlugged);
+      }
+    } else {
+      co_await SleepFor(loop_, interval_ns);
+    }
+
+    if (link->inbox->failed()) {
+      *error = link->inbox->error();
+      co_return;
+    }
+    if (MonotonicNanos() - link->inbox->last_inbound_ns() > grace_ns) {
+      *error = "HeartbeatTimeout";
+      co_return;
+    }
+    if (!co_await Send(link, heartbeat)) {
+      *error = "heartbeat send failed";
+      co_return;
+    }
+    Count(&Stats::heartbeats);
+  }
+}
+
+Task<bool> AsyncConnection::Send(Link* link, const EncodedMessage& message) {
+  const int written = co_await AsyncWrite(loop_, link->transport.get(),
+                                          message, options_.write_timeout_ms);
+  co_return written == static_cast<int>(message.size());
+}
+
+std::unique_ptr<AsyncConnection::Link> AsyncConnection::OpenLink() {
+  std::unique_ptr<Transport> transport =
+      options_.open ? options_.open() : nullptr;
+  if (!transport) {
+    return nullptr;
+  }
+  std::unique_ptr<Link> link(new Link());
+  Link* raw = link.get();
+  raw->transport = std::move(transport);
+  raw->inbox.reset(new Inbox(loop_, [this, raw](const Message& message) {
+    Count(&Stats::messages_in);
+    if (static_cast<MessageType>(message.header.type) ==
+        MessageType::kUnplugged) {
+      // A Plugged kept from before must not count for the next phone.
+      raw->inbox->Forget(MessageType::kPlugged);
+      if (state() == State::kPlugged) {
+        SetState(State::kWaitingForPhone);
+      }
+    }
+    if (on_message_) {
+      on_message_(message);
+    }
+  }));
+  raw->read_loop.reset(new ReadLoop(
+      raw->transport.get(), BufferPool::Create(),
+      [raw](Message message) { raw->inbox->Push(std::move(message)); },
+      [raw](const std::string& error) { raw->inbox->Fail(error); }));
+  raw->read_loop->Start(options_.heartbeat_grace_ms);
+  return link;
+}
+
+void AsyncConnection::ShutDownLink() {
+  if (link_ == nullptr) {
+    return;
+  }
+  link_->transport->Close();
+  link_->read_loop->Stop();
+}
+
+void AsyncConnection::CloseLink() {
+  ShutDownLink();
+  link_.reset();
+}
+
+}  // namespace carlink
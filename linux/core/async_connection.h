@@ -0,0 +1,124 @@
+#ifndef CARLINK_CORE_ASYNC_CONNECTION_H_
+#define CARLINK_CORE_ASYNC_CONNECTION_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "core/async.h"
+#include "core/demuxer.h"
+#include "core/event_loop.h"
+#include "core/protocol.h"
+#include "core/transport.h"
+
+namespace carlink {
+
+struct AsyncConnectionOptions {
+  DongleConfig config;
+  // Opens the transport for each attempt, e.g. UsbTransport::OpenDongle;
+  // null while there is no dongle. Called on the loop thread.
+  std::function<std::unique_ptr<Transport>()> open;
+  int write_timeout_ms = 1000;
+  // For Opened after the init messages.
+  int handshake_timeout_ms = 5000;
+  int heartbeat_interval_ms = 2000;
+  // Inbound silence that counts as a dead link.
+  int heartbeat_grace_ms = 6000;
+  // Between failed attempts, doubling up to the maximum; a link that got
+  // through the handshake starts over from the initial delay.
+  int backoff_initial_ms = 250;
+  int backoff_max_ms = 8000;
+};
+
+// The dongle's connection lifecycle, written as coroutines on an event
+// loop rather than as threads and flags: open the transport, send the init
+// messages and await Opened, wait for the phone, heartbeat, and on any
+// failure close and try again after a backoff. A thread per link reads the
+// transport; writes, timers and waits for a message all suspend a
+// coroutine on the loop instead of blocking one.
+//
+// Every inbound message and state change is delivered on the loop thread.
+class AsyncConnection {
+ public:
+  enum class State {
+    kStopped,
+    kConnecting,
+    kHandshaking,
+    // Opened: the dongle is there, without a phone yet.
+    kWaitingForPhone,
+    kPlugged,
+    kBackoff,
+  };
+  static const char* StateName(State state);
+
+  struct Stats {
+    uint64_t attempts = 0;
+    uint64_t handshakes = 0;
+    uint64_t handshake_failures = 0;
+    uint64_t link_failures = 0;
+    uint64_t heartbeats = 0;
+    uint64_t messages_in = 0;
+  };
+
+  using StateCallback = std::function<void(State state)>;
+  using MessageCallback = std::function<void(const Message& message)>;
+
+  // |loop| is not owned and must outlive the connection.
+  AsyncConnection(EventLoop* loop, const AsyncConnectionOptions& options,
+                  StateCallback on_state, MessageCallback on_message);
+  // Stop().
+  ~AsyncConnection();
+
+  AsyncConnection(const AsyncConnection&) = delete;
+  AsyncConnection& operator=(const AsyncConnection&) = delete;
+
+  // Any thread but the loop's.
+  void Start();
+  // Closes the link and destroys the coroutines wherever they are
+  // suspended. Any thread; waits for the loop when called elsewhere.
+  void Stop();
+
+  // Any thread.
+  State state() const;
+  Stats stats() const;
+
+ private:
+  struct Link;
+
+  // Runs forever: connect, handshake, stay connected, back off.
+  Task<void> Run();
+  // Init messages, then Opened. False if any write fails or Opened is
+  // late.
+  Task<bool> Handshake(Link* link);
+  // Returns once the link failed, with the reason in |error|.
+  Task<void> StayConnected(Link* link, std::string* error);
+  Task<bool> Send(Link* link, const EncodedMessage& message);
+
+  std::unique_ptr<Link> OpenLink();
+  // Closes the transport and stops the read thread; the inbox stays.
+  void ShutDownLink();
+  void CloseLink();
+  void SetState(State state);
+  void Count(uint64_t Stats::*counter);
+  void StopOnLoop();
+
+  EventLoop* loop_;
+  const AsyncConnectionOptions options_;
+  StateCallback on_state_;
+  MessageCallback on_message_;
+
+  // Loop thread.
+  Task<void> task_;
+  std::unique_ptr<Link> link_;
+
+  mutable std::mutex mutex_;
+  State state_ = State::kStopped;
+  Stats stats_;
+};
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_ASYNC_CONNECTION_H_
@@ -0,0 +1,119 @@
+#include "core/audio.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "core/protocol.h"
+#include "core/simd.h"
+
+namespace carlink {
+
+bool AudioFormatForDecodeType(uint32_t decode_type, AudioFormat* format) {
+  switch (decode_type) {
+    case 1:
+    case 2:
+      *format = {44100, 2};
+      return true;
+    case 3:
+      *format = {8000, 1};
+      return true;
+    case 4:
+      *format = {48000, 2};
+      return true;
+    case 5:
+      *format = {16000, 1};
+      return true;
+    case 6:
+      *format = {24000, 1};
+      return true;
+    case 7:
+      *format = {16000, 2};
+      return true;
+  }
+  return false;
+}
+
+bool ParseAudioPacket(const uint8_t* payload, size_t length,
+                      AudioPacket* packet) {
+  if (length < kAudioDataHeaderSize) {
+    return false;
+  }
+  *packet = AudioPacket();
+  packet->decode_type = ReadU32(payload);
+  uint32_t volume_bits = ReadU32(payload + 4);
+  memcpy(&packet->volume, &volume_bits, sizeof(float));
+  packet->audio_type = ReadU32(payload + 8);
+
+  const size_t amount = length - kAudioDataHeaderSize;
+  const uint8_t* extra = payload + kAudioDataHeaderSize;
+  if (amount == 1) {
+    packet->command = static_cast<AudioCommand>(extra[0]);
+  } else if (amount == 4) {
+    uint32_t bits = ReadU32(extra);
+    memcpy(&packet->volume_duration, &bits, sizeof(float));
+  } else {
+    packet->samples = reinterpret_cast<const int16_t*>(extra);
+    packet->sample_count = amount / 2;
+  }
+  return true;
+}
+
+Resampler::Resampler(uint32_t output_rate) : output_rate_(output_rate) {}
+
+void Resampler::Configure(const AudioFormat& input) {
+  input_ = input;
+  step_ = static_cast<uint32_t>(
+      (static_cast<uint64_t>(input.sample_rate) << 16) / output_rate_);
+  position_ = 0;
+  primed_ = false;
+}
+
+void Resampler::Process(const int16_t* samples, size_t frames,
+                        std::vector<int16_t>* out) {
+  if (frames == 0 || input_.channels == 0 || step_ == 0) {
+    return;
+  }
+  const uint32_t channels = input_.channels;
+  if (!primed_) {
+    last_[0] = samples[0];
+    last_[1] = channels > 1 ? samples[1] : samples[0];
+    primed_ = true;
+  }
+
+  const SimdKernels& kernels = Simd();
+  // Chunks keep 16.16 positions within 32 bits.
+  const size_t kMaxChunkFrames = 16384;
+  for (size_t done = 0; done < frames;) {
+    const size_t chunk = std::min(frames - done, kMaxChunkFrames);
+    // Stereo frames with |last_| in front, which |position_| is relative
+    // to; input frames may be mono.
+    stereo_.resize((chunk + 1) * 2);
+    stereo_[0] = last_[0];
+    stereo_[1] = last_[1];
+    const int16_t* in = samples + done * channels;
+    for (size_t i = 0; i < chunk; i++) {
+      stereo_[2 + 2 * i] = in[i * channels];
+      stereo_[3 + 2 * i] = in[i * channels + (channels > 1 ? 1 : 0)];
+    }
+
+    const uint32_t limit = static_cast<uint32_t>(chunk) << 16;
+    const size_t count =
+        position_ < limit ? (limit - position_ + step_ - 1) / step_ : 0;
+    const size_t offset = out->size();
+    out->resize(offset + 2 * count);
+    const size_t written = kernels.resample_stereo(
+        stereo_.data(), chunk + 1, position_, step_, out->data() + offset);
+    position_ += static_cast<uint32_t>(written) * step_;
+    position_ -= limit;
+
+    last_[0] = stereo_[2 * chunk];
+    last_[1] = stereo_[2 * chunk + 1];
+    done += chunk;
+  }
+}
+
+void MixSamples(int16_t* dst, const int16_t* src, size_t count, int gain) {
+  Simd().mix_samples(dst, src, count, gain);
+}
+
+}  // namespace carlink
@@ -0,0 +1,86 @@
+#ifndef CARLINK_CORE_AUDIO_H_
+#define CARLINK_CORE_AUDIO_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace carlink {
+
+// Format of the interleaved 16-bit PCM in an AudioData message.
+struct AudioFormat {
+  uint32_t sample_rate = 0;
+  uint32_t channels = 0;
+};
+
+// Looks up the format for an AudioData decode type (decodeTypeMap in Dart).
+bool AudioFormatForDecodeType(uint32_t decode_type, AudioFormat* format);
+
+enum class AudioCommand : uint8_t {
+  kNone = 0,
+  kOutputStart = 1,
+  kOutputStop = 2,
+  kInputConfig = 3,
+  kPhonecallStart = 4,
+  kPhonecallStop = 5,
+  kNaviStart = 6,
+  kNaviStop = 7,
+  kSiriStart = 8,
+  kSiriStop = 9,
+  kMediaStart = 10,
+  kMediaStop = 11,
+  kAlertStart = 12,
+  kAlertStop = 13,
+};
+
+// A parsed AudioData payload. |samples| points into the payload.
+struct AudioPacket {
+  uint32_t decode_type = 0;
+  float volume = 0;
+  uint32_t audio_type = 0;
+  AudioCommand command = AudioCommand::kNone;
+  float volume_duration = 0;
+  const int16_t* samples = nullptr;
+  size_t sample_count = 0;
+};
+
+// Size of the decode type/volume/audio type prefix.
+constexpr size_t kAudioDataHeaderSize = 12;
+
+bool ParseAudioPacket(const uint8_t* payload, size_t length,
+                      AudioPacket* packet);
+
+// Streaming linear-interpolation resampler from any AudioFormat to
+// interleaved stereo at a fixed output rate. Keeps the fractional position
+// and last input frame across calls, so packets can be fed one by one.
+class Resampler {
+ public:
+  explicit Resampler(uint32_t output_rate = 48000);
+
+  // Resets state when the input format changes.
+  void Configure(const AudioFormat& input);
+
+  const AudioFormat& input() const { return input_; }
+
+  // Appends the resampled stereo frames for |frames| input frames to |out|.
+  void Process(const int16_t* samples, size_t frames,
+               std::vector<int16_t>* out);
+
+ private:
+  AudioFormat input_;
+  uint32_t output_rate_;
+  // Input frames advanced per output frame, 16.16 fixed point.
+  uint32_t step_ = 0x10000;
+  uint32_t position_ = 0;
+  int16_t last_[2] = {0, 0};
+  bool primed_ = false;
+  // Scratch for the input as stereo frames after |last_|.
+  std::vector<int16_t> stereo_;
+};
+
+// dst[i] = saturate(dst[i] + src[i] * gain / 256) for |count| samples.
+void MixSamples(int16_t* dst, const int16_t* src, size_t count, int gain);
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_AUDIO_H_
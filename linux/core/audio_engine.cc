@@ -0,0 +1,199 @@
+#include "core/audio_engine.h"
+
+#include <cstring>
+
+#include "core/log.h"
+#include "core/thread_stats.h"
+#include "core/trace.h"
+
+namespace carlink {
+
+AudioEngine::AudioEngine(std::unique_ptr<AudioSink> sink)
+    : AudioEngine(std::move(sink), Options()) {}
+
+AudioEngine::AudioEngine(std::unique_ptr<AudioSink> sink,
+                         const Options& options)
+    : sink_(std::move(sink)), options_(options) {}
+
+AudioEngine::~AudioEngine() {
+  Stop();
+}
+
+bool AudioEngine::Start() {
+  if (running_.load()) {
+    return true;
+  }
+  if (!sink_->Open(options_.output_rate, 2)) {
+    return false;
+  }
+  running_.store(true);
+  polled_ = false;
+  thread_ = std::thread(&AudioEngine::Run, this);
+  return true;
+}
+
+bool AudioEngine::StartPolled(int64_t now_ns) {
+  if (running_.load()) {
+    return true;
+  }
+  if (!sink_->Open(options_.output_rate, 2)) {
+    return false;
+  }
+  running_.store(true);
+  polled_ = true;
+  period_.assign(options_.period_frames * 2, 0);
+  polled_start_ns_ = now_ns;
+  polled_periods_ = 0;
+  return true;
+}
+
+void AudioEngine::Stop() {
+  if (!running_.exchange(false)) {
+    return;
+  }
+  if (!polled_) {
+    thread_.join();
+  }
+  sink_->Close();
+}
+
+int64_t AudioEngine::next_period_ns() const {
+  // From the period count rather than summed, so nothing drifts.
+  return polled_start_ns_ +
+         static_cast<int64_t>(polled_periods_ * options_.period_frames *
+                              1000000000 / options_.output_rate);
+}
+
+void AudioEngine::RenderUntil(int64_t now_ns) {
+  while (running_.load(std::memory_order_relaxed) &&
+         next_period_ns() <= now_ns) {
+    memset(period_.data(), 0, period_.size() * sizeof(int16_t));
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      MixPeriod(period_.data());
+    }
+    polled_periods_++;
+    if (!sink_->Write(period_.data(), options_.period_frames)) {
+      Log(LogLevel::kError, "[AUDIO] sink write failed, stopping playout");
+      running_.store(false);
+      return;
+    }
+  }
+}
+
+void AudioEngine::Push(const AudioPacket& packet) {
+  TraceScope trace("audio.push", packet.sample_count);
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_.packets++;
+
+  if (packet.command != AudioCommand::kNone) {
+    stats_.commands++;
+    return;
+  }
+  if (packet.sample_count == 0) {
+    return;
+  }
+
+  AudioFormat format;
+  if (!AudioFormatForDecodeType(packet.decode_type, &format)) {
+    return;
+  }
+
+  std::unique_ptr<Stream>& slot = streams_[packet.audio_type];
+  if (!slot) {
+    slot.reset(new Stream(options_.output_rate));
+  }
+  Stream& stream = *slot;
+  if (stream.format.sample_rate != format.sample_rate ||
+      stream.format.channels != format.channels) {
+    if (stream.format.sample_rate != 0) {
+      stats_.format_changes++;
+    }
+    Log(LogLevel::kInfo, "[AUDIO] stream %u: %uHz %uch", packet.audio_type,
+        format.sample_rate, format.channels);
+    stream.format = format;
+    stream.resampler.Configure(format);
+    stream.buffer.clear();
+    stream.head = 0;
+    stream.playing = false;
+  }
+
+  const size_t frames = packet.sample_count / format.channels;
+  stats_.frames_in += frames;
+  stream.resampler.Process(packet.samples, frames, &stream.buffer);
+
+  const size_t max_samples =
+      static_cast<size_t>(options_.output_rate) * options_.max_buffer_ms / 1000 *
+      2;
+  if (stream.available() > max_samples) {
+    const size_t excess = stream.available() - max_samples;
+    stream.head += excess;
+    stats_.overflow_frames += excess / 2;
+  }
+  // Compact once the consumed prefix dominates the buffer.
+  if (stream.head > 0 && stream.head >= stream.available()) {
+    stream.buffer.erase(stream.buffer.begin(),
+                        stream.buffer.begin() + stream.head);
+    stream.head = 0;
+  }
+}
+
+void AudioEngine::MixPeriod(int16_t* out) {
+  const size_t needed = static_cast<size_t>(options_.period_frames) * 2;
+  const size_t prebuffer = static_cast<size_t>(options_.output_rate) *
+                           options_.prebuffer_ms / 1000 * 2;
+  uint64_t active = 0;
+
+  for (auto& entry : streams_) {
+    Stream& stream = *entry.second;
+    if (!stream.playing) {
+      if (stream.available() < prebuffer) {
+        continue;
+      }
+      stream.playing = true;
+    }
+    active++;
+
+    const size_t count =
+        stream.available() < needed ? stream.available() : needed;
+    MixSamples(out, stream.buffer.data() + stream.head, count, 256);
+    stream.head += count;
+    if (count < needed) {
+      // Ran dry: go back to buffering so playback resumes smoothly.
+      stats_.underruns++;
+      stream.playing = false;
+    }
+  }
+  stats_.active_streams = active;
+  stats_.frames_played += options_.period_frames;
+}
+
+void AudioEngine::Run() {
+  SetCurrentThreadName("carlink-audio");
+  Log(LogLevel::kInfo, "[AUDIO] playout thread started (%s)", sink_->name());
+  std::vector<int16_t> period(options_.period_frames * 2);
+
+  while (running_.load(std::memory_order_acquire)) {
+    memset(period.data(), 0, period.size() * sizeof(int16_t));
+    {
+      TraceScope trace("audio.mix");
+      std::lock_guard<std::mutex> lock(mutex_);
+      MixPeriod(period.data());
+    }
+    // Blocks until the device has room: the callback's pacing.
+    TraceScope trace("audio.write", options_.period_frames);
+    if (!sink_->Write(period.data(), options_.period_frames)) {
+      Log(LogLevel::kError, "[AUDIO] sink write failed, stopping playout");
+      break;
+    }
+  }
+
+  Log(LogLevel::kInfo, "[AUDIO] playout thread stopped");
+}
+
+AudioEngine::Stats AudioEngine::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+}  // namespace carlink
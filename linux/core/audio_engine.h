@@ -0,0 +1,105 @@
+#ifndef CARLINK_CORE_AUDIO_ENGINE_H_
+#define CARLINK_CORE_AUDIO_ENGINE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "core/audio.h"
+#include "core/audio_sink.h"
+
+namespace carlink {
+
+// Plays AudioData streams natively. Each audio type (media, navigation,
+// call, ...) gets its own resampler and jitter buffer; a playout thread
+// mixes whatever is buffered into fixed periods for the sink.
+//
+// A polled engine (StartPolled()) has no playout thread: RenderUntil()
+// mixes the periods due by a given clock time, and the sink must not block.
+class AudioEngine {
+ public:
+  struct Options {
+    uint32_t output_rate = 48000;
+    // 10 ms periods.
+    uint32_t period_frames = 480;
+    // A stream starts (or restarts after an underrun) once this much is
+    // buffered.
+    uint32_t prebuffer_ms = 60;
+    // Oldest audio is dropped beyond this, bounding latency.
+    uint32_t max_buffer_ms = 500;
+  };
+
+  struct Stats {
+    uint64_t packets = 0;
+    uint64_t commands = 0;
+    uint64_t frames_in = 0;
+    uint64_t frames_played = 0;
+    uint64_t underruns = 0;
+    uint64_t overflow_frames = 0;
+    uint64_t format_changes = 0;
+    uint64_t active_streams = 0;
+  };
+
+  explicit AudioEngine(std::unique_ptr<AudioSink> sink);
+  AudioEngine(std::unique_ptr<AudioSink> sink, const Options& options);
+  ~AudioEngine();
+
+  AudioEngine(const AudioEngine&) = delete;
+  AudioEngine& operator=(const AudioEngine&) = delete;
+
+  bool Start();
+  bool StartPolled(int64_t now_ns);
+  void Stop();
+
+  // Polled engines only. Plays every period due by |now_ns|.
+  void RenderUntil(int64_t now_ns);
+  // Clock time the next period is due.
+  int64_t next_period_ns() const;
+
+  // USB thread.
+  void Push(const AudioPacket& packet);
+
+  const char* sink_name() const { return sink_->name(); }
+
+  Stats stats() const;
+
+ private:
+  struct Stream {
+    AudioFormat format;
+    Resampler resampler;
+    // Interleaved stereo at the output rate; consumed from |head|.
+    std::vector<int16_t> buffer;
+    size_t head = 0;
+    bool playing = false;
+
+    explicit Stream(uint32_t rate) : resampler(rate) {}
+    size_t available() const { return buffer.size() - head; }
+  };
+
+  void Run();
+  // Mixes one period into |out|. Called with |mutex_| held.
+  void MixPeriod(int16_t* out);
+
+  std::unique_ptr<AudioSink> sink_;
+  const Options options_;
+
+  mutable std::mutex mutex_;
+  std::map<uint32_t, std::unique_ptr<Stream>> streams_;
+
+  std::thread thread_;
+  std::atomic<bool> running_{false};
+  bool polled_ = false;
+  std::vector<int16_t> period_;
+  int64_t polled_start_ns_ = 0;
+  uint64_t polled_periods_ = 0;
+
+  Stats stats_;
+};
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_AUDIO_ENGINE_H_
@@ -0,0 +1,119 @@
+#include "core/audio_sink.h"
+
+#include <chrono>
+#include <thread>
+
+#ifdef CARLINK_HAVE_ALSA
+#include <alsa/asoundlib.h>
+#endif
+
+#include "core/log.h"
+
+namespace carlink {
+
+namespace {
+
+class NullAudioSink : public AudioSink {
+ public:
+  explicit NullAudioSink(bool paced) : paced_(paced) {}
+
+  const char* name() const override { return "null"; }
+
+  bool Open(uint32_t sample_rate, uint32_t channels) override {
+    sample_rate_ = sample_rate;
+    next_ = std::chrono::steady_clock::now();
+    return true;
+  }
+
+  bool Write(const int16_t* samples, size_t frames) override {
+    if (!paced_) {
+      return true;
+    }
+    next_ += std::chrono::microseconds(frames * 1000000 / sample_rate_);
+    std::this_thread::sleep_until(next_);
+    return true;
+  }
+
+  void Close() override {}
+
+ private:
+  const bool paced_;
+  uint32_t sample_rate_ = 48000;
+  std::chrono::steady_clock::time_point next_;
+};
+
+#ifdef CARLINK_HAVE_ALSA
+class AlsaAudioSink : public AudioSink {
+ public:
+  ~AlsaAudioSink() override { Close(); }
+
+  const char* name() const override { return "alsa"; }
+
+  bool Open(uint32_t sample_rate, uint32_t channels) override {
+    channels_ = channels;
+    int err = snd_pcm_open(&pcm_, "default", SND_PCM_STREAM_PLAYBACK, 0);
+    if (err < 0) {
+      Log(LogLevel::kError, "[AUDIO] snd_pcm_open: %s", snd_strerror(err));
+      pcm_ = nullptr;
+      return false;
+    }
+    // 60 ms of device buffering, enough to ride out a late USB transfer.
+    err = snd_pcm_set_params(pcm_, SND_PCM_FORMAT_S16_LE,
+                             SND_PCM_ACCESS_RW_INTERLEAVED, channels,
+                             sample_rate, 1, 60000);
+    if (err < 0) {
+      Log(LogLevel::kError, "[AUDIO] snd_pcm_set_params: %s",
+          snd_strerror(err));
+      Close();
+      return false;
+    }
+    return true;
+  }
+
+  bool Write(const int16_t* samples, size_t frames) override {
+    while (frames > 0) {
+      snd_pcm_sframes_t written = snd_pcm_writei(pcm_, samples, frames);
+      if (written < 0) {
+        written = snd_pcm_recover(pcm_, static_cast<int>(written), 1);
+        if (written < 0) {
+          Log(LogLevel::kError, "[AUDIO] snd_pcm_writei: %s",
+              snd_strerror(static_cast<int>(written)));
+          return false;
+        }
+        continue;
+      }
+      samples += written * channels_;
+      frames -= written;
+    }
+    return true;
+  }
+
+  void Close() override {
+    if (pcm_ != nullptr) {
+      snd_pcm_drop(pcm_);
+      snd_pcm_close(pcm_);
+      pcm_ = nullptr;
+    }
+  }
+
+ private:
+  snd_pcm_t* pcm_ = nullptr;
+  uint32_t channels_ = 2;
+};
+#endif  // CARLINK_HAVE_ALSA
+
+}  // namespace
+
+std::unique_ptr<AudioSink> CreateNullAudioSink(bool paced) {
+  return std::unique_ptr<AudioSink>(new NullAudioSink(paced));
+}
+
+std::unique_ptr<AudioSink> CreateAudioSink() {
+#ifdef CARLINK_HAVE_ALSA
+  return std::unique_ptr<AudioSink>(new AlsaAudioSink());
+#else
+  return CreateNullAudioSink();
+#endif
+}
+
+}  // namespace carlink
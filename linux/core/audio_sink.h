@@ -0,0 +1,32 @@
+#ifndef CARLINK_CORE_AUDIO_SINK_H_
+#define CARLINK_CORE_AUDIO_SINK_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace carlink {
+
+// Output device for the mixed stream. Write() blocks until the device has
+// room, which is what paces the playout thread.
+class AudioSink {
+ public:
+  virtual ~AudioSink() = default;
+
+  virtual const char* name() const = 0;
+  virtual bool Open(uint32_t sample_rate, uint32_t channels) = 0;
+  virtual bool Write(const int16_t* samples, size_t frames) = 0;
+  virtual void Close() = 0;
+};
+
+// Discards audio, sleeping for the duration of every write unless
+// |paced| is false (for polled engines).
+std::unique_ptr<AudioSink> CreateNullAudioSink(bool paced = true);
+
+// The ALSA "default" PCM when the core was built with ALSA, otherwise the
+// null sink.
+std::unique_ptr<AudioSink> CreateAudioSink();
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_AUDIO_SINK_H_
@@ -0,0 +1,237 @@
+#include "core/bitstream_analyzer.h"
+
+#include "core/h264_bitstream.h"
+#include "core/nal_scanner.h"
+
+namespace carlink {
+
+namespace {
+
+// Enough RBSP for an SPS, scaling lists included, or for a slice header up
+// to frame_num.
+constexpr size_t kMaxSpsBytes = 256;
+constexpr size_t kMaxSliceHeaderBytes = 32;
+
+// scaling_list() only needs skipping.
+void SkipScalingList(BitReader* reader, int size) {
+  int last = 8;
+  int next = 8;
+  for (int i = 0; i < size && next != 0; i++) {
+    next = (last + reader->ReadSe() + 256) % 256;
+    last = next == 0 ? last : next;
+  }
+}
+
+}  // namespace
+
+bool BitstreamAnalyzer::ParseSps(const uint8_t* data, size_t length) {
+  uint8_t rbsp[kMaxSpsBytes];
+  BitReader reader(rbsp, UnescapeRbsp(data, length, rbsp, sizeof(rbsp)));
+  const uint32_t profile = reader.ReadBits(8);
+  reader.ReadBits(8);  // constraint flags
+  const uint32_t level = reader.ReadBits(8);
+  reader.ReadUe();  // seq_parameter_set_id
+  uint32_t chroma_format = 1;
+  bool separate_colour_plane = false;
+  if (profile == 100 || profile == 110 || profile == 122 || profile == 244 ||
+      profile == 44 || profile == 83 || profile == 86 || profile == 118 ||
+      profile == 128 || profile == 138 || profile == 139 || profile == 134 ||
+      profile == 135) {
+    chroma_format = reader.ReadUe();
+    if (chroma_format == 3) {
+      separate_colour_plane = reader.ReadBit();
+    }
+    reader.ReadUe();   // bit_depth_luma_minus8
+    reader.ReadUe();   // bit_depth_chroma_minus8
+    reader.ReadBit();  // qpprime_y_zero_transform_bypass_flag
+    if (reader.ReadBit()) {  // seq_scaling_matrix_present_flag
+      for (int i = 0; i < (chroma_format != 3 ? 8 : 12); i++) {
+        if (reader.ReadBit()) {
+          SkipScalingList(&reader, i < 6 ? 16 : 64);
+        }
+      }
+    }
+  }
+  const uint32_t log2_max_frame_num = reader.ReadUe() + 4;
+  const uint32_t poc_type = reader.ReadUe();
+  if (poc_type == 0) {
+    reader.ReadUe();  // log2_max_pic_order_cnt_lsb_minus4
+  } else if (poc_type == 1) {
+    reader.ReadBit();  // delta_pic_order_always_zero_flag
+    reader.ReadSe();   // offset_for_non_ref_pic
+    reader.ReadSe();   // offset_for_top_to_bottom_field
+    const uint32_t cycle = reader.ReadUe();
+    for (uint32_t i = 0; i < cycle && !reader.overrun(); i++) {
+      reader.ReadSe();
+    }
+  }
+  reader.ReadUe();  // max_num_ref_frames
+  const bool gaps_allowed = reader.ReadBit();
+  const uint32_t mb_width = reader.ReadUe() + 1;
+  const uint32_t map_height = reader.ReadUe() + 1;
+  const bool frame_mbs_only = reader.ReadBit();
+  if (!frame_mbs_only) {
+    reader.ReadBit();  // mb_adaptive_frame_field_flag
+  }
+  reader.ReadBit();  // direct_8x8_inference_flag
+  uint32_t crop_left = 0, crop_right = 0, crop_top = 0, crop_bottom = 0;
+  if (reader.ReadBit()) {
+    crop_left = reader.ReadUe();
+    crop_right = reader.ReadUe();
+    crop_top = reader.ReadUe();
+    crop_bottom = reader.ReadUe();
+  }
+  if (reader.overrun() || log2_max_frame_num > 16) {
+    return false;
+  }
+
+  // Crop units of 4:2:0; 4:4:4 and monochrome streams never come from a
+  // phone.
+  const uint32_t crop_x = chroma_format == 1 || chroma_format == 2 ? 2 : 1;
+  const uint32_t crop_y =
+      (chroma_format == 1 ? 2 : 1) * (frame_mbs_only ? 1 : 2);
+  const uint32_t height = map_height * 16 * (frame_mbs_only ? 1 : 2);
+  Set(kProfile, profile);
+  Set(kLevel, level);
+  Set(kWidth, mb_width * 16 - crop_x * (crop_left + crop_right));
+  Set(kHeight, height - crop_y * (crop_top + crop_bottom));
+  log2_max_frame_num_ = log2_max_frame_num;
+  separate_colour_plane_ = separate_colour_plane;
+  gaps_allowed_ = gaps_allowed;
+  have_sps_ = true;
+  return true;
+}
+
+BitstreamAnalyzer::Result BitstreamAnalyzer::Analyze(const uint8_t* data,
+                                                     size_t length,
+                                                     int64_t now_ns) {
+  Result result;
+  Add(kAccessUnits);
+
+  // Instantaneous bitrate over whole seconds.
+  if (window_start_ns_ == 0) {
+    window_start_ns_ = now_ns;
+  } else if (now_ns - window_start_ns_ >= 1000000000) {
+    const uint64_t bitrate =
+        window_bytes_ * 8 * 1000000000 / (now_ns - window_start_ns_);
+    Set(kBitrate, bitrate);
+    if (bitrate > values_[kBitratePeak].load(std::memory_order_relaxed)) {
+      Set(kBitratePeak, bitrate);
+    }
+    window_start_ns_ = now_ns;
+    window_bytes_ = 0;
+  }
+  window_bytes_ += length;
+
+  NalScanner scanner(data, length);
+  NalUnit unit;
+  while (scanner.Next(&unit)) {
+    if (unit.size < 2) {
+      continue;
+    }
+    if (unit.type == kNalSps) {
+      ParseSps(unit.data + 1, unit.size - 1);
+      continue;
+    }
+    if (unit.type != kNalSlice && unit.type != kNalIdr) {
+      continue;
+    }
+    if (!have_sps_) {
+      break;
+    }
+    // The first slice speaks for the picture.
+    uint8_t rbsp[kMaxSliceHeaderBytes];
+    BitReader reader(rbsp, UnescapeRbsp(unit.data + 1, unit.size - 1, rbsp,
+                                        sizeof(rbsp)));
+    reader.ReadUe();  // first_mb_in_slice
+    const uint32_t slice_type = reader.ReadUe() % 5;
+    reader.ReadUe();  // pic_parameter_set_id
+    if (separate_colour_plane_) {
+      reader.ReadBits(2);  // colour_plane_id
+    }
+    const uint32_t frame_num = reader.ReadBits(log2_max_frame_num_);
+    if (reader.overrun()) {
+      break;
+    }
+    result.parsed = true;
+    result.idr = unit.type == kNalIdr;
+    const bool reference = (unit.data[0] >> 5) & 3;
+
+    if (result.idr) {
+      Add(kIdrFrames);
+      const uint64_t since = values_[kFramesSinceIdr].load(
+          std::memory_order_relaxed);
+      if (values_[kIdrFrames].load(std::memory_order_relaxed) > 1) {
+        Set(kGopLength, since);
+        if (since > values_[kGopLengthMax].load(std::memory_order_relaxed)) {
+          Set(kGopLengthMax, since);
+        }
+      }
+      Set(kFramesSinceIdr, 1);
+      idr_sizes_.Record(length);
+    } else {
+      // slice_type 0 P, 1 B, 2 I, 3 SP, 4 SI.
+      Add(slice_type == 1 ? kBFrames
+                          : slice_type == 2 || slice_type == 4 ? kIFrames
+                                                                : kPFrames);
+      Add(kFramesSinceIdr);
+      frame_sizes_.Record(length);
+    }
+
+    // Every picture carries the previous reference picture's frame_num
+    // plus one, or the same again after non-reference pictures.
+    const uint32_t max_frame_num = 1u << log2_max_frame_num_;
+    if (result.idr) {
+      have_frame_num_ = true;
+    } else if (have_frame_num_ && !gaps_allowed_ &&
+               frame_num != prev_ref_frame_num_ &&
+               frame_num != (prev_ref_frame_num_ + 1) % max_frame_num) {
+      result.missing =
+          (frame_num - prev_ref_frame_num_ - 1 + max_frame_num) %
+          max_frame_num;
+      Add(kFrameNumGaps);
+      Add(kFramesMissing, result.missing);
+    }
+    if (reference) {
+      prev_ref_frame_num_ = frame_num;
+    }
+    break;
+  }
+  if (!result.parsed) {
+    Add(kUnparsed);
+  }
+  return result;
+}
+
+BitstreamAnalyzer::Stats BitstreamAnalyzer::stats() const {
+  uint64_t values[kCounterCount];
+  for (int i = 0; i < kCounterCount; i++) {
+    values[i] = values_[i].load(std::memory_order_relaxed);
+  }
+  Stats stats;
+  stats.access_units = values[kAccessUnits];
+  stats.idr_frames = values[kIdrFrames];
+  stats.i_frames = values[kIFrames];
+  stats.p_frames = values[kPFrames];
+  stats.b_frames = values[kBFrames];
+  stats.unparsed = values[kUnparsed];
+  stats.frame_num_gaps = values[kFrameNumGaps];
+  stats.frames_missing = values[kFramesMissing];
+  stats.profile = static_cast<uint32_t>(values[kProfile]);
+  stats.level = static_cast<uint32_t>(values[kLevel]);
+  stats.width = static_cast<uint32_t>(values[kWidth]);
+  stats.height = static_cast<uint32_t>(values[kHeight]);
+  stats.gop_length = values[kGopLength];
+  stats.gop_length_max = values[kGopLengthMax];
+  stats.frames_since_idr = values[kFramesSinceIdr];
+  stats.bitrate_bps = values[kBitrate];
+  stats.bitrate_peak_bps = values[kBitratePeak];
+  stats.idr_size_p50 = idr_sizes_.Percentile(50);
+  stats.idr_size_max = idr_sizes_.max();
+  stats.frame_size_p50 = frame_sizes_.Percentile(50);
+  stats.frame_size_p99 = frame_sizes_.Percentile(99);
+  stats.frame_size_max = frame_sizes_.max();
+  return stats;
+}
+
+}  // namespace carlink
@@ -0,0 +1,120 @@
+#ifndef CARLINK_CORE_BITSTREAM_ANALYZER_H_
+#define CARLINK_CORE_BITSTREAM_ANALYZER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "core/histogram.h"
+
+namespace carlink {
+
+// What the phone actually sends, measured on the live VideoData path: the
+// SPS, frame types and frame_num from the first slice header of every
+// access unit, GOP length, bitrate and frame size percentiles. A frame_num
+// that skips ahead means access units were lost before they reached us.
+//
+// Analyze() is cheap (NAL headers plus a few dozen bytes of slice header,
+// no allocation) and must be called from one thread; stats() from any.
+class BitstreamAnalyzer {
+ public:
+  struct Stats {
+    uint64_t access_units = 0;
+    uint64_t idr_frames = 0;
+    uint64_t i_frames = 0;
+    uint64_t p_frames = 0;
+    uint64_t b_frames = 0;
+    // Access units without a parsable slice, or before the first SPS.
+    uint64_t unparsed = 0;
+    uint64_t frame_num_gaps = 0;
+    // Access units the gaps stand for.
+    uint64_t frames_missing = 0;
+    // From the last SPS; 0 before one arrived.
+    uint32_t profile = 0;
+    uint32_t level = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    // IDR to IDR, in access units: the last, the longest, and how many
+    // since the last IDR.
+    uint64_t gop_length = 0;
+    uint64_t gop_length_max = 0;
+    uint64_t frames_since_idr = 0;
+    // Over the last whole second, and the highest such second.
+    uint64_t bitrate_bps = 0;
+    uint64_t bitrate_peak_bps = 0;
+    uint64_t idr_size_p50 = 0;
+    uint64_t idr_size_max = 0;
+    // Frames other than IDRs.
+    uint64_t frame_size_p50 = 0;
+    uint64_t frame_size_p99 = 0;
+    uint64_t frame_size_max = 0;
+  };
+
+  // Per access unit.
+  struct Result {
+    bool parsed = false;
+    bool idr = false;
+    // Access units lost right before this one.
+    uint32_t missing = 0;
+  };
+
+  BitstreamAnalyzer() = default;
+
+  BitstreamAnalyzer(const BitstreamAnalyzer&) = delete;
+  BitstreamAnalyzer& operator=(const BitstreamAnalyzer&) = delete;
+
+  // One Annex-B access unit that arrived at |now_ns|.
+  Result Analyze(const uint8_t* data, size_t length, int64_t now_ns);
+
+  Stats stats() const;
+
+ private:
+  enum Counter {
+    kAccessUnits,
+    kIdrFrames,
+    kIFrames,
+    kPFrames,
+    kBFrames,
+    kUnparsed,
+    kFrameNumGaps,
+    kFramesMissing,
+    kProfile,
+    kLevel,
+    kWidth,
+    kHeight,
+    kGopLength,
+    kGopLengthMax,
+    kFramesSinceIdr,
+    kBitrate,
+    kBitratePeak,
+    kCounterCount,
+  };
+
+  // The SPS fields slice headers and gap detection need.
+  bool ParseSps(const uint8_t* data, size_t length);
+  void Set(Counter counter, uint64_t value) {
+    values_[counter].store(value, std::memory_order_relaxed);
+  }
+  void Add(Counter counter, uint64_t delta = 1) {
+    Set(counter, values_[counter].load(std::memory_order_relaxed) + delta);
+  }
+
+  // Written only by the analyzing thread.
+  std::atomic<uint64_t> values_[kCounterCount] = {};
+  Histogram idr_sizes_;
+  Histogram frame_sizes_;
+
+  // Analyzing thread only.
+  bool have_sps_ = false;
+  uint32_t log2_max_frame_num_ = 4;
+  bool separate_colour_plane_ = false;
+  bool gaps_allowed_ = false;
+  bool have_frame_num_ = false;
+  uint32_t prev_ref_frame_num_ = 0;
+  int64_t window_start_ns_ = 0;
+  uint64_t window_bytes_ = 0;
+};
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_BITSTREAM_ANALYZER_H_
@@ -0,0 +1,120 @@
+#include "core/buffer_pool.h"
+
+namespace carlink {
+
+Buffer& Buffer::operator=(Buffer&& other) noexcept {
+  if (this != &other) {
+    Release();
+    pool_ = std::move(other.pool_);
+    data_ = other.data_;
+    size_ = other.size_;
+    capacity_ = other.capacity_;
+    other.data_ = nullptr;
+    other.size_ = 0;
+    other.capacity_ = 0;
+  }
+  return *this;
+}
+
+void Buffer::Release() {
+  if (data_ == nullptr) {
+    return;
+  }
+  if (pool_) {
+    pool_->Return(data_, capacity_);
+    pool_.reset();
+  } else {
+    delete[] data_;
+  }
+  data_ = nullptr;
+  size_ = 0;
+  capacity_ = 0;
+}
+
+std::shared_ptr<BufferPool> BufferPool::Create(size_t max_cached_per_class) {
+  return std::shared_ptr<BufferPool>(new BufferPool(max_cached_per_class));
+}
+
+BufferPool::BufferPool(size_t max_cached_per_class)
+    : max_cached_per_class_(max_cached_per_class) {}
+
+BufferPool::~BufferPool() {
+  for (auto& list : free_) {
+    for (uint8_t* data : list) {
+      delete[] data;
+    }
+  }
+}
+
+int BufferPool::ClassFor(size_t size) {
+  int shift = kMinClassShift;
+  while (shift <= kMaxClassShift && (static_cast<size_t>(1) << shift) < size) {
+    shift++;
+  }
+  return shift > kMaxClassShift ? -1 : shift - kMinClassShift;
+}
+
+Buffer BufferPool::Acquire(size_t size) {
+  counters_.Add(kAcquired);
+
+  Buffer buffer;
+  buffer.pool_ = shared_from_this();
+  buffer.size_ = size;
+
+  const int index = ClassFor(size);
+  if (index < 0) {
+    // Oversized, never cached.
+    buffer.data_ = new uint8_t[size];
+    buffer.capacity_ = size;
+    counters_.Add(kAllocated);
+    return buffer;
+  }
+
+  const size_t capacity = static_cast<size_t>(1) << (index + kMinClassShift);
+  buffer.capacity_ = capacity;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!free_[index].empty()) {
+      buffer.data_ = free_[index].back();
+      free_[index].pop_back();
+      cached_bytes_ -= capacity;
+    }
+  }
+  if (buffer.data_ != nullptr) {
+    counters_.Add(kReused);
+  } else {
+    buffer.data_ = new uint8_t[capacity];
+    counters_.Add(kAllocated);
+  }
+  return buffer;
+}
+
+void BufferPool::Return(uint8_t* data, size_t capacity) {
+  counters_.Add(kReturned);
+  const int index = ClassFor(capacity);
+  if (index >= 0 &&
+      (static_cast<size_t>(1) << (index + kMinClassShift)) == capacity) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_[index].size() < max_cached_per_class_) {
+      free_[index].push_back(data);
+      cached_bytes_ += capacity;
+      return;
+    }
+  }
+  delete[] data;
+}
+
+BufferPool::Stats BufferPool::stats() const {
+  uint64_t counters[kCounterCount];
+  counters_.Snapshot(counters);
+  Stats stats;
+  stats.acquired = counters[kAcquired];
+  stats.reused = counters[kReused];
+  stats.allocated = counters[kAllocated];
+  stats.outstanding = counters[kAcquired] - counters[kReturned];
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats.cached_bytes = cached_bytes_;
+  return stats;
+}
+
+}  // namespace carlink
@@ -0,0 +1,100 @@
+#ifndef CARLINK_CORE_BUFFER_POOL_H_
+#define CARLINK_CORE_BUFFER_POOL_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "core/sharded_counters.h"
+
+namespace carlink {
+
+class BufferPool;
+
+// Move-only byte buffer that returns its storage to the pool it came from.
+class Buffer {
+ public:
+  Buffer() = default;
+  ~Buffer() { Release(); }
+
+  Buffer(Buffer&& other) noexcept { *this = std::move(other); }
+  Buffer& operator=(Buffer&& other) noexcept;
+
+  Buffer(const Buffer&) = delete;
+  Buffer& operator=(const Buffer&) = delete;
+
+  uint8_t* data() { return data_; }
+  const uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+  size_t capacity() const { return capacity_; }
+  bool empty() const { return size_ == 0; }
+
+  // Shrinks the visible size; never grows past capacity().
+  void set_size(size_t size) { size_ = size < capacity_ ? size : capacity_; }
+
+ private:
+  friend class BufferPool;
+
+  void Release();
+
+  std::shared_ptr<BufferPool> pool_;
+  uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+  size_t capacity_ = 0;
+};
+
+// Recycles payload buffers in power-of-two size classes so the USB thread
+// does not hit the allocator for every message. Thread-safe: buffers are
+// usually acquired on the USB thread and released on a consumer thread.
+class BufferPool : public std::enable_shared_from_this<BufferPool> {
+ public:
+  struct Stats {
+    uint64_t acquired = 0;
+    uint64_t reused = 0;
+    uint64_t allocated = 0;
+    uint64_t cached_bytes = 0;
+    uint64_t outstanding = 0;
+  };
+
+  static std::shared_ptr<BufferPool> Create(size_t max_cached_per_class = 16);
+
+  ~BufferPool();
+
+  Buffer Acquire(size_t size);
+
+  Stats stats() const;
+
+ private:
+  static constexpr int kMinClassShift = 8;   // 256 bytes
+  static constexpr int kMaxClassShift = 23;  // 8 MiB
+  static constexpr int kClassCount = kMaxClassShift - kMinClassShift + 1;
+
+  friend class Buffer;
+
+  explicit BufferPool(size_t max_cached_per_class);
+
+  static int ClassFor(size_t size);
+  void Return(uint8_t* data, size_t capacity);
+
+  const size_t max_cached_per_class_;
+  mutable std::mutex mutex_;
+  std::vector<uint8_t*> free_[kClassCount];
+  uint64_t cached_bytes_ = 0;
+
+  // Buffers are acquired on one thread and often returned on another.
+  enum Counter {
+    kAcquired,
+    kReused,
+    kAllocated,
+    kReturned,
+    kCounterCount,
+  };
+  ShardedCounters counters_{kCounterCount};
+};
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_BUFFER_POOL_H_
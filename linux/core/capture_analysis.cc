@@ -0,0 +1,313 @@
+#include "core/capture_analysis.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <thread>
+
+#include "core/audio.h"
+#include "core/protocol.h"
+
+namespace carlink {
+
+namespace {
+
+// What one thread gathers over its range of messages. State that spans
+// chunks (GOPs, gaps, audio formats) keeps its first and last values so
+// neighbouring chunks can be stitched together.
+struct Chunk {
+  uint64_t messages = 0;
+  int64_t first_ns = 0;
+  int64_t last_ns = 0;
+
+  std::map<uint32_t, MessageTypeCount> types;
+  std::vector<uint64_t> video_bytes_per_second;
+
+  // Video frames before the first IDR, in complete GOPs, and after the
+  // last IDR.
+  bool has_idr = false;
+  uint32_t leading_frames = 0;
+  std::vector<uint32_t> gop_lengths;
+  uint32_t trailing_frames = 0;
+  std::vector<uint32_t> idr_sizes;
+  std::vector<uint32_t> p_sizes;
+
+  // Per audio type: the first packet's time and decode type, and the last
+  // decode type.
+  std::map<uint32_t, std::pair<int64_t, uint32_t>> audio_first;
+  std::map<uint32_t, uint32_t> audio_last;
+  std::vector<AudioFormatChange> audio_changes;
+
+  uint64_t heartbeats = 0;
+  int64_t first_heartbeat_ns = -1;
+  int64_t last_heartbeat_ns = -1;
+  CaptureGap longest_heartbeat_gap;
+  std::vector<CaptureGap> heartbeat_gaps;
+
+  int64_t first_inbound_ns = -1;
+  int64_t last_inbound_ns = -1;
+  CaptureGap longest_inbound_silence;
+};
+
+void NoteGap(int64_t start_ns, int64_t end_ns, CaptureGap* longest) {
+  if (end_ns - start_ns > longest->length_ns) {
+    longest->start_ns = start_ns;
+    longest->length_ns = end_ns - start_ns;
+  }
+}
+
+void ScanChunk(const CaptureReader& reader, size_t begin, size_t end,
+               const CaptureAnalysisOptions& options, Chunk* chunk) {
+  CaptureReader::BlockCache cache;
+  for (size_t i = begin; i < end; i++) {
+    const CaptureRecord record = reader.record(i, &cache);
+    const int64_t now = record.timestamp_ns;
+    if (chunk->messages == 0) {
+      chunk->first_ns = now;
+    }
+    chunk->last_ns = now;
+    chunk->messages++;
+
+    MessageTypeCount& count = chunk->types[record.type];
+    count.type = record.type;
+    if (record.direction == CaptureDirection::kInbound) {
+      count.inbound++;
+      count.inbound_bytes += record.length;
+      if (chunk->last_inbound_ns >= 0) {
+        NoteGap(chunk->last_inbound_ns, now, &chunk->longest_inbound_silence);
+      } else {
+        chunk->first_inbound_ns = now;
+      }
+      chunk->last_inbound_ns = now;
+    } else {
+      count.outbound++;
+      count.outbound_bytes += record.length;
+    }
+
+    const MessageType type = static_cast<MessageType>(record.type);
+    if (type == MessageType::kVideoData &&
+        record.direction == CaptureDirection::kInbound &&
+        record.length > kVideoDataHeaderSize) {
+      const uint32_t size = record.length - kVideoDataHeaderSize;
+      const size_t second = static_cast<size_t>(std::max<int64_t>(now, 0) /
+                                                1000000000);
+      if (chunk->video_bytes_per_second.size() <= second) {
+        chunk->video_bytes_per_second.resize(second + 1);
+      }
+      chunk->video_bytes_per_second[second] += size;
+
+      if (record.flags & kCaptureKeyframe) {
+        chunk->idr_sizes.push_back(size);
+        if (chunk->has_idr) {
+          chunk->gop_lengths.push_back(chunk->trailing_frames);
+        } else {
+          chunk->leading_frames = chunk->trailing_frames;
+          chunk->has_idr = true;
+        }
+        chunk->trailing_frames = 1;
+      } else {
+        chunk->p_sizes.push_back(size);
+        chunk->trailing_frames++;
+      }
+    } else if (type == MessageType::kAudioData &&
+               record.direction == CaptureDirection::kInbound) {
+      AudioPacket packet;
+      if (ParseAudioPacket(record.payload, record.length, &packet) &&
+          packet.sample_count > 0) {
+        auto last = chunk->audio_last.find(packet.audio_type);
+        if (last == chunk->audio_last.end()) {
+          chunk->audio_first[packet.audio_type] = {now, packet.decode_type};
+          chunk->audio_last[packet.audio_type] = packet.decode_type;
+        } else if (last->second != packet.decode_type) {
+          chunk->audio_changes.push_back(
+              {now, packet.audio_type, last->second, packet.decode_type});
+          last->second = packet.decode_type;
+        }
+      }
+    } else if (type == MessageType::kHeartBeat &&
+               record.direction == CaptureDirection::kOutbound) {
+      chunk->heartbeats++;
+      if (chunk->last_heartbeat_ns >= 0) {
+        NoteGap(chunk->last_heartbeat_ns, now,
+                &chunk->longest_heartbeat_gap);
+        if (now - chunk->last_heartbeat_ns > options.heartbeat_gap_ns) {
+          chunk->heartbeat_gaps.push_back(
+              {chunk->last_heartbeat_ns, now - chunk->last_heartbeat_ns});
+        }
+      } else {
+        chunk->first_heartbeat_ns = now;
+      }
+      chunk->last_heartbeat_ns = now;
+    }
+  }
+}
+
+FrameSizeStats SizeStats(std::vector<uint32_t>* sizes) {
+  FrameSizeStats stats;
+  if (sizes->empty()) {
+    return stats;
+  }
+  std::sort(sizes->begin(), sizes->end());
+  stats.count = sizes->size();
+  for (uint32_t size : *sizes) {
+    stats.total_bytes += size;
+  }
+  stats.min = sizes->front();
+  stats.p50 = (*sizes)[(sizes->size() - 1) / 2];
+  stats.p95 = (*sizes)[(sizes->size() - 1) * 95 / 100];
+  stats.max = sizes->back();
+  return stats;
+}
+
+}  // namespace
+
+CaptureAnalysis AnalyzeCapture(const CaptureReader& reader,
+                               const CaptureAnalysisOptions& options) {
+  const size_t count = reader.message_count();
+  size_t threads = options.threads;
+  if (threads == 0) {
+    // Not worth a thread for a few thousand records.
+    const size_t cores =
+        options.pool != nullptr
+            ? options.pool->threads() + 1
+            : std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min<size_t>(cores, std::max<size_t>(1, count / 4096));
+  }
+
+  // The calling thread scans a chunk too.
+  std::unique_ptr<WorkerPool> own_pool;
+  WorkerPool* pool = options.pool;
+  if (pool == nullptr && threads > 1) {
+    own_pool.reset(new WorkerPool(static_cast<int>(threads) - 1));
+    pool = own_pool.get();
+  }
+  std::vector<Chunk> chunks(threads);
+  auto scan = [&](int i) {
+    ScanChunk(reader, count * i / threads, count * (i + 1) / threads, options,
+              &chunks[i]);
+  };
+  if (pool != nullptr) {
+    pool->ParallelFor(WorkerPool::kBackground, static_cast<int>(threads),
+                      scan);
+  } else {
+    scan(0);
+  }
+
+  // Stitch the chunks together in order.
+  CaptureAnalysis analysis;
+  std::map<uint32_t, MessageTypeCount> types;
+  std::vector<uint32_t> idr_sizes;
+  std::vector<uint32_t> p_sizes;
+  bool seen_idr = false;
+  uint32_t open_gop = 0;
+  std::map<uint32_t, uint32_t> audio_last;
+  int64_t last_heartbeat_ns = -1;
+  int64_t last_inbound_ns = -1;
+  for (Chunk& chunk : chunks) {
+    if (chunk.messages == 0) {
+      continue;
+    }
+    if (analysis.messages == 0) {
+      analysis.first_ns = chunk.first_ns;
+    }
+    analysis.last_ns = chunk.last_ns;
+    analysis.messages += chunk.messages;
+
+    for (const auto& entry : chunk.types) {
+      MessageTypeCount& total = types[entry.first];
+      total.type = entry.first;
+      total.inbound += entry.second.inbound;
+      total.inbound_bytes += entry.second.inbound_bytes;
+      total.outbound += entry.second.outbound;
+      total.outbound_bytes += entry.second.outbound_bytes;
+    }
+
+    std::vector<uint64_t>& timeline = analysis.video_bytes_per_second;
+    if (timeline.size() < chunk.video_bytes_per_second.size()) {
+      timeline.resize(chunk.video_bytes_per_second.size());
+    }
+    for (size_t i = 0; i < chunk.video_bytes_per_second.size(); i++) {
+      timeline[i] += chunk.video_bytes_per_second[i];
+    }
+
+    if (chunk.has_idr) {
+      if (seen_idr) {
+        analysis.gop_lengths.push_back(open_gop + chunk.leading_frames);
+      }
+      analysis.gop_lengths.insert(analysis.gop_lengths.end(),
+                                  chunk.gop_lengths.begin(),
+                                  chunk.gop_lengths.end());
+      seen_idr = true;
+      open_gop = chunk.trailing_frames;
+    } else {
+      open_gop += chunk.trailing_frames;
+    }
+    idr_sizes.insert(idr_sizes.end(), chunk.idr_sizes.begin(),
+                     chunk.idr_sizes.end());
+    p_sizes.insert(p_sizes.end(), chunk.p_sizes.begin(), chunk.p_sizes.end());
+
+    for (const auto& entry : chunk.audio_first) {
+      const uint32_t audio_type = entry.first;
+      const uint32_t decode_type = entry.second.second;
+      auto last = audio_last.find(audio_type);
+      if (last == audio_last.end() || last->second != decode_type) {
+        analysis.audio_format_changes.push_back(
+            {entry.second.first, audio_type,
+             last == audio_last.end() ? 0 : last->second, decode_type});
+      }
+    }
+    analysis.audio_format_changes.insert(
+        analysis.audio_format_changes.end(), chunk.audio_changes.begin(),
+        chunk.audio_changes.end());
+    for (const auto& entry : chunk.audio_last) {
+      audio_last[entry.first] = entry.second;
+    }
+
+    analysis.heartbeats += chunk.heartbeats;
+    if (chunk.heartbeats > 0) {
+      if (last_heartbeat_ns >= 0) {
+        const int64_t gap = chunk.first_heartbeat_ns - last_heartbeat_ns;
+        NoteGap(last_heartbeat_ns, chunk.first_heartbeat_ns,
+                &analysis.longest_heartbeat_gap);
+        if (gap > options.heartbeat_gap_ns) {
+          analysis.heartbeat_gaps.push_back({last_heartbeat_ns, gap});
+        }
+      }
+      if (chunk.longest_heartbeat_gap.length_ns >
+          analysis.longest_heartbeat_gap.length_ns) {
+        analysis.longest_heartbeat_gap = chunk.longest_heartbeat_gap;
+      }
+      analysis.heartbeat_gaps.insert(analysis.heartbeat_gaps.end(),
+                                     chunk.heartbeat_gaps.begin(),
+                                     chunk.heartbeat_gaps.end());
+      last_heartbeat_ns = chunk.last_heartbeat_ns;
+    }
+
+    if (chunk.last_inbound_ns >= 0) {
+      if (last_inbound_ns >= 0) {
+        NoteGap(last_inbound_ns, chunk.first_inbound_ns,
+                &analysis.longest_inbound_silence);
+      }
+      if (chunk.longest_inbound_silence.length_ns >
+          analysis.longest_inbound_silence.length_ns) {
+        analysis.longest_inbound_silence = chunk.longest_inbound_silence;
+      }
+      last_inbound_ns = chunk.last_inbound_ns;
+    }
+  }
+
+  for (const auto& entry : types) {
+    analysis.types.push_back(entry.second);
+  }
+  // Changes of different streams were merged chunk by chunk.
+  std::stable_sort(analysis.audio_format_changes.begin(),
+                   analysis.audio_format_changes.end(),
+                   [](const AudioFormatChange& a, const AudioFormatChange& b) {
+                     return a.timestamp_ns < b.timestamp_ns;
+                   });
+  analysis.idr_frames = SizeStats(&idr_sizes);
+  analysis.p_frames = SizeStats(&p_sizes);
+  return analysis;
+}
+
+}  // namespace carlink
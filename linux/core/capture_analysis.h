@@ -0,0 +1,92 @@
+#ifndef CARLINK_CORE_CAPTURE_ANALYSIS_H_
+#define CARLINK_CORE_CAPTURE_ANALYSIS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "core/capture_reader.h"
+#include "core/worker_pool.h"
+
+namespace carlink {
+
+struct CaptureAnalysisOptions {
+  // Chunks scanned in parallel; 0 for one per core.
+  int threads = 0;
+  // Scans on this pool's background lane, e.g. the process's shared one.
+  // Null for a pool of the analysis's own. Not owned.
+  WorkerPool* pool = nullptr;
+  // Outbound heartbeats further apart than this are listed. The host sends
+  // one every 2 s.
+  int64_t heartbeat_gap_ns = 3000000000;
+};
+
+struct MessageTypeCount {
+  uint32_t type = 0;
+  uint64_t inbound = 0;
+  uint64_t inbound_bytes = 0;
+  uint64_t outbound = 0;
+  uint64_t outbound_bytes = 0;
+};
+
+// H.264 bytes per frame, without the VideoData header.
+struct FrameSizeStats {
+  uint64_t count = 0;
+  uint64_t total_bytes = 0;
+  uint32_t min = 0;
+  uint32_t p50 = 0;
+  uint32_t p95 = 0;
+  uint32_t max = 0;
+};
+
+// The decode type of an audio stream (AudioData audioType) changed.
+struct AudioFormatChange {
+  int64_t timestamp_ns = 0;
+  uint32_t audio_type = 0;
+  // 0 for the first packet of the stream.
+  uint32_t from_decode_type = 0;
+  uint32_t to_decode_type = 0;
+};
+
+struct CaptureGap {
+  // Capture time of the message before the gap.
+  int64_t start_ns = 0;
+  int64_t length_ns = 0;
+};
+
+// Everything carlink_analyze reports. Timestamps are capture time, relative
+// to the start of the recording.
+struct CaptureAnalysis {
+  uint64_t messages = 0;
+  int64_t first_ns = 0;
+  int64_t last_ns = 0;
+
+  // Sorted by type.
+  std::vector<MessageTypeCount> types;
+
+  // Inbound video bytes per second of capture time.
+  std::vector<uint64_t> video_bytes_per_second;
+  // Frames per complete GOP, i.e. between two IDRs, in order.
+  std::vector<uint32_t> gop_lengths;
+  FrameSizeStats idr_frames;
+  FrameSizeStats p_frames;
+
+  std::vector<AudioFormatChange> audio_format_changes;
+
+  uint64_t heartbeats = 0;
+  CaptureGap longest_heartbeat_gap;
+  // Gaps over CaptureAnalysisOptions::heartbeat_gap_ns, in order.
+  std::vector<CaptureGap> heartbeat_gaps;
+
+  CaptureGap longest_inbound_silence;
+};
+
+// Scans every record of |reader|, split into one chunk of messages per
+// thread; the chunks are merged in order, so the result does not depend on
+// the thread count or pool.
+CaptureAnalysis AnalyzeCapture(const CaptureReader& reader,
+                               const CaptureAnalysisOptions& options);
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_CAPTURE_ANALYSIS_H_
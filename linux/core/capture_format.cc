@@ -0,0 +1,81 @@
+#include "core/capture_format.h"
+
+#include <cstring>
+
+#include "core/protocol.h"
+
+namespace carlink {
+
+void EncodeCaptureFileHeader(const CaptureFileHeader& header, uint8_t* out) {
+  memset(out, 0, kCaptureFileHeaderSize);
+  WriteU32(out, kCaptureMagic);
+  WriteU32(out + 4, header.version);
+  WriteU32(out + 8, header.flags);
+  WriteU64(out + 16, static_cast<uint64_t>(header.start_unix_ns));
+  WriteU64(out + 24, static_cast<uint64_t>(header.start_monotonic_ns));
+}
+
+bool DecodeCaptureFileHeader(const uint8_t* data, CaptureFileHeader* header) {
+  if (ReadU32(data) != kCaptureMagic) {
+    return false;
+  }
+  header->version = ReadU32(data + 4);
+  header->flags = ReadU32(data + 8);
+  header->start_unix_ns = static_cast<int64_t>(ReadU64(data + 16));
+  header->start_monotonic_ns = static_cast<int64_t>(ReadU64(data + 24));
+  return header->version == kCaptureVersion;
+}
+
+void EncodeCaptureRecordHeader(const CaptureRecord& record, uint8_t* out) {
+  WriteU64(out, static_cast<uint64_t>(record.timestamp_ns));
+  WriteU32(out + 8, record.length);
+  WriteU32(out + 12, record.type);
+  out[16] = static_cast<uint8_t>(record.direction);
+  out[17] = record.flags;
+  out[18] = 0;
+  out[19] = 0;
+}
+
+void DecodeCaptureRecordHeader(const uint8_t* data, CaptureRecord* record) {
+  record->timestamp_ns = static_cast<int64_t>(ReadU64(data));
+  record->length = ReadU32(data + 8);
+  record->type = ReadU32(data + 12);
+  record->direction = static_cast<CaptureDirection>(data[16]);
+  record->flags = data[17];
+}
+
+void EncodeCaptureBlockHeader(const CaptureBlockHeader& header,
+                              uint8_t* out) {
+  WriteU32(out, header.stored_size |
+                    (header.compressed ? 0 : kCaptureBlockUncompressed));
+  WriteU32(out + 4, header.raw_size);
+}
+
+void DecodeCaptureBlockHeader(const uint8_t* data,
+                              CaptureBlockHeader* header) {
+  const uint32_t stored = ReadU32(data);
+  header->stored_size = stored & ~kCaptureBlockUncompressed;
+  header->compressed = (stored & kCaptureBlockUncompressed) == 0;
+  header->raw_size = ReadU32(data + 4);
+}
+
+void EncodeCaptureFooter(const CaptureFooter& footer, uint8_t* out) {
+  WriteU64(out, footer.index_offset);
+  WriteU64(out + 8, footer.message_count);
+  WriteU64(out + 16, footer.keyframe_count);
+  WriteU32(out + 24, kCaptureIndexMagic);
+  WriteU32(out + 28, footer.block_count);
+}
+
+bool DecodeCaptureFooter(const uint8_t* data, CaptureFooter* footer) {
+  if (ReadU32(data + 24) != kCaptureIndexMagic) {
+    return false;
+  }
+  footer->index_offset = ReadU64(data);
+  footer->message_count = ReadU64(data + 8);
+  footer->keyframe_count = ReadU64(data + 16);
+  footer->block_count = ReadU32(data + 28);
+  return true;
+}
+
+}  // namespace carlink
@@ -0,0 +1,119 @@
+#ifndef CARLINK_CORE_CAPTURE_FORMAT_H_
+#define CARLINK_CORE_CAPTURE_FORMAT_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace carlink {
+
+// Session capture files record every CPC200 message in both directions:
+//
+//   file header
+//   records     record header + payload, back to back
+//   index       message offsets (u64), then keyframe message numbers (u64)
+//   footer      fixed size, the last bytes of the file
+//
+// All integers are little-endian and nothing is aligned, so readers can
+// mmap the file and seek through the index directly. A file without a
+// valid footer (the recorder never closed it) is still readable by
+// scanning the records.
+//
+// In a compressed capture (kCaptureCompressed) the records are grouped
+// into LZ4 blocks, each a block header and the compressed bytes. A record
+// never spans two blocks. Message offsets then refer to the uncompressed
+// record stream, numbered as if the file were not compressed, and the
+// index ends with one (stream offset, file offset) pair (u64 each) per
+// block.
+
+constexpr uint32_t kCaptureMagic = 0x50414343;       // "CCAP"
+constexpr uint32_t kCaptureIndexMagic = 0x58444943;  // "CIDX"
+constexpr uint32_t kCaptureVersion = 1;
+
+constexpr size_t kCaptureFileHeaderSize = 32;
+constexpr size_t kCaptureRecordHeaderSize = 20;
+constexpr size_t kCaptureFooterSize = 32;
+constexpr size_t kCaptureBlockHeaderSize = 8;
+
+enum CaptureFileFlags : uint32_t {
+  kCaptureCompressed = 1 << 0,
+};
+
+// Set in a block's stored size when it holds the records uncompressed
+// because LZ4 did not make them smaller.
+constexpr uint32_t kCaptureBlockUncompressed = 0x80000000;
+
+enum class CaptureDirection : uint8_t {
+  // Dongle to host.
+  kInbound = 0,
+  kOutbound = 1,
+};
+
+enum CaptureRecordFlags : uint8_t {
+  // VideoData holding an IDR.
+  kCaptureKeyframe = 1 << 0,
+};
+
+struct CaptureFileHeader {
+  uint32_t version = kCaptureVersion;
+  uint32_t flags = 0;
+  // Wall clock at the start, for reports.
+  int64_t start_unix_ns = 0;
+  // MonotonicNanos() at the start; record timestamps are relative to it.
+  int64_t start_monotonic_ns = 0;
+};
+
+struct CaptureRecord {
+  int64_t timestamp_ns = 0;
+  uint32_t type = 0;
+  CaptureDirection direction = CaptureDirection::kInbound;
+  uint8_t flags = 0;
+  uint32_t length = 0;
+  // Points into the capture, only set by readers.
+  const uint8_t* payload = nullptr;
+};
+
+struct CaptureFooter {
+  uint64_t index_offset = 0;
+  uint64_t message_count = 0;
+  uint64_t keyframe_count = 0;
+  // Compressed captures only.
+  uint32_t block_count = 0;
+};
+
+struct CaptureBlockHeader {
+  // Bytes following the header, without kCaptureBlockUncompressed.
+  uint32_t stored_size = 0;
+  uint32_t raw_size = 0;
+  bool compressed = true;
+};
+
+inline uint64_t ReadU64(const uint8_t* data) {
+  uint64_t value = 0;
+  for (int i = 7; i >= 0; i--) {
+    value = value << 8 | data[i];
+  }
+  return value;
+}
+
+inline void WriteU64(uint8_t* data, uint64_t value) {
+  for (int i = 0; i < 8; i++) {
+    data[i] = (value >> (i * 8)) & 0xff;
+  }
+}
+
+void EncodeCaptureFileHeader(const CaptureFileHeader& header, uint8_t* out);
+bool DecodeCaptureFileHeader(const uint8_t* data, CaptureFileHeader* header);
+
+void EncodeCaptureRecordHeader(const CaptureRecord& record, uint8_t* out);
+// Fills everything but |payload|.
+void DecodeCaptureRecordHeader(const uint8_t* data, CaptureRecord* record);
+
+void EncodeCaptureBlockHeader(const CaptureBlockHeader& header, uint8_t* out);
+void DecodeCaptureBlockHeader(const uint8_t* data, CaptureBlockHeader* header);
+
+void EncodeCaptureFooter(const CaptureFooter& footer, uint8_t* out);
+bool DecodeCaptureFooter(const uint8_t* data, CaptureFooter* footer);
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_CAPTURE_FORMAT_H_
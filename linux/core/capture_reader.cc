@@ -0,0 +1,269 @@
+#include "core/capture_reader.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+
+#include "core/log.h"
+#include "core/lz4.h"
+
+namespace carlink {
+
+CaptureReader::~CaptureReader() {
+  Unmap();
+}
+
+void CaptureReader::Unmap() {
+  if (mapping_ != nullptr) {
+    munmap(mapping_, mapping_size_);
+    mapping_ = nullptr;
+    mapping_size_ = 0;
+  }
+}
+
+bool CaptureReader::Open(const std::string& path) {
+  Unmap();
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    Log(LogLevel::kError, "[CAPTURE] cannot open %s: %s", path.c_str(),
+        strerror(errno));
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0) {
+    close(fd);
+    Log(LogLevel::kError, "[CAPTURE] %s is empty", path.c_str());
+    return false;
+  }
+  void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    Log(LogLevel::kError, "[CAPTURE] cannot map %s: %s", path.c_str(),
+        strerror(errno));
+    return false;
+  }
+  mapping_ = mapping;
+  mapping_size_ = info.st_size;
+  // Records are read front to back far more often than not.
+  madvise(mapping_, mapping_size_, MADV_SEQUENTIAL);
+  return Parse(static_cast<const uint8_t*>(mapping_), mapping_size_);
+}
+
+bool CaptureReader::Parse(const uint8_t* data, size_t size) {
+  data_ = data;
+  size_ = size;
+  index_ = nullptr;
+  offsets_.clear();
+  keyframes_.clear();
+  blocks_.clear();
+  cache_ = BlockCache();
+  if (size < kCaptureFileHeaderSize ||
+      !DecodeCaptureFileHeader(data, &header_)) {
+    Log(LogLevel::kError, "[CAPTURE] not a capture file");
+    return false;
+  }
+  indexed_ = ReadFooter();
+  if (!indexed_) {
+    Log(LogLevel::kWarning, "[CAPTURE] no index, scanning records");
+    blocks_.clear();
+    if (compressed()) {
+      ScanBlocks();
+    } else {
+      Scan();
+    }
+  }
+  return true;
+}
+
+bool CaptureReader::ReadFooter() {
+  if (size_ < kCaptureFileHeaderSize + kCaptureFooterSize) {
+    return false;
+  }
+  CaptureFooter footer;
+  if (!DecodeCaptureFooter(data_ + size_ - kCaptureFooterSize, &footer)) {
+    return false;
+  }
+  const uint64_t index_size =
+      (footer.message_count + footer.keyframe_count) * 8 +
+      uint64_t{footer.block_count} * 16;
+  if (footer.index_offset < kCaptureFileHeaderSize ||
+      footer.index_offset + index_size + kCaptureFooterSize != size_) {
+    return false;
+  }
+  const uint8_t* index = data_ + footer.index_offset;
+  if (compressed() &&
+      !ReadBlockTable(
+          index + (footer.message_count + footer.keyframe_count) * 8,
+          footer.block_count, footer.index_offset)) {
+    return false;
+  }
+  index_ = index;
+  message_count_ = footer.message_count;
+  keyframe_count_ = footer.keyframe_count;
+  return true;
+}
+
+void CaptureReader::Scan() {
+  size_t position = kCaptureFileHeaderSize;
+  while (position + kCaptureRecordHeaderSize <= size_) {
+    CaptureRecord record;
+    DecodeCaptureRecordHeader(data_ + position, &record);
+    const size_t end = position + kCaptureRecordHeaderSize + record.length;
+    if (end > size_) {
+      // Cut off mid-record.
+      break;
+    }
+    if (record.flags & kCaptureKeyframe) {
+      keyframes_.push_back(offsets_.size());
+    }
+    offsets_.push_back(position);
+    position = end;
+  }
+  message_count_ = offsets_.size();
+  keyframe_count_ = keyframes_.size();
+}
+
+bool CaptureReader::ReadBlockTable(const uint8_t* table, size_t count,
+                                   uint64_t index_offset) {
+  blocks_.reserve(count);
+  for (size_t i = 0; i < count; i++) {
+    Block block;
+    block.stream_offset = ReadU64(table + i * 16);
+    block.file_offset = ReadU64(table + i * 16 + 8);
+    if (block.file_offset + kCaptureBlockHeaderSize > index_offset) {
+      return false;
+    }
+    DecodeCaptureBlockHeader(data_ + block.file_offset, &block.header);
+    if (block.file_offset + kCaptureBlockHeaderSize +
+            block.header.stored_size > index_offset) {
+      return false;
+    }
+    blocks_.push_back(block);
+  }
+  return true;
+}
+
+void CaptureReader::ScanBlocks() {
+  uint64_t stream_position = kCaptureFileHeaderSize;
+  size_t position = kCaptureFileHeaderSize;
+  BlockCache cache;
+  while (position + kCaptureBlockHeaderSize <= size_) {
+    Block block;
+    block.stream_offset = stream_position;
+    block.file_offset = position;
+    DecodeCaptureBlockHeader(data_ + position, &block.header);
+    const size_t end =
+        position + kCaptureBlockHeaderSize + block.header.stored_size;
+    if (end > size_) {
+      break;
+    }
+    blocks_.push_back(block);
+    const uint8_t* records = BlockData(blocks_.size() - 1, &cache);
+    if (records == nullptr) {
+      blocks_.pop_back();
+      break;
+    }
+    size_t offset = 0;
+    while (offset + kCaptureRecordHeaderSize <= block.header.raw_size) {
+      CaptureRecord record;
+      DecodeCaptureRecordHeader(records + offset, &record);
+      const size_t record_end =
+          offset + kCaptureRecordHeaderSize + record.length;
+      if (record_end > block.header.raw_size) {
+        break;
+      }
+      if (record.flags & kCaptureKeyframe) {
+        keyframes_.push_back(offsets_.size());
+      }
+      offsets_.push_back(stream_position + offset);
+      offset = record_end;
+    }
+    stream_position += block.header.raw_size;
+    position = end;
+  }
+  message_count_ = offsets_.size();
+  keyframe_count_ = keyframes_.size();
+}
+
+const uint8_t* CaptureReader::BlockData(size_t index,
+                                        BlockCache* cache) const {
+  const Block& block = blocks_[index];
+  const uint8_t* stored = data_ + block.file_offset + kCaptureBlockHeaderSize;
+  if (!block.header.compressed) {
+    return block.header.stored_size == block.header.raw_size ? stored
+                                                             : nullptr;
+  }
+  if (cache->block != index) {
+    cache->block = SIZE_MAX;
+    cache->data.resize(block.header.raw_size);
+    if (Lz4Decompress(stored, block.header.stored_size, cache->data.data(),
+                      cache->data.size()) !=
+        static_cast<int64_t>(block.header.raw_size)) {
+      return nullptr;
+    }
+    cache->block = index;
+  }
+  return cache->data.data();
+}
+
+CaptureRecord CaptureReader::record(size_t index) const {
+  return record(index, &cache_);
+}
+
+CaptureRecord CaptureReader::record(size_t index, BlockCache* cache) const {
+  const uint64_t position = offset(index);
+  CaptureRecord record;
+  if (!compressed()) {
+    DecodeCaptureRecordHeader(data_ + position, &record);
+    record.payload = data_ + position + kCaptureRecordHeaderSize;
+    return record;
+  }
+  // The last block starting at or before |position|.
+  auto it = std::upper_bound(
+      blocks_.begin(), blocks_.end(), position,
+      [](uint64_t value, const Block& block) {
+        return value < block.stream_offset;
+      });
+  if (it == blocks_.begin()) {
+    return record;
+  }
+  const size_t block = it - blocks_.begin() - 1;
+  const uint8_t* records = BlockData(block, cache);
+  const uint64_t offset = position - blocks_[block].stream_offset;
+  if (records == nullptr ||
+      offset + kCaptureRecordHeaderSize > blocks_[block].header.raw_size) {
+    return record;
+  }
+  DecodeCaptureRecordHeader(records + offset, &record);
+  if (offset + kCaptureRecordHeaderSize + record.length >
+      blocks_[block].header.raw_size) {
+    return CaptureRecord();
+  }
+  record.payload = records + offset + kCaptureRecordHeaderSize;
+  return record;
+}
+
+size_t CaptureReader::SeekKeyframe(int64_t timestamp_ns) const {
+  if (keyframe_count_ == 0) {
+    return message_count_;
+  }
+  // Binary search for the first keyframe after |timestamp_ns|.
+  size_t low = 0;
+  size_t high = keyframe_count_;
+  while (low < high) {
+    const size_t middle = low + (high - low) / 2;
+    if (record(keyframe(middle)).timestamp_ns <= timestamp_ns) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return keyframe(low > 0 ? low - 1 : 0);
+}
+
+}  // namespace carlink
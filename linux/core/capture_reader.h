@@ -0,0 +1,112 @@
+#ifndef CARLINK_CORE_CAPTURE_READER_H_
+#define CARLINK_CORE_CAPTURE_READER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "core/capture_format.h"
+
+namespace carlink {
+
+// Read-only view of a capture file (see capture_format.h). Records are
+// returned in place, pointing into the mapping; nothing is copied.
+//
+// Records of a compressed capture point into a decompressed block instead,
+// valid until the next record() call with the same cache. record(index)
+// uses a cache of the reader's own and so is not thread-safe there; pass
+// each thread a BlockCache of its own.
+class CaptureReader {
+ public:
+  struct BlockCache {
+    size_t block = SIZE_MAX;
+    std::vector<uint8_t> data;
+  };
+
+  CaptureReader() = default;
+  ~CaptureReader();
+
+  CaptureReader(const CaptureReader&) = delete;
+  CaptureReader& operator=(const CaptureReader&) = delete;
+
+  // Maps |path| read-only.
+  bool Open(const std::string& path);
+
+  // Reads a capture already in memory. |data| must outlive the reader.
+  bool Parse(const uint8_t* data, size_t size);
+
+  const CaptureFileHeader& header() const { return header_; }
+
+  // False when the footer was missing and the index was rebuilt by
+  // scanning, e.g. after a crash while recording.
+  bool indexed() const { return indexed_; }
+
+  bool compressed() const { return (header_.flags & kCaptureCompressed) != 0; }
+  size_t block_count() const { return blocks_.size(); }
+
+  size_t message_count() const { return message_count_; }
+  size_t keyframe_count() const { return keyframe_count_; }
+
+  // File offset of message |index|, or its offset in the uncompressed
+  // record stream in a compressed capture.
+  uint64_t offset(size_t index) const {
+    return index_ != nullptr ? ReadU64(index_ + index * 8)
+                             : offsets_[index];
+  }
+  // Message number of keyframe |index|.
+  uint64_t keyframe(size_t index) const {
+    return index_ != nullptr ? ReadU64(index_ + (message_count_ + index) * 8)
+                             : keyframes_[index];
+  }
+
+  CaptureRecord record(size_t index) const;
+  CaptureRecord record(size_t index, BlockCache* cache) const;
+
+  // The last keyframe at or before |timestamp_ns| (relative to the start),
+  // as a message number, or the first keyframe if there is none before.
+  // Returns message_count() when the capture has no keyframes.
+  size_t SeekKeyframe(int64_t timestamp_ns) const;
+
+  const uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  struct Block {
+    uint64_t stream_offset;
+    uint64_t file_offset;
+    CaptureBlockHeader header;
+  };
+
+  void Unmap();
+  bool ReadFooter();
+  bool ReadBlockTable(const uint8_t* table, size_t count,
+                      uint64_t index_offset);
+  void Scan();
+  void ScanBlocks();
+  // The decompressed records of block |index|, or null if it is corrupt.
+  const uint8_t* BlockData(size_t index, BlockCache* cache) const;
+
+  void* mapping_ = nullptr;
+  size_t mapping_size_ = 0;
+
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+  CaptureFileHeader header_;
+
+  bool indexed_ = false;
+  size_t message_count_ = 0;
+  size_t keyframe_count_ = 0;
+  // The on-disk index, or null when |offsets_| and |keyframes_| were
+  // rebuilt.
+  const uint8_t* index_ = nullptr;
+  std::vector<uint64_t> offsets_;
+  std::vector<uint64_t> keyframes_;
+
+  std::vector<Block> blocks_;
+  mutable BlockCache cache_;
+};
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_CAPTURE_READER_H_
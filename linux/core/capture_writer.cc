@@ -0,0 +1,315 @@
+#include "core/capture_writer.h"
+
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <ctime>
+
+#include "core/clock.h"
+#include "core/log.h"
+#include "core/lz4.h"
+#include "core/nal_scanner.h"
+#include "core/protocol.h"
+
+namespace carlink {
+
+CaptureWriter::CaptureWriter() : CaptureWriter(Options()) {}
+
+CaptureWriter::CaptureWriter(const Options& options)
+    : options_(options), file_(options.file) {}
+
+CaptureWriter::~CaptureWriter() {
+  Close();
+}
+
+bool CaptureWriter::Open(const std::string& path) {
+  Close();
+  if (!file_.Open(path)) {
+    return false;
+  }
+
+  CaptureFileHeader header;
+  header.flags = options_.compress ? kCaptureCompressed : 0;
+  timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  header.start_unix_ns =
+      static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+  header.start_monotonic_ns = MonotonicNanos();
+  uint8_t encoded[kCaptureFileHeaderSize];
+  EncodeCaptureFileHeader(header, encoded);
+
+  const size_t block_count = options_.max_pending_blocks + 1;
+  if (options_.compress) {
+    std::lock_guard<std::mutex> commit_lock(commit_mutex_);
+    next_commit_ = 0;
+    done_.resize(block_count);
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_ = Stats();
+    message_offsets_.clear();
+    message_offsets_.reserve(1 << 16);
+    keyframes_.clear();
+    start_monotonic_ns_ = header.start_monotonic_ns;
+    stream_position_ = kCaptureFileHeaderSize;
+    file_.Append(encoded, sizeof(encoded), FileWriter::Overflow::kWait);
+
+    if (options_.compress) {
+      // Allocated once, so recording allocates nothing per block.
+      if (free_blocks_.empty() && !current_) {
+        for (size_t i = 0; i < block_count; i++) {
+          free_blocks_.emplace_back(new Block());
+          free_blocks_.back()->raw.reserve(options_.block_size);
+          free_blocks_.back()->stored.reserve(
+              Lz4CompressBound(options_.block_size));
+        }
+      }
+      next_sequence_ = 0;
+      block_index_.clear();
+      pool_ = options_.pool;
+      if (pool_ == nullptr) {
+        if (!own_pool_) {
+          own_pool_.reset(
+              new WorkerPool(std::max(options_.compression_threads, 1)));
+        }
+        pool_ = own_pool_.get();
+      }
+    }
+  }
+
+  recording_.store(true);
+  Log(LogLevel::kInfo, "[CAPTURE] recording to %s", path.c_str());
+  return true;
+}
+
+void CaptureWriter::Close() {
+  if (!recording_.exchange(false)) {
+    return;
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (options_.compress) {
+    if (current_ && !current_->raw.empty()) {
+      SealBlock();
+    } else if (current_) {
+      free_blocks_.push_back(std::move(current_));
+    }
+    free_cv_.wait(lock, [this] {
+      return free_blocks_.size() == options_.max_pending_blocks + 1;
+    });
+  }
+  WriteIndex();
+  file_.Close();
+  stats_.file = file_.stats();
+  Log(LogLevel::kInfo,
+      "[CAPTURE] closed: %llu messages, %llu keyframes, %llu dropped",
+      static_cast<unsigned long long>(stats_.messages),
+      static_cast<unsigned long long>(stats_.keyframes),
+      static_cast<unsigned long long>(stats_.dropped_messages));
+}
+
+void CaptureWriter::Record(CaptureDirection direction, uint32_t type,
+                           const uint8_t* payload, size_t length,
+                           int64_t monotonic_ns) {
+  if (!recording_.load(std::memory_order_relaxed)) {
+    return;
+  }
+  CaptureRecord record;
+  record.type = type;
+  record.direction = direction;
+  record.length = static_cast<uint32_t>(length);
+  if (direction == CaptureDirection::kInbound &&
+      type == static_cast<uint32_t>(MessageType::kVideoData) &&
+      length > kVideoDataHeaderSize &&
+      ContainsIdr(payload + kVideoDataHeaderSize,
+                  length - kVideoDataHeaderSize)) {
+    record.flags |= kCaptureKeyframe;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!recording_.load(std::memory_order_relaxed)) {
+    return;
+  }
+  record.timestamp_ns = monotonic_ns - start_monotonic_ns_;
+  uint8_t header[kCaptureRecordHeaderSize];
+  EncodeCaptureRecordHeader(record, header);
+  const iovec parts[] = {
+      {header, sizeof(header)},
+      {const_cast<uint8_t*>(payload), length},
+  };
+
+  const size_t size = sizeof(header) + length;
+  uint64_t offset;
+  bool appended;
+  if (options_.compress) {
+    offset = stream_position_;
+    appended = AppendCompressed(header, payload, length);
+  } else {
+    offset = file_.position();
+    appended = file_.Append(parts, 2, FileWriter::Overflow::kDrop);
+  }
+  if (!appended) {
+    stats_.dropped_messages++;
+    stats_.dropped_bytes += size;
+    return;
+  }
+  stream_position_ += size;
+  if (record.flags & kCaptureKeyframe) {
+    keyframes_.push_back(message_offsets_.size());
+    stats_.keyframes++;
+  }
+  message_offsets_.push_back(offset);
+  stats_.messages++;
+  stats_.bytes += size;
+}
+
+void CaptureWriter::RecordEncoded(CaptureDirection direction,
+                                  const uint8_t* data, size_t length,
+                                  int64_t monotonic_ns) {
+  if (!recording_.load(std::memory_order_relaxed)) {
+    return;
+  }
+  MessageHeader header;
+  if (length < kHeaderSize ||
+      DecodeHeader(data, &header) != HeaderStatus::kOk ||
+      header.length != length - kHeaderSize) {
+    return;
+  }
+  Record(direction, header.type, data + kHeaderSize, header.length,
+         monotonic_ns);
+}
+
+CaptureWriter::Stats CaptureWriter::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Stats stats = stats_;
+  if (file_.is_open()) {
+    stats.file = file_.stats();
+  }
+  return stats;
+}
+
+bool CaptureWriter::AppendCompressed(const uint8_t* header,
+                                     const uint8_t* payload, size_t length) {
+  const size_t size = kCaptureRecordHeaderSize + length;
+  const bool need_block =
+      !current_ || (!current_->raw.empty() &&
+                    current_->raw.size() + size > options_.block_size);
+  if (need_block) {
+    if (free_blocks_.empty()) {
+      return false;
+    }
+    if (current_) {
+      SealBlock();
+    }
+    current_ = std::move(free_blocks_.back());
+    free_blocks_.pop_back();
+    current_->raw.clear();
+    current_->stream_offset = stream_position_;
+    current_->fill_start_ns = MonotonicNanos();
+  }
+  std::vector<uint8_t>& raw = current_->raw;
+  raw.insert(raw.end(), header, header + kCaptureRecordHeaderSize);
+  raw.insert(raw.end(), payload, payload + length);
+  if (MonotonicNanos() - current_->fill_start_ns >=
+      int64_t{options_.file.flush_interval_ms} * 1000000) {
+    SealBlock();
+  }
+  return true;
+}
+
+void CaptureWriter::SealBlock() {
+  current_->sequence = next_sequence_++;
+  Block* block = current_.release();
+  pool_->Post(WorkerPool::kBackground, [this, block] { CompressBlock(block); });
+}
+
+void CaptureWriter::CompressBlock(Block* block) {
+  const std::vector<uint8_t>& raw = block->raw;
+  block->stored.resize(Lz4CompressBound(raw.size()));
+  const int64_t start = MonotonicNanos();
+  const size_t compressed_size =
+      Lz4Compress(raw.data(), raw.size(), block->stored.data());
+  const int64_t elapsed = MonotonicNanos() - start;
+  block->compressed = compressed_size < raw.size();
+  block->stored_size = block->compressed ? compressed_size : raw.size();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.blocks++;
+    stats_.stored_bytes += kCaptureBlockHeaderSize + block->stored_size;
+    stats_.compress_ns += elapsed;
+  }
+  CommitBlock(block);
+}
+
+void CaptureWriter::CommitBlock(Block* block) {
+  std::lock_guard<std::mutex> commit_lock(commit_mutex_);
+  done_[block->sequence % done_.size()].reset(block);
+  while (true) {
+    std::unique_ptr<Block>& next = done_[next_commit_ % done_.size()];
+    if (!next || next->sequence != next_commit_) {
+      return;
+    }
+    WriteBlock(*next);
+    next_commit_++;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      free_blocks_.push_back(std::move(next));
+    }
+    free_cv_.notify_all();
+  }
+}
+
+void CaptureWriter::WriteBlock(const Block& block) {
+  CaptureBlockHeader header;
+  header.stored_size = static_cast<uint32_t>(block.stored_size);
+  header.raw_size = static_cast<uint32_t>(block.raw.size());
+  header.compressed = block.compressed;
+  uint8_t encoded[kCaptureBlockHeaderSize];
+  EncodeCaptureBlockHeader(header, encoded);
+  const uint8_t* stored =
+      block.compressed ? block.stored.data() : block.raw.data();
+  const iovec parts[] = {
+      {encoded, sizeof(encoded)},
+      {const_cast<uint8_t*>(stored), block.stored_size},
+  };
+  block_index_.push_back(block.stream_offset);
+  block_index_.push_back(file_.position());
+  file_.Append(parts, 2, FileWriter::Overflow::kWait);
+}
+
+// Called with |mutex_| held, after recording stopped.
+void CaptureWriter::WriteIndex() {
+  CaptureFooter footer;
+  footer.index_offset = file_.position();
+  footer.message_count = message_offsets_.size();
+  footer.keyframe_count = keyframes_.size();
+  footer.block_count = static_cast<uint32_t>(block_index_.size() / 2);
+
+  // Through the same buffers, in chunks, so a long session's index needs
+  // no extra memory.
+  uint8_t chunk[8 * 512];
+  size_t used = 0;
+  auto append = [&](uint64_t value) {
+    WriteU64(chunk + used, value);
+    used += 8;
+    if (used == sizeof(chunk)) {
+      file_.Append(chunk, used, FileWriter::Overflow::kWait);
+      used = 0;
+    }
+  };
+  for (uint64_t offset : message_offsets_) {
+    append(offset);
+  }
+  for (uint64_t keyframe : keyframes_) {
+    append(keyframe);
+  }
+  for (uint64_t offset : block_index_) {
+    append(offset);
+  }
+  file_.Append(chunk, used, FileWriter::Overflow::kWait);
+
+  uint8_t encoded[kCaptureFooterSize];
+  EncodeCaptureFooter(footer, encoded);
+  file_.Append(encoded, sizeof(encoded), FileWriter::Overflow::kWait);
+}
+
+}  // namespace carlink
@@ -0,0 +1,148 @@
+#ifndef CARLINK_CORE_CAPTURE_WRITER_H_
+#define CARLINK_CORE_CAPTURE_WRITER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "core/capture_format.h"
+#include "core/file_writer.h"
+#include "core/worker_pool.h"
+
+namespace carlink {
+
+// Records messages to a capture file (see capture_format.h).
+//
+// Record() copies the message into preallocated buffers and returns; the
+// file is written in the background. When the disk (or the compressor)
+// falls behind and every buffer is taken, messages are dropped whole and
+// counted rather than stalling the caller.
+//
+// With |compress|, records are gathered into blocks compressed with LZ4 in
+// parallel on a WorkerPool's background lane; blocks are still written in
+// order. A block is sealed when full, or by the first record to find it
+// older than the flush interval, so a crash loses little.
+class CaptureWriter {
+ public:
+  struct Options {
+    FileWriter::Options file;
+    bool compress = false;
+    // Records are gathered into blocks of about this size; a larger
+    // record gets a block of its own.
+    size_t block_size = 256 * 1024;
+    // Compresses on this pool, e.g. the process's shared one. Null for a
+    // pool of |compression_threads| of the writer's own. Not owned.
+    WorkerPool* pool = nullptr;
+    int compression_threads = 2;
+    // Blocks sealed but not yet written.
+    size_t max_pending_blocks = 8;
+  };
+
+  struct Stats {
+    uint64_t messages = 0;
+    uint64_t keyframes = 0;
+    // Record bytes, before compression.
+    uint64_t bytes = 0;
+    uint64_t dropped_messages = 0;
+    uint64_t dropped_bytes = 0;
+    // Compressed captures only. |compress_ns| is the summed time the
+    // workers spent compressing.
+    uint64_t blocks = 0;
+    uint64_t stored_bytes = 0;
+    uint64_t compress_ns = 0;
+    FileWriter::Stats file;
+  };
+
+  CaptureWriter();
+  explicit CaptureWriter(const Options& options);
+  ~CaptureWriter();
+
+  CaptureWriter(const CaptureWriter&) = delete;
+  CaptureWriter& operator=(const CaptureWriter&) = delete;
+
+  // Open() and Close() may race with Record() on other threads, but not
+  // with each other.
+  bool Open(const std::string& path);
+  // Writes what is buffered, then the index and footer.
+  void Close();
+  bool is_open() const { return recording_.load(std::memory_order_relaxed); }
+
+  // Any thread. |monotonic_ns| is a MonotonicNanos() timestamp.
+  void Record(CaptureDirection direction, uint32_t type,
+              const uint8_t* payload, size_t length, int64_t monotonic_ns);
+
+  // Records an encoded message (header and payload), e.g. a bulk OUT
+  // transfer. Data that does not start with a valid header is ignored.
+  void RecordEncoded(CaptureDirection direction, const uint8_t* data,
+                     size_t length, int64_t monotonic_ns);
+
+  Stats stats() const;
+
+ private:
+  struct Block {
+    uint64_t sequence = 0;
+    // Offset of the first record in the uncompressed stream.
+    uint64_t stream_offset = 0;
+    std::vector<uint8_t> raw;
+    int64_t fill_start_ns = 0;
+    // LZ4 output; |raw| is stored instead when it does not shrink.
+    std::vector<uint8_t> stored;
+    size_t stored_size = 0;
+    bool compressed = false;
+  };
+
+  // Called with |mutex_| held.
+  bool AppendCompressed(const uint8_t* header, const uint8_t* payload,
+                        size_t length);
+  void SealBlock();
+
+  // Pool task. Takes ownership of |block|.
+  void CompressBlock(Block* block);
+  // Writes |block| once the blocks before it are, and any after it that
+  // were waiting on it.
+  void CommitBlock(Block* block);
+  void WriteBlock(const Block& block);
+  void WriteIndex();
+
+  const Options options_;
+  // Lets Record() return early without locking while not recording.
+  std::atomic<bool> recording_{false};
+  FileWriter file_;
+
+  // Keeps the index in file order.
+  mutable std::mutex mutex_;
+  int64_t start_monotonic_ns_ = 0;
+  // Offset of the next record in the uncompressed stream.
+  uint64_t stream_position_ = 0;
+  std::vector<uint64_t> message_offsets_;
+  std::vector<uint64_t> keyframes_;
+  Stats stats_;
+
+  // Compression: blocks cycle from |free_blocks_| to |current_|, to a pool
+  // task once sealed, and back once written. Guarded by |mutex_|.
+  std::vector<std::unique_ptr<Block>> free_blocks_;
+  std::unique_ptr<Block> current_;
+  uint64_t next_sequence_ = 0;
+  // Signalled as blocks come back, for Close() to wait for all of them.
+  std::condition_variable free_cv_;
+  std::unique_ptr<WorkerPool> own_pool_;
+  WorkerPool* pool_ = nullptr;
+
+  // Compressed blocks are appended strictly in sequence order; one
+  // compressed early waits in |done_|, at its sequence modulo the block
+  // count, for those before it. Taken before |mutex_| when both are.
+  std::mutex commit_mutex_;
+  std::vector<std::unique_ptr<Block>> done_;
+  uint64_t next_commit_ = 0;
+  // (stream offset, file offset) per written block.
+  std::vector<uint64_t> block_index_;
+};
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_CAPTURE_WRITER_H_
@@ -0,0 +1,68 @@
+#ifndef CARLINK_CORE_CLOCK_H_
+#define CARLINK_CORE_CLOCK_H_
+
+#include <time.h>
+
+#include <atomic>
+#include <cstdint>
+
+namespace carlink {
+
+// CLOCK_MONOTONIC in nanoseconds.
+inline int64_t MonotonicNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// CLOCK_REALTIME in nanoseconds, for wall-clock log stamps.
+inline int64_t RealtimeNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Where the session's timers and arrival stamps read the time from.
+class Clock {
+ public:
+  virtual ~Clock() = default;
+  // Nanoseconds on a monotonic scale; only differences are meaningful.
+  virtual int64_t Now() const = 0;
+};
+
+class SystemClock : public Clock {
+ public:
+  int64_t Now() const override { return MonotonicNanos(); }
+
+  // Shared, stateless instance.
+  static Clock* Get() {
+    static SystemClock clock;
+    return &clock;
+  }
+};
+
+// Time that only moves when the harness says so, for deterministic replay:
+// see SessionOptions::polled.
+class VirtualClock : public Clock {
+ public:
+  // Starts past zero, which several places treat as "never".
+  explicit VirtualClock(int64_t start_ns = 1000000000) : now_(start_ns) {}
+
+  int64_t Now() const override {
+    return now_.load(std::memory_order_acquire);
+  }
+
+  // Never moves backwards.
+  void AdvanceTo(int64_t ns) {
+    if (ns > now_.load(std::memory_order_relaxed)) {
+      now_.store(ns, std::memory_order_release);
+    }
+  }
+
+ private:
+  std::atomic<int64_t> now_;
+};
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_CLOCK_H_
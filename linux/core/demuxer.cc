@@ -0,0 +1,117 @@
+#include "core/demuxer.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "core/clock.h"
+#include "core/log.h"
+#include "core/simd.h"
+
+namespace carlink {
+
+size_t FindMagic(const uint8_t* data, size_t length) {
+  return Simd().find_magic(data, length);
+}
+
+Demuxer::Demuxer(std::shared_ptr<BufferPool> pool, MessageCallback on_message,
+                 Clock* clock)
+    : pool_(std::move(pool)),
+      on_message_(std::move(on_message)),
+      clock_(clock) {}
+
+void Demuxer::Reset() {
+  header_filled_ = 0;
+  in_sync_ = true;
+  in_payload_ = false;
+  payload_filled_ = 0;
+  pending_ = Message();
+}
+
+void Demuxer::Resync() {
+  if (in_sync_) {
+    in_sync_ = false;
+    stats_.resyncs++;
+  }
+  // Keep whatever follows the bad magic in the header buffer; the next magic
+  // may already be in there, or start in its last three bytes.
+  size_t offset = FindMagic(header_bytes_ + 1, header_filled_ - 1) + 1;
+  if (offset == header_filled_ && header_filled_ > 4) {
+    offset = header_filled_ - 3;
+  }
+  stats_.skipped_bytes += offset;
+  memmove(header_bytes_, header_bytes_ + offset, header_filled_ - offset);
+  header_filled_ -= offset;
+}
+
+void Demuxer::Feed(const uint8_t* data, size_t length, int64_t arrival_ns) {
+  stats_.bytes += length;
+
+  while (length > 0) {
+    if (!in_payload_) {
+      if (header_filled_ == 0 && length >= 4 &&
+          ReadU32(data) != kMessageMagic) {
+        // Out of sync with nothing buffered: skip straight to the next magic,
+        // keeping a tail that may be the start of a split one.
+        size_t skip = FindMagic(data, length);
+        if (skip == length) {
+          skip = length - 3;
+        }
+        if (in_sync_) {
+          in_sync_ = false;
+          stats_.resyncs++;
+        }
+        stats_.skipped_bytes += skip;
+        data += skip;
+        length -= skip;
+        continue;
+      }
+
+      const size_t take = std::min(length, kHeaderSize - header_filled_);
+      memcpy(header_bytes_ + header_filled_, data, take);
+      header_filled_ += take;
+      data += take;
+      length -= take;
+      if (header_filled_ < kHeaderSize) {
+        continue;
+      }
+
+      MessageHeader header;
+      const HeaderStatus status = DecodeHeader(header_bytes_, &header);
+      if (status != HeaderStatus::kOk) {
+        if (in_sync_) {
+          Log(LogLevel::kWarning, "[DEMUX] bad header (%d), resyncing",
+              static_cast<int>(status));
+        }
+        Resync();
+        continue;
+      }
+      header_filled_ = 0;
+      in_sync_ = true;
+
+      pending_.header = header;
+      pending_.payload = pool_->Acquire(header.length);
+      payload_filled_ = 0;
+      in_payload_ = true;
+    }
+
+    const size_t take =
+        std::min(length, pending_.header.length - payload_filled_);
+    if (take > 0) {
+      memcpy(pending_.payload.data() + payload_filled_, data, take);
+      payload_filled_ += take;
+      data += take;
+      length -= take;
+    }
+    if (payload_filled_ == pending_.header.length) {
+      in_payload_ = false;
+      pending_.arrival_ns = arrival_ns;
+      pending_.demux_ns = clock_->Now();
+      stats_.messages++;
+      Message message = std::move(pending_);
+      pending_ = Message();
+      on_message_(std::move(message));
+    }
+  }
+}
+
+}  // namespace carlink
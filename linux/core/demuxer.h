@@ -0,0 +1,79 @@
+#ifndef CARLINK_CORE_DEMUXER_H_
+#define CARLINK_CORE_DEMUXER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include "core/buffer_pool.h"
+#include "core/clock.h"
+#include "core/protocol.h"
+
+namespace carlink {
+
+// A complete inbound message.
+struct Message {
+  MessageHeader header;
+  Buffer payload;
+  // When the transfer carrying the last payload byte completed, on the
+  // reader's clock.
+  int64_t arrival_ns = 0;
+  // When the demuxer emitted it, on the same clock.
+  int64_t demux_ns = 0;
+};
+
+// Returns the offset of the first occurrence of the header magic in
+// [data, data + length), or |length| if there is none. A magic split across
+// the end of the range is not reported.
+size_t FindMagic(const uint8_t* data, size_t length);
+
+// Splits the inbound byte stream into messages. Bytes may arrive in any
+// chunking: a transfer can hold several messages, or a fraction of one.
+//
+// When a header fails validation the demuxer drops bytes up to the next
+// magic and carries on, instead of tearing down the session the way the
+// Android read loop does.
+class Demuxer {
+ public:
+  using MessageCallback = std::function<void(Message message)>;
+
+  struct Stats {
+    uint64_t messages = 0;
+    uint64_t bytes = 0;
+    uint64_t resyncs = 0;
+    uint64_t skipped_bytes = 0;
+  };
+
+  // |clock| stamps demux_ns; arrival_ns comes from Feed().
+  Demuxer(std::shared_ptr<BufferPool> pool, MessageCallback on_message,
+          Clock* clock = SystemClock::Get());
+
+  // Consumes |length| bytes that arrived at |arrival_ns|.
+  void Feed(const uint8_t* data, size_t length, int64_t arrival_ns);
+
+  // Drops any partial message.
+  void Reset();
+
+  const Stats& stats() const { return stats_; }
+
+ private:
+  void Resync();
+
+  std::shared_ptr<BufferPool> pool_;
+  MessageCallback on_message_;
+  Clock* const clock_;
+
+  uint8_t header_bytes_[kHeaderSize];
+  size_t header_filled_ = 0;
+  bool in_sync_ = true;
+  bool in_payload_ = false;
+  Message pending_;
+  size_t payload_filled_ = 0;
+
+  Stats stats_;
+};
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_DEMUXER_H_
@@ -0,0 +1,185 @@
+#include "core/event_loop.h"
+
+#include <chrono>
+
+#include "core/clock.h"
+#include "core/thread_stats.h"
+
+namespace carlink {
+
+namespace {
+
+// Post(std::function) wraps the task in one of these and frees it once run.
+struct TaskEvent : EventLoop::Event {
+  std::function<void()> task;
+
+  static void RunTask(EventLoop::Event* event) {
+    TaskEvent* self = static_cast<TaskEvent*>(event);
+    self->task();
+    delete self;
+  }
+};
+
+}  // namespace
+
+EventLoop::EventLoop() : thread_(&EventLoop::Run, this) {}
+
+EventLoop::~EventLoop() {
+  Stop();
+}
+
+void EventLoop::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cv_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  // Only the one-off tasks are ours to free.
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (Event** list : {&ready_head_, &timers_}) {
+    while (*list != nullptr) {
+      Event* event = *list;
+      *list = event->next;
+      event->queued = false;
+      if (event->run == &TaskEvent::RunTask) {
+        delete static_cast<TaskEvent*>(event);
+      }
+    }
+  }
+  ready_tail_ = nullptr;
+}
+
+void EventLoop::Post(Event* event) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (event->queued) {
+      return;
+    }
+    event->queued = true;
+    event->due_ns = 0;
+    event->next = nullptr;
+    if (ready_tail_ != nullptr) {
+      ready_tail_->next = event;
+    } else {
+      ready_head_ = event;
+    }
+    ready_tail_ = event;
+  }
+  cv_.notify_one();
+}
+
+void EventLoop::PostAt(Event* event, int64_t due_ns) {
+  bool soonest;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (event->queued) {
+      Unlink(event);
+    }
+    event->queued = true;
+    event->due_ns = due_ns;
+    Event** link = &timers_;
+    while (*link != nullptr && (*link)->due_ns <= due_ns) {
+      link = &(*link)->next;
+    }
+    event->next = *link;
+    *link = event;
+    soonest = timers_ == event;
+  }
+  if (soonest) {
+    cv_.notify_one();
+  }
+}
+
+bool EventLoop::Cancel(Event* event) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!event->queued) {
+    return false;
+  }
+  Unlink(event);
+  return true;
+}
+
+void EventLoop::Post(std::function<void()> task) {
+  TaskEvent* event = new TaskEvent();
+  event->run = &TaskEvent::RunTask;
+  event->task = std::move(task);
+  Post(event);
+}
+
+void EventLoop::Unlink(Event* event) {
+  Event* previous = nullptr;
+  for (Event* it = ready_head_; it != nullptr; previous = it, it = it->next) {
+    if (it == event) {
+      (previous != nullptr ? previous->next : ready_head_) = it->next;
+      if (ready_tail_ == it) {
+        ready_tail_ = previous;
+      }
+      event->queued = false;
+      return;
+    }
+  }
+  for (Event** link = &timers_; *link != nullptr; link = &(*link)->next) {
+    if (*link == event) {
+      *link = event->next;
+      event->queued = false;
+      return;
+    }
+  }
+}
+
+void EventLoop::Run() {
+  SetCurrentThreadName("carlink-loop");
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_) {
+    const int64_t now = MonotonicNanos();
+    // Due timers join the ready queue in due order.
+    while (timers_ != nullptr && timers_->due_ns <= now) {
+      Event* timer = timers_;
+      timers_ = timer->next;
+      const uint64_t late = now - timer->due_ns;
+      if (late > stats_.timer_late_max_ns) {
+        stats_.timer_late_max_ns = late;
+      }
+      stats_.timers_run++;
+      timer->next = nullptr;
+      if (ready_tail_ != nullptr) {
+        ready_tail_->next = timer;
+      } else {
+        ready_head_ = timer;
+      }
+      ready_tail_ = timer;
+    }
+
+    if (ready_head_ != nullptr) {
+      Event* event = ready_head_;
+      ready_head_ = event->next;
+      if (ready_head_ == nullptr) {
+        ready_tail_ = nullptr;
+      }
+      event->next = nullptr;
+      event->queued = false;
+      stats_.events_run++;
+      lock.unlock();
+      // May free or re-post itself.
+      event->run(event);
+      lock.lock();
+      continue;
+    }
+
+    if (timers_ != nullptr) {
+      cv_.wait_for(lock, std::chrono::nanoseconds(timers_->due_ns - now));
+    } else {
+      cv_.wait(lock);
+    }
+  }
+}
+
+EventLoop::Stats EventLoop::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+}  // namespace carlink
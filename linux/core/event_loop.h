@@ -0,0 +1,85 @@
+#ifndef CARLINK_CORE_EVENT_LOOP_H_
+#define CARLINK_CORE_EVENT_LOOP_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace carlink {
+
+// One thread that runs posted work and timers in order, for control flow
+// that waits on USB completions, inbound messages and timeouts without a
+// blocked thread per wait (core/async.h builds coroutines on it).
+//
+// Work is an intrusive Event the caller owns, so posting and arming timers
+// allocate nothing; Post(std::function) is there for the odd one-off.
+class EventLoop {
+ public:
+  // Caller-owned work. Must stay alive until it has run or was cancelled.
+  struct Event {
+    void (*run)(Event* event) = nullptr;
+
+    // Owned by the loop while queued.
+    Event* next = nullptr;
+    int64_t due_ns = 0;
+    bool queued = false;
+  };
+
+  struct Stats {
+    uint64_t events_run = 0;
+    uint64_t timers_run = 0;
+    // Worst delay from a timer's due time to it running.
+    uint64_t timer_late_max_ns = 0;
+  };
+
+  EventLoop();
+  // Stop().
+  ~EventLoop();
+
+  EventLoop(const EventLoop&) = delete;
+  EventLoop& operator=(const EventLoop&) = delete;
+
+  // Joins the thread. Events still queued never run.
+  void Stop();
+
+  // Any thread. Runs |event| after what is already queued; a no-op while
+  // it is queued.
+  void Post(Event* event);
+  // Any thread. Runs |event| once MonotonicNanos() reaches |due_ns|,
+  // re-arming it if it is already queued.
+  void PostAt(Event* event, int64_t due_ns);
+  // Unqueues |event|. Returns false if it was not queued, e.g. it already
+  // ran. Call on the loop thread to be sure it is not running either.
+  bool Cancel(Event* event);
+
+  // Any thread. Allocates.
+  void Post(std::function<void()> task);
+
+  bool InLoopThread() const {
+    return std::this_thread::get_id() == thread_.get_id();
+  }
+
+  Stats stats() const;
+
+ private:
+  void Run();
+  // With |mutex_| held.
+  void Unlink(Event* event);
+
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stopping_ = false;
+  // FIFO of ready events.
+  Event* ready_head_ = nullptr;
+  Event* ready_tail_ = nullptr;
+  // Timers, soonest first. A handful at a time, so a sorted list will do.
+  Event* timers_ = nullptr;
+  Stats stats_;
+  std::thread thread_;
+};
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_EVENT_LOOP_H_
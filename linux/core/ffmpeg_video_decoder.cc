@@ -0,0 +1,107 @@
+#include "core/video_decoder.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+}
+
+#include "core/log.h"
+
+namespace carlink {
+
+namespace {
+
+class FfmpegVideoDecoder : public VideoDecoder {
+ public:
+  ~FfmpegVideoDecoder() override {
+    av_frame_free(&frame_);
+    av_packet_free(&packet_);
+    avcodec_free_context(&context_);
+  }
+
+  bool Init() {
+    const AVCodec* codec = avcodec_find_decoder(AV_CODEC_ID_H264);
+    if (codec == nullptr) {
+      Log(LogLevel::kError, "[DECODER] H.264 decoder not available");
+      return false;
+    }
+    codec_ = codec;
+    return Open() && (packet_ = av_packet_alloc()) != nullptr &&
+           (frame_ = av_frame_alloc()) != nullptr;
+  }
+
+  const char* name() const override { return "ffmpeg"; }
+
+  bool Decode(const uint8_t* data, size_t length,
+              const FrameCallback& on_frame) override {
+    if (context_ == nullptr) {
+      return false;
+    }
+    // The packet borrows |data|; avcodec copies what it needs to keep.
+    packet_->data = const_cast<uint8_t*>(data);
+    packet_->size = static_cast<int>(length);
+    int ret = avcodec_send_packet(context_, packet_);
+    packet_->data = nullptr;
+    packet_->size = 0;
+    if (ret < 0 && ret != AVERROR(EAGAIN)) {
+      return false;
+    }
+
+    while ((ret = avcodec_receive_frame(context_, frame_)) >= 0) {
+      if (frame_->format == AV_PIX_FMT_YUV420P ||
+          frame_->format == AV_PIX_FMT_YUVJ420P) {
+        VideoFrame out;
+        out.width = frame_->width;
+        out.height = frame_->height;
+        out.y = frame_->data[0];
+        out.u = frame_->data[1];
+        out.v = frame_->data[2];
+        out.y_stride = frame_->linesize[0];
+        out.uv_stride = frame_->linesize[1];
+        on_frame(out);
+      }
+      av_frame_unref(frame_);
+    }
+    return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF;
+  }
+
+  void Reset() override {
+    avcodec_free_context(&context_);
+    Open();
+  }
+
+ private:
+  bool Open() {
+    context_ = avcodec_alloc_context3(codec_);
+    if (context_ == nullptr) {
+      return false;
+    }
+    // Projection streams have no B-frames; output every picture as soon as
+    // it is decoded.
+    context_->flags |= AV_CODEC_FLAG_LOW_DELAY;
+    context_->thread_type = FF_THREAD_SLICE;
+    if (avcodec_open2(context_, codec_, nullptr) < 0) {
+      Log(LogLevel::kError, "[DECODER] avcodec_open2 failed");
+      avcodec_free_context(&context_);
+      return false;
+    }
+    return true;
+  }
+
+  const AVCodec* codec_ = nullptr;
+  AVCodecContext* context_ = nullptr;
+  AVPacket* packet_ = nullptr;
+  AVFrame* frame_ = nullptr;
+};
+
+}  // namespace
+
+std::unique_ptr<VideoDecoder> CreateFfmpegVideoDecoder() {
+  std::unique_ptr<FfmpegVideoDecoder> decoder(new FfmpegVideoDecoder());
+  if (!decoder->Init()) {
+    return nullptr;
+  }
+  return std::move(decoder);
+}
+
+}  // namespace carlink
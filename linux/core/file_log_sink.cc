@@ -0,0 +1,79 @@
+#include "core/file_log_sink.h"
+
+#include <cstdio>
+#include <ctime>
+
+#include "core/clock.h"
+
+namespace carlink {
+
+namespace {
+
+char LevelLetter(LogLevel level) {
+  switch (level) {
+    case LogLevel::kDebug:
+      return 'D';
+    case LogLevel::kInfo:
+      return 'I';
+    case LogLevel::kWarning:
+      return 'W';
+    case LogLevel::kError:
+      return 'E';
+  }
+  return '?';
+}
+
+}  // namespace
+
+FileLogSink::FileLogSink() : FileLogSink(FileWriter::Options()) {}
+
+FileLogSink::FileLogSink(const FileWriter::Options& options)
+    : file_(options) {}
+
+bool FileLogSink::Open(const std::string& path) {
+  return file_.Open(path);
+}
+
+void FileLogSink::Close() {
+  file_.Close();
+}
+
+void FileLogSink::Write(LogLevel level, const std::string& line) {
+  WriteAt(RealtimeNanos(), level, line);
+}
+
+void FileLogSink::WriteAt(int64_t realtime_ns, LogLevel level,
+                          const std::string& line) {
+  const time_t seconds = realtime_ns / 1000000000;
+  tm local;
+  localtime_r(&seconds, &local);
+  char prefix[48];
+  const size_t length = strftime(prefix, sizeof(prefix), "%F %T", &local);
+  const int written =
+      snprintf(prefix + length, sizeof(prefix) - length, ".%03ld %c ",
+               static_cast<long>(realtime_ns % 1000000000 / 1000000),
+               LevelLetter(level));
+
+  const iovec parts[] = {
+      {prefix, length + written},
+      {const_cast<char*>(line.data()), line.size()},
+      {const_cast<char*>("\n"), 1},
+  };
+  file_.Append(parts, 3, FileWriter::Overflow::kWait);
+}
+
+LogSink FileLogSink::sink() {
+  return [this](LogLevel level, const std::string& line) {
+    Write(level, line);
+  };
+}
+
+LogBatchSink FileLogSink::batch_sink() {
+  return [this](const std::vector<LogRecord>& batch) {
+    for (const LogRecord& record : batch) {
+      WriteAt(record.timestamp_ns, record.level, record.line);
+    }
+  };
+}
+
+}  // namespace carlink
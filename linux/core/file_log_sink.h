@@ -0,0 +1,42 @@
+#ifndef CARLINK_CORE_FILE_LOG_SINK_H_
+#define CARLINK_CORE_FILE_LOG_SINK_H_
+
+#include <string>
+
+#include "core/file_writer.h"
+#include "core/log.h"
+#include "core/log_ring.h"
+
+namespace carlink {
+
+// Appends timestamped log lines to a file through a FileWriter, so logging
+// from a pipeline thread costs a copy rather than a write(). When the disk
+// cannot keep up, callers wait for a free buffer; FileWriter::Stats shows
+// how often and for how long.
+class FileLogSink {
+ public:
+  FileLogSink();
+  explicit FileLogSink(const FileWriter::Options& options);
+
+  bool Open(const std::string& path);
+  void Close();
+
+  // Any thread; matches LogSink.
+  void Write(LogLevel level, const std::string& line);
+
+  // A LogSink for SetLogSink(). The FileLogSink must outlive its use.
+  LogSink sink();
+  // A LogRing sink writing each record with the time it was logged.
+  LogBatchSink batch_sink();
+
+  FileWriter::Stats stats() const { return file_.stats(); }
+
+ private:
+  void WriteAt(int64_t realtime_ns, LogLevel level, const std::string& line);
+
+  FileWriter file_;
+};
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_FILE_LOG_SINK_H_
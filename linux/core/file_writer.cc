@@ -0,0 +1,436 @@
+#include "core/file_writer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+
+#include "core/clock.h"
+#include "core/log.h"
+#include "core/thread_stats.h"
+
+namespace carlink {
+
+namespace {
+
+// O_DIRECT offsets, lengths and buffer addresses must be multiples of the
+// logical block size; a page covers every common device.
+constexpr size_t kDirectAlignment = 4096;
+
+}  // namespace
+
+FileWriter::FileWriter() : FileWriter(Options()) {}
+
+FileWriter::FileWriter(const Options& options) : options_(options) {}
+
+FileWriter::~FileWriter() {
+  Close();
+  for (Buffer& buffer : buffers_) {
+    free(buffer.data);
+  }
+}
+
+bool FileWriter::Open(const std::string& path) {
+  Close();
+
+  bool direct = options_.direct;
+  if (direct && options_.buffer_size % kDirectAlignment != 0) {
+    Log(LogLevel::kWarning, "[IO] buffer size not aligned, O_DIRECT off");
+    direct = false;
+  }
+  const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+  int fd = open(path.c_str(), flags | (direct ? O_DIRECT : 0), 0644);
+  if (fd < 0 && direct && errno == EINVAL) {
+    Log(LogLevel::kWarning, "[IO] %s does not support O_DIRECT",
+        path.c_str());
+    direct = false;
+    fd = open(path.c_str(), flags, 0644);
+  }
+  if (fd < 0) {
+    Log(LogLevel::kError, "[IO] cannot open %s: %s", path.c_str(),
+        strerror(errno));
+    return false;
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  // Buffers live as long as the writer, so reopening allocates nothing.
+  if (buffers_.empty()) {
+    const size_t count = std::max<size_t>(options_.buffer_count, 2);
+    buffers_.resize(count);
+    iovecs_.resize(count);
+    for (size_t i = 0; i < count; i++) {
+      void* data = nullptr;
+      if (posix_memalign(&data, kDirectAlignment, options_.buffer_size) !=
+          0) {
+        abort();
+      }
+      buffers_[i].data = static_cast<uint8_t*>(data);
+      iovecs_[i].iov_base = data;
+      iovecs_[i].iov_len = options_.buffer_size;
+    }
+    queue_.resize(count);
+    free_.reserve(count);
+  }
+  free_.clear();
+  for (size_t i = buffers_.size(); i > 0; i--) {
+    free_.push_back(static_cast<int>(i - 1));
+  }
+  queue_head_ = 0;
+  queued_ = 0;
+  in_flight_ = 0;
+  current_ = -1;
+  position_ = 0;
+  stopping_ = false;
+  stats_ = Stats();
+  latency_.Reset();
+  fd_ = fd;
+  direct_ = direct;
+
+  const size_t max_in_flight =
+      std::min(std::max<size_t>(options_.max_in_flight, 1), buffers_.size());
+  if (options_.backend != Backend::kThreads &&
+      ring_.Init(static_cast<unsigned>(max_in_flight))) {
+    backend_name_ =
+        ring_.RegisterBuffers(iovecs_.data(),
+                              static_cast<unsigned>(iovecs_.size()))
+            ? "io_uring"
+            : "io_uring (unregistered)";
+    threads_.emplace_back(&FileWriter::RunIoUring, this);
+  } else {
+    backend_name_ = "threads";
+    for (size_t i = 0; i < max_in_flight; i++) {
+      threads_.emplace_back(&FileWriter::RunThread, this);
+    }
+  }
+  lock.unlock();
+  if (options_.backend == Backend::kIoUring &&
+      strcmp(backend_name_, "threads") == 0) {
+    Log(LogLevel::kWarning, "[IO] io_uring unavailable, using threads");
+  }
+  Log(LogLevel::kInfo, "[IO] writing %s via %s%s", path.c_str(),
+      backend_name_, direct_ ? ", O_DIRECT" : "");
+  return true;
+}
+
+void FileWriter::Close() {
+  if (!is_open()) {
+    return;
+  }
+  Flush();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  io_cv_.notify_all();
+  for (std::thread& thread : threads_) {
+    thread.join();
+  }
+  threads_.clear();
+
+  Stats stats;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    close(fd_);
+    fd_ = -1;
+    backend_name_ = "";
+    stats = stats_;
+  }
+  // Outside the lock: this writer may be the log's own file.
+  if (stats.io_uring_error != 0) {
+    Log(LogLevel::kWarning, "[IO] io_uring failed (%s), finished via threads",
+        strerror(stats.io_uring_error));
+  }
+  if (stats.errors > 0) {
+    Log(LogLevel::kError, "[IO] %llu writes failed, last error: %s",
+        static_cast<unsigned long long>(stats.errors),
+        strerror(stats.last_error));
+  }
+}
+
+bool FileWriter::is_open() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return fd_ >= 0;
+}
+
+uint64_t FileWriter::position() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return position_;
+}
+
+size_t FileWriter::FreeSpace() const {
+  const size_t current =
+      current_ >= 0 ? options_.buffer_size - buffers_[current_].used : 0;
+  return current + free_.size() * options_.buffer_size;
+}
+
+bool FileWriter::Append(const void* data, size_t length, Overflow overflow) {
+  iovec part;
+  part.iov_base = const_cast<void*>(data);
+  part.iov_len = length;
+  return Append(&part, 1, overflow);
+}
+
+bool FileWriter::Append(const iovec* parts, int count, Overflow overflow) {
+  size_t total = 0;
+  for (int i = 0; i < count; i++) {
+    total += parts[i].iov_len;
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (fd_ < 0 || stopping_) {
+    return false;
+  }
+  if (overflow == Overflow::kDrop && total > FreeSpace()) {
+    stats_.dropped_appends++;
+    stats_.dropped_bytes += total;
+    return false;
+  }
+
+  int64_t waited_ns = 0;
+  for (int i = 0; i < count; i++) {
+    const uint8_t* data = static_cast<const uint8_t*>(parts[i].iov_base);
+    size_t remaining = parts[i].iov_len;
+    while (remaining > 0) {
+      if (current_ < 0) {
+        if (free_.empty()) {
+          // Only reachable with kWait.
+          const int64_t start = MonotonicNanos();
+          free_cv_.wait(lock, [this] { return !free_.empty(); });
+          waited_ns += MonotonicNanos() - start;
+        }
+        current_ = free_.back();
+        free_.pop_back();
+        Buffer& buffer = buffers_[current_];
+        buffer.used = 0;
+        buffer.offset = position_;
+        buffer.fill_start_ns = MonotonicNanos();
+      }
+      Buffer& buffer = buffers_[current_];
+      const size_t n = std::min(remaining, options_.buffer_size - buffer.used);
+      memcpy(buffer.data + buffer.used, data, n);
+      buffer.used += n;
+      position_ += n;
+      data += n;
+      remaining -= n;
+      if (buffer.used == options_.buffer_size) {
+        Seal();
+      }
+    }
+  }
+  if (waited_ns > 0) {
+    stats_.backpressure_waits++;
+    stats_.backpressure_ns += waited_ns;
+  }
+  return true;
+}
+
+void FileWriter::Flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (current_ >= 0 && buffers_[current_].used > 0) {
+    Seal();
+  }
+  free_cv_.wait(lock, [this] {
+    return fd_ < 0 || (queued_ == 0 && in_flight_ == 0);
+  });
+}
+
+void FileWriter::Seal() {
+  queue_[(queue_head_ + queued_) % queue_.size()] = current_;
+  queued_++;
+  current_ = -1;
+  io_cv_.notify_one();
+}
+
+bool FileWriter::TakeQueued(int* index) {
+  if (queued_ == 0) {
+    return false;
+  }
+  *index = queue_[queue_head_];
+  queue_head_ = (queue_head_ + 1) % queue_.size();
+  queued_--;
+  in_flight_++;
+  stats_.max_in_flight =
+      std::max<uint64_t>(stats_.max_in_flight, in_flight_);
+  Buffer& buffer = buffers_[*index];
+  if (direct_ && buffer.used % kDirectAlignment != 0) {
+    ClearDirect();
+  }
+  buffer.submit_ns = MonotonicNanos();
+  return true;
+}
+
+void FileWriter::ClearDirect() {
+  const int flags = fcntl(fd_, F_GETFL);
+  if (flags >= 0) {
+    fcntl(fd_, F_SETFL, flags & ~O_DIRECT);
+  }
+  direct_ = false;
+}
+
+void FileWriter::Complete(int index, int64_t result) {
+  const Buffer& buffer = buffers_[index];
+  latency_.Record(MonotonicNanos() - buffer.submit_ns);
+  in_flight_--;
+  stats_.writes++;
+  if (result == static_cast<int64_t>(buffer.used)) {
+    stats_.bytes += buffer.used;
+  } else {
+    stats_.errors++;
+    stats_.last_error = result < 0 ? static_cast<int>(-result) : EIO;
+  }
+  free_.push_back(index);
+  free_cv_.notify_all();
+}
+
+bool FileWriter::FlushIdle(int64_t now_ns) {
+  // Partial buffers would turn O_DIRECT off, so they wait to fill up.
+  if (direct_ || current_ < 0 || buffers_[current_].used == 0 ||
+      now_ns - buffers_[current_].fill_start_ns <
+          int64_t{options_.flush_interval_ms} * 1000000) {
+    return false;
+  }
+  Seal();
+  return true;
+}
+
+int64_t FileWriter::WriteAll(const Buffer& buffer) {
+  size_t written = 0;
+  while (written < buffer.used) {
+    const ssize_t result = pwrite(fd_, buffer.data + written,
+                                  buffer.used - written,
+                                  buffer.offset + written);
+    if (result < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -errno;
+    }
+    written += result;
+  }
+  return static_cast<int64_t>(written);
+}
+
+void FileWriter::RunThread() {
+  SetCurrentThreadName("carlink-write");
+  const auto interval = std::chrono::milliseconds(options_.flush_interval_ms);
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    int index;
+    if (TakeQueued(&index)) {
+      const Buffer& buffer = buffers_[index];
+      lock.unlock();
+      const int64_t result = WriteAll(buffer);
+      lock.lock();
+      Complete(index, result);
+      continue;
+    }
+    if (stopping_) {
+      break;
+    }
+    io_cv_.wait_for(lock, interval);
+    FlushIdle(MonotonicNanos());
+  }
+}
+
+void FileWriter::RunIoUring() {
+  SetCurrentThreadName("carlink-write");
+  const auto interval = std::chrono::milliseconds(options_.flush_interval_ms);
+  const size_t max_in_flight =
+      std::min(std::max<size_t>(options_.max_in_flight, 1), buffers_.size());
+  // Prepared but not yet taken by the kernel, oldest first.
+  std::vector<int> unsubmitted;
+  unsubmitted.reserve(max_in_flight);
+  std::unique_lock<std::mutex> lock(mutex_);
+  // Completes what the kernel finished; called without |mutex_|.
+  auto reap = [this, &lock] {
+    bool reaped = false;
+    uint64_t user_data;
+    int32_t result;
+    while (ring_.PopCompletion(&user_data, &result)) {
+      const int completed = static_cast<int>(user_data);
+      const Buffer& buffer = buffers_[completed];
+      int64_t written = result;
+      if (result >= 0 && static_cast<size_t>(result) < buffer.used) {
+        // Short write: finish synchronously, rare for regular files.
+        Buffer rest = buffer;
+        rest.data += result;
+        rest.used -= result;
+        rest.offset += result;
+        const int64_t rest_written = WriteAll(rest);
+        written = rest_written < 0 ? rest_written : result + rest_written;
+      }
+      lock.lock();
+      Complete(completed, written);
+      lock.unlock();
+      reaped = true;
+    }
+    return reaped;
+  };
+  while (true) {
+    int index;
+    while (in_flight_ < max_in_flight && TakeQueued(&index)) {
+      const Buffer& buffer = buffers_[index];
+      ring_.PrepareWrite(fd_, buffer.data, buffer.used, buffer.offset, index,
+                         static_cast<uint64_t>(index));
+      unsubmitted.push_back(index);
+    }
+    if (in_flight_ == 0) {
+      if (stopping_) {
+        break;
+      }
+      io_cv_.wait_for(lock, interval);
+      FlushIdle(MonotonicNanos());
+      continue;
+    }
+
+    // Buffers in flight are not touched by appenders.
+    lock.unlock();
+    if (!ring_.Submit(1)) {
+      // Retrying a ring that keeps failing would hold Flush() and Close()
+      // forever, so the rest of this file goes through pwrite(): what the
+      // kernel never took is written here, what it took is waited out.
+      const int error = errno;
+      ring_.DiscardPending();
+      for (int pending : unsubmitted) {
+        const int64_t written = WriteAll(buffers_[pending]);
+        lock.lock();
+        Complete(pending, written);
+        lock.unlock();
+      }
+      lock.lock();
+      // No write failed; Close() reports the switch.
+      stats_.io_uring_error = error;
+      while (in_flight_ > 0) {
+        lock.unlock();
+        if (!reap()) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        lock.lock();
+      }
+      lock.unlock();
+      RunThread();
+      return;
+    }
+    unsubmitted.erase(unsubmitted.begin(),
+                      unsubmitted.end() - ring_.pending());
+    reap();
+    lock.lock();
+    FlushIdle(MonotonicNanos());
+  }
+}
+
+FileWriter::Stats FileWriter::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Stats stats = stats_;
+  stats.latency_p50_ns = latency_.Percentile(50);
+  stats.latency_p99_ns = latency_.Percentile(99);
+  stats.latency_p999_ns = latency_.Percentile(99.9);
+  stats.latency_max_ns = latency_.max();
+  return stats;
+}
+
+}  // namespace carlink
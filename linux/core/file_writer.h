@@ -0,0 +1,162 @@
+#ifndef CARLINK_CORE_FILE_WRITER_H_
+#define CARLINK_CORE_FILE_WRITER_H_
+
+#include <sys/uio.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "core/histogram.h"
+#include "core/io_uring.h"
+
+namespace carlink {
+
+// Appends to a file without doing I/O on the caller's thread.
+//
+// Appended bytes are copied into a fixed set of preallocated buffers; full
+// buffers (and partial ones idle for |flush_interval_ms|) are written in
+// the background, at most |max_in_flight| at a time. Writes go through
+// io_uring with the buffers registered when the kernel allows it, and
+// through a small pool of pwrite() threads otherwise. A ring that fails to
+// submit hands the rest of the file to pwrite() on its thread.
+class FileWriter {
+ public:
+  enum class Backend {
+    kAuto,
+    kIoUring,
+    kThreads,
+  };
+
+  // What Append() does when every buffer is taken.
+  enum class Overflow {
+    // Block until writes complete (backpressure).
+    kWait,
+    // Drop the whole append.
+    kDrop,
+  };
+
+  struct Options {
+    size_t buffer_size = 1 << 20;
+    size_t buffer_count = 16;
+    size_t max_in_flight = 4;
+    int flush_interval_ms = 250;
+    // Bypass the page cache. Needs a filesystem that supports it; falls
+    // back to buffered writes otherwise, and for an unaligned tail.
+    bool direct = false;
+    Backend backend = Backend::kAuto;
+  };
+
+  struct Stats {
+    uint64_t writes = 0;
+    uint64_t bytes = 0;
+    uint64_t errors = 0;
+    // errno of the last failed write.
+    int last_error = 0;
+    // errno of the io_uring submission that failed, after which the file
+    // went on through pwrite(); 0 if none did.
+    int io_uring_error = 0;
+    uint64_t dropped_appends = 0;
+    uint64_t dropped_bytes = 0;
+    // Appends that had to wait for a free buffer, and for how long.
+    uint64_t backpressure_waits = 0;
+    uint64_t backpressure_ns = 0;
+    uint64_t max_in_flight = 0;
+    // Submission to completion, per write.
+    uint64_t latency_p50_ns = 0;
+    uint64_t latency_p99_ns = 0;
+    uint64_t latency_p999_ns = 0;
+    uint64_t latency_max_ns = 0;
+  };
+
+  FileWriter();
+  explicit FileWriter(const Options& options);
+  ~FileWriter();
+
+  FileWriter(const FileWriter&) = delete;
+  FileWriter& operator=(const FileWriter&) = delete;
+
+  // Creates or truncates |path|.
+  bool Open(const std::string& path);
+  // Writes everything appended so far and closes the file.
+  void Close();
+  bool is_open() const;
+
+  // "io_uring", "io_uring (unregistered)" or "threads"; empty when closed.
+  const char* backend_name() const { return backend_name_; }
+  bool direct() const { return direct_; }
+
+  // Any thread. Appends the |count| parts as one unit: with kDrop either
+  // all of them or nothing is written.
+  bool Append(const iovec* parts, int count, Overflow overflow);
+  bool Append(const void* data, size_t length, Overflow overflow);
+
+  // Bytes appended so far, i.e. the file offset of the next append.
+  uint64_t position() const;
+
+  // Starts writing the partially filled buffer and waits until every
+  // append so far is on disk (as far as write() goes).
+  void Flush();
+
+  Stats stats() const;
+
+ private:
+  struct Buffer {
+    uint8_t* data = nullptr;
+    size_t used = 0;
+    uint64_t offset = 0;
+    int64_t submit_ns = 0;
+    int64_t fill_start_ns = 0;
+  };
+
+  // Called with |mutex_| held.
+  size_t FreeSpace() const;
+  void Seal();
+  void Complete(int index, int64_t result);
+  bool TakeQueued(int* index);
+  bool FlushIdle(int64_t now_ns);
+  void ClearDirect();
+
+  void RunIoUring();
+  void RunThread();
+  // Returns the bytes written or -errno. Runs on I/O threads, which never
+  // log: the log may be written through this very writer.
+  int64_t WriteAll(const Buffer& buffer);
+
+  const Options options_;
+  int fd_ = -1;
+  bool direct_ = false;
+  const char* backend_name_ = "";
+  IoUring ring_;
+  std::vector<std::thread> threads_;
+
+  mutable std::mutex mutex_;
+  // Wakes I/O threads, and appenders waiting for a free buffer.
+  std::condition_variable io_cv_;
+  std::condition_variable free_cv_;
+  bool stopping_ = false;
+
+  std::vector<Buffer> buffers_;
+  std::vector<iovec> iovecs_;
+  std::vector<int> free_;
+  // Sealed buffers waiting to be written, in file order.
+  std::vector<int> queue_;
+  size_t queue_head_ = 0;
+  size_t queued_ = 0;
+  size_t in_flight_ = 0;
+  // The buffer being filled, or -1.
+  int current_ = -1;
+  uint64_t position_ = 0;
+
+  Stats stats_;
+  Histogram latency_;
+};
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_FILE_WRITER_H_
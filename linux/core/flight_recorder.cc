@@ -0,0 +1,280 @@
+#include "core/flight_recorder.h"
+
+#include <sys/stat.h>
+
+#include <cctype>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <ctime>
+#include <thread>
+
+#include "core/log.h"
+#include "core/protocol.h"
+#include "core/thread_stats.h"
+
+namespace carlink {
+
+namespace {
+
+constexpr int64_t kSnapshotIntervalNs = 1000000000;
+
+// Record() and Events() mask the index, so the ring must be a power of two.
+size_t RingSize(size_t capacity) {
+  size_t size = 1;
+  while (size < capacity) {
+    size <<= 1;
+  }
+  return size;
+}
+
+}  // namespace
+
+FlightRecorder::FlightRecorder(Clock* clock)
+    : FlightRecorder(Options(), clock) {}
+
+FlightRecorder::FlightRecorder(const Options& options, Clock* clock)
+    : options_(options),
+      clock_(clock != nullptr ? clock : SystemClock::Get()),
+      slots_(RingSize(options.capacity)),
+      directory_(options.directory) {}
+
+FlightRecorder::~FlightRecorder() {
+  {
+    std::lock_guard<std::mutex> lock(async_mutex_);
+    async_stopping_ = true;
+  }
+  async_cv_.notify_one();
+  if (async_thread_.joinable()) {
+    async_thread_.join();
+  }
+}
+
+void FlightRecorder::Record(Kind kind, uint32_t id, uint64_t value) {
+  const uint64_t index = next_.fetch_add(1, std::memory_order_relaxed);
+  const uint64_t sequence = index + 1;
+  Slot& slot = slots_[index & (slots_.size() - 1)];
+  // A seqlock per slot: readers skip a slot whose sequence changed while
+  // they copied it. A writer lapped by a newer one for the same slot gives
+  // way rather than publish a stale event over it.
+  uint64_t current = slot.sequence.load(std::memory_order_relaxed);
+  while (true) {
+    if ((current & ~kWriting) > sequence) {
+      return;
+    }
+    if ((current & kWriting) != 0) {
+      // The writer one lap behind is still copying.
+      std::this_thread::yield();
+      current = slot.sequence.load(std::memory_order_relaxed);
+      continue;
+    }
+    if (slot.sequence.compare_exchange_weak(current, sequence | kWriting,
+                                            std::memory_order_relaxed)) {
+      break;
+    }
+  }
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.timestamp_ns = clock_->Now();
+  slot.value = value;
+  slot.id = id;
+  slot.kind = kind;
+  slot.sequence.store(sequence, std::memory_order_release);
+}
+
+void FlightRecorder::RecordOutbound(const uint8_t* data, size_t length) {
+  MessageHeader header;
+  if (length >= kHeaderSize &&
+      DecodeHeader(data, &header) == HeaderStatus::kOk) {
+    Record(Kind::kOutbound, header.type, header.length);
+  }
+}
+
+bool FlightRecorder::CounterSnapshotDue() {
+  const int64_t now = clock_->Now();
+  int64_t due = next_snapshot_ns_.load(std::memory_order_relaxed);
+  return now >= due &&
+         next_snapshot_ns_.compare_exchange_strong(
+             due, now + kSnapshotIntervalNs, std::memory_order_relaxed);
+}
+
+std::vector<FlightRecorder::Event> FlightRecorder::Events(
+    int64_t window_ns) const {
+  const uint64_t end = next_.load(std::memory_order_acquire);
+  const uint64_t begin = end > slots_.size() ? end - slots_.size() : 0;
+  const int64_t since = clock_->Now() - window_ns;
+
+  std::vector<Event> events;
+  for (uint64_t index = begin; index < end; index++) {
+    const Slot& slot = slots_[index & (slots_.size() - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != index + 1) {
+      // Being written, or already overwritten.
+      continue;
+    }
+    Event event;
+    event.timestamp_ns = slot.timestamp_ns;
+    event.kind = slot.kind;
+    event.id = slot.id;
+    event.value = slot.value;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) != index + 1 ||
+        event.timestamp_ns < since) {
+      continue;
+    }
+    events.push_back(event);
+  }
+  return events;
+}
+
+std::string FlightRecorder::Dump(const std::string& reason) {
+  std::lock_guard<std::mutex> lock(dump_mutex_);
+  const int64_t now = clock_->Now();
+  if (directory_.empty() ||
+      (dumps_.load(std::memory_order_relaxed) > 0 &&
+       now - last_dump_ns_ <
+           static_cast<int64_t>(options_.min_dump_interval_ms) * 1000000)) {
+    return std::string();
+  }
+  last_dump_ns_ = now;
+
+  const std::vector<Event> events =
+      Events(static_cast<int64_t>(options_.window_ms) * 1000000);
+
+  std::string word;
+  for (char c : reason) {
+    if (!isalnum(static_cast<unsigned char>(c))) {
+      break;
+    }
+    word += c;
+  }
+  const time_t wall = time(nullptr);
+  tm local;
+  localtime_r(&wall, &local);
+  char stamp[32];
+  strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+  const std::string path = directory_ + "/flight-" + stamp + "-" +
+                           (word.empty() ? "dump" : word) + ".txt";
+
+  if (mkdir(directory_.c_str(), 0755) != 0 && errno != EEXIST) {
+    Log(LogLevel::kError, "[FLIGHT] cannot create %s", directory_.c_str());
+    return std::string();
+  }
+  FILE* file = fopen(path.c_str(), "w");
+  if (file == nullptr) {
+    Log(LogLevel::kError, "[FLIGHT] cannot open %s", path.c_str());
+    return std::string();
+  }
+  char when[32];
+  strftime(when, sizeof(when), "%F %T", &local);
+  fprintf(file, "# carlink flight recorder: %s at %s\n", reason.c_str(), when);
+  fprintf(file, "# last %.1f s, %zu events; times in ms before the dump\n",
+          options_.window_ms / 1e3, events.size());
+  fprintf(file, "# t_ms kind id value\n");
+  for (const Event& event : events) {
+    const char* id;
+    switch (event.kind) {
+      case Kind::kInbound:
+      case Kind::kOutbound:
+        id = MessageTypeName(event.id);
+        break;
+      case Kind::kQueueDepth:
+        id = event.id == kVideoQueue ? "video" : "unknown";
+        break;
+      case Kind::kCounter:
+        id = CounterName(event.id);
+        break;
+      default:
+        id = "-";
+        break;
+    }
+    fprintf(file, "%.3f %s %s %" PRIu64 "\n",
+            (event.timestamp_ns - now) / 1e6, KindName(event.kind), id,
+            event.value);
+  }
+  if (fclose(file) != 0) {
+    Log(LogLevel::kError, "[FLIGHT] cannot write %s", path.c_str());
+    return std::string();
+  }
+  dumps_.fetch_add(1, std::memory_order_relaxed);
+  Log(LogLevel::kWarning, "[FLIGHT] %s: wrote %zu events to %s",
+      reason.c_str(), events.size(), path.c_str());
+  return path;
+}
+
+void FlightRecorder::DumpAsync(const std::string& reason) {
+  {
+    std::lock_guard<std::mutex> lock(async_mutex_);
+    if (async_pending_ || async_stopping_) {
+      return;
+    }
+    async_reason_ = reason;
+    async_pending_ = true;
+    if (!async_thread_.joinable()) {
+      async_thread_ = std::thread([this] {
+        SetCurrentThreadName("carlink-flight");
+        std::unique_lock<std::mutex> lock(async_mutex_);
+        while (true) {
+          async_cv_.wait(lock,
+                         [this] { return async_pending_ || async_stopping_; });
+          if (!async_pending_) {
+            return;
+          }
+          const std::string pending = async_reason_;
+          lock.unlock();
+          Dump(pending);
+          lock.lock();
+          async_pending_ = false;
+        }
+      });
+    }
+  }
+  async_cv_.notify_one();
+}
+
+void FlightRecorder::set_directory(const std::string& directory) {
+  std::lock_guard<std::mutex> lock(dump_mutex_);
+  directory_ = directory;
+}
+
+const char* FlightRecorder::KindName(Kind kind) {
+  switch (kind) {
+    case Kind::kInbound:
+      return "in";
+    case Kind::kOutbound:
+      return "out";
+    case Kind::kTransfer:
+      return "transfer";
+    case Kind::kQueueDepth:
+      return "queue";
+    case Kind::kCounter:
+      return "counter";
+  }
+  return "unknown";
+}
+
+const char* FlightRecorder::CounterName(uint32_t counter) {
+  switch (counter) {
+    case kMessagesIn:
+      return "messages_in";
+    case kBytesIn:
+      return "bytes_in";
+    case kMessagesOut:
+      return "messages_out";
+    case kSendFailures:
+      return "send_failures";
+    case kResyncs:
+      return "resyncs";
+    case kFramesDecoded:
+      return "frames_decoded";
+    case kFramesDropped:
+      return "frames_dropped";
+    case kDecodeErrors:
+      return "decode_errors";
+    case kAudioUnderruns:
+      return "audio_underruns";
+    case kAudioOverflowFrames:
+      return "audio_overflow_frames";
+  }
+  return "unknown";
+}
+
+}  // namespace carlink
@@ -0,0 +1,149 @@
+#ifndef CARLINK_CORE_FLIGHT_RECORDER_H_
+#define CARLINK_CORE_FLIGHT_RECORDER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "core/clock.h"
+
+namespace carlink {
+
+// Keeps the recent history of a session, so a dead link comes with the
+// seconds leading up to it rather than one log line: message headers in
+// both directions, bulk-IN transfer sizes, queue depths and a once a
+// second snapshot of the counters.
+//
+// Events go into a fixed ring of 32-byte slots. Any thread may record; a
+// slot costs an atomic increment and a few stores, with no locks and no
+// allocation. Dump() writes the last |window_ms| to a text file;
+// DumpAsync() hands that to a thread of the recorder's own.
+class FlightRecorder {
+ public:
+  enum class Kind : uint8_t {
+    // |id| is the message type, |value| the payload length.
+    kInbound,
+    kOutbound,
+    // A completed bulk-IN transfer of |value| bytes.
+    kTransfer,
+    // |id| is a Queue, |value| its depth.
+    kQueueDepth,
+    // |id| is a Counter, |value| its running total.
+    kCounter,
+  };
+
+  enum Queue : uint32_t {
+    kVideoQueue,
+  };
+
+  enum Counter : uint32_t {
+    kMessagesIn,
+    kBytesIn,
+    kMessagesOut,
+    kSendFailures,
+    kResyncs,
+    kFramesDecoded,
+    kFramesDropped,
+    kDecodeErrors,
+    kAudioUnderruns,
+    kAudioOverflowFrames,
+  };
+
+  struct Options {
+    // Events kept; rounded up to a power of two.
+    size_t capacity = 32768;
+    // How far back a dump goes.
+    int window_ms = 30000;
+    // Dumps closer together than this are skipped, so a burst of decoder
+    // errors writes one file.
+    int min_dump_interval_ms = 10000;
+    // Where dumps go; empty to record without dumping.
+    std::string directory;
+  };
+
+  struct Event {
+    int64_t timestamp_ns;
+    Kind kind;
+    uint32_t id;
+    uint64_t value;
+  };
+
+  // |clock| may be null for the system clock.
+  explicit FlightRecorder(Clock* clock = nullptr);
+  FlightRecorder(const Options& options, Clock* clock);
+  // Writes a dump still pending from DumpAsync() first.
+  ~FlightRecorder();
+
+  FlightRecorder(const FlightRecorder&) = delete;
+  FlightRecorder& operator=(const FlightRecorder&) = delete;
+
+  // Any thread.
+  void Record(Kind kind, uint32_t id, uint64_t value);
+  void RecordCounter(Counter counter, uint64_t value) {
+    Record(Kind::kCounter, counter, value);
+  }
+  // Records an encoded message (header included) sent to the dongle.
+  void RecordOutbound(const uint8_t* data, size_t length);
+
+  // True at most once a second: time for the caller to record its
+  // counters.
+  bool CounterSnapshotDue();
+
+  // The events of the last |window_ns|, oldest first.
+  std::vector<Event> Events(int64_t window_ns) const;
+
+  // Writes the last window to a new file in the directory, named after the
+  // time and the first word of |reason|. Returns its path, or an empty
+  // string when dumping is off, rate limited or failed. Any thread; does
+  // file I/O.
+  std::string Dump(const std::string& reason);
+  // Dump() without waiting for it, for the decoder and read threads that
+  // hit the error. A request made while one is pending is dropped, as the
+  // rate limit would skip it anyway. Any thread.
+  void DumpAsync(const std::string& reason);
+
+  void set_directory(const std::string& directory);
+  uint64_t dumps() const { return dumps_.load(std::memory_order_relaxed); }
+
+  static const char* KindName(Kind kind);
+  static const char* CounterName(uint32_t counter);
+
+ private:
+  static constexpr uint64_t kWriting = uint64_t{1} << 63;
+
+  struct Slot {
+    // Index + 1 once written; with kWriting set while being written.
+    std::atomic<uint64_t> sequence{0};
+    int64_t timestamp_ns = 0;
+    uint64_t value = 0;
+    uint32_t id = 0;
+    Kind kind = Kind::kInbound;
+  };
+
+  const Options options_;
+  Clock* const clock_;
+  std::vector<Slot> slots_;
+  std::atomic<uint64_t> next_{0};
+  std::atomic<int64_t> next_snapshot_ns_{0};
+
+  std::mutex dump_mutex_;
+  std::string directory_;
+  int64_t last_dump_ns_ = 0;
+  std::atomic<uint64_t> dumps_{0};
+
+  // Guards the DumpAsync() thread, started on first use.
+  std::mutex async_mutex_;
+  std::condition_variable async_cv_;
+  std::thread async_thread_;
+  std::string async_reason_;
+  bool async_pending_ = false;
+  bool async_stopping_ = false;
+};
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_FLIGHT_RECORDER_H_
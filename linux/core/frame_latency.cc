@@ -0,0 +1,55 @@
+#include "core/frame_latency.h"
+
+namespace carlink {
+
+const char* FrameLatency::StageName(Stage stage) {
+  switch (stage) {
+    case kDemux:
+      return "demux";
+    case kQueue:
+      return "queue";
+    case kDecode:
+      return "decode";
+    case kConvert:
+      return "convert";
+    case kPublish:
+      return "publish";
+    case kPresent:
+      return "present";
+    case kTotal:
+      return "total";
+    case kStageCount:
+      break;
+  }
+  return "unknown";
+}
+
+void FrameLatency::Record(Stage stage, int64_t start_ns, int64_t end_ns) {
+  if (start_ns <= 0 || end_ns <= 0) {
+    return;
+  }
+  // Only a replay, mixing virtual and real stamps, goes backwards.
+  histograms_[stage].Record(end_ns > start_ns ? end_ns - start_ns : 0);
+}
+
+void FrameLatency::Reset() {
+  for (Histogram& histogram : histograms_) {
+    histogram.Reset();
+  }
+}
+
+FrameLatency::Stats FrameLatency::stats() const {
+  Stats stats;
+  for (int i = 0; i < kStageCount; i++) {
+    const Histogram& histogram = histograms_[i];
+    StageStats& stage = stats.stages[i];
+    stage.count = histogram.count();
+    stage.p50_ns = histogram.Percentile(50);
+    stage.p99_ns = histogram.Percentile(99);
+    stage.p999_ns = histogram.Percentile(99.9);
+    stage.max_ns = histogram.max();
+  }
+  return stats;
+}
+
+}  // namespace carlink
@@ -0,0 +1,84 @@
+#ifndef CARLINK_CORE_FRAME_LATENCY_H_
+#define CARLINK_CORE_FRAME_LATENCY_H_
+
+#include <cstdint>
+
+#include "core/histogram.h"
+
+namespace carlink {
+
+// MonotonicNanos() stamps of one access unit on its way to the screen, 0
+// for stages not reached yet.
+struct FrameTimestamps {
+  // Bulk-IN transfer carrying its last byte completed.
+  int64_t arrival_ns = 0;
+  // Demuxer emitted the message.
+  int64_t demux_ns = 0;
+  int64_t decode_start_ns = 0;
+  // Decoder returned the picture.
+  int64_t decode_end_ns = 0;
+  // Converted to RGBA.
+  int64_t convert_end_ns = 0;
+  // Handed to the presenter, just before mark_texture_frame_available.
+  int64_t published_ns = 0;
+};
+
+// Per-stage video latency histograms. Each stage is recorded by whoever
+// holds the frame when it completes: the pipeline up to decoding, the frame
+// sink after that. Record() is lock-free and may be called from any thread.
+class FrameLatency {
+ public:
+  enum Stage {
+    // Arrival to demuxed.
+    kDemux,
+    // Demuxed to decode start: time in the decode queue.
+    kQueue,
+    kDecode,
+    // Decode end to RGBA.
+    kConvert,
+    // RGBA to mark_texture_frame_available returning.
+    kPublish,
+    // Published to picked up by the next copy_pixels.
+    kPresent,
+    // Arrival until the sink is done with the frame: presented for a
+    // texture, written for the CLI.
+    kTotal,
+    kStageCount,
+  };
+
+  struct StageStats {
+    uint64_t count = 0;
+    uint64_t p50_ns = 0;
+    uint64_t p99_ns = 0;
+    uint64_t p999_ns = 0;
+    uint64_t max_ns = 0;
+  };
+
+  struct Stats {
+    StageStats stages[kStageCount];
+  };
+
+  FrameLatency() = default;
+
+  FrameLatency(const FrameLatency&) = delete;
+  FrameLatency& operator=(const FrameLatency&) = delete;
+
+  // Name used by getStats and the CLI, e.g. "decode".
+  static const char* StageName(Stage stage);
+
+  // Records |end_ns| - |start_ns| when both are set.
+  void Record(Stage stage, int64_t start_ns, int64_t end_ns);
+  void Reset();
+
+  Stats stats() const;
+  void TakeSnapshot(Stage stage, Histogram::Snapshot* snapshot) const {
+    histograms_[stage].TakeSnapshot(snapshot);
+  }
+
+ private:
+  Histogram histograms_[kStageCount];
+};
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_FRAME_LATENCY_H_
@@ -0,0 +1,220 @@
+#include "core/glass_to_glass.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "core/input.h"
+#include "core/protocol.h"
+
+namespace carlink {
+
+namespace {
+
+constexpr int kCell = 8;
+constexpr int kSyncBits = 4;
+constexpr uint32_t kSync = 0xa;
+constexpr int kCells = kSyncBits + 32 + 16 + 8;
+// Video range luma.
+constexpr uint8_t kBlack = 16;
+constexpr uint8_t kWhite = 235;
+constexpr uint8_t kGray = 96;
+constexpr int kBarWidth = 32;
+constexpr int kTouchSize = 32;
+
+uint8_t Checksum(const CounterPattern& pattern) {
+  return static_cast<uint8_t>(pattern.counter ^ (pattern.counter >> 8) ^
+                              (pattern.counter >> 16) ^
+                              (pattern.counter >> 24) ^ pattern.touch_id ^
+                              (pattern.touch_id >> 8));
+}
+
+// The strip's bits in cell order.
+void PatternBits(const CounterPattern& pattern, bool* bits) {
+  int cell = 0;
+  auto put = [&bits, &cell](uint32_t value, int count) {
+    for (int i = count - 1; i >= 0; i--) {
+      bits[cell++] = (value >> i) & 1;
+    }
+  };
+  put(kSync, kSyncBits);
+  put(pattern.counter, 32);
+  put(pattern.touch_id, 16);
+  put(Checksum(pattern), 8);
+}
+
+void FillRect(uint8_t* plane, int stride, int x, int y, int width, int height,
+              uint8_t value) {
+  for (int row = y; row < y + height; row++) {
+    memset(plane + row * stride + x, value, width);
+  }
+}
+
+}  // namespace
+
+void DrawCounterPattern(const CounterPattern& pattern, uint8_t* y,
+                        int y_stride) {
+  bool bits[kCells];
+  PatternBits(pattern, bits);
+  for (int cell = 0; cell < kCells; cell++) {
+    FillRect(y, y_stride, cell * kCell, 0, kCell, kCell,
+             bits[cell] ? kWhite : kBlack);
+  }
+}
+
+bool ReadCounterPattern(const RgbaFrame& frame, CounterPattern* pattern) {
+  if (frame.width < kCounterPatternMinWidth || frame.height < kCell) {
+    return false;
+  }
+  // Cell centres of the middle row, green channel.
+  const uint8_t* row = frame.pixels.data() + (kCell / 2) * frame.width * 4;
+  uint64_t value = 0;
+  for (int cell = 0; cell < kCells; cell++) {
+    value = (value << 1) | (row[(cell * kCell + kCell / 2) * 4 + 1] > 128);
+  }
+  if ((value >> (kCells - kSyncBits)) != kSync) {
+    return false;
+  }
+  CounterPattern read;
+  read.counter = static_cast<uint32_t>(value >> 24);
+  read.touch_id = static_cast<uint16_t>(value >> 8);
+  if (Checksum(read) != static_cast<uint8_t>(value)) {
+    return false;
+  }
+  *pattern = read;
+  return true;
+}
+
+CounterPatternSource::CounterPatternSource(int width, int height,
+                                           Clock* clock)
+    : clock_(clock != nullptr ? clock : SystemClock::Get()),
+      encoder_(width, height),
+      y_(static_cast<size_t>(width) * height),
+      uv_(static_cast<size_t>(width) * height / 2, 128) {}
+
+void CounterPatternSource::NextAccessUnit(bool keyframe,
+                                          std::vector<uint8_t>* out) {
+  const int width = encoder_.width();
+  const int height = encoder_.height();
+  CounterPattern pattern;
+  float touch_x, touch_y;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pattern.counter = next_counter_;
+    pattern.touch_id = touch_id_;
+    touch_x = touch_x_;
+    touch_y = touch_y_;
+  }
+
+  // Below the strip: gray, a bar sweeping across so motion is visible on
+  // screen, and the echoed touch.
+  const int top = 2 * kCell;
+  std::fill(y_.begin(), y_.end(), kGray);
+  FillRect(y_.data(), width, 0, 0, width, top, kBlack);
+  const int bar = static_cast<int>(pattern.counter * 8 % (width - kBarWidth));
+  FillRect(y_.data(), width, bar, top, kBarWidth, height - top, kBlack);
+  if (pattern.touch_id != 0) {
+    const int x = std::min(static_cast<int>(touch_x * width),
+                           width - kTouchSize);
+    const int y = std::max(top, std::min(static_cast<int>(touch_y * height),
+                                         height - kTouchSize));
+    FillRect(y_.data(), width, x, y, kTouchSize,
+             std::min(kTouchSize, height - y), kWhite);
+  }
+  DrawCounterPattern(pattern, y_.data(), width);
+
+  VideoFrame frame;
+  frame.width = width;
+  frame.height = height;
+  frame.y = y_.data();
+  frame.u = uv_.data();
+  frame.v = uv_.data() + uv_.size() / 2;
+  frame.y_stride = width;
+  frame.uv_stride = width / 2;
+  encoder_.Encode(frame, keyframe, out);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  sent_counter_[pattern.counter % kHistory] = pattern.counter;
+  sent_ns_[pattern.counter % kHistory] = clock_->Now();
+  next_counter_++;
+}
+
+void CounterPatternSource::OnHostMessage(const Message& message) {
+  if (message.header.type != static_cast<uint32_t>(MessageType::kTouch) ||
+      message.payload.size() < 12) {
+    return;
+  }
+  const uint8_t* payload = message.payload.data();
+  if (ReadU32(payload) != static_cast<uint32_t>(TouchAction::kDown)) {
+    return;
+  }
+  const uint32_t x = ReadU32(payload + 4);
+  std::lock_guard<std::mutex> lock(mutex_);
+  touch_id_ = static_cast<uint16_t>(x);
+  touch_x_ = x / 10000.0f;
+  touch_y_ = ReadU32(payload + 8) / 10000.0f;
+}
+
+int64_t CounterPatternSource::SentAt(uint32_t counter) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (counter >= next_counter_ ||
+      sent_counter_[counter % kHistory] != counter) {
+    return -1;
+  }
+  return sent_ns_[counter % kHistory];
+}
+
+uint32_t CounterPatternSource::frames() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return next_counter_;
+}
+
+GlassToGlassProbe::GlassToGlassProbe(const CounterPatternSource* source)
+    : source_(source) {}
+
+void GlassToGlassProbe::OnTouchSent(uint16_t id, int64_t now_ns) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  touch_ids_[id % kTouchHistory] = id;
+  touch_sent_ns_[id % kTouchHistory] = now_ns;
+  stats_.touches_sent++;
+}
+
+void GlassToGlassProbe::OnPresented(const RgbaFrame& frame, int64_t now_ns) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (frame.sequence == last_sequence_) {
+    return;
+  }
+  last_sequence_ = frame.sequence;
+  stats_.presented++;
+
+  CounterPattern pattern;
+  if (!ReadCounterPattern(frame, &pattern)) {
+    stats_.unreadable++;
+    return;
+  }
+  if (have_counter_ && pattern.counter > last_counter_) {
+    stats_.dropped += pattern.counter - last_counter_ - 1;
+  }
+  have_counter_ = true;
+  last_counter_ = pattern.counter;
+
+  const int64_t sent_ns = source_->SentAt(pattern.counter);
+  if (sent_ns >= 0 && now_ns >= sent_ns) {
+    latency_.Record(now_ns - sent_ns);
+  }
+  if (pattern.touch_id != last_touch_id_) {
+    last_touch_id_ = pattern.touch_id;
+    const size_t slot = pattern.touch_id % kTouchHistory;
+    if (pattern.touch_id != 0 && touch_ids_[slot] == pattern.touch_id &&
+        now_ns >= touch_sent_ns_[slot]) {
+      touch_latency_.Record(now_ns - touch_sent_ns_[slot]);
+      stats_.touches_seen++;
+    }
+  }
+}
+
+GlassToGlassProbe::Stats GlassToGlassProbe::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+}  // namespace carlink
@@ -0,0 +1,130 @@
+#ifndef CARLINK_CORE_GLASS_TO_GLASS_H_
+#define CARLINK_CORE_GLASS_TO_GLASS_H_
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "core/clock.h"
+#include "core/histogram.h"
+#include "core/pcm_h264.h"
+#include "core/rgba_frame_buffer.h"
+#include "core/simulated_dongle.h"
+
+namespace carlink {
+
+// What a frame of the glass-to-glass stream carries in its top 8 rows: a
+// strip of 60 black or white 8x8 cells, sync 1010, the 32-bit frame
+// counter and the 16-bit id of the last touch the source saw, MSB first,
+// then an 8-bit xor checksum. Big enough to survive a lossy encoder and
+// scaling by whole factors.
+struct CounterPattern {
+  uint32_t counter = 0;
+  uint16_t touch_id = 0;
+};
+
+// Narrowest frame the strip fits in.
+constexpr int kCounterPatternMinWidth = 480;
+
+// Draws |pattern| into rows 0-7 of the luma plane |y|.
+void DrawCounterPattern(const CounterPattern& pattern, uint8_t* y,
+                        int y_stride);
+
+// Reads the strip back from a presented frame. False if the sync or the
+// checksum does not match, e.g. a torn or corrupt picture.
+bool ReadCounterPattern(const RgbaFrame& frame, CounterPattern* pattern);
+
+// Encodes the counter stream for SimulatedDongle: each access unit is the
+// next counter on a gray background with a moving bar, plus a white square
+// where the host last touched down. A Touch's x coordinate (0..10000)
+// doubles as its touch id, so the host can tell which touch a frame
+// echoes; see GlassToGlassProbe::TouchX().
+class CounterPatternSource : public SimulatedDongle::VideoSource {
+ public:
+  // |width| and |height| multiples of 16, |width| at least
+  // kCounterPatternMinWidth. Null |clock| for the system clock.
+  CounterPatternSource(int width, int height, Clock* clock = nullptr);
+
+  // SimulatedDongle::VideoSource, reading thread.
+  void NextAccessUnit(bool keyframe, std::vector<uint8_t>* out) override;
+  void OnHostMessage(const Message& message) override;
+
+  // When frame |counter| was handed to the dongle, or -1 if it was never
+  // sent or is too old to remember.
+  int64_t SentAt(uint32_t counter) const;
+
+  uint32_t frames() const;
+
+ private:
+  static constexpr size_t kHistory = 1024;
+
+  Clock* const clock_;
+  PcmH264Encoder encoder_;
+  std::vector<uint8_t> y_;
+  std::vector<uint8_t> uv_;
+
+  mutable std::mutex mutex_;
+  uint32_t next_counter_ = 0;
+  uint16_t touch_id_ = 0;
+  float touch_x_ = 0;
+  float touch_y_ = 0;
+  // Send time of counter c at c % kHistory.
+  uint32_t sent_counter_[kHistory] = {};
+  int64_t sent_ns_[kHistory] = {};
+};
+
+// Turns what the presenter shows into glass-to-glass numbers: for every
+// newly presented frame, present time minus the time the dongle sent it;
+// counters skipped between two presented frames are dropped frames. A
+// frame echoing a new touch id gives that touch's input-to-display
+// latency.
+class GlassToGlassProbe {
+ public:
+  explicit GlassToGlassProbe(const CounterPatternSource* source);
+
+  GlassToGlassProbe(const GlassToGlassProbe&) = delete;
+  GlassToGlassProbe& operator=(const GlassToGlassProbe&) = delete;
+
+  // Normalised x coordinate to send touch |id| (1..9999) with.
+  static float TouchX(uint16_t id) { return (id + 0.5f) / 10000.0f; }
+
+  // The host sent touch |id| at |now_ns|.
+  void OnTouchSent(uint16_t id, int64_t now_ns);
+  // The presenter shows |frame| at |now_ns|; the same frame again is
+  // ignored.
+  void OnPresented(const RgbaFrame& frame, int64_t now_ns);
+
+  struct Stats {
+    uint64_t presented = 0;
+    uint64_t dropped = 0;
+    // Presented frames whose strip could not be read.
+    uint64_t unreadable = 0;
+    uint64_t touches_sent = 0;
+    uint64_t touches_seen = 0;
+  };
+  Stats stats() const;
+
+  // Nanoseconds.
+  const Histogram& latency() const { return latency_; }
+  const Histogram& touch_latency() const { return touch_latency_; }
+
+ private:
+  static constexpr size_t kTouchHistory = 64;
+
+  const CounterPatternSource* const source_;
+  Histogram latency_;
+  Histogram touch_latency_;
+
+  mutable std::mutex mutex_;
+  Stats stats_;
+  uint64_t last_sequence_ = 0;
+  bool have_counter_ = false;
+  uint32_t last_counter_ = 0;
+  uint16_t last_touch_id_ = 0;
+  uint16_t touch_ids_[kTouchHistory] = {};
+  int64_t touch_sent_ns_[kTouchHistory] = {};
+};
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_GLASS_TO_GLASS_H_
@@ -0,0 +1,151 @@
+#include "core/h264_bitstream.h"
+
+namespace carlink {
+
+void BitWriter::WriteBits(uint32_t value, int count) {
+  for (int i = count - 1; i >= 0; i--) {
+    partial_ = (partial_ << 1) | ((value >> i) & 1);
+    if (++bits_ == 8) {
+      data_.push_back(static_cast<uint8_t>(partial_));
+      partial_ = 0;
+      bits_ = 0;
+    }
+  }
+}
+
+void BitWriter::WriteUe(uint32_t value) {
+  // value + 1 in binary, preceded by one zero per bit after the first.
+  const uint64_t code = static_cast<uint64_t>(value) + 1;
+  int length = 0;
+  while ((code >> length) > 1) {
+    length++;
+  }
+  WriteBits(0, length);
+  if (length + 1 > 32) {
+    WriteBits(static_cast<uint32_t>(code >> 32), length + 1 - 32);
+    WriteBits(static_cast<uint32_t>(code), 32);
+  } else {
+    WriteBits(static_cast<uint32_t>(code), length + 1);
+  }
+}
+
+void BitWriter::WriteSe(int32_t value) {
+  // 1 -> 1, -1 -> 2, 2 -> 3, ...
+  WriteUe(value > 0 ? 2 * static_cast<uint32_t>(value) - 1
+                    : 2 * static_cast<uint32_t>(-static_cast<int64_t>(value)));
+}
+
+void BitWriter::AlignWithZeros() {
+  if (bits_ != 0) {
+    WriteBits(0, 8 - bits_);
+  }
+}
+
+void BitWriter::WriteBytes(const uint8_t* data, size_t length) {
+  data_.insert(data_.end(), data, data + length);
+}
+
+void BitWriter::WriteTrailingBits() {
+  WriteBit(true);
+  AlignWithZeros();
+}
+
+BitReader::BitReader(const uint8_t* data, size_t length)
+    : data_(data), length_(length) {}
+
+uint32_t BitReader::ReadBits(int count) {
+  uint32_t value = 0;
+  for (int i = 0; i < count; i++) {
+    uint32_t bit = 0;
+    if (position_ < length_ * 8) {
+      bit = (data_[position_ >> 3] >> (7 - (position_ & 7))) & 1;
+      position_++;
+    } else {
+      overrun_ = true;
+    }
+    value = (value << 1) | bit;
+  }
+  return value;
+}
+
+uint32_t BitReader::ReadUe() {
+  int zeros = 0;
+  while (!ReadBit()) {
+    if (overrun_ || ++zeros > 31) {
+      overrun_ = true;
+      return 0;
+    }
+  }
+  if (zeros == 0) {
+    return 0;
+  }
+  return ((1u << zeros) - 1) + ReadBits(zeros);
+}
+
+int32_t BitReader::ReadSe() {
+  const uint32_t code = ReadUe();
+  return (code & 1) ? static_cast<int32_t>((code + 1) / 2)
+                    : -static_cast<int32_t>(code / 2);
+}
+
+void BitReader::SkipToByteBoundary() {
+  position_ = (position_ + 7) & ~static_cast<size_t>(7);
+  if (position_ > length_ * 8) {
+    position_ = length_ * 8;
+    overrun_ = true;
+  }
+}
+
+const uint8_t* BitReader::ReadBytes(size_t length) {
+  const size_t offset = position_ / 8;
+  if (!byte_aligned() || length > length_ - offset) {
+    overrun_ = true;
+    return nullptr;
+  }
+  position_ += length * 8;
+  return data_ + offset;
+}
+
+void AppendNalUnit(uint8_t header, const std::vector<uint8_t>& rbsp,
+                   std::vector<uint8_t>* out) {
+  static const uint8_t kStartCode[] = {0, 0, 0, 1};
+  out->insert(out->end(), kStartCode, kStartCode + sizeof(kStartCode));
+  out->push_back(header);
+  int zeros = 0;
+  for (uint8_t byte : rbsp) {
+    // 00 00 followed by 00-03 would read as a start code or escape.
+    if (zeros == 2 && byte <= 3) {
+      out->push_back(3);
+      zeros = 0;
+    }
+    out->push_back(byte);
+    zeros = byte == 0 ? zeros + 1 : 0;
+  }
+  if (zeros > 0) {
+    // A payload may not end in a zero byte.
+    out->push_back(3);
+  }
+}
+
+std::vector<uint8_t> UnescapeRbsp(const uint8_t* data, size_t length) {
+  std::vector<uint8_t> rbsp(length);
+  rbsp.resize(UnescapeRbsp(data, length, rbsp.data(), rbsp.size()));
+  return rbsp;
+}
+
+size_t UnescapeRbsp(const uint8_t* data, size_t length, uint8_t* out,
+                    size_t capacity) {
+  size_t written = 0;
+  int zeros = 0;
+  for (size_t i = 0; i < length && written < capacity; i++) {
+    if (zeros == 2 && data[i] == 3) {
+      zeros = 0;
+      continue;
+    }
+    out[written++] = data[i];
+    zeros = data[i] == 0 ? zeros + 1 : 0;
+  }
+  return written;
+}
+
+}  // namespace carlink
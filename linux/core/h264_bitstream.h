@@ -0,0 +1,83 @@
+#ifndef CARLINK_CORE_H264_BITSTREAM_H_
+#define CARLINK_CORE_H264_BITSTREAM_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace carlink {
+
+// Writes an H.264 RBSP MSB first: fixed-width fields and Exp-Golomb codes
+// (ITU-T H.264 7.2 and 9.1).
+class BitWriter {
+ public:
+  // |count| <= 32.
+  void WriteBits(uint32_t value, int count);
+  void WriteBit(bool bit) { WriteBits(bit ? 1 : 0, 1); }
+  void WriteUe(uint32_t value);
+  void WriteSe(int32_t value);
+  // Zero bits up to the next byte boundary.
+  void AlignWithZeros();
+  // Whole bytes; the writer must be byte aligned.
+  void WriteBytes(const uint8_t* data, size_t length);
+  // rbsp_trailing_bits(): a one, then zeros to the byte boundary.
+  void WriteTrailingBits();
+
+  bool byte_aligned() const { return bits_ == 0; }
+  // The bytes written so far; call once byte aligned.
+  const std::vector<uint8_t>& data() const { return data_; }
+
+ private:
+  std::vector<uint8_t> data_;
+  // Bits of the byte being filled, in the low |bits_| bits.
+  uint32_t partial_ = 0;
+  int bits_ = 0;
+};
+
+// Reads an RBSP written as above. Reads past the end return zeros and set
+// overrun(), so a truncated NAL unit needs one check at the end.
+class BitReader {
+ public:
+  BitReader(const uint8_t* data, size_t length);
+
+  // |count| <= 32.
+  uint32_t ReadBits(int count);
+  bool ReadBit() { return ReadBits(1) != 0; }
+  uint32_t ReadUe();
+  int32_t ReadSe();
+  void SkipToByteBoundary();
+  // |length| whole bytes, or nullptr if fewer are left; the reader must be
+  // byte aligned.
+  const uint8_t* ReadBytes(size_t length);
+
+  bool byte_aligned() const { return (position_ & 7) == 0; }
+  size_t bits_left() const {
+    return position_ < length_ * 8 ? length_ * 8 - position_ : 0;
+  }
+  bool overrun() const { return overrun_; }
+
+ private:
+  const uint8_t* data_;
+  size_t length_;
+  // In bits.
+  size_t position_ = 0;
+  bool overrun_ = false;
+};
+
+// Appends |rbsp| to |out| as an Annex-B NAL unit: a four-byte start code,
+// |header|, then the payload with emulation prevention bytes inserted.
+void AppendNalUnit(uint8_t header, const std::vector<uint8_t>& rbsp,
+                   std::vector<uint8_t>* out);
+
+// The RBSP of a NAL unit payload (after its header byte), with emulation
+// prevention bytes removed.
+std::vector<uint8_t> UnescapeRbsp(const uint8_t* data, size_t length);
+// The same into |out|, stopping after |capacity| bytes; returns how many
+// were written. A slice header fits in a few dozen bytes, so this reads one
+// without allocating.
+size_t UnescapeRbsp(const uint8_t* data, size_t length, uint8_t* out,
+                    size_t capacity);
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_H264_BITSTREAM_H_
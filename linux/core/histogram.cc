@@ -0,0 +1,102 @@
+#include "core/histogram.h"
+
+#include <algorithm>
+
+namespace carlink {
+
+Histogram::Histogram() {
+  Reset();
+}
+
+size_t Histogram::BucketIndex(uint64_t value) {
+  if (value < kSubBuckets) {
+    return static_cast<size_t>(value);
+  }
+  const int msb = 63 - __builtin_clzll(value);
+  const int shift = msb - kSubBucketBits;
+  return static_cast<size_t>(shift + 1) * kSubBuckets +
+         ((value >> shift) & (kSubBuckets - 1));
+}
+
+uint64_t Histogram::BucketLowerBound(size_t index) {
+  if (index < kSubBuckets) {
+    return index;
+  }
+  const int shift = static_cast<int>(index / kSubBuckets) - 1;
+  const uint64_t sub_bucket = index % kSubBuckets;
+  return (kSubBuckets | sub_bucket) << shift;
+}
+
+void Histogram::Record(uint64_t value) {
+  buckets_[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  uint64_t max = max_.load(std::memory_order_relaxed);
+  while (value > max &&
+         !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+  }
+}
+
+void Histogram::Reset() {
+  for (std::atomic<uint64_t>& bucket : buckets_) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+  count_.store(0, std::memory_order_relaxed);
+  max_.store(0, std::memory_order_relaxed);
+}
+
+uint64_t Histogram::Percentile(double percentile) const {
+  const uint64_t total = count();
+  if (total == 0) {
+    return 0;
+  }
+  const uint64_t rank = std::max<uint64_t>(
+      1, static_cast<uint64_t>(total * std::min(percentile, 100.0) / 100.0 +
+                               0.5));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kBucketCount; i++) {
+    seen += buckets_[i].load(std::memory_order_relaxed);
+    if (seen >= rank) {
+      // Middle of the bucket, capped by the largest value seen.
+      const uint64_t low = BucketLowerBound(i);
+      const uint64_t high =
+          i + 1 < kBucketCount ? BucketLowerBound(i + 1) - 1 : UINT64_MAX;
+      return std::min(low + (high - low) / 2, max());
+    }
+  }
+  return max();
+}
+
+void Histogram::TakeSnapshot(Snapshot* snapshot) const {
+  snapshot->count = 0;
+  for (size_t i = 0; i < kBucketCount; i++) {
+    snapshot->buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+    snapshot->count += snapshot->buckets[i];
+  }
+}
+
+uint64_t Histogram::Snapshot::PercentileSince(const Snapshot& earlier,
+                                              double percentile) const {
+  // A histogram reset in between counts from zero.
+  const bool reset = earlier.count > count;
+  const uint64_t total = reset ? count : count - earlier.count;
+  if (total == 0) {
+    return 0;
+  }
+  const uint64_t rank = std::max<uint64_t>(
+      1, static_cast<uint64_t>(total * std::min(percentile, 100.0) / 100.0 +
+                               0.5));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kBucketCount; i++) {
+    const uint64_t before = reset ? 0 : earlier.buckets[i];
+    seen += buckets[i] > before ? buckets[i] - before : 0;
+    if (seen >= rank) {
+      const uint64_t low = BucketLowerBound(i);
+      const uint64_t high =
+          i + 1 < kBucketCount ? BucketLowerBound(i + 1) - 1 : UINT64_MAX;
+      return low + (high - low) / 2;
+    }
+  }
+  return 0;
+}
+
+}  // namespace carlink
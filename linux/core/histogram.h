@@ -0,0 +1,61 @@
+#ifndef CARLINK_CORE_HISTOGRAM_H_
+#define CARLINK_CORE_HISTOGRAM_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace carlink {
+
+// Log-linear histogram of non-negative values (typically nanoseconds):
+// every power of two is split into 16 linear sub-buckets, so percentiles
+// are within ~6% of the true value over the full 64-bit range.
+//
+// Record() is lock-free and may be called from any thread; readers see a
+// consistent-enough view without stopping writers.
+class Histogram {
+ public:
+  static constexpr int kSubBucketBits = 4;
+  static constexpr int kSubBuckets = 1 << kSubBucketBits;
+  static constexpr size_t kBucketCount = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+  Histogram();
+
+  Histogram(const Histogram&) = delete;
+  Histogram& operator=(const Histogram&) = delete;
+
+  void Record(uint64_t value);
+  void Reset();
+
+  uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+  uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+
+  // Value at |percentile| (0-100), or 0 when empty.
+  uint64_t Percentile(double percentile) const;
+
+  // Bucket counts at one point in time. Percentiles over an interval come
+  // from two snapshots, without resetting the histogram under its readers.
+  struct Snapshot {
+    uint64_t buckets[kBucketCount] = {};
+    uint64_t count = 0;
+
+    // Value at |percentile| of what was recorded after |earlier|, or 0 if
+    // nothing was.
+    uint64_t PercentileSince(const Snapshot& earlier,
+                             double percentile) const;
+  };
+  void TakeSnapshot(Snapshot* snapshot) const;
+
+  static size_t BucketIndex(uint64_t value);
+  // Smallest value that lands in bucket |index|.
+  static uint64_t BucketLowerBound(size_t index);
+
+ private:
+  std::atomic<uint64_t> buckets_[kBucketCount];
+  std::atomic<uint64_t> count_{0};
+  std::atomic<uint64_t> max_{0};
+};
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_HISTOGRAM_H_
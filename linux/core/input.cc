@@ -0,0 +1,61 @@
+#include "core/input.h"
+
+#include <cstring>
+
+namespace carlink {
+
+namespace {
+
+uint32_t ToTouchCoordinate(float value) {
+  const float scaled = value * 10000.0f;
+  if (!(scaled > 0.0f)) {
+    return 0;
+  }
+  return scaled > 10000.0f ? 10000 : static_cast<uint32_t>(scaled);
+}
+
+void WriteFloat(uint8_t* data, float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  WriteU32(data, bits);
+}
+
+}  // namespace
+
+EncodedMessage EncodeTouch(TouchAction action, float x, float y) {
+  uint8_t payload[16] = {};
+  WriteU32(payload, static_cast<uint32_t>(action));
+  WriteU32(payload + 4, ToTouchCoordinate(x));
+  WriteU32(payload + 8, ToTouchCoordinate(y));
+  return EncodeMessage(MessageType::kTouch, payload, sizeof(payload));
+}
+
+EncodedMessage EncodeMultiTouch(const std::vector<TouchPoint>& touches) {
+  std::vector<uint8_t> payload(touches.size() * 16);
+  uint8_t* out = payload.data();
+  for (const TouchPoint& touch : touches) {
+    WriteFloat(out, touch.x);
+    WriteFloat(out + 4, touch.y);
+    WriteU32(out + 8, static_cast<uint32_t>(touch.action));
+    WriteU32(out + 12, touch.id);
+    out += 16;
+  }
+  return EncodeMessage(MessageType::kMultiTouch, payload.data(),
+                       payload.size());
+}
+
+EncodedMessage EncodeMicrophoneAudio(const int16_t* samples, size_t count) {
+  std::vector<uint8_t> payload(12 + count * 2);
+  WriteU32(payload.data(), 5);
+  WriteFloat(payload.data() + 4, 0.0f);
+  WriteU32(payload.data() + 8, 3);
+  for (size_t i = 0; i < count; i++) {
+    const uint16_t sample = static_cast<uint16_t>(samples[i]);
+    payload[12 + i * 2] = sample & 0xff;
+    payload[12 + i * 2 + 1] = sample >> 8;
+  }
+  return EncodeMessage(MessageType::kAudioData, payload.data(),
+                       payload.size());
+}
+
+}  // namespace carlink
@@ -0,0 +1,43 @@
+#ifndef CARLINK_CORE_INPUT_H_
+#define CARLINK_CORE_INPUT_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "core/protocol.h"
+
+namespace carlink {
+
+// TouchAction in lib/driver/sendable.dart.
+enum class TouchAction : uint32_t {
+  kDown = 14,
+  kMove = 15,
+  kUp = 16,
+};
+
+// MultiTouchAction in lib/driver/sendable.dart.
+enum class MultiTouchAction : uint32_t {
+  kUp = 0,
+  kDown = 1,
+  kMove = 2,
+};
+
+// A touch point in normalised 0..1 display coordinates.
+struct TouchPoint {
+  float x = 0;
+  float y = 0;
+  MultiTouchAction action = MultiTouchAction::kDown;
+  uint32_t id = 0;
+};
+
+// Single touch event, coordinates clamped to 0..1.
+EncodedMessage EncodeTouch(TouchAction action, float x, float y);
+
+EncodedMessage EncodeMultiTouch(const std::vector<TouchPoint>& touches);
+
+// Microphone PCM, 16 kHz mono (SendAudio in Dart).
+EncodedMessage EncodeMicrophoneAudio(const int16_t* samples, size_t count);
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_INPUT_H_
@@ -0,0 +1,199 @@
+#include "core/io_uring.h"
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace carlink {
+
+namespace {
+
+int Setup(unsigned entries, io_uring_params* params) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int Enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+  return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit,
+                                  min_complete, flags, nullptr, 0));
+}
+
+int Register(int fd, unsigned opcode, const void* arg, unsigned count) {
+  return static_cast<int>(
+      syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+unsigned LoadAcquire(const unsigned* value) {
+  return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+}
+
+void StoreRelease(unsigned* value, unsigned new_value) {
+  __atomic_store_n(value, new_value, __ATOMIC_RELEASE);
+}
+
+}  // namespace
+
+IoUring::~IoUring() {
+  Release();
+}
+
+void IoUring::Release() {
+  if (sqes_ != nullptr) {
+    munmap(sqes_, sqes_size_);
+    sqes_ = nullptr;
+  }
+  if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) {
+    munmap(cq_ring_, cq_ring_size_);
+  }
+  cq_ring_ = nullptr;
+  if (sq_ring_ != nullptr) {
+    munmap(sq_ring_, sq_ring_size_);
+    sq_ring_ = nullptr;
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+  buffers_registered_ = false;
+  pending_ = 0;
+}
+
+bool IoUring::Init(unsigned entries) {
+  Release();
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  fd_ = Setup(entries, &params);
+  if (fd_ < 0) {
+    return false;
+  }
+
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ =
+      params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) {
+    sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+  }
+  sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+  if (sq_ring_ == MAP_FAILED) {
+    sq_ring_ = nullptr;
+    Release();
+    return false;
+  }
+  if (single_mmap) {
+    cq_ring_ = sq_ring_;
+  } else {
+    cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED) {
+      cq_ring_ = nullptr;
+      Release();
+      return false;
+    }
+  }
+  sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+  void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    Release();
+    return false;
+  }
+  sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+  auto* sq = static_cast<uint8_t*>(sq_ring_);
+  sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+  sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  sq_entries_ = params.sq_entries;
+  sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+  auto* cq = static_cast<uint8_t*>(cq_ring_);
+  cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+  cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+  // IORING_OP_WRITE needs 5.6, which is also when probing arrived.
+  std::vector<uint8_t> probe_storage(sizeof(io_uring_probe) +
+                                     256 * sizeof(io_uring_probe_op));
+  auto* probe = reinterpret_cast<io_uring_probe*>(probe_storage.data());
+  if (Register(fd_, IORING_REGISTER_PROBE, probe, 256) < 0 ||
+      probe->last_op < IORING_OP_WRITE ||
+      !(probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED) ||
+      !(probe->ops[IORING_OP_WRITE_FIXED].flags & IO_URING_OP_SUPPORTED)) {
+    Release();
+    return false;
+  }
+  return true;
+}
+
+bool IoUring::RegisterBuffers(const iovec* buffers, unsigned count) {
+  buffers_registered_ =
+      Register(fd_, IORING_REGISTER_BUFFERS, buffers, count) == 0;
+  return buffers_registered_;
+}
+
+bool IoUring::PrepareWrite(int fd, const uint8_t* data, size_t length,
+                           uint64_t offset, int buffer_index,
+                           uint64_t user_data) {
+  const unsigned tail = *sq_tail_;
+  if (tail - LoadAcquire(sq_head_) >= sq_entries_) {
+    return false;
+  }
+  const unsigned index = tail & sq_mask_;
+  io_uring_sqe* sqe = &sqes_[index];
+  memset(sqe, 0, sizeof(*sqe));
+  const bool fixed = buffer_index >= 0 && buffers_registered_;
+  sqe->opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+  sqe->fd = fd;
+  sqe->off = offset;
+  sqe->addr = reinterpret_cast<uint64_t>(data);
+  sqe->len = static_cast<uint32_t>(length);
+  if (fixed) {
+    sqe->buf_index = static_cast<uint16_t>(buffer_index);
+  }
+  sqe->user_data = user_data;
+  sq_array_[index] = index;
+  StoreRelease(sq_tail_, tail + 1);
+  pending_++;
+  return true;
+}
+
+bool IoUring::Submit(unsigned wait) {
+  while (true) {
+    const int result = Enter(fd_, pending_, wait,
+                             wait > 0 ? IORING_ENTER_GETEVENTS : 0);
+    if (result >= 0) {
+      pending_ -= std::min<unsigned>(pending_, result);
+      return true;
+    }
+    if (errno != EINTR) {
+      return false;
+    }
+  }
+}
+
+void IoUring::DiscardPending() {
+  // The kernel reads the queue only inside io_uring_enter().
+  StoreRelease(sq_tail_, *sq_tail_ - pending_);
+  pending_ = 0;
+}
+
+bool IoUring::PopCompletion(uint64_t* user_data, int32_t* result) {
+  const unsigned head = *cq_head_;
+  if (head == LoadAcquire(cq_tail_)) {
+    return false;
+  }
+  const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+  *user_data = cqe.user_data;
+  *result = cqe.res;
+  StoreRelease(cq_head_, head + 1);
+  return true;
+}
+
+}  // namespace carlink
@@ -0,0 +1,80 @@
+#ifndef CARLINK_CORE_IO_URING_H_
+#define CARLINK_CORE_IO_URING_H_
+
+#include <sys/uio.h>
+
+#include <cstddef>
+#include <cstdint>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace carlink {
+
+// Just enough io_uring for file writes, on the raw system calls so there
+// is no liburing dependency. Not thread-safe: one thread submits and reaps.
+class IoUring {
+ public:
+  IoUring() = default;
+  ~IoUring();
+
+  IoUring(const IoUring&) = delete;
+  IoUring& operator=(const IoUring&) = delete;
+
+  // False when the kernel has no io_uring (or it is disabled) or does not
+  // support the write opcodes.
+  bool Init(unsigned entries);
+
+  // Pins |buffers| so writes from them skip the per-I/O page mapping.
+  // Fails e.g. when RLIMIT_MEMLOCK is too low; plain writes still work.
+  bool RegisterBuffers(const iovec* buffers, unsigned count);
+  bool buffers_registered() const { return buffers_registered_; }
+
+  // Queues a write of |length| bytes at |offset|. |buffer_index| names a
+  // registered buffer containing |data|, or is -1. Returns false when the
+  // submission queue is full.
+  bool PrepareWrite(int fd, const uint8_t* data, size_t length,
+                    uint64_t offset, int buffer_index, uint64_t user_data);
+
+  // Submits queued writes and waits for at least |wait| completions.
+  // Returns false on error.
+  bool Submit(unsigned wait);
+  // Writes prepared but not yet taken by a Submit(), oldest first in the
+  // order they were prepared.
+  unsigned pending() const { return pending_; }
+  // Takes those back, so they are never issued and their buffers are free.
+  void DiscardPending();
+
+  // Pops one completion; |result| is the byte count or -errno.
+  bool PopCompletion(uint64_t* user_data, int32_t* result);
+
+ private:
+  void Release();
+
+  int fd_ = -1;
+  bool buffers_registered_ = false;
+
+  void* sq_ring_ = nullptr;
+  size_t sq_ring_size_ = 0;
+  void* cq_ring_ = nullptr;
+  size_t cq_ring_size_ = 0;
+  io_uring_sqe* sqes_ = nullptr;
+  size_t sqes_size_ = 0;
+
+  unsigned* sq_head_ = nullptr;
+  unsigned* sq_tail_ = nullptr;
+  unsigned sq_mask_ = 0;
+  unsigned sq_entries_ = 0;
+  unsigned* sq_array_ = nullptr;
+  unsigned* cq_head_ = nullptr;
+  unsigned* cq_tail_ = nullptr;
+  unsigned cq_mask_ = 0;
+  io_uring_cqe* cqes_ = nullptr;
+
+  // Prepared but not yet submitted.
+  unsigned pending_ = 0;
+};
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_IO_URING_H_
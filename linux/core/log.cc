@@ -0,0 +1,59 @@
+#include "core/log.h"
+
+#include <cstdarg>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+
+#include "core/log_ring.h"
+
+namespace carlink {
+
+namespace {
+
+std::mutex& SinkMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+std::shared_ptr<LogSink>& Sink() {
+  static std::shared_ptr<LogSink> sink;
+  return sink;
+}
+
+}  // namespace
+
+void SetLogSink(LogSink sink) {
+  std::lock_guard<std::mutex> lock(SinkMutex());
+  Sink() = sink ? std::make_shared<LogSink>(std::move(sink)) : nullptr;
+}
+
+void Log(LogLevel level, const char* format, ...) {
+  LogRing* ring = CurrentLogRing();
+  if (ring != nullptr) {
+    va_list args;
+    va_start(args, format);
+    ring->Write(level, format, args);
+    va_end(args);
+    return;
+  }
+
+  char line[512];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+
+  std::shared_ptr<LogSink> sink;
+  {
+    std::lock_guard<std::mutex> lock(SinkMutex());
+    sink = Sink();
+  }
+  if (sink) {
+    (*sink)(level, line);
+  } else {
+    fprintf(stderr, "%s\n", line);
+  }
+}
+
+}  // namespace carlink
@@ -0,0 +1,28 @@
+#ifndef CARLINK_CORE_LOG_H_
+#define CARLINK_CORE_LOG_H_
+
+#include <functional>
+#include <string>
+
+namespace carlink {
+
+enum class LogLevel {
+  kDebug,
+  kInfo,
+  kWarning,
+  kError,
+};
+
+using LogSink = std::function<void(LogLevel level, const std::string& line)>;
+
+// Routes core log lines to |sink|; lines go to stderr when no sink is set.
+// The sink may be called from any pipeline thread. A LogRing, when set
+// (core/log_ring.h), takes precedence.
+void SetLogSink(LogSink sink);
+
+void Log(LogLevel level, const char* format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_LOG_H_
@@ -0,0 +1,450 @@
+#include "core/log_ring.h"
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+
+#include "core/clock.h"
+#include "core/thread_stats.h"
+
+namespace carlink {
+
+namespace {
+
+std::atomic<LogRing*> g_log_ring{nullptr};
+std::atomic<uint64_t> g_next_ring_id{1};
+
+int CurrentTid() {
+  return static_cast<int>(syscall(SYS_gettid));
+}
+
+void AppendFormatted(std::string* out, const char* spec, ...)
+    __attribute__((format(printf, 2, 3)));
+
+void AppendFormatted(std::string* out, const char* spec, ...) {
+  char buffer[128];
+  va_list args;
+  va_start(args, spec);
+  const int length = vsnprintf(buffer, sizeof(buffer), spec, args);
+  va_end(args);
+  if (length < 0) {
+    return;
+  }
+  if (static_cast<size_t>(length) < sizeof(buffer)) {
+    out->append(buffer, length);
+    return;
+  }
+  // Wide fields only.
+  std::vector<char> wide(length + 1);
+  va_start(args, spec);
+  vsnprintf(wide.data(), wide.size(), spec, args);
+  va_end(args);
+  out->append(wide.data(), length);
+}
+
+}  // namespace
+
+std::string FormatLogArgs(const char* format, const LogArg* args,
+                          size_t count) {
+  std::string out;
+  size_t next = 0;
+  for (const char* p = format; *p != '\0'; p++) {
+    if (*p != '%') {
+      out += *p;
+      continue;
+    }
+    if (p[1] == '%') {
+      out += '%';
+      p++;
+      continue;
+    }
+
+    // Keep flags, width and precision; drop length modifiers.
+    char spec[32] = "%";
+    size_t length = 1;
+    const char* q = p + 1;
+    while (*q != '\0' && strchr("-+ #0", *q) != nullptr && length < 8) {
+      spec[length++] = *q++;
+    }
+    while (isdigit(static_cast<unsigned char>(*q)) && length < 16) {
+      spec[length++] = *q++;
+    }
+    if (*q == '.') {
+      spec[length++] = *q++;
+      while (isdigit(static_cast<unsigned char>(*q)) && length < 24) {
+        spec[length++] = *q++;
+      }
+    }
+    while (*q != '\0' && strchr("hlLqjzt", *q) != nullptr) {
+      q++;
+    }
+    const char conversion = *q;
+    if (conversion == '\0') {
+      break;
+    }
+    p = q;
+
+    const LogArg* arg = next < count ? &args[next++] : nullptr;
+    const bool integer = arg != nullptr && (arg->type == LogArg::kSigned ||
+                                            arg->type == LogArg::kUnsigned);
+    switch (conversion) {
+      case 'd':
+      case 'i':
+        if (!integer) {
+          break;
+        }
+        strcpy(spec + length, "lld");
+        AppendFormatted(&out, spec, static_cast<long long>(arg->i));
+        continue;
+      case 'u':
+      case 'x':
+      case 'X':
+      case 'o':
+        if (!integer) {
+          break;
+        }
+        spec[length++] = 'l';
+        spec[length++] = 'l';
+        spec[length++] = conversion;
+        spec[length] = '\0';
+        AppendFormatted(&out, spec, static_cast<unsigned long long>(arg->u));
+        continue;
+      case 'c':
+        if (!integer) {
+          break;
+        }
+        strcpy(spec + length, "c");
+        AppendFormatted(&out, spec, static_cast<int>(arg->i));
+        continue;
+      case 'p':
+        if (!integer) {
+          break;
+        }
+        AppendFormatted(&out, "0x%llx",
+                        static_cast<unsigned long long>(arg->u));
+        continue;
+      case 'f':
+      case 'F':
+      case 'e':
+      case 'E':
+      case 'g':
+      case 'G':
+      case 'a':
+      case 'A':
+        if (arg == nullptr || arg->type == LogArg::kString ||
+            arg->type == LogArg::kNone) {
+          break;
+        }
+        spec[length++] = conversion;
+        spec[length] = '\0';
+        AppendFormatted(&out, spec,
+                        arg->type == LogArg::kDouble
+                            ? arg->d
+                            : arg->type == LogArg::kSigned
+                                  ? static_cast<double>(arg->i)
+                                  : static_cast<double>(arg->u));
+        continue;
+      case 's':
+        if (arg == nullptr || arg->type != LogArg::kString) {
+          break;
+        }
+        if (length == 1) {
+          out.append(arg->s.data, arg->s.length);
+        } else {
+          strcpy(spec + length, "s");
+          AppendFormatted(&out, spec,
+                          std::string(arg->s.data, arg->s.length).c_str());
+        }
+        continue;
+      default:
+        break;
+    }
+    out += "<?>";
+  }
+  return out;
+}
+
+// A fixed-size record: either a formatted line in |text|, or a format with
+// captured arguments whose strings live in |text|.
+struct LogRing::Slot {
+  static constexpr size_t kMaxArgs = 6;
+
+  int64_t timestamp_ns = 0;
+  // nullptr when |text| holds the formatted line.
+  const char* format = nullptr;
+  LogLevel level = LogLevel::kInfo;
+  uint8_t arg_count = 0;
+  uint16_t text_length = 0;
+  LogArg args[kMaxArgs];
+  char text[344];
+};
+static_assert(sizeof(LogArg) == 24, "LogArg layout changed");
+
+// One thread's single-producer, single-consumer ring.
+struct LogRing::ThreadBuffer {
+  ThreadBuffer(size_t size, int tid) : slots(size), tid(tid) {}
+
+  std::vector<Slot> slots;
+  const int tid;
+  // Next slot to drain; written by the flusher.
+  std::atomic<uint64_t> head{0};
+  // Next slot to fill; written by the owner.
+  std::atomic<uint64_t> tail{0};
+  // The owner exited: drop the buffer once drained.
+  std::atomic<bool> retired{false};
+};
+
+LogRing::LogRing(LogBatchSink sink) : LogRing(std::move(sink), Options()) {}
+
+LogRing::LogRing(LogBatchSink sink, const Options& options)
+    : sink_(std::move(sink)),
+      options_(options),
+      id_(g_next_ring_id.fetch_add(1, std::memory_order_relaxed)) {}
+
+LogRing::~LogRing() {
+  Stop();
+}
+
+void LogRing::Start() {
+  std::lock_guard<std::mutex> lock(wake_mutex_);
+  if (running_) {
+    return;
+  }
+  running_ = true;
+  thread_ = std::thread(&LogRing::Run, this);
+}
+
+void LogRing::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    running_ = false;
+  }
+  wake_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  Flush();
+}
+
+void LogRing::Run() {
+  SetCurrentThreadName("carlink-log");
+  std::unique_lock<std::mutex> lock(wake_mutex_);
+  while (running_) {
+    wake_.wait_for(lock, std::chrono::milliseconds(options_.flush_interval_ms),
+                   [this] { return !running_; });
+    lock.unlock();
+    Flush();
+    lock.lock();
+  }
+}
+
+LogRing::ThreadBuffer* LogRing::CurrentBuffer() {
+  struct Cache {
+    ~Cache() { Retire(); }
+    void Retire() {
+      if (buffer) {
+        buffer->retired.store(true, std::memory_order_release);
+      }
+    }
+
+    uint64_t ring_id = 0;
+    std::shared_ptr<ThreadBuffer> buffer;
+  };
+  static thread_local Cache cache;
+
+  if (cache.ring_id != id_) {
+    cache.Retire();
+    cache.buffer = std::make_shared<ThreadBuffer>(options_.records_per_thread,
+                                                  CurrentTid());
+    cache.ring_id = id_;
+    std::lock_guard<std::mutex> lock(buffers_mutex_);
+    buffers_.push_back(cache.buffer);
+  }
+  return cache.buffer.get();
+}
+
+LogRing::Slot* LogRing::Reserve(LogLevel level, ThreadBuffer** buffer) {
+  const int64_t now = RealtimeNanos();
+  const int index = static_cast<int>(level);
+  const uint32_t limit = options_.max_per_second[index];
+  if (limit != 0) {
+    RateWindow& window = rate_[index];
+    const int64_t second = now / 1000000000;
+    if (window.second.load(std::memory_order_relaxed) != second) {
+      // Threads racing here may each reset the count, letting a few extra
+      // lines through: close enough for a limiter.
+      window.second.store(second, std::memory_order_relaxed);
+      window.count.store(0, std::memory_order_relaxed);
+    }
+    if (window.count.fetch_add(1, std::memory_order_relaxed) >= limit) {
+      dropped_rate_limited_.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+  }
+
+  ThreadBuffer* current = CurrentBuffer();
+  const uint64_t tail = current->tail.load(std::memory_order_relaxed);
+  if (tail - current->head.load(std::memory_order_acquire) >=
+      current->slots.size()) {
+    dropped_full_.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  Slot* slot = &current->slots[tail & (current->slots.size() - 1)];
+  slot->timestamp_ns = now;
+  slot->level = level;
+  *buffer = current;
+  return slot;
+}
+
+void LogRing::Write(LogLevel level, const char* format, va_list args) {
+  ThreadBuffer* buffer;
+  Slot* slot = Reserve(level, &buffer);
+  if (slot == nullptr) {
+    return;
+  }
+  const int length = vsnprintf(slot->text, sizeof(slot->text), format, args);
+  slot->format = nullptr;
+  slot->text_length = static_cast<uint16_t>(
+      length < 0 ? 0 : std::min<size_t>(length, sizeof(slot->text) - 1));
+  buffer->tail.store(buffer->tail.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_release);
+}
+
+void LogRing::WriteDeferred(LogLevel level, const char* format,
+                            const LogArg* args, size_t count) {
+  ThreadBuffer* buffer;
+  Slot* slot = Reserve(level, &buffer);
+  if (slot == nullptr) {
+    return;
+  }
+  if (count > Slot::kMaxArgs) {
+    const std::string line = FormatLogArgs(format, args, count);
+    slot->format = nullptr;
+    slot->text_length = static_cast<uint16_t>(
+        std::min(line.size(), sizeof(slot->text) - 1));
+    memcpy(slot->text, line.data(), slot->text_length);
+  } else {
+    // Strings move into the slot; the caller's may be gone by the flush.
+    size_t used = 0;
+    for (size_t i = 0; i < count; i++) {
+      slot->args[i] = args[i];
+      if (args[i].type == LogArg::kString) {
+        const size_t length =
+            std::min<size_t>(args[i].s.length, sizeof(slot->text) - used);
+        memcpy(slot->text + used, args[i].s.data, length);
+        slot->args[i].s.data = slot->text + used;
+        slot->args[i].s.length = static_cast<uint32_t>(length);
+        used += length;
+      }
+    }
+    slot->format = format;
+    slot->arg_count = static_cast<uint8_t>(count);
+  }
+  buffer->tail.store(buffer->tail.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_release);
+}
+
+void LogRing::Drain(std::vector<LogRecord>* batch) {
+  std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+  {
+    std::lock_guard<std::mutex> lock(buffers_mutex_);
+    buffers = buffers_;
+  }
+
+  bool any_retired = false;
+  for (const std::shared_ptr<ThreadBuffer>& buffer : buffers) {
+    // Checked first: once retired, the tail read below is final.
+    const bool retired = buffer->retired.load(std::memory_order_acquire);
+    const uint64_t tail = buffer->tail.load(std::memory_order_acquire);
+    const size_t mask = buffer->slots.size() - 1;
+    for (uint64_t i = buffer->head.load(std::memory_order_relaxed); i < tail;
+         i++) {
+      const Slot& slot = buffer->slots[i & mask];
+      LogRecord record;
+      record.timestamp_ns = slot.timestamp_ns;
+      record.level = slot.level;
+      record.tid = buffer->tid;
+      record.line = slot.format != nullptr
+                        ? FormatLogArgs(slot.format, slot.args, slot.arg_count)
+                        : std::string(slot.text, slot.text_length);
+      batch->push_back(std::move(record));
+    }
+    buffer->head.store(tail, std::memory_order_release);
+    any_retired |= retired;
+    if (retired) {
+      buffer->slots.clear();
+    }
+  }
+
+  if (any_retired) {
+    std::lock_guard<std::mutex> lock(buffers_mutex_);
+    buffers_.erase(
+        std::remove_if(buffers_.begin(), buffers_.end(),
+                       [](const std::shared_ptr<ThreadBuffer>& buffer) {
+                         return buffer->slots.empty();
+                       }),
+        buffers_.end());
+  }
+
+  // Interleave the threads' lines by time.
+  std::stable_sort(batch->begin(), batch->end(),
+                   [](const LogRecord& a, const LogRecord& b) {
+                     return a.timestamp_ns < b.timestamp_ns;
+                   });
+}
+
+void LogRing::Flush() {
+  std::lock_guard<std::mutex> lock(flush_mutex_);
+  std::vector<LogRecord> batch;
+  Drain(&batch);
+  records_.fetch_add(batch.size(), std::memory_order_relaxed);
+
+  const uint64_t full = dropped_full_.load(std::memory_order_relaxed);
+  const uint64_t rate_limited =
+      dropped_rate_limited_.load(std::memory_order_relaxed);
+  if (full + rate_limited > reported_drops_) {
+    LogRecord record;
+    record.timestamp_ns = RealtimeNanos();
+    record.level = LogLevel::kWarning;
+    record.tid = CurrentTid();
+    char line[128];
+    snprintf(line, sizeof(line),
+             "[LOG] dropped %llu lines (%llu ring full, %llu rate limited)",
+             static_cast<unsigned long long>(full + rate_limited -
+                                             reported_drops_),
+             static_cast<unsigned long long>(full),
+             static_cast<unsigned long long>(rate_limited));
+    record.line = line;
+    batch.push_back(std::move(record));
+    reported_drops_ = full + rate_limited;
+  }
+
+  if (!batch.empty() && sink_) {
+    sink_(batch);
+    batches_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+LogRing::Stats LogRing::stats() const {
+  Stats stats;
+  stats.records = records_.load(std::memory_order_relaxed);
+  stats.batches = batches_.load(std::memory_order_relaxed);
+  stats.dropped_full = dropped_full_.load(std::memory_order_relaxed);
+  stats.dropped_rate_limited =
+      dropped_rate_limited_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void SetLogRing(LogRing* ring) {
+  g_log_ring.store(ring, std::memory_order_release);
+}
+
+LogRing* CurrentLogRing() {
+  return g_log_ring.load(std::memory_order_acquire);
+}
+
+}  // namespace carlink
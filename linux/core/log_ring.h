@@ -0,0 +1,189 @@
+#ifndef CARLINK_CORE_LOG_RING_H_
+#define CARLINK_CORE_LOG_RING_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "core/log.h"
+
+namespace carlink {
+
+// One argument of a LogDeferred() line, captured by value. Strings are
+// copied into the ring, so they need not outlive the call.
+struct LogArg {
+  enum Type : uint8_t {
+    kNone,
+    kSigned,
+    kUnsigned,
+    kDouble,
+    kString,
+  };
+
+  LogArg() : type(kNone), u(0) {}
+  template <typename T,
+            typename std::enable_if<std::is_integral<T>::value &&
+                                        std::is_signed<T>::value,
+                                    int>::type = 0>
+  LogArg(T value) : type(kSigned), i(value) {}
+  template <typename T,
+            typename std::enable_if<std::is_integral<T>::value &&
+                                        !std::is_signed<T>::value,
+                                    int>::type = 0>
+  LogArg(T value) : type(kUnsigned), u(value) {}
+  LogArg(double value) : type(kDouble), d(value) {}
+  LogArg(const char* value)
+      : type(kString),
+        s{value != nullptr ? value : "(null)",
+          value != nullptr ? static_cast<uint32_t>(strlen(value)) : 6} {}
+  LogArg(const std::string& value)
+      : type(kString),
+        s{value.data(), static_cast<uint32_t>(value.size())} {}
+
+  Type type;
+  union {
+    int64_t i;
+    uint64_t u;
+    double d;
+    struct {
+      const char* data;
+      uint32_t length;
+    } s;
+  };
+};
+
+// Formats |format| printf-style over |args|. Length modifiers are ignored
+// since every integer was widened on capture; a conversion without a
+// matching argument prints "<?>".
+std::string FormatLogArgs(const char* format, const LogArg* args,
+                          size_t count);
+
+// A formatted log line as handed to a LogRing's sink.
+struct LogRecord {
+  // CLOCK_REALTIME when Log() was called.
+  int64_t timestamp_ns = 0;
+  LogLevel level = LogLevel::kInfo;
+  int tid = 0;
+  std::string line;
+};
+
+using LogBatchSink = std::function<void(const std::vector<LogRecord>& batch)>;
+
+// Takes logging off the calling thread. Each thread writes records into its
+// own fixed-size ring without locks or allocation; a background thread
+// drains every ring every |flush_interval_ms|, formats deferred lines and
+// hands the batch, in time order, to the sink. A thread whose ring is full
+// drops the line instead of waiting, and each level can be rate limited;
+// the flusher reports drops as a warning line of its own.
+class LogRing {
+ public:
+  struct Options {
+    // Per thread; a power of two.
+    size_t records_per_thread = 256;
+    int flush_interval_ms = 100;
+    // Lines per second admitted at each LogLevel; 0 for no limit.
+    uint32_t max_per_second[4] = {500, 500, 100, 0};
+  };
+
+  struct Stats {
+    uint64_t records = 0;
+    uint64_t batches = 0;
+    uint64_t dropped_full = 0;
+    uint64_t dropped_rate_limited = 0;
+  };
+
+  explicit LogRing(LogBatchSink sink);
+  LogRing(LogBatchSink sink, const Options& options);
+  ~LogRing();
+
+  LogRing(const LogRing&) = delete;
+  LogRing& operator=(const LogRing&) = delete;
+
+  // Starts the flusher. Without it, Flush() delivers on the caller's thread.
+  void Start();
+  // Stops the flusher after a last flush.
+  void Stop();
+
+  // Delivers everything written so far. Any thread, but not from the sink.
+  void Flush();
+
+  // Any thread. Formats into the ring right away.
+  void Write(LogLevel level, const char* format, va_list args);
+  // Any thread. Copies the arguments; the flusher formats them.
+  void WriteDeferred(LogLevel level, const char* format, const LogArg* args,
+                     size_t count);
+
+  Stats stats() const;
+
+ private:
+  struct Slot;
+  struct ThreadBuffer;
+
+  ThreadBuffer* CurrentBuffer();
+  // Claims the next slot for |level|, or returns nullptr and counts a drop.
+  Slot* Reserve(LogLevel level, ThreadBuffer** buffer);
+  void Drain(std::vector<LogRecord>* batch);
+  void Run();
+
+  const LogBatchSink sink_;
+  const Options options_;
+  // Tells the thread-local buffer cache apart from an earlier ring that
+  // lived at the same address.
+  const uint64_t id_;
+
+  std::mutex buffers_mutex_;
+  std::vector<std::shared_ptr<ThreadBuffer>> buffers_;
+
+  struct RateWindow {
+    std::atomic<int64_t> second{0};
+    std::atomic<uint32_t> count{0};
+  };
+  RateWindow rate_[4];
+
+  std::atomic<uint64_t> records_{0};
+  std::atomic<uint64_t> batches_{0};
+  std::atomic<uint64_t> dropped_full_{0};
+  std::atomic<uint64_t> dropped_rate_limited_{0};
+  // Drops already reported by the flusher.
+  uint64_t reported_drops_ = 0;
+
+  // Serialises draining.
+  std::mutex flush_mutex_;
+  std::mutex wake_mutex_;
+  std::condition_variable wake_;
+  bool running_ = false;
+  std::thread thread_;
+};
+
+// Routes Log() and LogDeferred() into |ring| instead of the LogSink; nullptr
+// to go back. The ring must outlive every thread that may still log into it.
+void SetLogRing(LogRing* ring);
+LogRing* CurrentLogRing();
+
+// Log() for hot paths: with a LogRing set, only the arguments are copied
+// here and the line is formatted on the flusher thread. Arguments are
+// integers, floating point numbers or strings.
+template <typename... Args>
+void LogDeferred(LogLevel level, const char* format, const Args&... args) {
+  const LogArg captured[sizeof...(args) + 1] = {LogArg(args)...};
+  LogRing* ring = CurrentLogRing();
+  if (ring != nullptr) {
+    ring->WriteDeferred(level, format, captured, sizeof...(args));
+  } else {
+    Log(level, "%s",
+        FormatLogArgs(format, captured, sizeof...(args)).c_str());
+  }
+}
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_LOG_RING_H_
@@ -0,0 +1,208 @@
+#include "core/lz4.h"
+
+#include <cstring>
+
+namespace carlink {
+
+namespace {
+
+constexpr int kHashBits = 12;
+constexpr size_t kMinMatch = 4;
+// The last match must start at least this far from the end of the block,
+// and the last five bytes are always literals.
+constexpr size_t kMatchFindLimit = 12;
+constexpr size_t kLastLiterals = 5;
+constexpr size_t kMaxOffset = 65535;
+// After 2^kSkipTrigger misses the search starts skipping ahead faster, so
+// incompressible data (H.264 slices) is cheap to get through.
+constexpr int kSkipTrigger = 6;
+
+uint32_t Read32(const uint8_t* data) {
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+uint32_t Hash(uint32_t sequence) {
+  return (sequence * 2654435761u) >> (32 - kHashBits);
+}
+
+uint8_t* WriteLength(uint8_t* out, size_t length) {
+  while (length >= 255) {
+    *out++ = 255;
+    length -= 255;
+  }
+  *out++ = static_cast<uint8_t>(length);
+  return out;
+}
+
+uint8_t* WriteLiterals(uint8_t* out, const uint8_t* literals, size_t length,
+                       uint8_t** token) {
+  *token = out++;
+  if (length >= 15) {
+    **token = 15 << 4;
+    out = WriteLength(out, length - 15);
+  } else {
+    **token = static_cast<uint8_t>(length << 4);
+  }
+  memcpy(out, literals, length);
+  return out + length;
+}
+
+}  // namespace
+
+size_t Lz4Compress(const uint8_t* data, size_t length, uint8_t* out) {
+  uint8_t* const out_start = out;
+  const uint8_t* anchor = data;
+  const uint8_t* const end = data + length;
+
+  if (length >= kMatchFindLimit + 1) {
+    uint32_t table[1 << kHashBits] = {};
+    const uint8_t* const match_find_limit = end - kMatchFindLimit;
+    const uint8_t* const match_limit = end - kLastLiterals;
+    const uint8_t* ip = data + 1;
+
+    while (ip <= match_find_limit) {
+      // Find a match.
+      const uint8_t* match;
+      unsigned attempts = 1 << kSkipTrigger;
+      while (true) {
+        const uint32_t hash = Hash(Read32(ip));
+        match = data + table[hash];
+        table[hash] = static_cast<uint32_t>(ip - data);
+        if (match < ip && static_cast<size_t>(ip - match) <= kMaxOffset &&
+            Read32(match) == Read32(ip)) {
+          break;
+        }
+        ip += attempts++ >> kSkipTrigger;
+        if (ip > match_find_limit) {
+          goto last_literals;
+        }
+      }
+      // Extend backwards over bytes that also match.
+      while (ip > anchor && match > data && ip[-1] == match[-1]) {
+        ip--;
+        match--;
+      }
+
+      uint8_t* token;
+      out = WriteLiterals(out, anchor, ip - anchor, &token);
+
+      while (true) {
+        const uint16_t offset = static_cast<uint16_t>(ip - match);
+        *out++ = offset & 0xff;
+        *out++ = offset >> 8;
+
+        const uint8_t* const match_start = ip;
+        ip += kMinMatch;
+        match += kMinMatch;
+        while (ip < match_limit && *ip == *match) {
+          ip++;
+          match++;
+        }
+        const size_t match_length = ip - match_start - kMinMatch;
+        if (match_length >= 15) {
+          *token |= 15;
+          out = WriteLength(out, match_length - 15);
+        } else {
+          *token |= static_cast<uint8_t>(match_length);
+        }
+        anchor = ip;
+        if (ip > match_find_limit) {
+          goto last_literals;
+        }
+
+        table[Hash(Read32(ip - 2))] = static_cast<uint32_t>(ip - 2 - data);
+        // A match right away needs no literals.
+        const uint32_t hash = Hash(Read32(ip));
+        match = data + table[hash];
+        table[hash] = static_cast<uint32_t>(ip - data);
+        if (match < ip && static_cast<size_t>(ip - match) <= kMaxOffset &&
+            Read32(match) == Read32(ip)) {
+          token = out++;
+          *token = 0;
+          continue;
+        }
+        break;
+      }
+      ip++;
+    }
+  }
+
+last_literals:
+  uint8_t* token;
+  out = WriteLiterals(out, anchor, end - anchor, &token);
+  return out - out_start;
+}
+
+int64_t Lz4Decompress(const uint8_t* data, size_t length, uint8_t* out,
+                      size_t capacity) {
+  const uint8_t* ip = data;
+  const uint8_t* const end = data + length;
+  uint8_t* op = out;
+  uint8_t* const out_end = out + capacity;
+
+  while (ip < end) {
+    const uint8_t token = *ip++;
+
+    size_t literals = token >> 4;
+    if (literals == 15) {
+      uint8_t byte;
+      do {
+        if (ip >= end) {
+          return -1;
+        }
+        byte = *ip++;
+        literals += byte;
+      } while (byte == 255);
+    }
+    if (literals > static_cast<size_t>(end - ip) ||
+        literals > static_cast<size_t>(out_end - op)) {
+      return -1;
+    }
+    memcpy(op, ip, literals);
+    ip += literals;
+    op += literals;
+    if (ip == end) {
+      // The last sequence has no match.
+      break;
+    }
+
+    if (end - ip < 2) {
+      return -1;
+    }
+    const size_t offset = ip[0] | ip[1] << 8;
+    ip += 2;
+    if (offset == 0 || offset > static_cast<size_t>(op - out)) {
+      return -1;
+    }
+    size_t match_length = token & 15;
+    if (match_length == 15) {
+      uint8_t byte;
+      do {
+        if (ip >= end) {
+          return -1;
+        }
+        byte = *ip++;
+        match_length += byte;
+      } while (byte == 255);
+    }
+    match_length += kMinMatch;
+    if (match_length > static_cast<size_t>(out_end - op)) {
+      return -1;
+    }
+    const uint8_t* match = op - offset;
+    if (offset >= match_length) {
+      memcpy(op, match, match_length);
+      op += match_length;
+    } else {
+      // Overlapping copy repeats the last |offset| bytes.
+      for (size_t i = 0; i < match_length; i++) {
+        *op++ = *match++;
+      }
+    }
+  }
+  return op - out;
+}
+
+}  // namespace carlink
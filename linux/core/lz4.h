@@ -0,0 +1,30 @@
+#ifndef CARLINK_CORE_LZ4_H_
+#define CARLINK_CORE_LZ4_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace carlink {
+
+// LZ4 block format codec (https://github.com/lz4/lz4/blob/dev/doc/
+// lz4_Block_format.md). Output is readable by LZ4_decompress_safe() and
+// vice versa; only the single-block API is provided, the framing is up to
+// the caller.
+
+// Largest compressed size of |length| input bytes.
+constexpr size_t Lz4CompressBound(size_t length) {
+  return length + length / 255 + 16;
+}
+
+// Compresses |length| bytes into |out|, which must hold
+// Lz4CompressBound(length) bytes. Returns the compressed size.
+size_t Lz4Compress(const uint8_t* data, size_t length, uint8_t* out);
+
+// Decompresses a block into |out|. Returns the decompressed size, or -1 if
+// the block is malformed or does not fit in |capacity| bytes.
+int64_t Lz4Decompress(const uint8_t* data, size_t length, uint8_t* out,
+                      size_t capacity);
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_LZ4_H_
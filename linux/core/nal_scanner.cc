@@ -0,0 +1,85 @@
+#include "core/nal_scanner.h"
+
+#include "core/simd.h"
+
+namespace carlink {
+
+size_t FindStartCode(const uint8_t* data, size_t length) {
+  return Simd().find_start_code(data, length);
+}
+
+NalScanner::NalScanner(const uint8_t* data, size_t length)
+    : data_(data), length_(length), position_(FindStartCode(data, length)) {}
+
+bool NalScanner::Next(NalUnit* unit) {
+  if (position_ + 3 >= length_) {
+    return false;
+  }
+  const size_t begin = position_ + 3;
+  const size_t next = FindStartCode(data_ + begin, length_ - begin);
+  size_t end = begin + next;
+  position_ = end;
+  // A NAL unit never ends in a zero byte, so zeros before the next start
+  // code (or the end of the buffer) are padding.
+  while (end > begin && data_[end - 1] == 0) {
+    end--;
+  }
+  unit->data = data_ + begin;
+  unit->size = end - begin;
+  unit->type = data_[begin] & 0x1f;
+  return true;
+}
+
+bool ContainsIdr(const uint8_t* data, size_t length) {
+  NalScanner scanner(data, length);
+  NalUnit unit;
+  while (scanner.Next(&unit)) {
+    if (unit.type == kNalIdr) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::vector<AccessUnitRange> SplitAccessUnits(const uint8_t* data,
+                                              size_t length) {
+  std::vector<AccessUnitRange> units;
+  NalScanner scanner(data, length);
+  NalUnit unit;
+  AccessUnitRange current;
+  bool open = false;
+  bool has_slice = false;
+
+  while (scanner.Next(&unit)) {
+    // Back up over the start code, including a four-byte code's zero.
+    size_t start = unit.data - data - 3;
+    if (start > 0 && data[start - 1] == 0) {
+      start--;
+    }
+
+    const bool slice = unit.type == kNalSlice || unit.type == kNalIdr;
+    // first_mb_in_slice is ue(v), so zero is a single leading 1 bit.
+    const bool first_slice =
+        slice && unit.size > 1 && (unit.data[1] & 0x80) != 0;
+    if (open && has_slice && (!slice || first_slice)) {
+      current.size = start - current.offset;
+      units.push_back(current);
+      open = false;
+    }
+    if (!open) {
+      current = AccessUnitRange();
+      current.offset = start;
+      open = true;
+      has_slice = false;
+    }
+    has_slice = has_slice || slice;
+    current.idr = current.idr || unit.type == kNalIdr;
+  }
+  if (open && has_slice) {
+    current.size = length - current.offset;
+    units.push_back(current);
+  }
+  return units;
+}
+
+}  // namespace carlink
@@ -0,0 +1,64 @@
+#ifndef CARLINK_CORE_NAL_SCANNER_H_
+#define CARLINK_CORE_NAL_SCANNER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace carlink {
+
+enum NalType : uint8_t {
+  kNalSlice = 1,
+  kNalIdr = 5,
+  kNalSei = 6,
+  kNalSps = 7,
+  kNalPps = 8,
+  kNalAud = 9,
+};
+
+struct NalUnit {
+  // First byte after the start code (the NAL header).
+  const uint8_t* data = nullptr;
+  // Bytes up to the next start code, without the zero bytes padding it.
+  size_t size = 0;
+  uint8_t type = 0;
+};
+
+// Returns the offset of the next 00 00 01 start code in [data, data + length),
+// or |length|.
+size_t FindStartCode(const uint8_t* data, size_t length);
+
+// Iterates the NAL units of an Annex-B buffer.
+class NalScanner {
+ public:
+  NalScanner(const uint8_t* data, size_t length);
+
+  // Returns false once the buffer is exhausted.
+  bool Next(NalUnit* unit);
+
+ private:
+  const uint8_t* data_;
+  size_t length_;
+  size_t position_;
+};
+
+// True if the access unit contains an IDR slice.
+bool ContainsIdr(const uint8_t* data, size_t length);
+
+// A byte range of an Annex-B stream holding one picture, start codes
+// included.
+struct AccessUnitRange {
+  size_t offset = 0;
+  size_t size = 0;
+  bool idr = false;
+};
+
+// Splits a raw Annex-B stream into access units. A new unit starts at the
+// first parameter set, SEI or delimiter after a slice, or at a slice with
+// first_mb_in_slice == 0.
+std::vector<AccessUnitRange> SplitAccessUnits(const uint8_t* data,
+                                              size_t length);
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_NAL_SCANNER_H_
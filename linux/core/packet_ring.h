@@ -0,0 +1,120 @@
+#ifndef CARLINK_CORE_PACKET_RING_H_
+#define CARLINK_CORE_PACKET_RING_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace carlink {
+
+// Bounded single-producer/single-consumer queue between the USB thread and
+// a pipeline stage, the native counterpart of PacketRingByteBuffer on
+// Android. Push and pop are lock-free; the mutex is only taken to park and
+// wake a consumer that found the ring empty.
+template <typename T>
+class PacketRing {
+ public:
+  // |capacity| is rounded up to a power of two.
+  explicit PacketRing(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    slots_.resize(size);
+    mask_ = size - 1;
+  }
+
+  PacketRing(const PacketRing&) = delete;
+  PacketRing& operator=(const PacketRing&) = delete;
+
+  size_t capacity() const { return slots_.size(); }
+
+  size_t size() const {
+    return tail_.value.load(std::memory_order_acquire) -
+           head_.value.load(std::memory_order_acquire);
+  }
+
+  // Producer only. Returns false, leaving |item| untouched, when full.
+  bool TryPush(T& item) {
+    const size_t tail = tail_.value.load(std::memory_order_relaxed);
+    if (tail - head_.value.load(std::memory_order_acquire) == slots_.size()) {
+      return false;
+    }
+    slots_[tail & mask_] = std::move(item);
+    tail_.value.store(tail + 1, std::memory_order_release);
+    // Pairs with the fence in WaitPop so either the consumer sees the item
+    // or we see it waiting.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiting_.load(std::memory_order_relaxed)) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      cv_.notify_one();
+    }
+    return true;
+  }
+
+  // Consumer only.
+  bool TryPop(T* item) {
+    const size_t head = head_.value.load(std::memory_order_relaxed);
+    if (head == tail_.value.load(std::memory_order_acquire)) {
+      return false;
+    }
+    *item = std::move(slots_[head & mask_]);
+    slots_[head & mask_] = T();
+    head_.value.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only. Waits up to |timeout| for an item, or until Wake().
+  template <typename Rep, typename Period>
+  bool WaitPop(T* item, std::chrono::duration<Rep, Period> timeout) {
+    if (TryPop(item)) {
+      return true;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    waiting_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    cv_.wait_for(lock, timeout, [this] {
+      return woken_ || head_.value.load(std::memory_order_relaxed) !=
+                           tail_.value.load(std::memory_order_acquire);
+    });
+    waiting_.store(false, std::memory_order_relaxed);
+    woken_ = false;
+    lock.unlock();
+    return TryPop(item);
+  }
+
+  // Releases a consumer blocked in WaitPop, e.g. on shutdown.
+  void Wake() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    woken_ = true;
+    cv_.notify_all();
+  }
+
+ private:
+  std::vector<T> slots_;
+  size_t mask_ = 0;
+
+  // Keeps head and tail 64 bytes apart so producer and consumer never
+  // share a cache line. Padding instead of alignas(64), which C++14 new
+  // does not honour for heap-allocated owners.
+  struct PaddedIndex {
+    std::atomic<size_t> value{0};
+    char padding[64 - sizeof(std::atomic<size_t>)];
+  };
+
+  PaddedIndex head_;
+  PaddedIndex tail_;
+
+  std::atomic<bool> waiting_{false};
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool woken_ = false;
+};
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_PACKET_RING_H_
@@ -0,0 +1,337 @@
+#include "core/pcm_h264.h"
+
+#include <cstring>
+
+#include "core/h264_bitstream.h"
+#include "core/nal_scanner.h"
+
+namespace carlink {
+
+namespace {
+
+constexpr uint32_t kProfileBaseline = 66;
+constexpr uint32_t kLevel = 51;
+// frame_num is 4 bits.
+constexpr uint32_t kLog2MaxFrameNum = 4;
+// mb_type of I_PCM in an I slice.
+constexpr uint32_t kMbTypeIPcm = 25;
+// slice_type 7: I, and every slice of the picture is I.
+constexpr uint32_t kSliceTypeI = 7;
+constexpr int kMbSize = 16;
+constexpr int kMbBytes = 16 * 16 + 2 * 8 * 8;
+
+// nal_ref_idc 3 in the top bits.
+uint8_t NalHeader(NalType type) {
+  return static_cast<uint8_t>(0x60 | type);
+}
+
+}  // namespace
+
+PcmH264Encoder::PcmH264Encoder(int width, int height)
+    : width_(width), height_(height) {}
+
+void PcmH264Encoder::Encode(const VideoFrame& frame, bool idr,
+                            std::vector<uint8_t>* out) {
+  idr = idr || !started_;
+  started_ = true;
+  if (idr) {
+    frame_num_ = 0;
+
+    BitWriter sps;
+    sps.WriteBits(kProfileBaseline, 8);
+    // constraint_set0_flag and constraint_set1_flag: Baseline and Main
+    // decoders both accept it.
+    sps.WriteBits(0xc0, 8);
+    sps.WriteBits(kLevel, 8);
+    sps.WriteUe(0);  // seq_parameter_set_id
+    sps.WriteUe(kLog2MaxFrameNum - 4);
+    sps.WriteUe(2);  // pic_order_cnt_type: output order is decode order
+    sps.WriteUe(1);  // max_num_ref_frames
+    sps.WriteBit(false);  // gaps_in_frame_num_value_allowed_flag
+    sps.WriteUe(width_ / kMbSize - 1);
+    sps.WriteUe(height_ / kMbSize - 1);
+    sps.WriteBit(true);   // frame_mbs_only_flag
+    sps.WriteBit(true);   // direct_8x8_inference_flag
+    sps.WriteBit(false);  // frame_cropping_flag
+    sps.WriteBit(false);  // vui_parameters_present_flag
+    sps.WriteTrailingBits();
+    AppendNalUnit(NalHeader(kNalSps), sps.data(), out);
+
+    BitWriter pps;
+    pps.WriteUe(0);       // pic_parameter_set_id
+    pps.WriteUe(0);       // seq_parameter_set_id
+    pps.WriteBit(false);  // entropy_coding_mode_flag: CAVLC
+    pps.WriteBit(false);  // bottom_field_pic_order_in_frame_present_flag
+    pps.WriteUe(0);       // num_slice_groups_minus1
+    pps.WriteUe(0);       // num_ref_idx_l0_default_active_minus1
+    pps.WriteUe(0);       // num_ref_idx_l1_default_active_minus1
+    pps.WriteBit(false);  // weighted_pred_flag
+    pps.WriteBits(0, 2);  // weighted_bipred_idc
+    pps.WriteSe(0);       // pic_init_qp_minus26
+    pps.WriteSe(0);       // pic_init_qs_minus26
+    pps.WriteSe(0);       // chroma_qp_index_offset
+    pps.WriteBit(true);   // deblocking_filter_control_present_flag
+    pps.WriteBit(false);  // constrained_intra_pred_flag
+    pps.WriteBit(false);  // redundant_pic_cnt_present_flag
+    pps.WriteTrailingBits();
+    AppendNalUnit(NalHeader(kNalPps), pps.data(), out);
+  }
+
+  BitWriter slice;
+  slice.WriteUe(0);  // first_mb_in_slice
+  slice.WriteUe(kSliceTypeI);
+  slice.WriteUe(0);  // pic_parameter_set_id
+  slice.WriteBits(frame_num_, kLog2MaxFrameNum);
+  if (idr) {
+    slice.WriteUe(idr_pic_id_++ & 0xffff);
+    slice.WriteBit(false);  // no_output_of_prior_pics_flag
+    slice.WriteBit(false);  // long_term_reference_flag
+  } else {
+    slice.WriteBit(false);  // adaptive_ref_pic_marking_mode_flag
+  }
+  slice.WriteSe(0);  // slice_qp_delta
+  slice.WriteUe(1);  // disable_deblocking_filter_idc: off
+
+  const int mb_width = width_ / kMbSize;
+  const int mb_height = height_ / kMbSize;
+  for (int mb_y = 0; mb_y < mb_height; mb_y++) {
+    for (int mb_x = 0; mb_x < mb_width; mb_x++) {
+      slice.WriteUe(kMbTypeIPcm);
+      slice.AlignWithZeros();
+      for (int row = 0; row < kMbSize; row++) {
+        slice.WriteBytes(frame.y + (mb_y * kMbSize + row) * frame.y_stride +
+                             mb_x * kMbSize,
+                         kMbSize);
+      }
+      for (const uint8_t* plane : {frame.u, frame.v}) {
+        for (int row = 0; row < kMbSize / 2; row++) {
+          slice.WriteBytes(plane +
+                               (mb_y * kMbSize / 2 + row) * frame.uv_stride +
+                               mb_x * kMbSize / 2,
+                           kMbSize / 2);
+        }
+      }
+    }
+  }
+  slice.WriteTrailingBits();
+  AppendNalUnit(NalHeader(idr ? kNalIdr : kNalSlice), slice.data(), out);
+  frame_num_ = (frame_num_ + 1) % (1u << kLog2MaxFrameNum);
+}
+
+namespace {
+
+class PcmH264Decoder : public VideoDecoder {
+ public:
+  const char* name() const override { return "pcm"; }
+
+  bool Decode(const uint8_t* data, size_t length,
+              const FrameCallback& on_frame) override {
+    NalScanner scanner(data, length);
+    NalUnit unit;
+    while (scanner.Next(&unit)) {
+      if (unit.size < 1) {
+        continue;
+      }
+      const std::vector<uint8_t> rbsp = UnescapeRbsp(unit.data + 1,
+                                                     unit.size - 1);
+      bool ok = true;
+      switch (unit.type) {
+        case kNalSps:
+          ok = ParseSps(rbsp);
+          break;
+        case kNalPps:
+          ok = ParsePps(rbsp);
+          break;
+        case kNalIdr:
+        case kNalSlice:
+          ok = DecodeSlice(rbsp, unit.type == kNalIdr,
+                           (unit.data[0] >> 5) & 3);
+          break;
+        default:
+          break;
+      }
+      if (!ok) {
+        return false;
+      }
+      if (decoded_mbs_ == mb_width_ * mb_height_ && decoded_mbs_ > 0) {
+        decoded_mbs_ = 0;
+        VideoFrame frame;
+        frame.width = mb_width_ * kMbSize;
+        frame.height = mb_height_ * kMbSize;
+        frame.y = y_.data();
+        frame.u = u_.data();
+        frame.v = v_.data();
+        frame.y_stride = frame.width;
+        frame.uv_stride = frame.width / 2;
+        on_frame(frame);
+      }
+    }
+    return true;
+  }
+
+  void Reset() override {
+    have_sps_ = false;
+    have_pps_ = false;
+    decoded_mbs_ = 0;
+  }
+
+ private:
+  bool ParseSps(const std::vector<uint8_t>& rbsp) {
+    BitReader reader(rbsp.data(), rbsp.size());
+    const uint32_t profile = reader.ReadBits(8);
+    reader.ReadBits(16);  // constraint flags, level_idc
+    reader.ReadUe();      // seq_parameter_set_id
+    if (profile != kProfileBaseline) {
+      return false;
+    }
+    log2_max_frame_num_ = reader.ReadUe() + 4;
+    poc_type_ = reader.ReadUe();
+    if (poc_type_ == 0) {
+      log2_max_poc_lsb_ = reader.ReadUe() + 4;
+    } else if (poc_type_ != 2) {
+      return false;
+    }
+    reader.ReadUe();   // max_num_ref_frames
+    reader.ReadBit();  // gaps_in_frame_num_value_allowed_flag
+    const uint32_t mb_width = reader.ReadUe() + 1;
+    const uint32_t mb_height = reader.ReadUe() + 1;
+    const bool frame_mbs_only = reader.ReadBit();
+    reader.ReadBit();  // direct_8x8_inference_flag
+    const bool cropping = reader.ReadBit();
+    if (reader.overrun() || !frame_mbs_only || cropping || mb_width > 512 ||
+        mb_height > 512) {
+      return false;
+    }
+    mb_width_ = static_cast<int>(mb_width);
+    mb_height_ = static_cast<int>(mb_height);
+    const size_t luma = mb_width_ * mb_height_ * kMbSize * kMbSize;
+    y_.resize(luma);
+    u_.resize(luma / 4);
+    v_.resize(luma / 4);
+    decoded_mbs_ = 0;
+    have_sps_ = true;
+    return true;
+  }
+
+  bool ParsePps(const std::vector<uint8_t>& rbsp) {
+    BitReader reader(rbsp.data(), rbsp.size());
+    reader.ReadUe();  // pic_parameter_set_id
+    reader.ReadUe();  // seq_parameter_set_id
+    const bool cabac = reader.ReadBit();
+    bottom_field_poc_ = reader.ReadBit();
+    const uint32_t slice_groups = reader.ReadUe();
+    reader.ReadUe();  // num_ref_idx_l0_default_active_minus1
+    reader.ReadUe();  // num_ref_idx_l1_default_active_minus1
+    reader.ReadBit();     // weighted_pred_flag
+    reader.ReadBits(2);   // weighted_bipred_idc
+    reader.ReadSe();      // pic_init_qp_minus26
+    reader.ReadSe();      // pic_init_qs_minus26
+    reader.ReadSe();      // chroma_qp_index_offset
+    deblocking_control_ = reader.ReadBit();
+    reader.ReadBit();  // constrained_intra_pred_flag
+    redundant_pic_cnt_ = reader.ReadBit();
+    if (reader.overrun() || cabac || slice_groups != 0) {
+      return false;
+    }
+    have_pps_ = true;
+    return true;
+  }
+
+  bool DecodeSlice(const std::vector<uint8_t>& rbsp, bool idr,
+                   int nal_ref_idc) {
+    if (!have_sps_ || !have_pps_) {
+      return false;
+    }
+    BitReader reader(rbsp.data(), rbsp.size());
+    const uint32_t first_mb = reader.ReadUe();
+    const uint32_t slice_type = reader.ReadUe();
+    reader.ReadUe();  // pic_parameter_set_id
+    reader.ReadBits(log2_max_frame_num_);  // frame_num
+    if (idr) {
+      reader.ReadUe();  // idr_pic_id
+    }
+    if (poc_type_ == 0) {
+      reader.ReadBits(log2_max_poc_lsb_);
+      if (bottom_field_poc_) {
+        reader.ReadSe();
+      }
+    }
+    if (redundant_pic_cnt_) {
+      reader.ReadUe();
+    }
+    if (nal_ref_idc != 0) {
+      if (idr) {
+        reader.ReadBits(2);
+      } else if (reader.ReadBit()) {
+        // Memory management operations never come from PcmH264Encoder.
+        return false;
+      }
+    }
+    reader.ReadSe();  // slice_qp_delta
+    if (deblocking_control_ && reader.ReadUe() != 1) {
+      reader.ReadSe();  // slice_alpha_c0_offset_div2
+      reader.ReadSe();  // slice_beta_offset_div2
+    }
+    const int total = mb_width_ * mb_height_;
+    if (reader.overrun() || (slice_type != 2 && slice_type != 7) ||
+        static_cast<int>(first_mb) >= total) {
+      return false;
+    }
+
+    int mb = static_cast<int>(first_mb);
+    // The trailing bits are one 0x80 byte once the last sample is read.
+    while (mb < total && reader.bits_left() > 8) {
+      if (reader.ReadUe() != kMbTypeIPcm) {
+        return false;
+      }
+      reader.SkipToByteBoundary();
+      const uint8_t* samples = reader.ReadBytes(kMbBytes);
+      if (samples == nullptr) {
+        return false;
+      }
+      const int mb_x = mb % mb_width_;
+      const int mb_y = mb / mb_width_;
+      const int stride = mb_width_ * kMbSize;
+      for (int row = 0; row < kMbSize; row++) {
+        memcpy(&y_[(mb_y * kMbSize + row) * stride + mb_x * kMbSize],
+               samples, kMbSize);
+        samples += kMbSize;
+      }
+      for (std::vector<uint8_t>* plane : {&u_, &v_}) {
+        for (int row = 0; row < kMbSize / 2; row++) {
+          memcpy(&(*plane)[(mb_y * kMbSize / 2 + row) * stride / 2 +
+                           mb_x * kMbSize / 2],
+                 samples, kMbSize / 2);
+          samples += kMbSize / 2;
+        }
+      }
+      mb++;
+      decoded_mbs_++;
+    }
+    return true;
+  }
+
+  bool have_sps_ = false;
+  bool have_pps_ = false;
+  int mb_width_ = 0;
+  int mb_height_ = 0;
+  int log2_max_frame_num_ = 4;
+  uint32_t poc_type_ = 0;
+  int log2_max_poc_lsb_ = 4;
+  bool bottom_field_poc_ = false;
+  bool deblocking_control_ = false;
+  bool redundant_pic_cnt_ = false;
+  // Macroblocks of the current picture so far.
+  int decoded_mbs_ = 0;
+  std::vector<uint8_t> y_;
+  std::vector<uint8_t> u_;
+  std::vector<uint8_t> v_;
+};
+
+}  // namespace
+
+std::unique_ptr<VideoDecoder> CreatePcmH264Decoder() {
+  return std::unique_ptr<VideoDecoder>(new PcmH264Decoder());
+}
+
+}  // namespace carlink
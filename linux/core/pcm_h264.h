@@ -0,0 +1,45 @@
+#ifndef CARLINK_CORE_PCM_H264_H_
+#define CARLINK_CORE_PCM_H264_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "core/video_decoder.h"
+
+namespace carlink {
+
+// A minimal H.264 encoder: Baseline profile, every macroblock I_PCM, so
+// the samples go through uncompressed and any decoder reproduces them
+// exactly. About 1.5 bytes per pixel, which is fine for the synthetic
+// streams of the latency harness and tests; no codec library needed.
+//
+// The first picture, and any with |idr| set, is an IDR preceded by SPS and
+// PPS; the rest are non-IDR I slices with frame_num counting up.
+class PcmH264Encoder {
+ public:
+  // Multiples of 16.
+  PcmH264Encoder(int width, int height);
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+
+  // Appends one Annex-B access unit for the I420 |frame| to |out|.
+  void Encode(const VideoFrame& frame, bool idr, std::vector<uint8_t>* out);
+
+ private:
+  const int width_;
+  const int height_;
+  bool started_ = false;
+  uint32_t frame_num_ = 0;
+  uint32_t idr_pic_id_ = 0;
+};
+
+// Decodes what PcmH264Encoder writes (all-I_PCM CAVLC slices) and nothing
+// else; other streams are decode errors. Lets the pipeline run end to end
+// with real pictures on builds without FFmpeg.
+std::unique_ptr<VideoDecoder> CreatePcmH264Decoder();
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_PCM_H264_H_
@@ -0,0 +1,197 @@
+#include "core/protocol.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace carlink {
+
+namespace {
+
+const char kAirplayModel[] = "Magic-Car-Link-1.00";
+
+}  // namespace
+
+HeaderStatus DecodeHeader(const uint8_t* data, MessageHeader* header) {
+  if (ReadU32(data) != kMessageMagic) {
+    return HeaderStatus::kBadMagic;
+  }
+  const uint32_t length = ReadU32(data + 4);
+  const uint32_t type = ReadU32(data + 8);
+  if (ReadU32(data + 12) != ~type) {
+    return HeaderStatus::kBadTypeCheck;
+  }
+  if (length > kMaxPayloadSize) {
+    return HeaderStatus::kBadLength;
+  }
+  header->length = length;
+  header->type = type;
+  return HeaderStatus::kOk;
+}
+
+void EncodeHeader(uint32_t type, uint32_t length, uint8_t* out) {
+  WriteU32(out, kMessageMagic);
+  WriteU32(out + 4, length);
+  WriteU32(out + 8, type);
+  WriteU32(out + 12, ~type);
+}
+
+const char* MessageTypeName(uint32_t type) {
+  switch (static_cast<MessageType>(type)) {
+    case MessageType::kOpen:
+      return "Open";
+    case MessageType::kPlugged:
+      return "Plugged";
+    case MessageType::kPhase:
+      return "Phase";
+    case MessageType::kUnplugged:
+      return "Unplugged";
+    case MessageType::kTouch:
+      return "Touch";
+    case MessageType::kVideoData:
+      return "VideoData";
+    case MessageType::kAudioData:
+      return "AudioData";
+    case MessageType::kCommand:
+      return "Command";
+    case MessageType::kLogoType:
+      return "LogoType";
+    case MessageType::kBluetoothAddress:
+      return "BluetoothAddress";
+    case MessageType::kBluetoothPin:
+      return "BluetoothPIN";
+    case MessageType::kBluetoothDeviceName:
+      return "BluetoothDeviceName";
+    case MessageType::kWifiDeviceName:
+      return "WifiDeviceName";
+    case MessageType::kDisconnectPhone:
+      return "DisconnectPhone";
+    case MessageType::kBluetoothPairedList:
+      return "BluetoothPairedList";
+    case MessageType::kManufacturerInfo:
+      return "ManufacturerInfo";
+    case MessageType::kCloseDongle:
+      return "CloseDongle";
+    case MessageType::kMultiTouch:
+      return "MultiTouch";
+    case MessageType::kHiCarLink:
+      return "HiCarLink";
+    case MessageType::kBoxSettings:
+      return "BoxSettings";
+    case MessageType::kMediaData:
+      return "MediaData";
+    case MessageType::kSendFile:
+      return "SendFile";
+    case MessageType::kHeartBeat:
+      return "HeartBeat";
+    case MessageType::kSoftwareVersion:
+      return "SoftwareVersion";
+  }
+  return "Unknown";
+}
+
+EncodedMessage EncodeMessage(MessageType type, const uint8_t* payload,
+                             size_t length) {
+  EncodedMessage message(kHeaderSize + length);
+  EncodeHeader(static_cast<uint32_t>(type), static_cast<uint32_t>(length),
+               message.data());
+  if (length > 0) {
+    memcpy(message.data() + kHeaderSize, payload, length);
+  }
+  return message;
+}
+
+EncodedMessage EncodeCommand(Command command) {
+  uint8_t payload[4];
+  WriteU32(payload, static_cast<uint32_t>(command));
+  return EncodeMessage(MessageType::kCommand, payload, sizeof(payload));
+}
+
+EncodedMessage EncodeHeartBeat() {
+  return EncodeMessage(MessageType::kHeartBeat, nullptr, 0);
+}
+
+EncodedMessage EncodeOpen(const DongleConfig& config) {
+  uint8_t payload[28];
+  WriteU32(payload, config.width);
+  WriteU32(payload + 4, config.height);
+  WriteU32(payload + 8, config.fps);
+  WriteU32(payload + 12, config.format);
+  WriteU32(payload + 16, config.packet_max);
+  WriteU32(payload + 20, config.ibox_version);
+  WriteU32(payload + 24, config.phone_work_mode);
+  return EncodeMessage(MessageType::kOpen, payload, sizeof(payload));
+}
+
+EncodedMessage EncodeBoxSettings(const DongleConfig& config,
+                                 int64_t sync_time) {
+  char json[256];
+  const int length = snprintf(
+      json, sizeof(json),
+      "{\"mediaDelay\":%u,\"syncTime\":%lld,\"androidAutoSizeW\":%u,"
+      "\"androidAutoSizeH\":%u}",
+      config.media_delay, static_cast<long long>(sync_time), config.width,
+      config.height);
+  return EncodeMessage(MessageType::kBoxSettings,
+                       reinterpret_cast<const uint8_t*>(json), length);
+}
+
+EncodedMessage EncodeSendFile(const std::string& path, const uint8_t* content,
+                              size_t length) {
+  // name length (including NUL), name, content length, content.
+  const size_t name_length = path.size() + 1;
+  std::vector<uint8_t> payload(4 + name_length + 4 + length);
+  uint8_t* out = payload.data();
+  WriteU32(out, static_cast<uint32_t>(name_length));
+  memcpy(out + 4, path.c_str(), name_length);
+  WriteU32(out + 4 + name_length, static_cast<uint32_t>(length));
+  if (length > 0) {
+    memcpy(out + 8 + name_length, content, length);
+  }
+  return EncodeMessage(MessageType::kSendFile, payload.data(), payload.size());
+}
+
+EncodedMessage EncodeSendNumber(const std::string& path, uint32_t number) {
+  uint8_t content[4];
+  WriteU32(content, number);
+  return EncodeSendFile(path, content, sizeof(content));
+}
+
+EncodedMessage EncodeSendString(const std::string& path,
+                                const std::string& value) {
+  return EncodeSendFile(path, reinterpret_cast<const uint8_t*>(value.data()),
+                        value.size());
+}
+
+std::vector<EncodedMessage> BuildInitMessages(const DongleConfig& config,
+                                              int64_t sync_time) {
+  const std::string airplay_config =
+      std::string("oem_icon_visible=") + (config.oem_icon_visible ? "1" : "0") +
+      "\nname=" + config.box_name + "\nmodel=" + kAirplayModel +
+      "\noem_icon_path=/etc/oem_icon.png\noem_icon_label=" + config.box_name +
+      "\n";
+
+  std::vector<EncodedMessage> messages;
+  messages.push_back(EncodeSendNumber("/tmp/screen_dpi", config.dpi));
+  messages.push_back(EncodeOpen(config));
+  messages.push_back(EncodeSendNumber("/tmp/night_mode", config.night_mode));
+  messages.push_back(
+      EncodeSendNumber("/tmp/hand_drive_mode", config.right_hand_drive));
+  messages.push_back(EncodeSendNumber("/tmp/charge_mode", 1));
+  messages.push_back(EncodeSendString("/etc/box_name", config.box_name));
+  messages.push_back(EncodeSendString("/etc/airplay.conf", airplay_config));
+  messages.push_back(EncodeBoxSettings(config, sync_time));
+  messages.push_back(EncodeCommand(Command::kWifiEnable));
+  messages.push_back(
+      EncodeCommand(config.wifi_5ghz ? Command::kWifi5g : Command::kWifi24g));
+  messages.push_back(
+      EncodeCommand(config.box_mic ? Command::kBoxMic : Command::kMic));
+  messages.push_back(EncodeCommand(config.audio_transfer_mode
+                                       ? Command::kAudioTransferOn
+                                       : Command::kAudioTransferOff));
+  if (config.android_work_mode) {
+    messages.push_back(EncodeSendNumber("/etc/android_work_mode", 1));
+  }
+  return messages;
+}
+
+}  // namespace carlink
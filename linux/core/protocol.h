@@ -0,0 +1,154 @@
+#ifndef CARLINK_CORE_PROTOCOL_H_
+#define CARLINK_CORE_PROTOCOL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace carlink {
+
+// CPC200 message types, see lib/common.dart.
+enum class MessageType : uint32_t {
+  kOpen = 0x01,
+  kPlugged = 0x02,
+  kPhase = 0x03,
+  kUnplugged = 0x04,
+  kTouch = 0x05,
+  kVideoData = 0x06,
+  kAudioData = 0x07,
+  kCommand = 0x08,
+  kLogoType = 0x09,
+  kBluetoothAddress = 0x0a,
+  kBluetoothPin = 0x0c,
+  kBluetoothDeviceName = 0x0d,
+  kWifiDeviceName = 0x0e,
+  kDisconnectPhone = 0x0f,
+  kBluetoothPairedList = 0x12,
+  kManufacturerInfo = 0x14,
+  kCloseDongle = 0x15,
+  kMultiTouch = 0x17,
+  kHiCarLink = 0x18,
+  kBoxSettings = 0x19,
+  kMediaData = 0x2a,
+  kSendFile = 0x99,
+  kHeartBeat = 0xaa,
+  kSoftwareVersion = 0xcc,
+};
+
+// Command IDs carried by kCommand messages (CommandMapping in Dart).
+enum class Command : uint32_t {
+  kInvalid = 0,
+  kStartRecordAudio = 1,
+  kStopRecordAudio = 2,
+  kRequestHostUi = 3,
+  kSiri = 5,
+  kMic = 7,
+  kFrame = 12,
+  kBoxMic = 15,
+  kEnableNightMode = 16,
+  kDisableNightMode = 17,
+  kAudioTransferOn = 22,
+  kAudioTransferOff = 23,
+  kWifi24g = 24,
+  kWifi5g = 25,
+  kRequestVideoFocus = 500,
+  kReleaseVideoFocus = 501,
+  kWifiEnable = 1000,
+  kAutoConnectEnable = 1001,
+  kWifiConnect = 1002,
+  kWifiConnected = 1009,
+  kWifiDisconnected = 1010,
+  kWifiPair = 1012,
+};
+
+constexpr uint32_t kMessageMagic = 0x55aa55aa;
+constexpr size_t kHeaderSize = 16;
+
+// Upper bound for a single payload. Anything larger is treated as a corrupt
+// header and triggers a resync.
+constexpr uint32_t kMaxPayloadSize = 8 * 1024 * 1024;
+
+// Byte offset of the H.264 stream inside a VideoData payload.
+constexpr size_t kVideoDataHeaderSize = 20;
+
+struct MessageHeader {
+  uint32_t length = 0;
+  uint32_t type = 0;
+};
+
+enum class HeaderStatus {
+  kOk,
+  kBadMagic,
+  kBadTypeCheck,
+  kBadLength,
+};
+
+inline uint32_t ReadU32(const uint8_t* data) {
+  return static_cast<uint32_t>(data[0]) |
+         static_cast<uint32_t>(data[1]) << 8 |
+         static_cast<uint32_t>(data[2]) << 16 |
+         static_cast<uint32_t>(data[3]) << 24;
+}
+
+inline void WriteU32(uint8_t* data, uint32_t value) {
+  data[0] = value & 0xff;
+  data[1] = (value >> 8) & 0xff;
+  data[2] = (value >> 16) & 0xff;
+  data[3] = (value >> 24) & 0xff;
+}
+
+// Decodes the 16-byte header at |data|.
+HeaderStatus DecodeHeader(const uint8_t* data, MessageHeader* header);
+
+// Writes the 16-byte header for a |type| message with |length| payload bytes.
+void EncodeHeader(uint32_t type, uint32_t length, uint8_t* out);
+
+// Returns the Dart enum name of |type|, or "Unknown".
+const char* MessageTypeName(uint32_t type);
+
+// Session parameters sent during the handshake (DongleConfig in Dart).
+struct DongleConfig {
+  uint32_t width = 1920;
+  uint32_t height = 720;
+  uint32_t fps = 60;
+  uint32_t dpi = 160;
+  uint32_t format = 5;
+  uint32_t ibox_version = 2;
+  uint32_t packet_max = 49152;
+  uint32_t phone_work_mode = 2;
+  bool night_mode = false;
+  bool right_hand_drive = false;
+  uint32_t media_delay = 300;
+  bool audio_transfer_mode = true;
+  bool wifi_5ghz = true;
+  bool box_mic = false;
+  bool android_work_mode = false;
+  bool oem_icon_visible = false;
+  std::string box_name = "carlink";
+};
+
+// An encoded outbound message: header followed by payload.
+using EncodedMessage = std::vector<uint8_t>;
+
+EncodedMessage EncodeMessage(MessageType type, const uint8_t* payload,
+                             size_t length);
+EncodedMessage EncodeCommand(Command command);
+EncodedMessage EncodeHeartBeat();
+EncodedMessage EncodeOpen(const DongleConfig& config);
+EncodedMessage EncodeBoxSettings(const DongleConfig& config,
+                                 int64_t sync_time);
+EncodedMessage EncodeSendFile(const std::string& path, const uint8_t* content,
+                              size_t length);
+EncodedMessage EncodeSendNumber(const std::string& path, uint32_t number);
+EncodedMessage EncodeSendString(const std::string& path,
+                                const std::string& value);
+
+// The messages sent after opening the dongle, in the same order as
+// Dongle.start() in lib/driver/dongle_driver.dart.
+std::vector<EncodedMessage> BuildInitMessages(const DongleConfig& config,
+                                              int64_t sync_time);
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_PROTOCOL_H_
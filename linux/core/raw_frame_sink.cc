@@ -0,0 +1,48 @@
+#include "core/raw_frame_sink.h"
+
+#include "core/clock.h"
+#include "core/log.h"
+
+namespace carlink {
+
+RawFrameSink::~RawFrameSink() {
+  if (file_ != nullptr) {
+    fclose(file_);
+  }
+}
+
+bool RawFrameSink::Open(const std::string& path) {
+  file_ = fopen(path.c_str(), "wb");
+  if (file_ == nullptr) {
+    Log(LogLevel::kError, "[VIDEO] cannot open %s", path.c_str());
+    return false;
+  }
+  return true;
+}
+
+void RawFrameSink::WritePlane(const uint8_t* data, int stride, int width,
+                              int height) {
+  size_t written = 0;
+  for (int y = 0; y < height; y++) {
+    written += fwrite(data + static_cast<size_t>(y) * stride, 1, width, file_);
+  }
+  bytes_written_.fetch_add(written, std::memory_order_relaxed);
+}
+
+void RawFrameSink::OnFrame(const VideoFrame& frame) {
+  if (file_ == nullptr) {
+    return;
+  }
+  const int chroma_width = (frame.width + 1) / 2;
+  const int chroma_height = (frame.height + 1) / 2;
+  WritePlane(frame.y, frame.y_stride, frame.width, frame.height);
+  WritePlane(frame.u, frame.uv_stride, chroma_width, chroma_height);
+  WritePlane(frame.v, frame.uv_stride, chroma_width, chroma_height);
+  frames_written_.fetch_add(1, std::memory_order_relaxed);
+  if (frame.latency != nullptr) {
+    frame.latency->Record(FrameLatency::kTotal, frame.timestamps->arrival_ns,
+                          MonotonicNanos());
+  }
+}
+
+}  // namespace carlink
@@ -0,0 +1,45 @@
+#ifndef CARLINK_CORE_RAW_FRAME_SINK_H_
+#define CARLINK_CORE_RAW_FRAME_SINK_H_
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "core/video_pipeline.h"
+
+namespace carlink {
+
+// Writes decoded pictures as tightly packed I420, one after another, the
+// format ffplay reads with `-f rawvideo -pixel_format yuv420p`.
+class RawFrameSink : public FrameSink {
+ public:
+  RawFrameSink() = default;
+  ~RawFrameSink() override;
+
+  RawFrameSink(const RawFrameSink&) = delete;
+  RawFrameSink& operator=(const RawFrameSink&) = delete;
+
+  bool Open(const std::string& path);
+
+  // Decoder thread.
+  void OnFrame(const VideoFrame& frame) override;
+
+  uint64_t frames_written() const {
+    return frames_written_.load(std::memory_order_relaxed);
+  }
+  uint64_t bytes_written() const {
+    return bytes_written_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  void WritePlane(const uint8_t* data, int stride, int width, int height);
+
+  FILE* file_ = nullptr;
+  std::atomic<uint64_t> frames_written_{0};
+  std::atomic<uint64_t> bytes_written_{0};
+};
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_RAW_FRAME_SINK_H_
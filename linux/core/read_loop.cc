@@ -0,0 +1,141 @@
+#include "core/read_loop.h"
+
+#include "core/log.h"
+#include "core/thread_stats.h"
+#include "core/trace.h"
+
+namespace carlink {
+
+ReadLoop::ReadLoop(Transport* transport, std::shared_ptr<BufferPool> pool,
+                   Demuxer::MessageCallback on_message, ErrorCallback on_error,
+                   size_t transfer_size, Clock* clock)
+    : transport_(transport),
+      clock_(clock),
+      demuxer_(std::move(pool), std::move(on_message), clock),
+      on_error_(std::move(on_error)),
+      transfer_(transfer_size) {}
+
+ReadLoop::~ReadLoop() {
+  Stop();
+}
+
+void ReadLoop::Start(int timeout_ms) {
+  if (running_.exchange(true)) {
+    return;
+  }
+  if (thread_.joinable()) {
+    // A previous loop ended on its own.
+    thread_.join();
+  }
+  demuxer_.Reset();
+  timeout_ms_ = timeout_ms;
+  thread_ = std::thread(&ReadLoop::Run, this);
+}
+
+void ReadLoop::StartPolled(int timeout_ms) {
+  if (running_.exchange(true)) {
+    return;
+  }
+  demuxer_.Reset();
+  timeout_ms_ = timeout_ms;
+  last_inbound_ns_ = clock_->Now();
+}
+
+void ReadLoop::Poll() {
+  if (!running_.load(std::memory_order_acquire)) {
+    return;
+  }
+  std::string error;
+  int result;
+  while ((result = ReadOnce(0, &error)) > 0) {
+  }
+  if (result < 0 && running_.exchange(false) && on_error_) {
+    on_error_(error);
+  }
+}
+
+void ReadLoop::Stop() {
+  running_.store(false, std::memory_order_release);
+  if (!thread_.joinable()) {
+    return;
+  }
+  if (thread_.get_id() == std::this_thread::get_id()) {
+    // Stopped from a callback on the loop thread, which exits on its own.
+    thread_.detach();
+  } else {
+    thread_.join();
+  }
+}
+
+void ReadLoop::Run() {
+  SetCurrentThreadName("carlink-usb");
+  Log(LogLevel::kInfo, "[USB] Read loop started (%s)", transport_->name());
+
+  const int poll_ms = timeout_ms_ > 0 && timeout_ms_ < kPollMs ? timeout_ms_
+                                                               : kPollMs;
+  last_inbound_ns_ = clock_->Now();
+  std::string error;
+
+  while (running_.load(std::memory_order_acquire)) {
+    if (ReadOnce(poll_ms, &error) < 0) {
+      break;
+    }
+  }
+
+  Log(LogLevel::kInfo, "[USB] Read loop stopped");
+
+  // Only a loop that died on its own reports an error; Stop() is silent.
+  if (running_.exchange(false) && on_error_) {
+    on_error_(error);
+  }
+}
+
+int ReadLoop::ReadOnce(int poll_ms, std::string* error) {
+  const int result =
+      transport_->Read(transfer_.data(), transfer_.size(), poll_ms);
+  const int64_t now = clock_->Now();
+  if (result < 0) {
+    *error = "USBReadError readingLoopError error, return actualLength=" +
+             std::to_string(result);
+    return -1;
+  }
+  if (result == 0) {
+    if (timeout_ms_ > 0 &&
+        now - last_inbound_ns_ >= static_cast<int64_t>(timeout_ms_) * 1000000) {
+      *error = "USBReadError timeout after " + std::to_string(timeout_ms_) +
+               "ms";
+      return -1;
+    }
+    return 0;
+  }
+
+  last_inbound_ns_ = now;
+  transfers_.fetch_add(1, std::memory_order_relaxed);
+  bytes_.fetch_add(result, std::memory_order_relaxed);
+  TraceInstant("usb.transfer_in", result);
+  if (recorder_ != nullptr) {
+    recorder_->Record(FlightRecorder::Kind::kTransfer, 0, result);
+  }
+  {
+    TraceScope trace("demux", result);
+    demuxer_.Feed(transfer_.data(), result, now);
+  }
+
+  const Demuxer::Stats& stats = demuxer_.stats();
+  messages_.store(stats.messages, std::memory_order_relaxed);
+  resyncs_.store(stats.resyncs, std::memory_order_relaxed);
+  skipped_bytes_.store(stats.skipped_bytes, std::memory_order_relaxed);
+  return result;
+}
+
+ReadLoop::Stats ReadLoop::stats() const {
+  Stats stats;
+  stats.transfers = transfers_.load(std::memory_order_relaxed);
+  stats.bytes = bytes_.load(std::memory_order_relaxed);
+  stats.messages = messages_.load(std::memory_order_relaxed);
+  stats.resyncs = resyncs_.load(std::memory_order_relaxed);
+  stats.skipped_bytes = skipped_bytes_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+}  // namespace carlink
@@ -0,0 +1,98 @@
+#ifndef CARLINK_CORE_READ_LOOP_H_
+#define CARLINK_CORE_READ_LOOP_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "core/buffer_pool.h"
+#include "core/clock.h"
+#include "core/demuxer.h"
+#include "core/flight_recorder.h"
+#include "core/transport.h"
+
+namespace carlink {
+
+// Reads the transport in large transfers on a dedicated thread and feeds
+// the bytes to a Demuxer. Messages and the terminal error are delivered on
+// that thread.
+//
+// A polled loop (StartPolled()) has no thread: Poll() drains whatever the
+// transport has right now on the caller's thread.
+class ReadLoop {
+ public:
+  using ErrorCallback = std::function<void(const std::string& error)>;
+
+  struct Stats {
+    uint64_t transfers = 0;
+    uint64_t bytes = 0;
+    uint64_t messages = 0;
+    uint64_t resyncs = 0;
+    uint64_t skipped_bytes = 0;
+  };
+
+  // Large enough to drain a whole video access unit per transfer.
+  static constexpr size_t kDefaultTransferSize = 512 * 1024;
+
+  ReadLoop(Transport* transport, std::shared_ptr<BufferPool> pool,
+           Demuxer::MessageCallback on_message, ErrorCallback on_error,
+           size_t transfer_size = kDefaultTransferSize,
+           Clock* clock = SystemClock::Get());
+  ~ReadLoop();
+
+  ReadLoop(const ReadLoop&) = delete;
+  ReadLoop& operator=(const ReadLoop&) = delete;
+
+  // Fails with "USBReadError ..." after |timeout_ms| without inbound bytes,
+  // like the Android read loop.
+  void Start(int timeout_ms);
+  void StartPolled(int timeout_ms);
+  void Stop();
+
+  // Polled loops only. Reads until the transport has nothing more, with
+  // arrival times from the clock.
+  void Poll();
+
+  bool running() const { return running_.load(std::memory_order_acquire); }
+
+  // Records each transfer. Call before starting; may be null.
+  void set_flight_recorder(FlightRecorder* recorder) { recorder_ = recorder; }
+
+  Stats stats() const;
+
+ private:
+  // Slice a blocking read is split into, so Stop() returns promptly.
+  static constexpr int kPollMs = 100;
+
+  void Run();
+  // One transfer. Returns its size, 0 on timeout, or -1 with |error| set
+  // once the loop must end.
+  int ReadOnce(int poll_ms, std::string* error);
+
+  Transport* transport_;
+  Clock* clock_;
+  Demuxer demuxer_;
+  ErrorCallback on_error_;
+  FlightRecorder* recorder_ = nullptr;
+  std::vector<uint8_t> transfer_;
+  int timeout_ms_ = 0;
+  // Loop thread, or Poll().
+  int64_t last_inbound_ns_ = 0;
+
+  std::thread thread_;
+  std::atomic<bool> running_{false};
+
+  std::atomic<uint64_t> transfers_{0};
+  std::atomic<uint64_t> bytes_{0};
+  std::atomic<uint64_t> messages_{0};
+  std::atomic<uint64_t> resyncs_{0};
+  std::atomic<uint64_t> skipped_bytes_{0};
+};
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_READ_LOOP_H_
@@ -0,0 +1,22 @@
+#include "core/replay.h"
+
+#include <algorithm>
+
+namespace carlink {
+
+void RunVirtualTime(Session* session, SimulatedDongle* dongle,
+                    VirtualClock* clock, int64_t end_ns,
+                    const std::atomic<bool>* stop) {
+  while (!session->failed() && !dongle->replay_done() &&
+         (stop == nullptr || !stop->load(std::memory_order_relaxed))) {
+    const int64_t next =
+        std::min(dongle->NextEventNs(), session->NextDeadlineNs());
+    if (next == INT64_MAX || (end_ns != 0 && next > end_ns)) {
+      break;
+    }
+    clock->AdvanceTo(next);
+    session->Poll();
+  }
+}
+
+}  // namespace carlink
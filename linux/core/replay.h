@@ -0,0 +1,26 @@
+#ifndef CARLINK_CORE_REPLAY_H_
+#define CARLINK_CORE_REPLAY_H_
+
+#include <atomic>
+#include <cstdint>
+
+#include "core/clock.h"
+#include "core/session.h"
+#include "core/simulated_dongle.h"
+
+namespace carlink {
+
+// Drives a started, polled |session| whose transport is |dongle|, jumping
+// |clock| straight to the next message or timer. A run costs only the CPU
+// time of the work, and everything timing-dependent (audio buffering,
+// heartbeats, timeouts) happens identically on every run.
+//
+// Returns once the dongle's replay is over, the session failed, |clock|
+// reached |end_ns| (0 for no limit) or |stop| was set.
+void RunVirtualTime(Session* session, SimulatedDongle* dongle,
+                    VirtualClock* clock, int64_t end_ns,
+                    const std::atomic<bool>* stop = nullptr);
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_REPLAY_H_
@@ -0,0 +1,80 @@
+#include "core/rgba_frame_buffer.h"
+
+#include <algorithm>
+
+#include "core/clock.h"
+#include "core/trace.h"
+#include "core/yuv.h"
+
+namespace carlink {
+
+RgbaFrameBuffer::RgbaFrameBuffer(std::function<void()> on_published,
+                                 WorkerPool* pool)
+    : on_published_(std::move(on_published)), pool_(pool) {}
+
+void RgbaFrameBuffer::OnFrame(const VideoFrame& frame) {
+  TraceScope trace("video.convert", frame.width * frame.height);
+  RgbaFrame& slot = slots_[back_];
+  slot.width = frame.width;
+  slot.height = frame.height;
+  slot.pixels.resize(static_cast<size_t>(frame.width) * frame.height * 4);
+  const size_t stride = static_cast<size_t>(frame.width) * 4;
+  const int bands =
+      pool_ == nullptr
+          ? 1
+          : std::min(pool_->threads() + 1, frame.height / kMinBandRows);
+  if (bands > 1) {
+    // Even band boundaries, so chroma rows line up.
+    const int rows = ((frame.height + bands - 1) / bands + 1) & ~1;
+    pool_->ParallelFor(WorkerPool::kRealTime, bands, [&](int band) {
+      I420ToRgbaRows(frame, slot.pixels.data(), stride, band * rows,
+                     std::min(frame.height, (band + 1) * rows));
+    });
+  } else {
+    I420ToRgba(frame, slot.pixels.data(), stride);
+  }
+  slot.sequence = published_.load(std::memory_order_relaxed) + 1;
+
+  // The slot belongs to the presenter once published: keep what the
+  // publish stage needs.
+  FrameLatency* const latency = frame.latency;
+  slot.latency = latency;
+  slot.timestamps = frame.timestamps ? *frame.timestamps : FrameTimestamps();
+  const int64_t convert_end_ns = MonotonicNanos();
+  if (latency != nullptr) {
+    latency->Record(FrameLatency::kConvert, slot.timestamps.decode_end_ns,
+                    convert_end_ns);
+  }
+  slot.timestamps.convert_end_ns = convert_end_ns;
+  slot.timestamps.published_ns = convert_end_ns;
+
+  back_ = middle_.exchange(back_ | kDirty, std::memory_order_acq_rel) &
+          kIndexMask;
+  published_.fetch_add(1, std::memory_order_relaxed);
+
+  if (on_published_) {
+    on_published_();
+  }
+  if (latency != nullptr) {
+    latency->Record(FrameLatency::kPublish, convert_end_ns, MonotonicNanos());
+  }
+}
+
+const RgbaFrame* RgbaFrameBuffer::AcquireLatest() {
+  if (middle_.load(std::memory_order_relaxed) & kDirty) {
+    front_ = middle_.exchange(front_, std::memory_order_acq_rel) & kIndexMask;
+    const RgbaFrame& frame = slots_[front_];
+    TraceInstant("video.present", frame.sequence);
+    if (frame.latency != nullptr) {
+      const int64_t now = MonotonicNanos();
+      frame.latency->Record(FrameLatency::kPresent,
+                            frame.timestamps.published_ns, now);
+      frame.latency->Record(FrameLatency::kTotal, frame.timestamps.arrival_ns,
+                            now);
+    }
+  }
+  const RgbaFrame& frame = slots_[front_];
+  return frame.sequence == 0 ? nullptr : &frame;
+}
+
+}  // namespace carlink
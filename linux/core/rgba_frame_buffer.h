@@ -0,0 +1,71 @@
+#ifndef CARLINK_CORE_RGBA_FRAME_BUFFER_H_
+#define CARLINK_CORE_RGBA_FRAME_BUFFER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "core/frame_latency.h"
+#include "core/video_decoder.h"
+#include "core/video_pipeline.h"
+#include "core/worker_pool.h"
+
+namespace carlink {
+
+struct RgbaFrame {
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint64_t sequence = 0;
+  std::vector<uint8_t> pixels;
+  // Where the presenter records the last stages, null if nobody measures.
+  FrameTimestamps timestamps;
+  FrameLatency* latency = nullptr;
+};
+
+// Triple-buffered RGBA frames between the decoder thread and the thread
+// presenting them (the raster thread for a Flutter pixel buffer texture).
+// Neither side ever blocks: the decoder overwrites a frame nobody has
+// picked up yet, and the presenter keeps showing its frame until a newer
+// one is published.
+//
+// With a |pool|, frames are converted in bands of rows on its real-time
+// lane, the decoder thread taking one of them.
+class RgbaFrameBuffer : public FrameSink {
+ public:
+  // |on_published| runs on the decoder thread after each frame. |pool| is
+  // not owned and must outlive the buffer.
+  explicit RgbaFrameBuffer(std::function<void()> on_published = nullptr,
+                           WorkerPool* pool = nullptr);
+
+  // FrameSink, decoder thread.
+  void OnFrame(const VideoFrame& frame) override;
+
+  // Presenter thread. Returns the newest published frame, or nullptr if
+  // none was published yet. Stays valid until the next call. The first
+  // call to see a frame records its kPresent and kTotal latency.
+  const RgbaFrame* AcquireLatest();
+
+  uint64_t frames_published() const {
+    return published_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  // Fewer rows are not worth a handoff to another thread.
+  static constexpr int kMinBandRows = 64;
+  static constexpr uint32_t kDirty = 0x4;
+  static constexpr uint32_t kIndexMask = 0x3;
+
+  RgbaFrame slots_[3];
+  uint32_t back_ = 0;
+  std::atomic<uint32_t> middle_{1};
+  uint32_t front_ = 2;
+
+  std::function<void()> on_published_;
+  WorkerPool* const pool_;
+  std::atomic<uint64_t> published_{0};
+};
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_RGBA_FRAME_BUFFER_H_
@@ -0,0 +1,325 @@
+#include "core/session.h"
+
+#include <algorithm>
+#include <ctime>
+
+#include "core/audio.h"
+#include "core/log.h"
+#include "core/thread_stats.h"
+#include "core/trace.h"
+
+namespace carlink {
+
+namespace {
+
+// The watchdog looks at the inbound silence this often.
+constexpr int64_t kWatchdogTickNs = 1000000000;
+
+FlightRecorder::Options FlightRecorderOptions(const SessionOptions& options) {
+  FlightRecorder::Options recorder;
+  recorder.directory = options.flight_recorder_dir;
+  return recorder;
+}
+
+}  // namespace
+
+Session::Session(std::unique_ptr<Transport> transport,
+                 const SessionOptions& options,
+                 std::unique_ptr<VideoDecoder> decoder, FrameSink* frame_sink,
+                 std::unique_ptr<AudioSink> audio_sink,
+                 SessionListener* listener)
+    : transport_(std::move(transport)),
+      options_(options),
+      clock_(options.clock != nullptr ? options.clock : SystemClock::Get()),
+      listener_(listener),
+      flight_recorder_(FlightRecorderOptions(options), clock_),
+      pool_(BufferPool::Create()),
+      video_(std::move(decoder), frame_sink),
+      audio_(audio_sink ? new AudioEngine(std::move(audio_sink)) : nullptr),
+      read_loop_(transport_.get(), pool_,
+                 [this](Message message) { OnMessage(std::move(message)); },
+                 [this](const std::string& error) { OnReadError(error); },
+                 ReadLoop::kDefaultTransferSize, clock_) {
+  video_.SetKeyframeRequestHandler(
+      [this] { Send(EncodeCommand(Command::kFrame)); });
+  video_.set_flight_recorder(&flight_recorder_);
+  read_loop_.set_flight_recorder(&flight_recorder_);
+}
+
+Session::~Session() {
+  Stop();
+}
+
+bool Session::Start() {
+  {
+    std::lock_guard<std::mutex> lock(watchdog_mutex_);
+    if (running_) {
+      return true;
+    }
+    running_ = true;
+  }
+  failed_.store(false);
+
+  if (options_.polled) {
+    video_.StartPolled();
+  } else if (options_.worker_pool != nullptr) {
+    video_.StartOnPool(options_.worker_pool);
+  } else {
+    video_.Start();
+  }
+  if (audio_ && !(options_.polled ? audio_->StartPolled(clock_->Now())
+                                  : audio_->Start())) {
+    Log(LogLevel::kWarning, "[AUDIO] %s sink failed to open, audio disabled",
+        audio_->sink_name());
+    audio_.reset();
+  }
+  last_inbound_ns_.store(clock_->Now());
+  if (options_.polled) {
+    read_loop_.StartPolled(options_.read_timeout_ms);
+  } else {
+    read_loop_.Start(options_.read_timeout_ms);
+  }
+
+  Log(LogLevel::kInfo, "Dongle initializing");
+  for (const EncodedMessage& message :
+       BuildInitMessages(options_.config, time(nullptr))) {
+    if (!Send(message)) {
+      Fail("ReadingLoopError init send failed");
+      return false;
+    }
+  }
+
+  last_inbound_ns_.store(clock_->Now());
+  last_ping_ns_ = 0;
+  consecutive_failures_ = 0;
+  watchdog_alive_ = true;
+  if (options_.polled) {
+    next_watchdog_ns_ = clock_->Now() + kWatchdogTickNs;
+  } else {
+    watchdog_ = std::thread(&Session::RunWatchdog, this);
+  }
+  return true;
+}
+
+void Session::Poll() {
+  read_loop_.Poll();
+  const int64_t now = clock_->Now();
+  if (watchdog_alive_ && now >= next_watchdog_ns_) {
+    next_watchdog_ns_ = now + kWatchdogTickNs;
+    watchdog_alive_ = CheckHeartbeat(now);
+  }
+  if (audio_) {
+    audio_->RenderUntil(now);
+  }
+}
+
+int64_t Session::NextDeadlineNs() const {
+  int64_t deadline = watchdog_alive_ ? next_watchdog_ns_ : INT64_MAX;
+  if (audio_) {
+    deadline = std::min(deadline, audio_->next_period_ns());
+  }
+  return deadline;
+}
+
+void Session::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(watchdog_mutex_);
+    if (!running_) {
+      return;
+    }
+    running_ = false;
+  }
+  watchdog_cv_.notify_all();
+  if (watchdog_.joinable()) {
+    watchdog_.join();
+  }
+  transport_->Close();
+  read_loop_.Stop();
+  video_.Stop();
+  if (audio_) {
+    audio_->Stop();
+  }
+}
+
+bool Session::Send(const EncodedMessage& message) {
+  TraceScope trace("usb.transfer_out", message.size());
+  int written;
+  {
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    written = transport_->Write(message.data(), message.size(),
+                                options_.write_timeout_ms);
+  }
+  if (written != static_cast<int>(message.size())) {
+    counters_.Add(kSendFailures);
+    return false;
+  }
+  flight_recorder_.RecordOutbound(message.data(), message.size());
+  counters_.Add(kMessagesOut);
+  counters_.Add(kBytesOut, written);
+  if (capture_ != nullptr) {
+    capture_->RecordEncoded(CaptureDirection::kOutbound, message.data(),
+                            message.size(), clock_->Now());
+  }
+  return true;
+}
+
+void Session::OnMessage(Message message) {
+  // Any valid inbound message counts as "alive".
+  last_inbound_ns_.store(message.arrival_ns, std::memory_order_relaxed);
+  counters_.Add(kMessagesIn);
+  counters_.Add(kBytesIn, kHeaderSize + message.payload.size());
+  flight_recorder_.Record(FlightRecorder::Kind::kInbound, message.header.type,
+                          message.payload.size());
+  if (flight_recorder_.CounterSnapshotDue()) {
+    RecordCounters();
+  }
+  if (capture_ != nullptr) {
+    capture_->Record(CaptureDirection::kInbound, message.header.type,
+                     message.payload.data(), message.payload.size(),
+                     message.arrival_ns);
+  }
+
+  const auto type = static_cast<MessageType>(message.header.type);
+  if (type == MessageType::kVideoData) {
+    video_.Push(std::move(message));
+    return;
+  }
+  if (type == MessageType::kAudioData) {
+    AudioPacket packet;
+    if (ParseAudioPacket(message.payload.data(), message.payload.size(),
+                         &packet) &&
+        packet.sample_count > 0) {
+      if (audio_) {
+        audio_->Push(packet);
+      }
+      return;
+    }
+  }
+
+  if (type == MessageType::kOpen) {
+    Send(EncodeCommand(Command::kWifiConnect));
+  }
+  if (listener_ != nullptr) {
+    listener_->OnMessage(message);
+  }
+}
+
+void Session::OnReadError(const std::string& error) {
+  {
+    // Stop() closes the transport under the read loop, which may see that
+    // before its own stop.
+    std::lock_guard<std::mutex> lock(watchdog_mutex_);
+    if (!running_) {
+      return;
+    }
+  }
+  Fail("ReadingLoopError " + error);
+}
+
+void Session::Fail(const std::string& error) {
+  if (failed_.exchange(true)) {
+    return;
+  }
+  Log(LogLevel::kError, "%s", error.c_str());
+  RecordCounters();
+  flight_recorder_.DumpAsync(error);
+  if (listener_ != nullptr) {
+    listener_->OnError(error);
+  }
+}
+
+void Session::RunWatchdog() {
+  SetCurrentThreadName("carlink-watch");
+  Log(LogLevel::kInfo,
+      "Heartbeat watchdog started (tick 1s, interval %ds, grace %ds)",
+      options_.heartbeat_interval_ms / 1000,
+      options_.heartbeat_grace_ms / 1000);
+
+  std::unique_lock<std::mutex> lock(watchdog_mutex_);
+  while (running_) {
+    watchdog_cv_.wait_for(lock, std::chrono::nanoseconds(kWatchdogTickNs));
+    if (!running_) {
+      break;
+    }
+    lock.unlock();
+    const bool alive = CheckHeartbeat(clock_->Now());
+    lock.lock();
+    if (!alive) {
+      break;
+    }
+  }
+
+  Log(LogLevel::kInfo, "Heartbeat watchdog stopped");
+}
+
+bool Session::CheckHeartbeat(int64_t now) {
+  // Keeps the history going through inbound silence.
+  if (flight_recorder_.CounterSnapshotDue()) {
+    RecordCounters();
+  }
+  const int64_t interval_ns =
+      static_cast<int64_t>(options_.heartbeat_interval_ms) * 1000000;
+  const int64_t grace_ns =
+      static_cast<int64_t>(options_.heartbeat_grace_ms) * 1000000;
+  const int64_t since_inbound =
+      now - last_inbound_ns_.load(std::memory_order_relaxed);
+  if (since_inbound >= interval_ns && now - last_ping_ns_ >= interval_ns) {
+    last_ping_ns_ = now;
+    const bool sent = Send(EncodeHeartBeat());
+    counters_.Add(kHeartbeats);
+    consecutive_failures_ = sent ? 0 : consecutive_failures_ + 1;
+  }
+
+  if (since_inbound >= grace_ns || consecutive_failures_ >= 2) {
+    Log(LogLevel::kError,
+        "Heartbeat watchdog: DEAD (idle=%llds, hbSendFails=%d)",
+        static_cast<long long>(since_inbound / 1000000000),
+        consecutive_failures_);
+    Fail("HeartbeatTimeout");
+    return false;
+  }
+  return true;
+}
+
+void Session::RecordCounters() {
+  const Stats stats = this->stats();
+  flight_recorder_.RecordCounter(FlightRecorder::kMessagesIn,
+                                 stats.messages_in);
+  flight_recorder_.RecordCounter(FlightRecorder::kBytesIn, stats.bytes_in);
+  flight_recorder_.RecordCounter(FlightRecorder::kMessagesOut,
+                                 stats.messages_out);
+  flight_recorder_.RecordCounter(FlightRecorder::kSendFailures,
+                                 stats.send_failures);
+  flight_recorder_.RecordCounter(FlightRecorder::kResyncs, stats.read.resyncs);
+  flight_recorder_.RecordCounter(FlightRecorder::kFramesDecoded,
+                                 stats.video.frames_decoded);
+  flight_recorder_.RecordCounter(FlightRecorder::kFramesDropped,
+                                 stats.video.frames_dropped);
+  flight_recorder_.RecordCounter(FlightRecorder::kDecodeErrors,
+                                 stats.video.decode_errors);
+  flight_recorder_.RecordCounter(FlightRecorder::kAudioUnderruns,
+                                 stats.audio.underruns);
+  flight_recorder_.RecordCounter(FlightRecorder::kAudioOverflowFrames,
+                                 stats.audio.overflow_frames);
+}
+
+Session::Stats Session::stats() const {
+  uint64_t counters[kCounterCount];
+  counters_.Snapshot(counters);
+  Stats stats;
+  stats.messages_in = counters[kMessagesIn];
+  stats.messages_out = counters[kMessagesOut];
+  stats.bytes_in = counters[kBytesIn];
+  stats.bytes_out = counters[kBytesOut];
+  stats.send_failures = counters[kSendFailures];
+  stats.heartbeats = counters[kHeartbeats];
+  stats.read = read_loop_.stats();
+  stats.video = video_.stats();
+  if (audio_) {
+    stats.audio = audio_->stats();
+  }
+  stats.pool = pool_->stats();
+  return stats;
+}
+
+}  // namespace carlink
@@ -0,0 +1,173 @@
+#ifndef CARLINK_CORE_SESSION_H_
+#define CARLINK_CORE_SESSION_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "core/audio_engine.h"
+#include "core/buffer_pool.h"
+#include "core/capture_writer.h"
+#include "core/clock.h"
+#include "core/flight_recorder.h"
+#include "core/protocol.h"
+#include "core/read_loop.h"
+#include "core/transport.h"
+#include "core/video_pipeline.h"
+#include "core/worker_pool.h"
+
+namespace carlink {
+
+// Session events, delivered on the read thread (errors also on the
+// heartbeat thread).
+class SessionListener {
+ public:
+  virtual ~SessionListener() = default;
+
+  // Every inbound message except VideoData and PCM AudioData, which the
+  // session consumes itself.
+  virtual void OnMessage(const Message& message) {}
+
+  // The session is dead: "HeartbeatTimeout" or "ReadingLoopError ...".
+  // Reported once.
+  virtual void OnError(const std::string& error) {}
+};
+
+struct SessionOptions {
+  DongleConfig config;
+  int read_timeout_ms = 30000;
+  int write_timeout_ms = 1000;
+  // Ping after this much inbound silence, fail after the grace period.
+  int heartbeat_interval_ms = 2000;
+  int heartbeat_grace_ms = 6000;
+  // Arrival stamps and timers; null for the system clock.
+  Clock* clock = nullptr;
+  // Where the flight recorder dumps the last seconds on HeartbeatTimeout,
+  // ReadingLoopError or a decoder error; empty to not dump.
+  std::string flight_recorder_dir;
+  // No threads of the session's own: the caller drives reads, decoding,
+  // the watchdog and audio playout through Poll(), typically against a
+  // VirtualClock so a replay behaves identically on every run. The
+  // transport's Read() must return at once with a zero timeout.
+  bool polled = false;
+  // Decodes video on this pool, shared with the process's other sessions,
+  // instead of on a thread of the session's own. Not owned; must outlive
+  // the session. Ignored when polled.
+  WorkerPool* worker_pool = nullptr;
+};
+
+// A complete dongle session without any UI: the handshake and heartbeat
+// watchdog of lib/driver/dongle_driver.dart, plus native video decoding and
+// audio playout.
+//
+// Sessions share no state, so one process can drive several dongles, each
+// with its own transport, demuxer, decoder, audio engine and stats; give
+// them a common SessionOptions::worker_pool to bound the decoding threads.
+class Session {
+ public:
+  struct Stats {
+    uint64_t messages_in = 0;
+    uint64_t messages_out = 0;
+    uint64_t bytes_in = 0;
+    uint64_t bytes_out = 0;
+    uint64_t send_failures = 0;
+    uint64_t heartbeats = 0;
+    ReadLoop::Stats read;
+    VideoPipeline::Stats video;
+    AudioEngine::Stats audio;
+    BufferPool::Stats pool;
+  };
+
+  // |frame_sink| and |audio_sink| may be null to drop decoded pictures or
+  // skip audio playout.
+  Session(std::unique_ptr<Transport> transport, const SessionOptions& options,
+          std::unique_ptr<VideoDecoder> decoder, FrameSink* frame_sink,
+          std::unique_ptr<AudioSink> audio_sink, SessionListener* listener);
+  ~Session();
+
+  Session(const Session&) = delete;
+  Session& operator=(const Session&) = delete;
+
+  // Starts the pipelines and read loop, then sends the init messages.
+  bool Start();
+  void Stop();
+
+  // Thread-safe.
+  bool Send(const EncodedMessage& message);
+
+  // Polled sessions only: handles everything due by the clock's current
+  // time, inbound messages first, then the watchdog and audio playout.
+  void Poll();
+  // Clock time the next timer is due, for the caller to advance to.
+  int64_t NextDeadlineNs() const;
+
+  // Records every message in both directions to |capture| while it is
+  // open. Call before Start(); |capture| must outlive the session.
+  void set_capture(CaptureWriter* capture) { capture_ = capture; }
+
+  // OnError() was reported.
+  bool failed() const { return failed_.load(); }
+
+  VideoPipeline& video() { return video_; }
+  FlightRecorder& flight_recorder() { return flight_recorder_; }
+  AudioEngine* audio() { return audio_.get(); }
+
+  Stats stats() const;
+
+ private:
+  void OnMessage(Message message);
+  void OnReadError(const std::string& error);
+  void Fail(const std::string& error);
+  // Snapshots the counters into the flight recorder, once a second.
+  void RecordCounters();
+  void RunWatchdog();
+  // Watchdog thread, or Poll(). Returns false once the session failed.
+  bool CheckHeartbeat(int64_t now);
+
+  std::unique_ptr<Transport> transport_;
+  const SessionOptions options_;
+  Clock* clock_;
+  SessionListener* listener_;
+
+  FlightRecorder flight_recorder_;
+  std::shared_ptr<BufferPool> pool_;
+  VideoPipeline video_;
+  std::unique_ptr<AudioEngine> audio_;
+  ReadLoop read_loop_;
+
+  std::mutex send_mutex_;
+  CaptureWriter* capture_ = nullptr;
+
+  std::thread watchdog_;
+  std::mutex watchdog_mutex_;
+  std::condition_variable watchdog_cv_;
+  bool running_ = false;
+  // Watchdog thread, or Poll().
+  int64_t last_ping_ns_ = 0;
+  int consecutive_failures_ = 0;
+  int64_t next_watchdog_ns_ = 0;
+  bool watchdog_alive_ = false;
+
+  std::atomic<bool> failed_{false};
+  std::atomic<int64_t> last_inbound_ns_{0};
+
+  // Inbound on the read thread, outbound on any.
+  enum Counter {
+    kMessagesIn,
+    kMessagesOut,
+    kBytesIn,
+    kBytesOut,
+    kSendFailures,
+    kHeartbeats,
+    kCounterCount,
+  };
+  ShardedCounters counters_{kCounterCount};
+};
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_SESSION_H_
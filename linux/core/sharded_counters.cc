@@ -0,0 +1,121 @@
+#include "core/sharded_counters.h"
+
+#include <algorithm>
+
+namespace carlink {
+
+namespace {
+
+// 64 bytes of counters on each side of a thread's copy. Padding instead of
+// alignas(64), which C++14 new does not honour.
+constexpr size_t kPadding = 64 / sizeof(std::atomic<uint64_t>);
+
+std::atomic<uint64_t> g_next_id{1};
+
+}  // namespace
+
+struct ShardedCounters::Shard {
+  explicit Shard(size_t count)
+      : storage(new std::atomic<uint64_t>[count + 2 * kPadding]()),
+        values(storage.get() + kPadding) {}
+
+  std::unique_ptr<std::atomic<uint64_t>[]> storage;
+  std::atomic<uint64_t>* const values;
+  // The owner exited; its values are final.
+  std::atomic<bool> retired{false};
+};
+
+ShardedCounters::ShardedCounters(size_t count)
+    : count_(count),
+      id_(g_next_id.fetch_add(1, std::memory_order_relaxed)),
+      retired_(count) {}
+
+ShardedCounters::~ShardedCounters() = default;
+
+std::atomic<uint64_t>* ShardedCounters::Local() {
+  struct Entry {
+    uint64_t id;
+    std::shared_ptr<Shard> shard;
+  };
+  struct Cache {
+    ~Cache() {
+      for (const Entry& entry : entries) {
+        entry.shard->retired.store(true, std::memory_order_release);
+      }
+    }
+
+    // Most recently used first.
+    std::vector<Entry> entries;
+  };
+  static thread_local Cache cache;
+
+  std::vector<Entry>& entries = cache.entries;
+  if (!entries.empty() && entries.front().id == id_) {
+    return entries.front().shard->values;
+  }
+  auto it =
+      std::find_if(entries.begin(), entries.end(),
+                   [this](const Entry& entry) { return entry.id == id_; });
+  if (it == entries.end()) {
+    // Drop copies whose counters were destroyed; only this cache holds
+    // them.
+    entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                 [](const Entry& entry) {
+                                   return entry.shard.use_count() == 1;
+                                 }),
+                  entries.end());
+    Entry entry{id_, std::make_shared<Shard>(count_)};
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      shards_.push_back(entry.shard);
+    }
+    entries.insert(entries.begin(), std::move(entry));
+  } else {
+    std::rotate(entries.begin(), it, it + 1);
+  }
+  return entries.front().shard->values;
+}
+
+void ShardedCounters::Collect() const {
+  auto retired = std::remove_if(
+      shards_.begin(), shards_.end(),
+      [this](const std::shared_ptr<Shard>& shard) {
+        if (!shard->retired.load(std::memory_order_acquire)) {
+          return false;
+        }
+        for (size_t i = 0; i < count_; i++) {
+          retired_[i] += shard->values[i].load(std::memory_order_relaxed);
+        }
+        return true;
+      });
+  shards_.erase(retired, shards_.end());
+}
+
+uint64_t ShardedCounters::Get(size_t counter) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Collect();
+  uint64_t total = retired_[counter];
+  for (const std::shared_ptr<Shard>& shard : shards_) {
+    total += shard->values[counter].load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+void ShardedCounters::Snapshot(uint64_t* out) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Collect();
+  std::copy(retired_.begin(), retired_.end(), out);
+  for (const std::shared_ptr<Shard>& shard : shards_) {
+    for (size_t i = 0; i < count_; i++) {
+      out[i] += shard->values[i].load(std::memory_order_relaxed);
+    }
+  }
+}
+
+size_t ShardedCounters::threads() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Collect();
+  return shards_.size();
+}
+
+}  // namespace carlink
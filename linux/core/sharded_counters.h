@@ -0,0 +1,64 @@
+#ifndef CARLINK_CORE_SHARDED_COUNTERS_H_
+#define CARLINK_CORE_SHARDED_COUNTERS_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace carlink {
+
+// A fixed set of uint64 counters that several threads bump without
+// contending: each writing thread gets its own copy, padded so no two
+// threads share a cache line, and a read sums the copies. A bump is a
+// relaxed load and store on memory only its thread writes; no locked
+// instruction and no cache line ping-pong between the read loop, the
+// decoder and the main thread.
+//
+// Reads are for stats: each counter is exact once its writers are quiet,
+// and never goes backwards.
+class ShardedCounters {
+ public:
+  explicit ShardedCounters(size_t count);
+  ~ShardedCounters();
+
+  ShardedCounters(const ShardedCounters&) = delete;
+  ShardedCounters& operator=(const ShardedCounters&) = delete;
+
+  // Any thread. The first call from a thread registers its copy.
+  void Add(size_t counter, uint64_t delta = 1) {
+    std::atomic<uint64_t>& value = Local()[counter];
+    value.store(value.load(std::memory_order_relaxed) + delta,
+                std::memory_order_relaxed);
+  }
+
+  // Any thread. Sums every thread's copy.
+  uint64_t Get(size_t counter) const;
+  // All counters at once, |out| sized to count().
+  void Snapshot(uint64_t* out) const;
+
+  size_t count() const { return count_; }
+  // Threads currently holding a copy.
+  size_t threads() const;
+
+ private:
+  struct Shard;
+
+  // This thread's copy of the values.
+  std::atomic<uint64_t>* Local();
+  // Folds copies of exited threads into |retired_|. Needs |mutex_|.
+  void Collect() const;
+
+  const size_t count_;
+  const uint64_t id_;
+  mutable std::mutex mutex_;
+  mutable std::vector<std::shared_ptr<Shard>> shards_;
+  // Totals of threads that exited.
+  mutable std::vector<uint64_t> retired_;
+};
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_SHARDED_COUNTERS_H_
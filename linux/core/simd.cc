@@ -0,0 +1,127 @@
+#include "core/simd.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#if defined(CARLINK_HAVE_NEON)
+#include <sys/auxv.h>
+#endif
+
+#include "core/log.h"
+
+namespace carlink {
+
+namespace {
+
+constexpr SimdLevel kLevels[] = {SimdLevel::kScalar, SimdLevel::kSse41,
+                                 SimdLevel::kAvx2, SimdLevel::kNeon};
+
+// cpuid on x86, through the compiler runtime, which also checks that the
+// kernel saves the AVX registers; hwcaps on ARM.
+bool CpuSupports(SimdLevel level) {
+  switch (level) {
+    case SimdLevel::kScalar:
+      return true;
+#if defined(CARLINK_HAVE_X86_SIMD)
+    case SimdLevel::kSse41:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("sse4.1");
+    case SimdLevel::kAvx2:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx2");
+#endif
+#if defined(CARLINK_HAVE_NEON)
+    case SimdLevel::kNeon:
+#if defined(__aarch64__)
+      // HWCAP_ASIMD
+      return (getauxval(AT_HWCAP) & (1 << 1)) != 0;
+#else
+      // HWCAP_NEON
+      return (getauxval(AT_HWCAP) & (1 << 12)) != 0;
+#endif
+#endif
+    default:
+      return false;
+  }
+}
+
+const SimdKernels* Choose() {
+  const std::vector<SimdLevel> supported = SupportedSimdLevels();
+  SimdLevel chosen = supported.back();
+  std::string names;
+  for (SimdLevel level : supported) {
+    names += names.empty() ? "" : " ";
+    names += SimdLevelName(level);
+  }
+
+  const char* requested = getenv("CARLINK_SIMD");
+  if (requested != nullptr && requested[0] != '\0') {
+    bool found = false;
+    for (SimdLevel level : supported) {
+      if (strcmp(requested, SimdLevelName(level)) == 0) {
+        chosen = level;
+        found = true;
+      }
+    }
+    if (!found) {
+      Log(LogLevel::kWarning, "[SIMD] CARLINK_SIMD=%s not supported here",
+          requested);
+    }
+  }
+  Log(LogLevel::kInfo, "[SIMD] using %s kernels (supported: %s)",
+      SimdLevelName(chosen), names.c_str());
+  return GetSimdKernels(chosen);
+}
+
+}  // namespace
+
+const char* SimdLevelName(SimdLevel level) {
+  switch (level) {
+    case SimdLevel::kScalar:
+      return "scalar";
+    case SimdLevel::kSse41:
+      return "sse4.1";
+    case SimdLevel::kAvx2:
+      return "avx2";
+    case SimdLevel::kNeon:
+      return "neon";
+  }
+  return "unknown";
+}
+
+const SimdKernels* GetSimdKernels(SimdLevel level) {
+  switch (level) {
+    case SimdLevel::kScalar:
+      return ScalarKernels();
+#if defined(CARLINK_HAVE_X86_SIMD)
+    case SimdLevel::kSse41:
+      return Sse41Kernels();
+    case SimdLevel::kAvx2:
+      return Avx2Kernels();
+#endif
+#if defined(CARLINK_HAVE_NEON)
+    case SimdLevel::kNeon:
+      return NeonKernels();
+#endif
+    default:
+      return nullptr;
+  }
+}
+
+std::vector<SimdLevel> SupportedSimdLevels() {
+  std::vector<SimdLevel> levels;
+  for (SimdLevel level : kLevels) {
+    if (GetSimdKernels(level) != nullptr && CpuSupports(level)) {
+      levels.push_back(level);
+    }
+  }
+  return levels;
+}
+
+const SimdKernels& Simd() {
+  static const SimdKernels* kernels = Choose();
+  return *kernels;
+}
+
+}  // namespace carlink
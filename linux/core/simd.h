@@ -0,0 +1,63 @@
+#ifndef CARLINK_CORE_SIMD_H_
+#define CARLINK_CORE_SIMD_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace carlink {
+
+// Instruction sets the hot loops have variants for, worst to best.
+enum class SimdLevel {
+  kScalar,
+  kSse41,
+  kAvx2,
+  kNeon,
+};
+
+const char* SimdLevelName(SimdLevel level);
+
+// One variant of every vectorized kernel. All variants produce exactly
+// what the scalar one does.
+struct SimdKernels {
+  SimdLevel level;
+
+  // Offset of the first 00 00 01, or |length|.
+  size_t (*find_start_code)(const uint8_t* data, size_t length);
+  // Offset of the first aa 55 aa 55 message magic, or |length|.
+  size_t (*find_magic)(const uint8_t* data, size_t length);
+  // One row of BT.601 limited range I420 to RGBA; |u| and |v| hold
+  // (width + 1) / 2 samples.
+  void (*i420_to_rgba_row)(const uint8_t* y, const uint8_t* u,
+                           const uint8_t* v, uint8_t* dst, int width);
+  // Linear interpolation over |count| interleaved stereo frames, the first
+  // being the one before the packet: writes a frame for every |position|
+  // below (count - 1) << 16, advancing by |step| (16.16), and returns how
+  // many. count must stay below 32768.
+  size_t (*resample_stereo)(const int16_t* frames, size_t count,
+                            uint32_t position, uint32_t step, int16_t* out);
+  // dst[i] = saturate(dst[i] + src[i] * gain / 256).
+  void (*mix_samples)(int16_t* dst, const int16_t* src, size_t count,
+                      int gain);
+};
+
+// Levels this CPU and build can run, scalar first.
+std::vector<SimdLevel> SupportedSimdLevels();
+
+// The kernels for |level|, or null if this build has none.
+const SimdKernels* GetSimdKernels(SimdLevel level);
+
+// The best supported kernels, chosen and logged on first use. Setting
+// CARLINK_SIMD to a level name (scalar, sse4.1, avx2, neon) caps the
+// choice, for comparing variants on one machine.
+const SimdKernels& Simd();
+
+// Per-level tables, defined only where the build compiles that level.
+const SimdKernels* ScalarKernels();
+const SimdKernels* Sse41Kernels();
+const SimdKernels* Avx2Kernels();
+const SimdKernels* NeonKernels();
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_SIMD_H_
@@ -0,0 +1,230 @@
+// AVX2 kernels. Built with -mavx2 and only called after the CPU was
+// checked, so nothing here may be inline code shared with other files.
+
+#include <immintrin.h>
+
+#include <cstring>
+
+#include "core/simd.h"
+
+namespace carlink {
+
+namespace {
+
+inline __m256i Load(const void* p) {
+  return _mm256_loadu_si256(static_cast<const __m256i*>(p));
+}
+
+inline void Store(void* p, __m256i value) {
+  _mm256_storeu_si256(static_cast<__m256i*>(p), value);
+}
+
+// Both searches skip 64 bytes at a time on their rarer byte, 01 or the
+// magic's first aa 55 pair, and check the rest only in blocks that have it.
+size_t FindStartCode(const uint8_t* data, size_t length) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi8(1);
+  size_t i = 0;
+  while (i + 66 <= length) {
+    const __m256i ones =
+        _mm256_or_si256(_mm256_cmpeq_epi8(Load(data + i + 2), one),
+                        _mm256_cmpeq_epi8(Load(data + i + 34), one));
+    if (_mm256_testz_si256(ones, ones)) {
+      i += 64;
+      continue;
+    }
+    for (int half = 0; half < 2; half++, i += 32) {
+      const __m256i hit = _mm256_and_si256(
+          _mm256_and_si256(_mm256_cmpeq_epi8(Load(data + i), zero),
+                           _mm256_cmpeq_epi8(Load(data + i + 1), zero)),
+          _mm256_cmpeq_epi8(Load(data + i + 2), one));
+      const uint32_t mask = _mm256_movemask_epi8(hit);
+      if (mask != 0) {
+        return i + __builtin_ctz(mask);
+      }
+    }
+  }
+  return i + ScalarKernels()->find_start_code(data + i, length - i);
+}
+
+size_t FindMagic(const uint8_t* data, size_t length) {
+  const __m256i aa = _mm256_set1_epi8(static_cast<char>(0xaa));
+  const __m256i x55 = _mm256_set1_epi8(0x55);
+  size_t i = 0;
+  while (i + 67 <= length) {
+    const __m256i pairs = _mm256_or_si256(
+        _mm256_and_si256(_mm256_cmpeq_epi8(Load(data + i), aa),
+                         _mm256_cmpeq_epi8(Load(data + i + 1), x55)),
+        _mm256_and_si256(_mm256_cmpeq_epi8(Load(data + i + 32), aa),
+                         _mm256_cmpeq_epi8(Load(data + i + 33), x55)));
+    if (_mm256_testz_si256(pairs, pairs)) {
+      i += 64;
+      continue;
+    }
+    for (int half = 0; half < 2; half++, i += 32) {
+      const __m256i hit = _mm256_and_si256(
+          _mm256_and_si256(_mm256_cmpeq_epi8(Load(data + i), aa),
+                           _mm256_cmpeq_epi8(Load(data + i + 1), x55)),
+          _mm256_and_si256(_mm256_cmpeq_epi8(Load(data + i + 2), aa),
+                           _mm256_cmpeq_epi8(Load(data + i + 3), x55)));
+      const uint32_t mask = _mm256_movemask_epi8(hit);
+      if (mask != 0) {
+        return i + __builtin_ctz(mask);
+      }
+    }
+  }
+  return i + ScalarKernels()->find_magic(data + i, length - i);
+}
+
+// BT.601 for eight pixels of 32-bit lanes; |d| and |e| are U and V less
+// 128.
+inline void YuvToRgb(__m256i y, __m256i d, __m256i e, __m256i* r,
+                     __m256i* g, __m256i* b) {
+  const __m256i c = _mm256_add_epi32(
+      _mm256_mullo_epi32(_mm256_sub_epi32(y, _mm256_set1_epi32(16)),
+                         _mm256_set1_epi32(298)),
+      _mm256_set1_epi32(128));
+  *r = _mm256_srai_epi32(
+      _mm256_add_epi32(c, _mm256_mullo_epi32(e, _mm256_set1_epi32(409))), 8);
+  *g = _mm256_srai_epi32(
+      _mm256_sub_epi32(
+          _mm256_sub_epi32(c, _mm256_mullo_epi32(d, _mm256_set1_epi32(100))),
+          _mm256_mullo_epi32(e, _mm256_set1_epi32(208))),
+      8);
+  *b = _mm256_srai_epi32(
+      _mm256_add_epi32(c, _mm256_mullo_epi32(d, _mm256_set1_epi32(516))), 8);
+}
+
+// The saturating packs work within 128-bit halves; put the 64-bit quarters
+// back in order after them.
+inline __m256i PackWords(__m256i lo, __m256i hi) {
+  return _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xd8);
+}
+
+// Sixteen 32-bit lanes to sixteen bytes clamped to 0..255, like Clamp().
+inline __m128i PackBytes(__m256i lo, __m256i hi) {
+  const __m256i words = PackWords(lo, hi);
+  return _mm_packus_epi16(_mm256_castsi256_si128(words),
+                          _mm256_extracti128_si256(words, 1));
+}
+
+void I420ToRgbaRow(const uint8_t* y, const uint8_t* u, const uint8_t* v,
+                   uint8_t* dst, int width) {
+  const __m256i first = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+  const __m256i second = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);
+  const __m128i alpha = _mm_set1_epi8(static_cast<char>(0xff));
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    const __m128i luma =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(y + x));
+    const __m256i d = _mm256_sub_epi32(
+        _mm256_cvtepu8_epi32(
+            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(u + x / 2))),
+        _mm256_set1_epi32(128));
+    const __m256i e = _mm256_sub_epi32(
+        _mm256_cvtepu8_epi32(
+            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(v + x / 2))),
+        _mm256_set1_epi32(128));
+    __m256i r_lo, g_lo, b_lo, r_hi, g_hi, b_hi;
+    YuvToRgb(_mm256_cvtepu8_epi32(luma),
+             _mm256_permutevar8x32_epi32(d, first),
+             _mm256_permutevar8x32_epi32(e, first), &r_lo, &g_lo, &b_lo);
+    YuvToRgb(_mm256_cvtepu8_epi32(_mm_srli_si128(luma, 8)),
+             _mm256_permutevar8x32_epi32(d, second),
+             _mm256_permutevar8x32_epi32(e, second), &r_hi, &g_hi, &b_hi);
+    const __m128i r = PackBytes(r_lo, r_hi);
+    const __m128i g = PackBytes(g_lo, g_hi);
+    const __m128i b = PackBytes(b_lo, b_hi);
+    const __m128i rg_lo = _mm_unpacklo_epi8(r, g);
+    const __m128i rg_hi = _mm_unpackhi_epi8(r, g);
+    const __m128i ba_lo = _mm_unpacklo_epi8(b, alpha);
+    const __m128i ba_hi = _mm_unpackhi_epi8(b, alpha);
+    __m128i* out = reinterpret_cast<__m128i*>(dst + 4 * x);
+    _mm_storeu_si128(out, _mm_unpacklo_epi16(rg_lo, ba_lo));
+    _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(rg_lo, ba_lo));
+    _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(rg_hi, ba_hi));
+    _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(rg_hi, ba_hi));
+  }
+  ScalarKernels()->i420_to_rgba_row(y + x, u + x / 2, v + x / 2, dst + 4 * x,
+                                    width - x);
+}
+
+// Eight stereo frames packed as 32-bit lanes, left in the low half.
+inline __m256i Lerp(__m256i a, __m256i b, __m256i frac) {
+  const __m256i a_left = _mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16);
+  const __m256i b_left = _mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16);
+  const __m256i a_right = _mm256_srai_epi32(a, 16);
+  const __m256i b_right = _mm256_srai_epi32(b, 16);
+  const __m256i left = _mm256_add_epi32(
+      a_left, _mm256_srai_epi32(
+                  _mm256_mullo_epi32(_mm256_sub_epi32(b_left, a_left), frac),
+                  15));
+  const __m256i right = _mm256_add_epi32(
+      a_right,
+      _mm256_srai_epi32(
+          _mm256_mullo_epi32(_mm256_sub_epi32(b_right, a_right), frac), 15));
+  return _mm256_or_si256(_mm256_and_si256(left, _mm256_set1_epi32(0xffff)),
+                         _mm256_slli_epi32(right, 16));
+}
+
+size_t ResampleStereo(const int16_t* frames, size_t count, uint32_t position,
+                      uint32_t step, int16_t* out) {
+  const uint32_t limit = static_cast<uint32_t>(count - 1) << 16;
+  if (position >= limit) {
+    return 0;
+  }
+  const size_t total = (limit - position + step - 1) / step;
+  const int* pairs = reinterpret_cast<const int*>(frames);
+  __m256i p = _mm256_add_epi32(
+      _mm256_set1_epi32(position),
+      _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                         _mm256_set1_epi32(step)));
+  const __m256i advance = _mm256_set1_epi32(8 * step);
+  const __m256i low = _mm256_set1_epi32(0xffff);
+  size_t n = 0;
+  for (; n + 8 <= total; n += 8) {
+    const __m256i index = _mm256_srli_epi32(p, 16);
+    const __m256i a = _mm256_i32gather_epi32(pairs, index, 4);
+    const __m256i b = _mm256_i32gather_epi32(pairs + 1, index, 4);
+    const __m256i frac = _mm256_srli_epi32(_mm256_and_si256(p, low), 1);
+    Store(out + 2 * n, Lerp(a, b, frac));
+    p = _mm256_add_epi32(p, advance);
+  }
+  return n + ScalarKernels()->resample_stereo(
+                 frames, count, position + static_cast<uint32_t>(n) * step,
+                 step, out + 2 * n);
+}
+
+void MixSamples(int16_t* dst, const int16_t* src, size_t count, int gain) {
+  const __m256i g = _mm256_set1_epi32(gain);
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const __m256i s = Load(src + i);
+    const __m256i d = Load(dst + i);
+    const __m256i lo = _mm256_add_epi32(
+        _mm256_cvtepi16_epi32(_mm256_castsi256_si128(d)),
+        _mm256_srai_epi32(
+            _mm256_mullo_epi32(
+                _mm256_cvtepi16_epi32(_mm256_castsi256_si128(s)), g),
+            8));
+    const __m256i hi = _mm256_add_epi32(
+        _mm256_cvtepi16_epi32(_mm256_extracti128_si256(d, 1)),
+        _mm256_srai_epi32(
+            _mm256_mullo_epi32(
+                _mm256_cvtepi16_epi32(_mm256_extracti128_si256(s, 1)), g),
+            8));
+    Store(dst + i, PackWords(lo, hi));
+  }
+  ScalarKernels()->mix_samples(dst + i, src + i, count - i, gain);
+}
+
+const SimdKernels kKernels = {
+    SimdLevel::kAvx2, FindStartCode,  FindMagic,
+    I420ToRgbaRow,    ResampleStereo, MixSamples,
+};
+
+}  // namespace
+
+const SimdKernels* Avx2Kernels() { return &kKernels; }
+
+}  // namespace carlink
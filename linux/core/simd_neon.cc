@@ -0,0 +1,167 @@
+// NEON kernels for 32- and 64-bit ARM. 32-bit builds compile this file
+// with -mfpu=neon and call it only after the hwcaps said so.
+
+#include <arm_neon.h>
+
+#include <cstring>
+
+#include "core/simd.h"
+
+namespace carlink {
+
+namespace {
+
+inline bool Any(uint8x16_t mask) {
+  const uint64x2_t words = vreinterpretq_u64_u8(mask);
+  return (vgetq_lane_u64(words, 0) | vgetq_lane_u64(words, 1)) != 0;
+}
+
+// Both searches skip 64 bytes at a time on their rarer byte, 01 or the
+// magic's first aa 55 pair, and leave blocks that have it to the scalar
+// kernel, which finds the exact offset from there.
+size_t FindStartCode(const uint8_t* data, size_t length) {
+  const uint8x16_t one = vdupq_n_u8(1);
+  size_t i = 0;
+  for (; i + 66 <= length; i += 64) {
+    const uint8x16_t ones =
+        vorrq_u8(vorrq_u8(vceqq_u8(vld1q_u8(data + i + 2), one),
+                          vceqq_u8(vld1q_u8(data + i + 18), one)),
+                 vorrq_u8(vceqq_u8(vld1q_u8(data + i + 34), one),
+                          vceqq_u8(vld1q_u8(data + i + 50), one)));
+    if (Any(ones)) {
+      break;
+    }
+  }
+  return i + ScalarKernels()->find_start_code(data + i, length - i);
+}
+
+// The aa 55 pair at |p|, for 16 positions.
+inline uint8x16_t Pair(const uint8_t* p) {
+  return vandq_u8(vceqq_u8(vld1q_u8(p), vdupq_n_u8(0xaa)),
+                  vceqq_u8(vld1q_u8(p + 1), vdupq_n_u8(0x55)));
+}
+
+size_t FindMagic(const uint8_t* data, size_t length) {
+  size_t i = 0;
+  for (; i + 67 <= length; i += 64) {
+    const uint8x16_t pairs =
+        vorrq_u8(vorrq_u8(Pair(data + i), Pair(data + i + 16)),
+                 vorrq_u8(Pair(data + i + 32), Pair(data + i + 48)));
+    if (Any(pairs)) {
+      break;
+    }
+  }
+  return i + ScalarKernels()->find_magic(data + i, length - i);
+}
+
+// BT.601 for four pixels; |d| and |e| are U and V less 128.
+inline void YuvToRgb(int32x4_t y, int32x4_t d, int32x4_t e, int32x4_t* r,
+                     int32x4_t* g, int32x4_t* b) {
+  const int32x4_t c = vaddq_s32(
+      vmulq_n_s32(vsubq_s32(y, vdupq_n_s32(16)), 298), vdupq_n_s32(128));
+  *r = vshrq_n_s32(vmlaq_n_s32(c, e, 409), 8);
+  *g = vshrq_n_s32(vmlsq_n_s32(vmlsq_n_s32(c, d, 100), e, 208), 8);
+  *b = vshrq_n_s32(vmlaq_n_s32(c, d, 516), 8);
+}
+
+// Eight lanes to eight bytes clamped to 0..255, like Clamp().
+inline uint8x8_t PackBytes(int32x4_t lo, int32x4_t hi) {
+  return vqmovun_s16(vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+}
+
+// Four chroma samples, each doubled for two pixels, less 128.
+inline int16x8_t LoadChroma(const uint8_t* p) {
+  uint32_t bytes;
+  memcpy(&bytes, p, sizeof(bytes));
+  const uint8x8_t c = vreinterpret_u8_u32(vdup_n_u32(bytes));
+  return vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vzip_u8(c, c).val[0])),
+                   vdupq_n_s16(128));
+}
+
+void I420ToRgbaRow(const uint8_t* y, const uint8_t* u, const uint8_t* v,
+                   uint8_t* dst, int width) {
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    const int16x8_t luma = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(y + x)));
+    const int16x8_t d = LoadChroma(u + x / 2);
+    const int16x8_t e = LoadChroma(v + x / 2);
+    int32x4_t r_lo, g_lo, b_lo, r_hi, g_hi, b_hi;
+    YuvToRgb(vmovl_s16(vget_low_s16(luma)), vmovl_s16(vget_low_s16(d)),
+             vmovl_s16(vget_low_s16(e)), &r_lo, &g_lo, &b_lo);
+    YuvToRgb(vmovl_s16(vget_high_s16(luma)), vmovl_s16(vget_high_s16(d)),
+             vmovl_s16(vget_high_s16(e)), &r_hi, &g_hi, &b_hi);
+    uint8x8x4_t rgba;
+    rgba.val[0] = PackBytes(r_lo, r_hi);
+    rgba.val[1] = PackBytes(g_lo, g_hi);
+    rgba.val[2] = PackBytes(b_lo, b_hi);
+    rgba.val[3] = vdup_n_u8(0xff);
+    vst4_u8(dst + 4 * x, rgba);
+  }
+  ScalarKernels()->i420_to_rgba_row(y + x, u + x / 2, v + x / 2, dst + 4 * x,
+                                    width - x);
+}
+
+// One channel of four frames.
+inline int32x4_t Lerp(int32x4_t a, int32x4_t b, int32x4_t frac) {
+  return vaddq_s32(a, vshrq_n_s32(vmulq_s32(vsubq_s32(b, a), frac), 15));
+}
+
+size_t ResampleStereo(const int16_t* frames, size_t count, uint32_t position,
+                      uint32_t step, int16_t* out) {
+  const uint32_t limit = static_cast<uint32_t>(count - 1) << 16;
+  if (position >= limit) {
+    return 0;
+  }
+  const size_t total = (limit - position + step - 1) / step;
+  size_t n = 0;
+  for (; n + 4 <= total; n += 4) {
+    int16_t a[8], b[8];
+    int32_t frac[4];
+    for (int k = 0; k < 4; k++) {
+      const uint32_t p = position + k * step;
+      const int16_t* frame = frames + (p >> 16) * 2;
+      memcpy(a + 2 * k, frame, 4);
+      memcpy(b + 2 * k, frame + 2, 4);
+      frac[k] = (p & 0xffff) >> 1;
+    }
+    const int16x4x2_t sa = vld2_s16(a);
+    const int16x4x2_t sb = vld2_s16(b);
+    const int32x4_t f = vld1q_s32(frac);
+    int16x4x2_t result;
+    result.val[0] = vmovn_s32(
+        Lerp(vmovl_s16(sa.val[0]), vmovl_s16(sb.val[0]), f));
+    result.val[1] = vmovn_s32(
+        Lerp(vmovl_s16(sa.val[1]), vmovl_s16(sb.val[1]), f));
+    vst2_s16(out + 2 * n, result);
+    position += 4 * step;
+  }
+  return n + ScalarKernels()->resample_stereo(frames, count, position, step,
+                                              out + 2 * n);
+}
+
+void MixSamples(int16_t* dst, const int16_t* src, size_t count, int gain) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const int16x8_t s = vld1q_s16(src + i);
+    const int16x8_t d = vld1q_s16(dst + i);
+    const int32x4_t lo = vaddq_s32(
+        vmovl_s16(vget_low_s16(d)),
+        vshrq_n_s32(vmulq_n_s32(vmovl_s16(vget_low_s16(s)), gain), 8));
+    const int32x4_t hi = vaddq_s32(
+        vmovl_s16(vget_high_s16(d)),
+        vshrq_n_s32(vmulq_n_s32(vmovl_s16(vget_high_s16(s)), gain), 8));
+    vst1q_s16(dst + i, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+  }
+  ScalarKernels()->mix_samples(dst + i, src + i, count - i, gain);
+}
+
+const SimdKernels kKernels = {
+    SimdLevel::kNeon, FindStartCode,  FindMagic,
+    I420ToRgbaRow,    ResampleStereo, MixSamples,
+};
+
+}  // namespace
+
+const SimdKernels* NeonKernels() { return &kKernels; }
+
+}  // namespace carlink
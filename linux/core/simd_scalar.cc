@@ -0,0 +1,109 @@
+// The reference variant of every kernel in simd.h. Vector variants finish
+// their tails with these.
+
+#include <cstring>
+
+#include "core/simd.h"
+
+namespace carlink {
+
+namespace {
+
+size_t FindStartCode(const uint8_t* data, size_t length) {
+  if (length < 3) {
+    return length;
+  }
+  // Look for the 01 byte and check the two zeros before it; 01 is rarer than
+  // 00 in slice data, so memchr does most of the work.
+  size_t i = 2;
+  while (i < length) {
+    const void* hit = memchr(data + i, 0x01, length - i);
+    if (hit == nullptr) {
+      return length;
+    }
+    i = static_cast<const uint8_t*>(hit) - data;
+    if (data[i - 1] == 0 && data[i - 2] == 0) {
+      return i - 2;
+    }
+    i++;
+  }
+  return length;
+}
+
+size_t FindMagic(const uint8_t* data, size_t length) {
+  if (length < 4) {
+    return length;
+  }
+  const uint8_t* p = data;
+  const uint8_t* end = data + length - 3;
+  while (p < end) {
+    p = static_cast<const uint8_t*>(memchr(p, 0xaa, end - p));
+    if (p == nullptr) {
+      break;
+    }
+    if (p[1] == 0x55 && p[2] == 0xaa && p[3] == 0x55) {
+      return p - data;
+    }
+    p++;
+  }
+  return length;
+}
+
+inline uint8_t Clamp(int value) {
+  return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+void I420ToRgbaRow(const uint8_t* y, const uint8_t* u, const uint8_t* v,
+                   uint8_t* dst, int width) {
+  // 8.8 fixed point BT.601 coefficients.
+  const int kY = 298;
+  const int kRv = 409;
+  const int kGu = 100;
+  const int kGv = 208;
+  const int kBu = 516;
+
+  for (int x = 0; x < width; x++) {
+    const int c = (y[x] - 16) * kY + 128;
+    const int d = u[x / 2] - 128;
+    const int e = v[x / 2] - 128;
+    dst[0] = Clamp((c + kRv * e) >> 8);
+    dst[1] = Clamp((c - kGu * d - kGv * e) >> 8);
+    dst[2] = Clamp((c + kBu * d) >> 8);
+    dst[3] = 0xff;
+    dst += 4;
+  }
+}
+
+size_t ResampleStereo(const int16_t* frames, size_t count, uint32_t position,
+                      uint32_t step, int16_t* out) {
+  const uint32_t limit = static_cast<uint32_t>(count - 1) << 16;
+  size_t written = 0;
+  for (; position < limit; position += step) {
+    const int16_t* a = frames + (position >> 16) * 2;
+    // Q15 so the product stays within 32 bits for any two samples.
+    const int frac = (position & 0xffff) >> 1;
+    out[0] = static_cast<int16_t>(a[0] + (((a[2] - a[0]) * frac) >> 15));
+    out[1] = static_cast<int16_t>(a[1] + (((a[3] - a[1]) * frac) >> 15));
+    out += 2;
+    written++;
+  }
+  return written;
+}
+
+void MixSamples(int16_t* dst, const int16_t* src, size_t count, int gain) {
+  for (size_t i = 0; i < count; i++) {
+    int value = dst[i] + ((src[i] * gain) >> 8);
+    dst[i] = value > 32767 ? 32767 : (value < -32768 ? -32768 : value);
+  }
+}
+
+const SimdKernels kKernels = {
+    SimdLevel::kScalar, FindStartCode,  FindMagic,
+    I420ToRgbaRow,      ResampleStereo, MixSamples,
+};
+
+}  // namespace
+
+const SimdKernels* ScalarKernels() { return &kKernels; }
+
+}  // namespace carlink
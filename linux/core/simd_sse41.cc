@@ -0,0 +1,206 @@
+// SSE4.1 kernels. Built with -msse4.1 and only called after the CPU was
+// checked, so nothing here may be inline code shared with other files.
+
+#include <smmintrin.h>
+
+#include <cstring>
+
+#include "core/simd.h"
+
+namespace carlink {
+
+namespace {
+
+inline __m128i Load(const void* p) {
+  return _mm_loadu_si128(static_cast<const __m128i*>(p));
+}
+
+// Both searches skip 64 bytes at a time on their rarer byte, 01 or the
+// magic's first aa 55 pair, and check the rest only in blocks that have it.
+size_t FindStartCode(const uint8_t* data, size_t length) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi8(1);
+  size_t i = 0;
+  while (i + 66 <= length) {
+    const __m128i ones = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(Load(data + i + 2), one),
+                     _mm_cmpeq_epi8(Load(data + i + 18), one)),
+        _mm_or_si128(_mm_cmpeq_epi8(Load(data + i + 34), one),
+                     _mm_cmpeq_epi8(Load(data + i + 50), one)));
+    if (_mm_testz_si128(ones, ones)) {
+      i += 64;
+      continue;
+    }
+    for (int quarter = 0; quarter < 4; quarter++, i += 16) {
+      const __m128i hit = _mm_and_si128(
+          _mm_and_si128(_mm_cmpeq_epi8(Load(data + i), zero),
+                        _mm_cmpeq_epi8(Load(data + i + 1), zero)),
+          _mm_cmpeq_epi8(Load(data + i + 2), one));
+      const int mask = _mm_movemask_epi8(hit);
+      if (mask != 0) {
+        return i + __builtin_ctz(mask);
+      }
+    }
+  }
+  return i + ScalarKernels()->find_start_code(data + i, length - i);
+}
+
+// The aa 55 pair at |p|, for 16 positions.
+inline __m128i Pair(const uint8_t* p) {
+  return _mm_and_si128(
+      _mm_cmpeq_epi8(Load(p), _mm_set1_epi8(static_cast<char>(0xaa))),
+      _mm_cmpeq_epi8(Load(p + 1), _mm_set1_epi8(0x55)));
+}
+
+size_t FindMagic(const uint8_t* data, size_t length) {
+  size_t i = 0;
+  while (i + 67 <= length) {
+    const __m128i pairs =
+        _mm_or_si128(_mm_or_si128(Pair(data + i), Pair(data + i + 16)),
+                     _mm_or_si128(Pair(data + i + 32), Pair(data + i + 48)));
+    if (_mm_testz_si128(pairs, pairs)) {
+      i += 64;
+      continue;
+    }
+    for (int quarter = 0; quarter < 4; quarter++, i += 16) {
+      const int mask = _mm_movemask_epi8(
+          _mm_and_si128(Pair(data + i), Pair(data + i + 2)));
+      if (mask != 0) {
+        return i + __builtin_ctz(mask);
+      }
+    }
+  }
+  return i + ScalarKernels()->find_magic(data + i, length - i);
+}
+
+// BT.601 for four pixels of 32-bit lanes; |d| and |e| are U and V less 128.
+inline void YuvToRgb(__m128i y, __m128i d, __m128i e, __m128i* r,
+                     __m128i* g, __m128i* b) {
+  const __m128i c = _mm_add_epi32(
+      _mm_mullo_epi32(_mm_sub_epi32(y, _mm_set1_epi32(16)),
+                      _mm_set1_epi32(298)),
+      _mm_set1_epi32(128));
+  *r = _mm_srai_epi32(
+      _mm_add_epi32(c, _mm_mullo_epi32(e, _mm_set1_epi32(409))), 8);
+  *g = _mm_srai_epi32(
+      _mm_sub_epi32(
+          _mm_sub_epi32(c, _mm_mullo_epi32(d, _mm_set1_epi32(100))),
+          _mm_mullo_epi32(e, _mm_set1_epi32(208))),
+      8);
+  *b = _mm_srai_epi32(
+      _mm_add_epi32(c, _mm_mullo_epi32(d, _mm_set1_epi32(516))), 8);
+}
+
+// Eight 32-bit lanes to eight bytes clamped to 0..255, like Clamp().
+inline __m128i PackBytes(__m128i lo, __m128i hi) {
+  return _mm_packus_epi16(_mm_packs_epi32(lo, hi), _mm_setzero_si128());
+}
+
+// Four chroma samples, each doubled for two pixels, less 128.
+inline void LoadChroma(const uint8_t* p, __m128i* lo, __m128i* hi) {
+  int32_t bytes;
+  memcpy(&bytes, p, sizeof(bytes));
+  const __m128i c = _mm_sub_epi32(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(bytes)),
+                                  _mm_set1_epi32(128));
+  *lo = _mm_unpacklo_epi32(c, c);
+  *hi = _mm_unpackhi_epi32(c, c);
+}
+
+void I420ToRgbaRow(const uint8_t* y, const uint8_t* u, const uint8_t* v,
+                   uint8_t* dst, int width) {
+  const __m128i alpha = _mm_set1_epi8(static_cast<char>(0xff));
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    const __m128i luma =
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(y + x));
+    __m128i d_lo, d_hi, e_lo, e_hi;
+    LoadChroma(u + x / 2, &d_lo, &d_hi);
+    LoadChroma(v + x / 2, &e_lo, &e_hi);
+    __m128i r_lo, g_lo, b_lo, r_hi, g_hi, b_hi;
+    YuvToRgb(_mm_cvtepu8_epi32(luma), d_lo, e_lo, &r_lo, &g_lo, &b_lo);
+    YuvToRgb(_mm_cvtepu8_epi32(_mm_srli_si128(luma, 4)), d_hi, e_hi, &r_hi,
+             &g_hi, &b_hi);
+    const __m128i rg = _mm_unpacklo_epi8(PackBytes(r_lo, r_hi),
+                                         PackBytes(g_lo, g_hi));
+    const __m128i ba = _mm_unpacklo_epi8(PackBytes(b_lo, b_hi), alpha);
+    __m128i* out = reinterpret_cast<__m128i*>(dst + 4 * x);
+    _mm_storeu_si128(out, _mm_unpacklo_epi16(rg, ba));
+    _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(rg, ba));
+  }
+  ScalarKernels()->i420_to_rgba_row(y + x, u + x / 2, v + x / 2, dst + 4 * x,
+                                    width - x);
+}
+
+// Four stereo frames packed as 32-bit lanes, left in the low half.
+inline __m128i Lerp(__m128i a, __m128i b, __m128i frac) {
+  const __m128i a_left = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+  const __m128i b_left = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+  const __m128i a_right = _mm_srai_epi32(a, 16);
+  const __m128i b_right = _mm_srai_epi32(b, 16);
+  const __m128i left = _mm_add_epi32(
+      a_left,
+      _mm_srai_epi32(_mm_mullo_epi32(_mm_sub_epi32(b_left, a_left), frac),
+                     15));
+  const __m128i right = _mm_add_epi32(
+      a_right,
+      _mm_srai_epi32(_mm_mullo_epi32(_mm_sub_epi32(b_right, a_right), frac),
+                     15));
+  return _mm_or_si128(_mm_and_si128(left, _mm_set1_epi32(0xffff)),
+                      _mm_slli_epi32(right, 16));
+}
+
+size_t ResampleStereo(const int16_t* frames, size_t count, uint32_t position,
+                      uint32_t step, int16_t* out) {
+  const uint32_t limit = static_cast<uint32_t>(count - 1) << 16;
+  if (position >= limit) {
+    return 0;
+  }
+  const size_t total = (limit - position + step - 1) / step;
+  size_t n = 0;
+  // No gather before AVX2: the loads stay scalar, the arithmetic doesn't.
+  for (; n + 4 <= total; n += 4) {
+    uint32_t a[4], b[4], frac[4];
+    for (int k = 0; k < 4; k++) {
+      const uint32_t p = position + k * step;
+      const int16_t* frame = frames + (p >> 16) * 2;
+      memcpy(&a[k], frame, 4);
+      memcpy(&b[k], frame + 2, 4);
+      frac[k] = (p & 0xffff) >> 1;
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * n),
+                     Lerp(Load(a), Load(b), Load(frac)));
+    position += 4 * step;
+  }
+  return n + ScalarKernels()->resample_stereo(frames, count, position, step,
+                                              out + 2 * n);
+}
+
+void MixSamples(int16_t* dst, const int16_t* src, size_t count, int gain) {
+  const __m128i g = _mm_set1_epi32(gain);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m128i s = Load(src + i);
+    const __m128i d = Load(dst + i);
+    const __m128i lo = _mm_add_epi32(
+        _mm_cvtepi16_epi32(d),
+        _mm_srai_epi32(_mm_mullo_epi32(_mm_cvtepi16_epi32(s), g), 8));
+    const __m128i hi = _mm_add_epi32(
+        _mm_cvtepi16_epi32(_mm_srli_si128(d, 8)),
+        _mm_srai_epi32(
+            _mm_mullo_epi32(_mm_cvtepi16_epi32(_mm_srli_si128(s, 8)), g), 8));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                     _mm_packs_epi32(lo, hi));
+  }
+  ScalarKernels()->mix_samples(dst + i, src + i, count - i, gain);
+}
+
+const SimdKernels kKernels = {
+    SimdLevel::kSse41, FindStartCode,  FindMagic,
+    I420ToRgbaRow,     ResampleStereo, MixSamples,
+};
+
+}  // namespace
+
+const SimdKernels* Sse41Kernels() { return &kKernels; }
+
+}  // namespace carlink
@@ -0,0 +1,434 @@
+#include "core/simulated_dongle.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "core/audio.h"
+#include "core/clock.h"
+#include "core/log.h"
+#include "core/protocol.h"
+
+namespace carlink {
+
+namespace {
+
+constexpr uint32_t kAudioSampleRate = 48000;
+// decodeTypeMap: 4 is 48 kHz stereo.
+constexpr uint32_t kAudioDecodeType = 4;
+// Media stream.
+constexpr uint32_t kAudioType = 1;
+constexpr double kToneHz = 440.0;
+// Phase reported once streaming, as seen from real dongles.
+constexpr uint32_t kStreamingPhase = 8;
+// Real-time mode skips ahead instead of bursting after a stall longer than
+// this.
+constexpr int64_t kMaxCatchUpNs = 1000000000;
+
+bool ReadFile(const std::string& path, std::vector<uint8_t>* contents) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    return false;
+  }
+  uint8_t chunk[65536];
+  size_t read;
+  while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    contents->insert(contents->end(), chunk, chunk + read);
+  }
+  fclose(file);
+  return true;
+}
+
+}  // namespace
+
+SimulatedDongle::SimulatedDongle(const Options& options)
+    : options_(options),
+      clock_(options.clock != nullptr ? options.clock : SystemClock::Get()),
+      pool_(BufferPool::Create()),
+      host_demuxer_(pool_, [this](Message message) {
+        OnHostMessage(message);
+      }) {
+  if (!options_.replay_path.empty()) {
+    replay_.reset(new CaptureReader());
+    if (!replay_->Open(options_.replay_path)) {
+      replay_.reset();
+      return;
+    }
+    SkipOutboundRecords();
+    if (replay_next_ < replay_->message_count()) {
+      replay_first_ns_ = replay_->record(replay_next_).timestamp_ns;
+    }
+    Log(LogLevel::kInfo, "[SIM] replaying %zu messages from %s",
+        replay_->message_count(), options_.replay_path.c_str());
+    return;
+  }
+  if (options_.video_path.empty()) {
+    return;
+  }
+  if (!ReadFile(options_.video_path, &video_)) {
+    Log(LogLevel::kError, "[SIM] cannot read %s",
+        options_.video_path.c_str());
+    return;
+  }
+  units_ = SplitAccessUnits(video_.data(), video_.size());
+  Log(LogLevel::kInfo, "[SIM] %zu access units from %s", units_.size(),
+      options_.video_path.c_str());
+}
+
+bool SimulatedDongle::ok() const {
+  if (!options_.replay_path.empty()) {
+    return replay_ != nullptr;
+  }
+  return options_.video_path.empty() || !units_.empty();
+}
+
+int SimulatedDongle::Write(const uint8_t* data, size_t length,
+                           int timeout_ms) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (closed_) {
+    return -1;
+  }
+  StartReplay();
+  host_demuxer_.Feed(data, length, clock_->Now());
+  cv_.notify_all();
+  return static_cast<int>(length);
+}
+
+int SimulatedDongle::Read(uint8_t* data, size_t length, int timeout_ms) {
+  const auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::milliseconds(timeout_ms);
+  std::unique_lock<std::mutex> lock(mutex_);
+  StartReplay();
+
+  while (true) {
+    if (closed_) {
+      return -1;
+    }
+    if (pending_offset_ == pending_.size() && replay_) {
+      QueueDueReplay(clock_->Now());
+    } else if (pending_offset_ == pending_.size() && streaming_ &&
+               (has_video() || options_.audio)) {
+      QueueDueMedia(clock_->Now());
+    }
+    if (pending_offset_ < pending_.size()) {
+      const size_t count =
+          std::min(length, pending_.size() - pending_offset_);
+      memcpy(data, pending_.data() + pending_offset_, count);
+      pending_offset_ += count;
+      stats_.bytes_sent += count;
+      if (pending_offset_ == pending_.size()) {
+        pending_.clear();
+        pending_offset_ = 0;
+      }
+      return static_cast<int>(count);
+    }
+
+    auto wake = deadline;
+    const int64_t due_ns = NextEventLocked();
+    if (due_ns != INT64_MAX) {
+      const auto due = std::chrono::steady_clock::now() +
+                       std::chrono::nanoseconds(due_ns - clock_->Now());
+      wake = std::min(wake, due);
+    }
+    if (cv_.wait_until(lock, wake) == std::cv_status::timeout &&
+        std::chrono::steady_clock::now() >= deadline) {
+      return 0;
+    }
+  }
+}
+
+void SimulatedDongle::Close() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  closed_ = true;
+  cv_.notify_all();
+}
+
+void SimulatedDongle::Queue(const std::vector<uint8_t>& message) {
+  pending_.insert(pending_.end(), message.begin(), message.end());
+}
+
+void SimulatedDongle::OnHostMessage(const Message& message) {
+  stats_.host_messages++;
+  const uint8_t* payload = message.payload.data();
+  const size_t size = message.payload.size();
+
+  if (replay_) {
+    // The capture already holds the dongle's answers.
+    if (message.header.type == static_cast<uint32_t>(MessageType::kHeartBeat)) {
+      stats_.heartbeats++;
+    } else if (message.header.type ==
+                   static_cast<uint32_t>(MessageType::kCommand) &&
+               size >= 4 &&
+               ReadU32(payload) == static_cast<uint32_t>(Command::kFrame)) {
+      stats_.keyframe_requests++;
+    }
+    return;
+  }
+
+  if (options_.video_source != nullptr) {
+    options_.video_source->OnHostMessage(message);
+  }
+  switch (static_cast<MessageType>(message.header.type)) {
+    case MessageType::kOpen: {
+      if (size >= 28) {
+        width_ = ReadU32(payload);
+        height_ = ReadU32(payload + 4);
+        fps_ = ReadU32(payload + 8) > 0 ? ReadU32(payload + 8) : 60;
+      }
+      // Opened echoes the session parameters.
+      Queue(EncodeMessage(MessageType::kOpen, payload, size));
+
+      const char kBoxInfo[] =
+          "{\"uuid\":\"00000000000000000000000000000000\",\"MFD\":\"20240101\","
+          "\"boxType\":\"YA\",\"productType\":\"A15W\",\"OemName\":\"carlink\","
+          "\"hwVersion\":\"simulated\",\"WiFiChannel\":36}";
+      Queue(EncodeMessage(MessageType::kBoxSettings,
+                          reinterpret_cast<const uint8_t*>(kBoxInfo),
+                          sizeof(kBoxInfo) - 1));
+
+      uint8_t plugged[8];
+      WriteU32(plugged, options_.phone_type);
+      WriteU32(plugged + 4, 1);
+      Queue(EncodeMessage(MessageType::kPlugged, plugged, sizeof(plugged)));
+
+      uint8_t phase[4];
+      WriteU32(phase, kStreamingPhase);
+      Queue(EncodeMessage(MessageType::kPhase, phase, sizeof(phase)));
+      StartStreaming();
+      break;
+    }
+    case MessageType::kHeartBeat:
+      stats_.heartbeats++;
+      Queue(EncodeHeartBeat());
+      break;
+    case MessageType::kCommand:
+      if (size >= 4 &&
+          ReadU32(payload) == static_cast<uint32_t>(Command::kFrame) &&
+          has_video()) {
+        stats_.keyframe_requests++;
+        keyframe_requested_ = true;
+        // Jump to the next IDR, like an encoder forcing a keyframe.
+        for (size_t i = 0; i < units_.size(); i++) {
+          const size_t index = (next_unit_ + i) % units_.size();
+          if (units_[index].idr) {
+            next_unit_ = index;
+            break;
+          }
+        }
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+void SimulatedDongle::StartStreaming() {
+  if (streaming_) {
+    return;
+  }
+  streaming_ = true;
+  stream_start_ns_ = clock_->Now();
+  video_sent_ = 0;
+  audio_sent_ = 0;
+  next_unit_ = 0;
+
+  if (options_.audio) {
+    uint8_t start[kAudioDataHeaderSize + 1];
+    WriteU32(start, kAudioDecodeType);
+    WriteU32(start + 4, 0);
+    WriteU32(start + 8, kAudioType);
+    start[kAudioDataHeaderSize] =
+        static_cast<uint8_t>(AudioCommand::kMediaStart);
+    Queue(EncodeMessage(MessageType::kAudioData, start, sizeof(start)));
+  }
+}
+
+int64_t SimulatedDongle::NextMediaNs() const {
+  const int64_t video_ns =
+      !has_video() ? INT64_MAX
+                   : static_cast<int64_t>(video_sent_ * 1000000000 / fps_);
+  const int64_t audio_ns =
+      options_.audio ? static_cast<int64_t>(audio_sent_) *
+                           options_.audio_packet_ms * 1000000
+                     : INT64_MAX;
+  return std::min(video_ns, audio_ns);
+}
+
+void SimulatedDongle::QueueNextMedia() {
+  // Whichever stream is behind in media time goes next.
+  const int64_t video_ns =
+      !has_video() ? INT64_MAX
+                   : static_cast<int64_t>(video_sent_ * 1000000000 / fps_);
+  if (video_ns == NextMediaNs()) {
+    QueueVideoFrame();
+  } else {
+    QueueAudioPacket();
+  }
+}
+
+void SimulatedDongle::QueueDueMedia(int64_t now_ns) {
+  if (!options_.real_time) {
+    QueueNextMedia();
+    return;
+  }
+
+  const int64_t elapsed_ns = now_ns - stream_start_ns_;
+  if (elapsed_ns - NextMediaNs() > kMaxCatchUpNs) {
+    // Stalled (e.g. the host stopped reading): resume from now rather than
+    // bursting seconds of media.
+    Log(LogLevel::kWarning, "[SIM] host stalled, skipping ahead");
+    video_sent_ = elapsed_ns * fps_ / 1000000000;
+    audio_sent_ = elapsed_ns / (int64_t{options_.audio_packet_ms} * 1000000);
+  }
+  while (NextMediaNs() <= elapsed_ns) {
+    QueueNextMedia();
+  }
+}
+
+void SimulatedDongle::QueueVideoFrame() {
+  const uint8_t* data;
+  size_t size;
+  if (options_.video_source != nullptr) {
+    source_unit_.clear();
+    options_.video_source->NextAccessUnit(keyframe_requested_, &source_unit_);
+    keyframe_requested_ = false;
+    data = source_unit_.data();
+    size = source_unit_.size();
+  } else {
+    const AccessUnitRange& unit = units_[next_unit_];
+    next_unit_ = (next_unit_ + 1) % units_.size();
+    data = video_.data() + unit.offset;
+    size = unit.size;
+  }
+  video_sent_++;
+  stats_.video_frames++;
+
+  const size_t payload_size = kVideoDataHeaderSize + size;
+  const size_t start = pending_.size();
+  pending_.resize(start + kHeaderSize + payload_size);
+  uint8_t* out = pending_.data() + start;
+  EncodeHeader(static_cast<uint32_t>(MessageType::kVideoData),
+               static_cast<uint32_t>(payload_size), out);
+  out += kHeaderSize;
+  WriteU32(out, width_);
+  WriteU32(out + 4, height_);
+  WriteU32(out + 8, 0);
+  WriteU32(out + 12, static_cast<uint32_t>(size));
+  WriteU32(out + 16, 0);
+  memcpy(out + kVideoDataHeaderSize, data, size);
+}
+
+void SimulatedDongle::QueueAudioPacket() {
+  const size_t frames = kAudioSampleRate * options_.audio_packet_ms / 1000;
+  const size_t payload_size = kAudioDataHeaderSize + frames * 2 * 2;
+  const size_t start = pending_.size();
+  pending_.resize(start + kHeaderSize + payload_size);
+  uint8_t* out = pending_.data() + start;
+  EncodeHeader(static_cast<uint32_t>(MessageType::kAudioData),
+               static_cast<uint32_t>(payload_size), out);
+  out += kHeaderSize;
+  WriteU32(out, kAudioDecodeType);
+  WriteU32(out + 4, 0);
+  WriteU32(out + 8, kAudioType);
+  out += kAudioDataHeaderSize;
+
+  const double step = 2 * M_PI * kToneHz / kAudioSampleRate;
+  for (size_t i = 0; i < frames; i++) {
+    const uint16_t sample =
+        static_cast<uint16_t>(static_cast<int16_t>(8000 * sin(tone_phase_)));
+    tone_phase_ += step;
+    for (int channel = 0; channel < 2; channel++) {
+      *out++ = sample & 0xff;
+      *out++ = sample >> 8;
+    }
+  }
+  tone_phase_ = fmod(tone_phase_, 2 * M_PI);
+
+  audio_sent_++;
+  stats_.audio_packets++;
+}
+
+int64_t SimulatedDongle::NextEventNs() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return NextEventLocked();
+}
+
+int64_t SimulatedDongle::NextEventLocked() const {
+  if (pending_offset_ < pending_.size()) {
+    return clock_->Now();
+  }
+  if (replay_) {
+    return replay_started_ ? NextReplayNs() : INT64_MAX;
+  }
+  if (streaming_ && (has_video() || options_.audio)) {
+    return options_.real_time ? stream_start_ns_ + NextMediaNs()
+                              : clock_->Now();
+  }
+  return INT64_MAX;
+}
+
+bool SimulatedDongle::replay_done() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return replay_ && replay_next_ >= replay_->message_count() &&
+         pending_offset_ == pending_.size();
+}
+
+void SimulatedDongle::StartReplay() {
+  if (!replay_ || replay_started_) {
+    return;
+  }
+  replay_started_ = true;
+  replay_base_ns_ = clock_->Now() - replay_first_ns_;
+}
+
+void SimulatedDongle::SkipOutboundRecords() {
+  while (replay_next_ < replay_->message_count() &&
+         replay_->record(replay_next_).direction !=
+             CaptureDirection::kInbound) {
+    replay_next_++;
+  }
+}
+
+int64_t SimulatedDongle::NextReplayNs() const {
+  if (replay_next_ >= replay_->message_count()) {
+    return INT64_MAX;
+  }
+  if (!options_.real_time) {
+    return clock_->Now();
+  }
+  return replay_base_ns_ + replay_->record(replay_next_).timestamp_ns;
+}
+
+void SimulatedDongle::QueueDueReplay(int64_t now_ns) {
+  // Everything due at once, like a bulk transfer holding several messages.
+  while (replay_next_ < replay_->message_count() &&
+         NextReplayNs() <= now_ns) {
+    const CaptureRecord record = replay_->record(replay_next_++);
+    const size_t start = pending_.size();
+    pending_.resize(start + kHeaderSize + record.length);
+    EncodeHeader(record.type, record.length, pending_.data() + start);
+    if (record.length > 0) {
+      memcpy(pending_.data() + start + kHeaderSize, record.payload,
+             record.length);
+    }
+    if (record.type == static_cast<uint32_t>(MessageType::kVideoData)) {
+      stats_.video_frames++;
+    } else if (record.type == static_cast<uint32_t>(MessageType::kAudioData)) {
+      stats_.audio_packets++;
+    }
+    SkipOutboundRecords();
+    if (!options_.real_time) {
+      return;
+    }
+  }
+}
+
+SimulatedDongle::Stats SimulatedDongle::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+}  // namespace carlink
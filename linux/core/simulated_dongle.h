@@ -0,0 +1,165 @@
+#ifndef CARLINK_CORE_SIMULATED_DONGLE_H_
+#define CARLINK_CORE_SIMULATED_DONGLE_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "core/buffer_pool.h"
+#include "core/capture_reader.h"
+#include "core/clock.h"
+#include "core/demuxer.h"
+#include "core/nal_scanner.h"
+#include "core/transport.h"
+
+namespace carlink {
+
+// A Transport that behaves like a dongle with a phone attached, so the
+// native pipeline can be tested and benchmarked without hardware.
+//
+// It answers the handshake (Open -> Opened, BoxSettings, Plugged, Phase),
+// echoes HeartBeat, and once "plugged" streams VideoData from a raw Annex-B
+// file in a loop plus a synthetic 48 kHz stereo tone as AudioData.
+// Command::kFrame makes the next VideoData an IDR.
+//
+// In real-time mode media is paced by the frame rate from the host's Open
+// message; otherwise every Read() returns the next message immediately.
+//
+// With |replay_path| it instead replays the inbound messages of a capture
+// file at their recorded times, from when the host first reads or writes,
+// and answers nothing. Against a VirtualClock the harness advances the
+// clock to NextEventNs() and reads with a zero timeout; see
+// SessionOptions::polled.
+class SimulatedDongle : public Transport {
+ public:
+  // Generates VideoData on the fly instead of reading |video_path|, e.g.
+  // the counter pattern of the glass-to-glass harness. Called on the
+  // reading thread with the dongle's lock held, so keep it quick.
+  class VideoSource {
+   public:
+    virtual ~VideoSource() = default;
+    // Appends the next Annex-B access unit to |out|; an IDR if |keyframe|.
+    virtual void NextAccessUnit(bool keyframe, std::vector<uint8_t>* out) = 0;
+    // Every message the host sends, e.g. touches to echo.
+    virtual void OnHostMessage(const Message& message) {}
+  };
+
+  struct Options {
+    // Raw Annex-B stream, e.g. example/macos/video.h264. Empty for no video.
+    std::string video_path;
+    // Used instead of |video_path| when set. Not owned.
+    VideoSource* video_source = nullptr;
+    bool real_time = true;
+    bool audio = true;
+    // Milliseconds of PCM per AudioData message.
+    uint32_t audio_packet_ms = 20;
+    // PhoneType reported in Plugged; 3 is CarPlay.
+    uint32_t phone_type = 3;
+    // Capture file to replay instead of the synthetic streams.
+    std::string replay_path;
+    // Null for the system clock.
+    Clock* clock = nullptr;
+  };
+
+  struct Stats {
+    uint64_t host_messages = 0;
+    uint64_t heartbeats = 0;
+    uint64_t keyframe_requests = 0;
+    uint64_t video_frames = 0;
+    uint64_t audio_packets = 0;
+    uint64_t bytes_sent = 0;
+  };
+
+  explicit SimulatedDongle(const Options& options);
+
+  // False if |video_path| was given but holds no access units, or
+  // |replay_path| is not a capture.
+  bool ok() const;
+  size_t access_unit_count() const { return units_.size(); }
+
+  // Clock time Read() next has data: now while bytes are pending, the next
+  // due message otherwise. INT64_MAX when nothing is scheduled, e.g. once
+  // a replay is over.
+  int64_t NextEventNs() const;
+  // Every message of the replayed capture has been read.
+  bool replay_done() const;
+
+  const char* name() const override { return "simulated"; }
+  int Read(uint8_t* data, size_t length, int timeout_ms) override;
+  int Write(const uint8_t* data, size_t length, int timeout_ms) override;
+  void Close() override;
+
+  Stats stats() const;
+
+ private:
+  // Called with |mutex_| held.
+  void OnHostMessage(const Message& message);
+  void Queue(const std::vector<uint8_t>& message);
+  void StartStreaming();
+  // Appends media due at |now_ns|. In max-rate mode, appends the next
+  // message whatever its timestamp.
+  void QueueDueMedia(int64_t now_ns);
+  void QueueNextMedia();
+  void QueueVideoFrame();
+  void QueueAudioPacket();
+  // Stream time of the next media message.
+  int64_t NextMediaNs() const;
+  // NextEventNs() with |mutex_| held.
+  int64_t NextEventLocked() const;
+  bool has_video() const {
+    return options_.video_source != nullptr || !units_.empty();
+  }
+
+  // Replay. Called with |mutex_| held.
+  void StartReplay();
+  void QueueDueReplay(int64_t now_ns);
+  void SkipOutboundRecords();
+  // Clock time of the next inbound record, INT64_MAX at the end.
+  int64_t NextReplayNs() const;
+
+  const Options options_;
+  Clock* clock_;
+  std::vector<uint8_t> video_;
+  std::vector<AccessUnitRange> units_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  bool closed_ = false;
+
+  std::shared_ptr<BufferPool> pool_;
+  Demuxer host_demuxer_;
+
+  // Bytes the host has not read yet, consumed from |pending_offset_|.
+  std::vector<uint8_t> pending_;
+  size_t pending_offset_ = 0;
+
+  uint32_t width_ = 1920;
+  uint32_t height_ = 720;
+  uint32_t fps_ = 60;
+
+  bool streaming_ = false;
+  int64_t stream_start_ns_ = 0;
+  uint64_t video_sent_ = 0;
+  uint64_t audio_sent_ = 0;
+  size_t next_unit_ = 0;
+  // The next frame from |video_source| should be an IDR.
+  bool keyframe_requested_ = true;
+  std::vector<uint8_t> source_unit_;
+  double tone_phase_ = 0;
+
+  std::unique_ptr<CaptureReader> replay_;
+  size_t replay_next_ = 0;
+  bool replay_started_ = false;
+  // Clock time of capture time zero.
+  int64_t replay_base_ns_ = 0;
+  int64_t replay_first_ns_ = 0;
+
+  Stats stats_;
+};
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_SIMULATED_DONGLE_H_
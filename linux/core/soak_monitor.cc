@@ -0,0 +1,276 @@
+#include "core/soak_monitor.h"
+
+#include <dirent.h>
+#include <malloc.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cinttypes>
+
+#include "core/log.h"
+
+namespace carlink {
+
+namespace {
+
+constexpr double kMb = 1024.0 * 1024.0;
+
+uint64_t ReadRssBytes() {
+  FILE* file = fopen("/proc/self/statm", "r");
+  if (file == nullptr) {
+    return 0;
+  }
+  unsigned long long size = 0;
+  unsigned long long resident = 0;
+  const int read = fscanf(file, "%llu %llu", &size, &resident);
+  fclose(file);
+  return read == 2 ? resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE))
+                   : 0;
+}
+
+uint64_t CountOpenFds() {
+  DIR* dir = opendir("/proc/self/fd");
+  if (dir == nullptr) {
+    return 0;
+  }
+  uint64_t count = 0;
+  while (const struct dirent* entry = readdir(dir)) {
+    if (entry->d_name[0] != '.') {
+      count++;
+    }
+  }
+  closedir(dir);
+  // Not the one opendir() holds.
+  return count > 0 ? count - 1 : 0;
+}
+
+double Ms(uint64_t ns) { return ns / 1e6; }
+
+}  // namespace
+
+ProcessUsage ReadProcessUsage() {
+  ProcessUsage usage;
+  usage.rss_bytes = ReadRssBytes();
+  usage.open_fds = CountOpenFds();
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+  const struct mallinfo2 info = mallinfo2();
+  usage.heap_in_use_bytes = info.uordblks;
+  usage.heap_free_bytes = info.fordblks;
+  usage.heap_mmap_bytes = info.hblkhd;
+#elif defined(__GLIBC__)
+  // Wraps past 4 GB, which a soak of this process never reaches.
+  const struct mallinfo info = mallinfo();
+  usage.heap_in_use_bytes = static_cast<unsigned int>(info.uordblks);
+  usage.heap_free_bytes = static_cast<unsigned int>(info.fordblks);
+  usage.heap_mmap_bytes = static_cast<unsigned int>(info.hblkhd);
+#endif
+  return usage;
+}
+
+SoakMonitor::SoakMonitor(const SoakThresholds& thresholds)
+    : thresholds_(thresholds),
+      latency_(new Histogram::Snapshot()),
+      scratch_(new Histogram::Snapshot()) {}
+
+SoakMonitor::~SoakMonitor() {
+  if (csv_ != nullptr) {
+    fclose(csv_);
+  }
+}
+
+bool SoakMonitor::OpenCsv(const std::string& path) {
+  csv_ = fopen(path.c_str(), "w");
+  if (csv_ == nullptr) {
+    Log(LogLevel::kError, "[SOAK] cannot open %s", path.c_str());
+    return false;
+  }
+  fprintf(csv_,
+          "elapsed_s,rss_kb,heap_in_use_kb,heap_free_kb,heap_mmap_kb,fds,"
+          "video_queue,buffers_outstanding,buffers_cached_kb,"
+          "frames_decoded,frames_dropped,audio_underruns,latency_samples,"
+          "latency_p50_ms,latency_p99_ms\n");
+  fflush(csv_);
+  return true;
+}
+
+void SoakMonitor::BeginSession(Session* session) {
+  session->video().frame_latency().TakeSnapshot(FrameLatency::kTotal,
+                                                latency_.get());
+}
+
+bool SoakMonitor::Sample(Session* session, double elapsed_s) {
+  const Session::Stats stats = session->stats();
+  SoakSample sample;
+  sample.elapsed_s = elapsed_s;
+  sample.usage = ReadProcessUsage();
+  sample.video_queue_depth = stats.video.queue_depth;
+  sample.buffers_outstanding = stats.pool.outstanding;
+  sample.buffers_cached_bytes = stats.pool.cached_bytes;
+  sample.frames_decoded = stats.video.frames_decoded;
+  sample.frames_dropped = stats.video.frames_dropped;
+  sample.audio_underruns = stats.audio.underruns;
+
+  session->video().frame_latency().TakeSnapshot(FrameLatency::kTotal,
+                                                scratch_.get());
+  sample.latency_samples = scratch_->count >= latency_->count
+                               ? scratch_->count - latency_->count
+                               : scratch_->count;
+  sample.latency_p50_ns = scratch_->PercentileSince(*latency_, 50);
+  sample.latency_p99_ns = scratch_->PercentileSince(*latency_, 99);
+  std::swap(latency_, scratch_);
+  return Add(sample);
+}
+
+bool SoakMonitor::Add(const SoakSample& sample) {
+  samples_.push_back(sample);
+  if (csv_ != nullptr) {
+    const ProcessUsage& usage = sample.usage;
+    fprintf(csv_,
+            "%.0f,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64
+            ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64
+            ",%" PRIu64 ",%" PRIu64 ",%.3f,%.3f\n",
+            sample.elapsed_s, usage.rss_bytes / 1024,
+            usage.heap_in_use_bytes / 1024, usage.heap_free_bytes / 1024,
+            usage.heap_mmap_bytes / 1024, usage.open_fds,
+            sample.video_queue_depth, sample.buffers_outstanding,
+            sample.buffers_cached_bytes / 1024, sample.frames_decoded,
+            sample.frames_dropped, sample.audio_underruns,
+            sample.latency_samples, Ms(sample.latency_p50_ns),
+            Ms(sample.latency_p99_ns));
+    fflush(csv_);
+  }
+  if (!failed()) {
+    Check();
+  }
+  return !failed();
+}
+
+template <typename Metric>
+uint64_t SoakMonitor::Median(size_t first, size_t count,
+                             Metric metric) const {
+  std::vector<uint64_t> values;
+  for (size_t i = first; i < first + count && i < samples_.size(); i++) {
+    values.push_back(metric(samples_[i]));
+  }
+  if (values.empty()) {
+    return 0;
+  }
+  std::nth_element(values.begin(), values.begin() + values.size() / 2,
+                   values.end());
+  return values[values.size() / 2];
+}
+
+void SoakMonitor::Check() {
+  const size_t base = thresholds_.warmup_samples;
+  const size_t window = std::max<size_t>(thresholds_.window, 1);
+  if (samples_.size() < base + window) {
+    return;
+  }
+  const size_t last = samples_.size() - window;
+  char line[160];
+  auto growth = [&](const char* name, uint64_t limit, double scale,
+                    const char* unit, uint64_t (*metric)(const SoakSample&)) {
+    const uint64_t baseline = Median(base, window, metric);
+    const uint64_t current = Median(last, window, metric);
+    if (current > baseline && current - baseline > limit) {
+      snprintf(line, sizeof(line), "%s grew %.1f %s, limit %.1f %s", name,
+               (current - baseline) / scale, unit, limit / scale, unit);
+      violations_.push_back(line);
+    }
+  };
+  growth("rss", thresholds_.max_rss_growth_bytes, kMb, "MB",
+         [](const SoakSample& s) { return s.usage.rss_bytes; });
+  growth("heap", thresholds_.max_heap_growth_bytes, kMb, "MB",
+         [](const SoakSample& s) { return s.usage.heap_in_use_bytes; });
+  growth("open fds", thresholds_.max_fd_growth, 1, "",
+         [](const SoakSample& s) { return s.usage.open_fds; });
+
+  const uint64_t queue = Median(
+      last, window, [](const SoakSample& s) { return s.video_queue_depth; });
+  if (queue > thresholds_.max_video_queue_depth) {
+    snprintf(line, sizeof(line), "video queue at %" PRIu64 ", limit %" PRIu64,
+             queue, thresholds_.max_video_queue_depth);
+    violations_.push_back(line);
+  }
+
+  auto p99 = [](const SoakSample& s) { return s.latency_p99_ns; };
+  const uint64_t baseline_p99 = Median(base, window, p99);
+  const uint64_t current_p99 = Median(last, window, p99);
+  const uint64_t limit_p99 =
+      static_cast<uint64_t>(baseline_p99 *
+                            (1 + thresholds_.max_latency_growth)) +
+      thresholds_.latency_slack_ns;
+  if (current_p99 > limit_p99) {
+    snprintf(line, sizeof(line),
+             "latency p99 at %.2f ms, baseline %.2f ms, limit %.2f ms",
+             Ms(current_p99), Ms(baseline_p99), Ms(limit_p99));
+    violations_.push_back(line);
+  }
+  for (const std::string& violation : violations_) {
+    Log(LogLevel::kError, "[SOAK] %s", violation.c_str());
+  }
+}
+
+std::string SoakMonitor::Summary() const {
+  std::string summary;
+  char line[160];
+  const double hours =
+      samples_.empty() ? 0 : samples_.back().elapsed_s / 3600.0;
+  snprintf(line, sizeof(line), "soak: %zu samples over %.2f h\n",
+           samples_.size(), hours);
+  summary += line;
+
+  const size_t base = thresholds_.warmup_samples;
+  const size_t window = std::max<size_t>(thresholds_.window, 1);
+  if (samples_.size() >= base + window) {
+    const size_t last = samples_.size() - window;
+    snprintf(line, sizeof(line), "  %-18s %12s %12s %12s\n", "median of",
+             "baseline", "final", "change");
+    summary += line;
+    auto row = [&](const char* name, double scale,
+                   uint64_t (*metric)(const SoakSample&)) {
+      const double baseline = Median(base, window, metric) / scale;
+      const double current = Median(last, window, metric) / scale;
+      snprintf(line, sizeof(line), "  %-18s %12.2f %12.2f %+12.2f\n", name,
+               baseline, current, current - baseline);
+      summary += line;
+    };
+    row("rss MB", kMb, [](const SoakSample& s) { return s.usage.rss_bytes; });
+    row("heap in use MB", kMb,
+        [](const SoakSample& s) { return s.usage.heap_in_use_bytes; });
+    row("heap free MB", kMb,
+        [](const SoakSample& s) { return s.usage.heap_free_bytes; });
+    row("open fds", 1, [](const SoakSample& s) { return s.usage.open_fds; });
+    row("video queue", 1,
+        [](const SoakSample& s) { return s.video_queue_depth; });
+    row("buffers out", 1,
+        [](const SoakSample& s) { return s.buffers_outstanding; });
+    row("latency p50 ms", 1e6,
+        [](const SoakSample& s) { return s.latency_p50_ns; });
+    row("latency p99 ms", 1e6,
+        [](const SoakSample& s) { return s.latency_p99_ns; });
+  } else {
+    summary += "  too short to compare against a baseline\n";
+  }
+  if (!samples_.empty()) {
+    const SoakSample& final_sample = samples_.back();
+    snprintf(line, sizeof(line),
+             "  frames decoded %" PRIu64 ", dropped %" PRIu64
+             ", audio underruns %" PRIu64 "\n",
+             final_sample.frames_decoded, final_sample.frames_dropped,
+             final_sample.audio_underruns);
+    summary += line;
+  }
+
+  if (violations_.empty()) {
+    summary += "result: PASS\n";
+  } else {
+    summary += "result: FAIL\n";
+    for (const std::string& violation : violations_) {
+      summary += "  " + violation + "\n";
+    }
+  }
+  return summary;
+}
+
+}  // namespace carlink
@@ -0,0 +1,110 @@
+#ifndef CARLINK_CORE_SOAK_MONITOR_H_
+#define CARLINK_CORE_SOAK_MONITOR_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "core/histogram.h"
+#include "core/session.h"
+
+namespace carlink {
+
+// Resource usage of the whole process.
+struct ProcessUsage {
+  uint64_t rss_bytes = 0;
+  // glibc malloc: bytes handed out, free bytes it keeps, and bytes in
+  // mmapped chunks. 0 without glibc.
+  uint64_t heap_in_use_bytes = 0;
+  uint64_t heap_free_bytes = 0;
+  uint64_t heap_mmap_bytes = 0;
+  uint64_t open_fds = 0;
+};
+
+ProcessUsage ReadProcessUsage();
+
+// One row of a soak run.
+struct SoakSample {
+  double elapsed_s = 0;
+  ProcessUsage usage;
+  uint64_t video_queue_depth = 0;
+  uint64_t buffers_outstanding = 0;
+  uint64_t buffers_cached_bytes = 0;
+  uint64_t frames_decoded = 0;
+  uint64_t frames_dropped = 0;
+  uint64_t audio_underruns = 0;
+  // Arrival to sink over the interval since the previous sample.
+  uint64_t latency_samples = 0;
+  uint64_t latency_p50_ns = 0;
+  uint64_t latency_p99_ns = 0;
+};
+
+// How far a soak run may drift. Each metric is compared as the median of
+// the last |window| samples against the median of the |window| samples
+// after the warmup, so one slow minute does not fail a run but a leak or
+// a slowdown that persists does.
+struct SoakThresholds {
+  // Samples skipped before the baseline while caches and pools fill.
+  size_t warmup_samples = 5;
+  size_t window = 5;
+  uint64_t max_rss_growth_bytes = 64ull << 20;
+  uint64_t max_heap_growth_bytes = 32ull << 20;
+  uint64_t max_fd_growth = 8;
+  // Absolute, not drift: a queue that stays this deep is falling behind.
+  uint64_t max_video_queue_depth = 16;
+  // p99 latency may grow by this fraction of the baseline plus the slack.
+  double max_latency_growth = 0.5;
+  uint64_t latency_slack_ns = 5000000;
+};
+
+// Samples a long-running session, typically once a minute, writes every
+// sample as a CSV row and checks the drift thresholds after each one.
+class SoakMonitor {
+ public:
+  explicit SoakMonitor(const SoakThresholds& thresholds = SoakThresholds());
+  ~SoakMonitor();
+
+  SoakMonitor(const SoakMonitor&) = delete;
+  SoakMonitor& operator=(const SoakMonitor&) = delete;
+
+  // Writes the header now and a row per sample, flushed, so a run killed
+  // after hours still leaves its data.
+  bool OpenCsv(const std::string& path);
+
+  // Latency percentiles of the next Sample() start from |session|'s
+  // current histogram. Call when a session starts.
+  void BeginSession(Session* session);
+  // Samples |session| |elapsed_s| into the run and adds the sample.
+  // Returns false once a threshold is exceeded.
+  bool Sample(Session* session, double elapsed_s);
+  // Adds a sample taken elsewhere, e.g. by a test.
+  bool Add(const SoakSample& sample);
+
+  bool failed() const { return !violations_.empty(); }
+  // Why the run failed, one line per threshold exceeded.
+  const std::vector<std::string>& violations() const { return violations_; }
+  const std::vector<SoakSample>& samples() const { return samples_; }
+
+  // Baseline against final values of every metric, and the verdict.
+  std::string Summary() const;
+
+ private:
+  // Median of |metric| over |count| samples from |first|.
+  template <typename Metric>
+  uint64_t Median(size_t first, size_t count, Metric metric) const;
+  void Check();
+
+  const SoakThresholds thresholds_;
+  FILE* csv_ = nullptr;
+  std::vector<SoakSample> samples_;
+  std::vector<std::string> violations_;
+  // Latency histogram of the current session at the previous sample.
+  std::unique_ptr<Histogram::Snapshot> latency_;
+  std::unique_ptr<Histogram::Snapshot> scratch_;
+};
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_SOAK_MONITOR_H_
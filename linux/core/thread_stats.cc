@@ -0,0 +1,137 @@
+#include "core/thread_stats.h"
+
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "core/clock.h"
+
+namespace carlink {
+
+namespace {
+
+// Reads a small /proc file whole; false if it vanished with its thread.
+bool ReadProcFile(const std::string& path, std::string* contents) {
+  FILE* file = fopen(path.c_str(), "r");
+  if (file == nullptr) {
+    return false;
+  }
+  char buffer[4096];
+  const size_t length = fread(buffer, 1, sizeof(buffer) - 1, file);
+  fclose(file);
+  contents->assign(buffer, length);
+  return true;
+}
+
+// The value after "\n<key>:" in a status file.
+uint64_t StatusField(const std::string& status, const char* key) {
+  const size_t at = status.find(key);
+  return at == std::string::npos
+             ? 0
+             : strtoull(status.c_str() + at + strlen(key) + 1, nullptr, 10);
+}
+
+bool ReadThread(int tid, ThreadStats* stats) {
+  const std::string dir = "/proc/self/task/" + std::to_string(tid) + "/";
+  std::string stat;
+  if (!ReadProcFile(dir + "stat", &stat)) {
+    return false;
+  }
+  // "tid (comm) state ..."; comm may hold spaces and parentheses.
+  const size_t open = stat.find('(');
+  const size_t close = stat.rfind(')');
+  if (open == std::string::npos || close == std::string::npos ||
+      close < open) {
+    return false;
+  }
+  stats->tid = tid;
+  stats->name = stat.substr(open + 1, close - open - 1);
+
+  // Fields 14 and 15, utime and stime, counting from the state as 3.
+  const char* field = stat.c_str() + close + 2;
+  unsigned long long utime = 0;
+  unsigned long long stime = 0;
+  if (sscanf(field, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu",
+             &utime, &stime) != 2) {
+    return false;
+  }
+
+  std::string schedstat;
+  unsigned long long run_ns = 0;
+  unsigned long long wait_ns = 0;
+  if (ReadProcFile(dir + "schedstat", &schedstat) &&
+      sscanf(schedstat.c_str(), "%llu %llu", &run_ns, &wait_ns) == 2) {
+    stats->cpu_ns = run_ns;
+    stats->run_delay_ns = wait_ns;
+  } else {
+    static const long ticks_per_second = sysconf(_SC_CLK_TCK);
+    stats->cpu_ns = (utime + stime) * (1000000000ull / ticks_per_second);
+  }
+
+  std::string status;
+  if (ReadProcFile(dir + "status", &status)) {
+    stats->voluntary_switches =
+        StatusField(status, "\nvoluntary_ctxt_switches");
+    stats->involuntary_switches =
+        StatusField(status, "\nnonvoluntary_ctxt_switches");
+  }
+  return true;
+}
+
+}  // namespace
+
+void SetCurrentThreadName(const char* name) {
+  char truncated[16];
+  snprintf(truncated, sizeof(truncated), "%s", name);
+  pthread_setname_np(pthread_self(), truncated);
+}
+
+std::vector<ThreadStats> ReadThreadStats() {
+  std::vector<ThreadStats> threads;
+  DIR* dir = opendir("/proc/self/task");
+  if (dir == nullptr) {
+    return threads;
+  }
+  while (const dirent* entry = readdir(dir)) {
+    const int tid = atoi(entry->d_name);
+    ThreadStats stats;
+    if (tid > 0 && ReadThread(tid, &stats)) {
+      threads.push_back(stats);
+    }
+  }
+  closedir(dir);
+  std::sort(threads.begin(), threads.end(),
+            [](const ThreadStats& a, const ThreadStats& b) {
+              return a.tid < b.tid;
+            });
+  return threads;
+}
+
+std::vector<ThreadStats> ThreadStatsSampler::Sample() {
+  const int64_t now = MonotonicNanos();
+  std::vector<ThreadStats> threads = ReadThreadStats();
+  std::map<int, uint64_t> cpu_ns;
+  for (ThreadStats& thread : threads) {
+    cpu_ns[thread.tid] = thread.cpu_ns;
+    if (last_sample_ns_ == 0 || now <= last_sample_ns_) {
+      continue;
+    }
+    // A thread missing from the last sample started since.
+    const auto last = last_cpu_ns_.find(thread.tid);
+    const uint64_t previous = last != last_cpu_ns_.end() ? last->second : 0;
+    if (thread.cpu_ns >= previous) {
+      thread.cpu_percent =
+          100.0 * (thread.cpu_ns - previous) / (now - last_sample_ns_);
+    }
+  }
+  last_cpu_ns_.swap(cpu_ns);
+  last_sample_ns_ = now;
+  return threads;
+}
+
+}  // namespace carlink
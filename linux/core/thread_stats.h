@@ -0,0 +1,48 @@
+#ifndef CARLINK_CORE_THREAD_STATS_H_
+#define CARLINK_CORE_THREAD_STATS_H_
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace carlink {
+
+// Names the calling thread for top -H, perf, gdb and ThreadStats. Linux
+// keeps 15 characters; longer names are cut.
+void SetCurrentThreadName(const char* name);
+
+// One thread's scheduling counters, from /proc/self/task/<tid>.
+struct ThreadStats {
+  int tid = 0;
+  std::string name;
+  // Time on a CPU: schedstat when the kernel has it, else utime + stime at
+  // clock tick resolution.
+  uint64_t cpu_ns = 0;
+  // Runnable but waiting for a CPU; 0 without schedstat.
+  uint64_t run_delay_ns = 0;
+  // Blocked (I/O, locks, sleeps) vs preempted.
+  uint64_t voluntary_switches = 0;
+  uint64_t involuntary_switches = 0;
+  // Share of one CPU since the previous ThreadStatsSampler::Sample().
+  double cpu_percent = 0;
+};
+
+// Every thread of the process, by tid. Threads exiting meanwhile are
+// skipped.
+std::vector<ThreadStats> ReadThreadStats();
+
+// ReadThreadStats() plus each thread's CPU share between two calls. Not
+// thread-safe.
+class ThreadStatsSampler {
+ public:
+  std::vector<ThreadStats> Sample();
+
+ private:
+  int64_t last_sample_ns_ = 0;
+  std::map<int, uint64_t> last_cpu_ns_;
+};
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_THREAD_STATS_H_
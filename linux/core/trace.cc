@@ -0,0 +1,245 @@
+#include "core/trace.h"
+
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "core/log.h"
+
+namespace carlink {
+
+namespace internal {
+std::atomic<bool> g_trace_enabled{false};
+}  // namespace internal
+
+namespace {
+
+struct TraceEvent {
+  int64_t timestamp_ns;
+  const char* name;
+  int64_t arg;
+  // Saturates at ~4.3 s.
+  uint32_t duration_ns;
+  // Chrome trace phase: 'X' complete, 'i' instant, 'C' counter.
+  char phase;
+};
+static_assert(sizeof(TraceEvent) == 32, "keep events to half a cache line");
+
+// One thread's ring. Only the owner writes; the exporter copies events and
+// then drops any the owner may have overwritten during the copy.
+struct ThreadBuffer {
+  explicit ThreadBuffer(pid_t tid) : tid(tid), events(kTraceEventsPerThread) {
+    char thread_name[16] = {};
+    pthread_getname_np(pthread_self(), thread_name, sizeof(thread_name));
+    name = thread_name;
+  }
+
+  const pid_t tid;
+  std::string name;
+  std::vector<TraceEvent> events;
+  // Events ever written; the next one goes to head % size.
+  std::atomic<uint64_t> head{0};
+  // Set once the owner exited: the ring is complete, and freed once
+  // exported.
+  std::atomic<bool> exited{false};
+};
+
+std::mutex& RegistryMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+// Buffers outlive their threads until exported, so short-lived threads
+// still show up.
+std::vector<std::shared_ptr<ThreadBuffer>>& Registry() {
+  static std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+  return buffers;
+}
+
+// Drops the registry's hold on |rings|.
+void Forget(const std::vector<std::shared_ptr<ThreadBuffer>>& rings) {
+  std::lock_guard<std::mutex> lock(RegistryMutex());
+  std::vector<std::shared_ptr<ThreadBuffer>>& registry = Registry();
+  for (const std::shared_ptr<ThreadBuffer>& ring : rings) {
+    registry.erase(std::remove(registry.begin(), registry.end(), ring),
+                   registry.end());
+  }
+}
+
+std::atomic<int64_t> g_trace_start_ns{0};
+
+thread_local ThreadBuffer* t_buffer = nullptr;
+// Set while the thread's destructors run; it records nothing more.
+thread_local bool t_exiting = false;
+
+// Marks the thread's ring when the thread exits.
+struct RingOwner {
+  ~RingOwner() {
+    t_exiting = true;
+    t_buffer = nullptr;
+    ring->exited.store(true, std::memory_order_release);
+  }
+  std::shared_ptr<ThreadBuffer> ring;
+};
+
+ThreadBuffer* CurrentBuffer() {
+  if (t_buffer == nullptr && !t_exiting) {
+    auto buffer = std::make_shared<ThreadBuffer>(
+        static_cast<pid_t>(syscall(SYS_gettid)));
+    // Constructed here, off the hot path, so only tracing threads pay for
+    // its destructor.
+    static thread_local RingOwner owner;
+    owner.ring = buffer;
+    std::lock_guard<std::mutex> lock(RegistryMutex());
+    Registry().push_back(buffer);
+    t_buffer = buffer.get();
+  }
+  return t_buffer;
+}
+
+// Copies the events still in |buffer|, oldest first.
+std::vector<TraceEvent> Snapshot(const ThreadBuffer& buffer) {
+  const uint64_t head = buffer.head.load(std::memory_order_acquire);
+  const uint64_t begin =
+      head > kTraceEventsPerThread ? head - kTraceEventsPerThread : 0;
+  std::vector<TraceEvent> events;
+  events.reserve(head - begin);
+  for (uint64_t i = begin; i < head; i++) {
+    events.push_back(buffer.events[i % kTraceEventsPerThread]);
+  }
+  // Whatever the owner wrote meanwhile replaced the oldest events, and the
+  // one it may be writing now, at index |after|, replaces one more unless
+  // the owner has exited.
+  const bool exited = buffer.exited.load(std::memory_order_acquire);
+  const uint64_t after = buffer.head.load(std::memory_order_acquire);
+  const uint64_t reused = exited ? after : after + 1;
+  const uint64_t overwritten =
+      reused > kTraceEventsPerThread ? reused - kTraceEventsPerThread : 0;
+  if (overwritten > begin) {
+    events.erase(events.begin(),
+                 events.begin() +
+                     std::min<uint64_t>(overwritten - begin, events.size()));
+  }
+  return events;
+}
+
+}  // namespace
+
+namespace internal {
+
+void Append(char phase, const char* name, int64_t timestamp_ns,
+            int64_t duration_ns, int64_t arg) {
+  ThreadBuffer* buffer = CurrentBuffer();
+  if (buffer == nullptr) {
+    return;
+  }
+  const uint64_t head = buffer->head.load(std::memory_order_relaxed);
+  TraceEvent& event = buffer->events[head % kTraceEventsPerThread];
+  event.timestamp_ns = timestamp_ns;
+  event.name = name;
+  event.arg = arg;
+  event.duration_ns = duration_ns > UINT32_MAX
+                          ? UINT32_MAX
+                          : static_cast<uint32_t>(duration_ns);
+  event.phase = phase;
+  buffer->head.store(head + 1, std::memory_order_release);
+}
+
+}  // namespace internal
+
+void StartTracing() {
+  {
+    // Nothing they hold would be exported.
+    std::lock_guard<std::mutex> lock(RegistryMutex());
+    std::vector<std::shared_ptr<ThreadBuffer>>& registry = Registry();
+    registry.erase(
+        std::remove_if(registry.begin(), registry.end(),
+                       [](const std::shared_ptr<ThreadBuffer>& buffer) {
+                         return buffer->exited.load(std::memory_order_acquire);
+                       }),
+        registry.end());
+  }
+  g_trace_start_ns.store(MonotonicNanos(), std::memory_order_relaxed);
+  internal::g_trace_enabled.store(true, std::memory_order_relaxed);
+  Log(LogLevel::kInfo, "[TRACE] started");
+}
+
+void StopTracing() {
+  internal::g_trace_enabled.store(false, std::memory_order_relaxed);
+}
+
+bool WriteChromeTrace(const std::string& path) {
+  FILE* file = fopen(path.c_str(), "w");
+  if (file == nullptr) {
+    Log(LogLevel::kError, "[TRACE] cannot open %s", path.c_str());
+    return false;
+  }
+
+  std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+  {
+    std::lock_guard<std::mutex> lock(RegistryMutex());
+    buffers = Registry();
+  }
+  // Rings of threads that exited are complete once written out here.
+  std::vector<std::shared_ptr<ThreadBuffer>> exited;
+  for (const std::shared_ptr<ThreadBuffer>& buffer : buffers) {
+    if (buffer->exited.load(std::memory_order_acquire)) {
+      exited.push_back(buffer);
+    }
+  }
+  const int pid = getpid();
+  const int64_t start_ns = g_trace_start_ns.load(std::memory_order_relaxed);
+  size_t written = 0;
+
+  fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  bool first = true;
+  for (const std::shared_ptr<ThreadBuffer>& buffer : buffers) {
+    fprintf(file,
+            "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+            "\"args\":{\"name\":\"%s\"}}",
+            first ? "" : ",\n", pid, buffer->tid, buffer->name.c_str());
+    first = false;
+    for (const TraceEvent& event : Snapshot(*buffer)) {
+      if (event.timestamp_ns < start_ns) {
+        continue;
+      }
+      // Microseconds with nanosecond decimals.
+      const double ts = (event.timestamp_ns - start_ns) / 1e3;
+      if (event.phase == 'X') {
+        fprintf(file,
+                ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+                "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"arg\":%" PRId64 "}}",
+                event.name, pid, buffer->tid, ts, event.duration_ns / 1e3,
+                event.arg);
+      } else if (event.phase == 'C') {
+        fprintf(file,
+                ",\n{\"name\":\"%s\",\"ph\":\"C\",\"pid\":%d,\"tid\":%d,"
+                "\"ts\":%.3f,\"args\":{\"value\":%" PRId64 "}}",
+                event.name, pid, buffer->tid, ts, event.arg);
+      } else {
+        fprintf(file,
+                ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,"
+                "\"tid\":%d,\"ts\":%.3f,\"args\":{\"arg\":%" PRId64 "}}",
+                event.name, pid, buffer->tid, ts, event.arg);
+      }
+      written++;
+    }
+  }
+  fprintf(file, "\n]}\n");
+  const bool ok = fclose(file) == 0;
+  if (ok) {
+    Forget(exited);
+  }
+  Log(LogLevel::kInfo, "[TRACE] wrote %zu events to %s", written,
+      path.c_str());
+  return ok;
+}
+
+}  // namespace carlink
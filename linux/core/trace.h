@@ -0,0 +1,91 @@
+#ifndef CARLINK_CORE_TRACE_H_
+#define CARLINK_CORE_TRACE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "core/clock.h"
+
+namespace carlink {
+
+// Low-overhead tracing of pipeline events, for seeing how the USB, decoder,
+// audio and main threads interleave. Each thread appends fixed-size events
+// to its own ring without locks; WriteChromeTrace() exports them on demand
+// as Chrome trace JSON, which chrome://tracing and ui.perfetto.dev open.
+//
+// Event names must be string literals: only the pointer is stored. While
+// tracing is stopped every call site costs one relaxed load and a branch
+// predicted not taken.
+
+namespace internal {
+extern std::atomic<bool> g_trace_enabled;
+// Records one event on the calling thread's ring; out of line, so the
+// wrappers below inline to the TraceEnabled() test.
+void Append(char phase, const char* name, int64_t timestamp_ns,
+            int64_t duration_ns, int64_t arg);
+}  // namespace internal
+
+inline bool TraceEnabled() {
+  return __builtin_expect(
+      internal::g_trace_enabled.load(std::memory_order_relaxed), 0);
+}
+
+// Starts recording; events from before are not exported.
+void StartTracing();
+void StopTracing();
+
+// Writes the events recorded since StartTracing(), up to the last
+// kTraceEventsPerThread of each thread. Safe while threads keep tracing.
+// The ring of a thread that has exited is freed once written out.
+bool WriteChromeTrace(const std::string& path);
+
+// Ring size per thread; 1 MiB of events.
+constexpr size_t kTraceEventsPerThread = 32768;
+
+// A span on the calling thread, with an optional numeric argument such as a
+// byte count.
+inline void TraceComplete(const char* name, int64_t start_ns, int64_t end_ns,
+                          int64_t arg = 0) {
+  if (TraceEnabled()) {
+    internal::Append('X', name, start_ns, end_ns - start_ns, arg);
+  }
+}
+inline void TraceInstant(const char* name, int64_t arg = 0) {
+  if (TraceEnabled()) {
+    internal::Append('i', name, MonotonicNanos(), 0, arg);
+  }
+}
+// A value plotted as its own track, e.g. a queue depth.
+inline void TraceCounter(const char* name, int64_t value) {
+  if (TraceEnabled()) {
+    internal::Append('C', name, MonotonicNanos(), 0, value);
+  }
+}
+
+// Records the enclosing scope as a complete event.
+class TraceScope {
+ public:
+  explicit TraceScope(const char* name, int64_t arg = 0)
+      : name_(name), arg_(arg), start_ns_(TraceEnabled() ? MonotonicNanos()
+                                                         : 0) {}
+  ~TraceScope() {
+    if (start_ns_ != 0) {
+      TraceComplete(name_, start_ns_, MonotonicNanos(), arg_);
+    }
+  }
+
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+
+  void set_arg(int64_t arg) { arg_ = arg; }
+
+ private:
+  const char* name_;
+  int64_t arg_;
+  const int64_t start_ns_;
+};
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_TRACE_H_
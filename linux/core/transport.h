@@ -0,0 +1,45 @@
+#ifndef CARLINK_CORE_TRANSPORT_H_
+#define CARLINK_CORE_TRANSPORT_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace carlink {
+
+// The byte pipe to a dongle: the bulk endpoints of a real device, or
+// anything that behaves like them.
+//
+// Read() and Write() may be called concurrently from different threads.
+class Transport {
+ public:
+  virtual ~Transport() = default;
+
+  virtual const char* name() const = 0;
+
+  // Reads up to |length| bytes. Returns the number of bytes read, 0 on
+  // timeout, or a negative value once the transport is broken or closed.
+  virtual int Read(uint8_t* data, size_t length, int timeout_ms) = 0;
+
+  // Writes all |length| bytes. Returns the number written (less than
+  // |length| on timeout) or a negative value on error.
+  virtual int Write(const uint8_t* data, size_t length, int timeout_ms) = 0;
+
+  // Receives what Write() would have returned.
+  using WriteCallback = void (*)(void* context, int result);
+
+  // Starts a write and calls |done| once it finished: maybe before
+  // returning, maybe on another thread. |data| must stay valid until then.
+  // Transports with asynchronous I/O override it; this writes inline.
+  virtual void WriteAsync(const uint8_t* data, size_t length, int timeout_ms,
+                          WriteCallback done, void* context) {
+    done(context, Write(data, length, timeout_ms));
+  }
+
+  // Makes pending and future Read() calls return an error, and completes
+  // pending WriteAsync() calls before returning.
+  virtual void Close() = 0;
+};
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_TRANSPORT_H_
@@ -0,0 +1,426 @@
+#include "core/usb_device.h"
+
+#include <cstdio>
+
+#include "core/log.h"
+#include "core/thread_stats.h"
+
+#ifdef CARLINK_HAVE_LIBUSB
+#include <libusb.h>
+#endif
+
+namespace carlink {
+
+bool IsKnownDongle(uint16_t vendor_id, uint16_t product_id) {
+  return vendor_id == 0x1314 && (product_id == 0x1520 || product_id == 0x1521);
+}
+
+UsbDevice::UsbDevice(std::string identifier)
+    : identifier_(std::move(identifier)) {}
+
+#ifdef CARLINK_HAVE_LIBUSB
+
+namespace {
+
+std::string IdentifierOf(libusb_device* device) {
+  char identifier[16];
+  snprintf(identifier, sizeof(identifier), "%03u:%03u",
+           libusb_get_bus_number(device), libusb_get_device_address(device));
+  return identifier;
+}
+
+}  // namespace
+
+bool IsTransientUsbError(int result) {
+  // Not LIBUSB_ERROR_INTERRUPTED: that is a transfer cancelled on close.
+  return result == LIBUSB_ERROR_IO || result == LIBUSB_ERROR_PIPE ||
+         result == LIBUSB_ERROR_BUSY;
+}
+
+UsbDevice::~UsbDevice() {
+  CancelTransfers();
+  if (event_thread_.joinable()) {
+    events_stopping_.store(true);
+    event_thread_.join();
+  }
+  for (std::unique_ptr<Slot>& slot : slots_) {
+    libusb_free_transfer(slot->transfer);
+  }
+  if (handle_ != nullptr) {
+    libusb_close(handle_);
+  }
+  if (context_ != nullptr) {
+    libusb_exit(context_);
+  }
+}
+
+std::vector<UsbDeviceInfo> UsbDevice::List() {
+  std::vector<UsbDeviceInfo> result;
+  libusb_context* context = nullptr;
+  if (libusb_init(&context) != 0) {
+    Log(LogLevel::kError, "[USB] libusb_init failed");
+    return result;
+  }
+
+  libusb_device** devices = nullptr;
+  const ssize_t count = libusb_get_device_list(context, &devices);
+  for (ssize_t i = 0; i < count; i++) {
+    libusb_device_descriptor descriptor;
+    if (libusb_get_device_descriptor(devices[i], &descriptor) != 0) {
+      continue;
+    }
+    UsbDeviceInfo info;
+    info.identifier = IdentifierOf(devices[i]);
+    info.vendor_id = descriptor.idVendor;
+    info.product_id = descriptor.idProduct;
+    info.configuration_count = descriptor.bNumConfigurations;
+    result.push_back(std::move(info));
+  }
+  if (count >= 0) {
+    libusb_free_device_list(devices, 1);
+  }
+  libusb_exit(context);
+  return result;
+}
+
+std::unique_ptr<UsbDevice> UsbDevice::Open(const std::string& identifier) {
+  std::unique_ptr<UsbDevice> device(new UsbDevice(identifier));
+  if (libusb_init(&device->context_) != 0) {
+    device->context_ = nullptr;
+    return nullptr;
+  }
+
+  libusb_device** devices = nullptr;
+  const ssize_t count = libusb_get_device_list(device->context_, &devices);
+  int result = LIBUSB_ERROR_NO_DEVICE;
+  for (ssize_t i = 0; i < count; i++) {
+    if (IdentifierOf(devices[i]) == identifier) {
+      result = libusb_open(devices[i], &device->handle_);
+      break;
+    }
+  }
+  if (count >= 0) {
+    libusb_free_device_list(devices, 1);
+  }
+
+  if (result != 0) {
+    Log(LogLevel::kError, "[USB] open %s failed: %s", identifier.c_str(),
+        libusb_error_name(result));
+    device->handle_ = nullptr;
+    return nullptr;
+  }
+  libusb_set_auto_detach_kernel_driver(device->handle_, 1);
+  return device;
+}
+
+bool UsbDevice::GetConfiguration(int index,
+                                 UsbConfigurationInfo* configuration) {
+  libusb_config_descriptor* descriptor = nullptr;
+  if (libusb_get_config_descriptor(libusb_get_device(handle_), index,
+                                   &descriptor) != 0) {
+    return false;
+  }
+
+  configuration->id = descriptor->bConfigurationValue;
+  configuration->index = index;
+  configuration->interfaces.clear();
+  for (int i = 0; i < descriptor->bNumInterfaces; i++) {
+    const libusb_interface& interface = descriptor->interface[i];
+    for (int a = 0; a < interface.num_altsetting; a++) {
+      const libusb_interface_descriptor& setting = interface.altsetting[a];
+      UsbInterfaceInfo info;
+      info.id = setting.bInterfaceNumber;
+      info.alternate_setting = setting.bAlternateSetting;
+      for (int e = 0; e < setting.bNumEndpoints; e++) {
+        const libusb_endpoint_descriptor& endpoint = setting.endpoint[e];
+        UsbEndpointInfo endpoint_info;
+        endpoint_info.number = endpoint.bEndpointAddress & 0x0f;
+        endpoint_info.direction = endpoint.bEndpointAddress & 0x80;
+        endpoint_info.max_packet_size = endpoint.wMaxPacketSize;
+        info.endpoints.push_back(endpoint_info);
+      }
+      configuration->interfaces.push_back(std::move(info));
+    }
+  }
+  libusb_free_config_descriptor(descriptor);
+  return true;
+}
+
+bool UsbDevice::SetConfiguration(int id) {
+  int current = -1;
+  if (libusb_get_configuration(handle_, &current) == 0 && current == id) {
+    return true;
+  }
+  return libusb_set_configuration(handle_, id) == 0;
+}
+
+bool UsbDevice::ClaimInterface(int id, int alternate_setting) {
+  if (libusb_claim_interface(handle_, id) != 0) {
+    return false;
+  }
+  return alternate_setting == 0 ||
+         libusb_set_interface_alt_setting(handle_, id, alternate_setting) == 0;
+}
+
+bool UsbDevice::ReleaseInterface(int id) {
+  return libusb_release_interface(handle_, id) == 0;
+}
+
+bool UsbDevice::Reset() {
+  // The dongle re-enumerates after a reset, so NOT_FOUND is expected.
+  const int result = libusb_reset_device(handle_);
+  return result == 0 || result == LIBUSB_ERROR_NOT_FOUND;
+}
+
+int UsbDevice::BulkTransfer(uint8_t endpoint, uint8_t* data, int length,
+                            unsigned int timeout_ms) {
+  int transferred = 0;
+  const int result = libusb_bulk_transfer(handle_, endpoint, data, length,
+                                          &transferred, timeout_ms);
+  if (result == 0 || result == LIBUSB_ERROR_TIMEOUT ||
+      (transferred > 0 && (endpoint & LIBUSB_ENDPOINT_IN) == 0)) {
+    return transferred;
+  }
+  return result;
+}
+
+bool UsbDevice::SubmitBulkTransfer(uint8_t endpoint, uint8_t* data,
+                                   int length, unsigned int timeout_ms,
+                                   TransferCallback done, void* context) {
+  Slot* slot;
+  {
+    std::lock_guard<std::mutex> lock(async_mutex_);
+    if (idle_slots_.empty()) {
+      libusb_transfer* transfer = libusb_alloc_transfer(0);
+      if (transfer == nullptr) {
+        return false;
+      }
+      slots_.emplace_back(new Slot());
+      slots_.back()->device = this;
+      slots_.back()->transfer = transfer;
+      idle_slots_.push_back(slots_.back().get());
+    }
+    slot = idle_slots_.back();
+    idle_slots_.pop_back();
+    slot->done = done;
+    slot->context = context;
+    slot->in_flight = true;
+    in_flight_++;
+    if (!event_thread_.joinable()) {
+      event_thread_ = std::thread(&UsbDevice::RunEvents, this);
+    }
+  }
+
+  libusb_fill_bulk_transfer(slot->transfer, handle_, endpoint, data, length,
+                            &UsbDevice::OnTransferDone, slot, timeout_ms);
+  const int result = libusb_submit_transfer(slot->transfer);
+  if (result != 0) {
+    Log(LogLevel::kWarning, "[USB] submit to %02x failed: %s", endpoint,
+        libusb_error_name(result));
+    std::lock_guard<std::mutex> lock(async_mutex_);
+    slot->in_flight = false;
+    in_flight_--;
+    idle_slots_.push_back(slot);
+    async_cv_.notify_all();
+    return false;
+  }
+  return true;
+}
+
+void UsbDevice::OnTransferDone(libusb_transfer* transfer) {
+  Slot* slot = static_cast<Slot*>(transfer->user_data);
+  int result;
+  switch (transfer->status) {
+    case LIBUSB_TRANSFER_COMPLETED:
+    case LIBUSB_TRANSFER_TIMED_OUT:
+      result = transfer->actual_length;
+      break;
+    case LIBUSB_TRANSFER_CANCELLED:
+      result = LIBUSB_ERROR_INTERRUPTED;
+      break;
+    case LIBUSB_TRANSFER_STALL:
+      result = LIBUSB_ERROR_PIPE;
+      break;
+    case LIBUSB_TRANSFER_NO_DEVICE:
+      result = LIBUSB_ERROR_NO_DEVICE;
+      break;
+    case LIBUSB_TRANSFER_OVERFLOW:
+      result = LIBUSB_ERROR_OVERFLOW;
+      break;
+    default:
+      result = LIBUSB_ERROR_IO;
+      break;
+  }
+  if (result < 0 && transfer->actual_length > 0 &&
+      (transfer->endpoint & LIBUSB_ENDPOINT_IN) == 0) {
+    // Part of it went out: a short write, not an error worth a retry.
+    result = transfer->actual_length;
+  }
+  // The slot is free again before |done| runs, so the callback can submit
+  // the next transfer on it.
+  const TransferCallback done = slot->done;
+  void* const context = slot->context;
+  UsbDevice* device = slot->device;
+  {
+    std::lock_guard<std::mutex> lock(device->async_mutex_);
+    slot->in_flight = false;
+    device->idle_slots_.push_back(slot);
+  }
+  done(context, result);
+  // Counted down only after the callback, so CancelTransfers() returning
+  // means no callback is still running.
+  std::lock_guard<std::mutex> lock(device->async_mutex_);
+  device->in_flight_--;
+  device->async_cv_.notify_all();
+}
+
+void UsbDevice::CancelTransfers() {
+  std::unique_lock<std::mutex> lock(async_mutex_);
+  for (std::unique_ptr<Slot>& slot : slots_) {
+    if (slot->in_flight) {
+      libusb_cancel_transfer(slot->transfer);
+    }
+  }
+  async_cv_.wait(lock, [this] { return in_flight_ == 0; });
+}
+
+void UsbDevice::RunEvents() {
+  SetCurrentThreadName("carlink-usb-ev");
+  // The timeout bounds how long the destructor waits for this thread.
+  while (!events_stopping_.load()) {
+    struct timeval timeout = {0, 100000};
+    libusb_handle_events_timeout_completed(context_, &timeout, nullptr);
+  }
+}
+
+#else  // CARLINK_HAVE_LIBUSB
+
+bool IsTransientUsbError(int result) {
+  return false;
+}
+
+UsbDevice::~UsbDevice() = default;
+
+std::vector<UsbDeviceInfo> UsbDevice::List() {
+  return {};
+}
+
+std::unique_ptr<UsbDevice> UsbDevice::Open(const std::string& identifier) {
+  Log(LogLevel::kError, "[USB] built without libusb");
+  return nullptr;
+}
+
+bool UsbDevice::GetConfiguration(int index,
+                                 UsbConfigurationInfo* configuration) {
+  return false;
+}
+
+bool UsbDevice::SetConfiguration(int id) {
+  return false;
+}
+
+bool UsbDevice::ClaimInterface(int id, int alternate_setting) {
+  return false;
+}
+
+bool UsbDevice::ReleaseInterface(int id) {
+  return false;
+}
+
+bool UsbDevice::Reset() {
+  return false;
+}
+
+int UsbDevice::BulkTransfer(uint8_t endpoint, uint8_t* data, int length,
+                            unsigned int timeout_ms) {
+  return -1;
+}
+
+bool UsbDevice::SubmitBulkTransfer(uint8_t endpoint, uint8_t* data,
+                                   int length, unsigned int timeout_ms,
+                                   TransferCallback done, void* context) {
+  return false;
+}
+
+void UsbDevice::CancelTransfers() {}
+
+#endif  // CARLINK_HAVE_LIBUSB
+
+UsbTransport::UsbTransport(std::shared_ptr<UsbDevice> device,
+                           uint8_t endpoint_in, uint8_t endpoint_out)
+    : device_(std::move(device)),
+      endpoint_in_(endpoint_in),
+      endpoint_out_(endpoint_out) {}
+
+std::unique_ptr<UsbTransport> UsbTransport::OpenDongle() {
+  for (const UsbDeviceInfo& info : UsbDevice::List()) {
+    if (!IsKnownDongle(info.vendor_id, info.product_id)) {
+      continue;
+    }
+    std::unique_ptr<UsbDevice> device = UsbDevice::Open(info.identifier);
+    UsbConfigurationInfo configuration;
+    if (!device || !device->GetConfiguration(0, &configuration) ||
+        configuration.interfaces.empty() ||
+        !device->SetConfiguration(configuration.id)) {
+      continue;
+    }
+    const UsbInterfaceInfo& interface = configuration.interfaces.front();
+    if (!device->ClaimInterface(interface.id, interface.alternate_setting)) {
+      continue;
+    }
+
+    int endpoint_in = -1;
+    int endpoint_out = -1;
+    for (const UsbEndpointInfo& endpoint : interface.endpoints) {
+      if (endpoint.direction == 0x80 && endpoint_in < 0) {
+        endpoint_in = endpoint.address();
+      } else if (endpoint.direction == 0x00 && endpoint_out < 0) {
+        endpoint_out = endpoint.address();
+      }
+    }
+    if (endpoint_in < 0 || endpoint_out < 0) {
+      continue;
+    }
+
+    Log(LogLevel::kInfo, "[USB] opened dongle %04x:%04x at %s",
+        info.vendor_id, info.product_id, info.identifier.c_str());
+    return std::unique_ptr<UsbTransport>(
+        new UsbTransport(std::move(device), endpoint_in, endpoint_out));
+  }
+  return nullptr;
+}
+
+int UsbTransport::Read(uint8_t* data, size_t length, int timeout_ms) {
+  if (closed_.load(std::memory_order_acquire)) {
+    return -1;
+  }
+  return device_->BulkTransfer(endpoint_in_, data, static_cast<int>(length),
+                               timeout_ms);
+}
+
+int UsbTransport::Write(const uint8_t* data, size_t length, int timeout_ms) {
+  if (closed_.load(std::memory_order_acquire)) {
+    return -1;
+  }
+  // libusb takes a non-const buffer for both directions.
+  return device_->BulkTransfer(endpoint_out_, const_cast<uint8_t*>(data),
+                               static_cast<int>(length), timeout_ms);
+}
+
+void UsbTransport::WriteAsync(const uint8_t* data, size_t length,
+                              int timeout_ms, WriteCallback done,
+                              void* context) {
+  if (closed_.load(std::memory_order_acquire) ||
+      !device_->SubmitBulkTransfer(endpoint_out_, const_cast<uint8_t*>(data),
+                                   static_cast<int>(length), timeout_ms, done,
+                                   context)) {
+    done(context, -1);
+  }
+}
+
+void UsbTransport::Close() {
+  closed_.store(true, std::memory_order_release);
+  device_->CancelTransfers();
+}
+
+}  // namespace carlink
@@ -0,0 +1,171 @@
+#ifndef CARLINK_CORE_USB_DEVICE_H_
+#define CARLINK_CORE_USB_DEVICE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "core/transport.h"
+
+#ifdef CARLINK_HAVE_LIBUSB
+struct libusb_context;
+struct libusb_device_handle;
+struct libusb_transfer;
+#endif
+
+namespace carlink {
+
+// Mirrors the maps in lib/usb.dart.
+struct UsbEndpointInfo {
+  uint8_t number = 0;
+  // 0x80 for IN, 0x00 for OUT.
+  uint8_t direction = 0;
+  uint16_t max_packet_size = 0;
+
+  uint8_t address() const { return number | direction; }
+};
+
+struct UsbInterfaceInfo {
+  int id = 0;
+  int alternate_setting = 0;
+  std::vector<UsbEndpointInfo> endpoints;
+};
+
+struct UsbConfigurationInfo {
+  int id = 0;
+  int index = 0;
+  std::vector<UsbInterfaceInfo> interfaces;
+};
+
+struct UsbDeviceInfo {
+  // "<bus>:<address>", stable until the device is unplugged or reset.
+  std::string identifier;
+  uint16_t vendor_id = 0;
+  uint16_t product_id = 0;
+  int configuration_count = 0;
+};
+
+// knownDevices in lib/driver/sendable.dart.
+bool IsKnownDongle(uint16_t vendor_id, uint16_t product_id);
+
+// A negative bulk transfer result worth another attempt: the device is
+// still there, e.g. an I/O error or a stall. A cancelled transfer is final.
+bool IsTransientUsbError(int result);
+
+// An opened USB device. Each instance owns its own libusb context, so
+// several dongles can be driven independently.
+//
+// Without libusb every operation fails.
+class UsbDevice {
+ public:
+  ~UsbDevice();
+
+  UsbDevice(const UsbDevice&) = delete;
+  UsbDevice& operator=(const UsbDevice&) = delete;
+
+  static std::vector<UsbDeviceInfo> List();
+
+  // Returns nullptr if the device is gone or cannot be opened.
+  static std::unique_ptr<UsbDevice> Open(const std::string& identifier);
+
+  const std::string& identifier() const { return identifier_; }
+
+  bool GetConfiguration(int index, UsbConfigurationInfo* configuration);
+  bool SetConfiguration(int id);
+  bool ClaimInterface(int id, int alternate_setting);
+  bool ReleaseInterface(int id);
+  bool Reset();
+
+  // Returns the bytes transferred, which may be short on timeout, or a
+  // negative libusb error. An OUT transfer that failed part way returns
+  // the bytes that went out, as resending them would repeat them.
+  int BulkTransfer(uint8_t endpoint, uint8_t* data, int length,
+                   unsigned int timeout_ms);
+
+  // Receives what BulkTransfer() would have returned; LIBUSB_ERROR_
+  // INTERRUPTED when cancelled.
+  using TransferCallback = void (*)(void* context, int result);
+
+  // Queues a bulk transfer and returns at once. |done| runs on the
+  // device's event thread, started on first use; |data| must stay valid
+  // until then. Returns false, without calling |done|, if the transfer
+  // could not be submitted. Transfers are recycled, so a steady stream of
+  // them allocates nothing.
+  bool SubmitBulkTransfer(uint8_t endpoint, uint8_t* data, int length,
+                          unsigned int timeout_ms, TransferCallback done,
+                          void* context);
+
+  // Cancels the submitted transfers and waits for their callbacks.
+  void CancelTransfers();
+
+ private:
+#ifdef CARLINK_HAVE_LIBUSB
+  // One libusb transfer and the callback it completes to.
+  struct Slot {
+    UsbDevice* device = nullptr;
+    libusb_transfer* transfer = nullptr;
+    TransferCallback done = nullptr;
+    void* context = nullptr;
+    bool in_flight = false;
+  };
+
+  static void OnTransferDone(libusb_transfer* transfer);
+  void RunEvents();
+#endif
+
+  explicit UsbDevice(std::string identifier);
+
+  std::string identifier_;
+#ifdef CARLINK_HAVE_LIBUSB
+  libusb_context* context_ = nullptr;
+  libusb_device_handle* handle_ = nullptr;
+
+  // Asynchronous transfers.
+  std::mutex async_mutex_;
+  std::condition_variable async_cv_;
+  std::vector<std::unique_ptr<Slot>> slots_;
+  std::vector<Slot*> idle_slots_;
+  int in_flight_ = 0;
+  std::thread event_thread_;
+  std::atomic<bool> events_stopping_{false};
+#endif
+};
+
+// Transport over the bulk endpoints of a claimed dongle interface. The
+// device is shared so the plugin can keep serving bulkTransferOut calls
+// from Dart on it.
+class UsbTransport : public Transport {
+ public:
+  UsbTransport(std::shared_ptr<UsbDevice> device, uint8_t endpoint_in,
+               uint8_t endpoint_out);
+
+  // Opens the first known dongle the same way UsbDeviceWrapper.open() does:
+  // configuration 0, first interface, its bulk IN/OUT endpoints.
+  static std::unique_ptr<UsbTransport> OpenDongle();
+
+  UsbDevice* device() const { return device_.get(); }
+
+  const char* name() const override { return "usb"; }
+  int Read(uint8_t* data, size_t length, int timeout_ms) override;
+  int Write(const uint8_t* data, size_t length, int timeout_ms) override;
+  // A libusb asynchronous transfer, completed on the device's event thread.
+  void WriteAsync(const uint8_t* data, size_t length, int timeout_ms,
+                  WriteCallback done, void* context) override;
+  // Also cancels the device's asynchronous transfers and waits for them.
+  void Close() override;
+
+ private:
+  std::shared_ptr<UsbDevice> device_;
+  uint8_t endpoint_in_;
+  uint8_t endpoint_out_;
+  std::atomic<bool> closed_{false};
+};
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_USB_DEVICE_H_
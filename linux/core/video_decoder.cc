@@ -0,0 +1,33 @@
+#include "core/video_decoder.h"
+
+namespace carlink {
+
+namespace {
+
+// Stand-in for builds without a codec library: the transport, demux and
+// queueing stages still run, but no pictures come out.
+class NullVideoDecoder : public VideoDecoder {
+ public:
+  const char* name() const override { return "null"; }
+
+  bool Decode(const uint8_t* data, size_t length,
+              const FrameCallback& on_frame) override {
+    return true;
+  }
+
+  void Reset() override {}
+};
+
+}  // namespace
+
+std::unique_ptr<VideoDecoder> CreateVideoDecoder() {
+#ifdef CARLINK_HAVE_FFMPEG
+  std::unique_ptr<VideoDecoder> decoder = CreateFfmpegVideoDecoder();
+  if (decoder) {
+    return decoder;
+  }
+#endif
+  return std::unique_ptr<VideoDecoder>(new NullVideoDecoder());
+}
+
+}  // namespace carlink
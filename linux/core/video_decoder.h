@@ -0,0 +1,56 @@
+#ifndef CARLINK_CORE_VIDEO_DECODER_H_
+#define CARLINK_CORE_VIDEO_DECODER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include "core/frame_latency.h"
+
+namespace carlink {
+
+// A decoded I420 picture. Planes are owned by the decoder and only valid
+// inside the frame callback.
+struct VideoFrame {
+  int width = 0;
+  int height = 0;
+  const uint8_t* y = nullptr;
+  const uint8_t* u = nullptr;
+  const uint8_t* v = nullptr;
+  int y_stride = 0;
+  int uv_stride = 0;
+  // Set by VideoPipeline for its sink: the stamps of the access unit this
+  // picture came from, and where to record the stages after decoding.
+  const FrameTimestamps* timestamps = nullptr;
+  FrameLatency* latency = nullptr;
+};
+
+class VideoDecoder {
+ public:
+  using FrameCallback = std::function<void(const VideoFrame& frame)>;
+
+  virtual ~VideoDecoder() = default;
+
+  virtual const char* name() const = 0;
+
+  // Decodes one Annex-B access unit, calling |on_frame| for every picture
+  // it produces before returning. Returns false on a decode error.
+  virtual bool Decode(const uint8_t* data, size_t length,
+                      const FrameCallback& on_frame) = 0;
+
+  // Drops decoder state; the next access unit should be an IDR.
+  virtual void Reset() = 0;
+};
+
+// Returns the FFmpeg decoder when the core was built with libavcodec, or a
+// decoder that accepts access units without producing pictures.
+std::unique_ptr<VideoDecoder> CreateVideoDecoder();
+
+#ifdef CARLINK_HAVE_FFMPEG
+std::unique_ptr<VideoDecoder> CreateFfmpegVideoDecoder();
+#endif
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_VIDEO_DECODER_H_
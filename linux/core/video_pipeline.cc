@@ -0,0 +1,308 @@
+#include "core/video_pipeline.h"
+
+#include "core/clock.h"
+#include "core/log.h"
+#include "core/nal_scanner.h"
+#include "core/thread_stats.h"
+#include "core/trace.h"
+
+namespace carlink {
+
+VideoPipeline::VideoPipeline(std::unique_ptr<VideoDecoder> decoder,
+                             FrameSink* sink,
+                             size_t queue_capacity)
+    : decoder_(std::move(decoder)), sink_(sink), queue_(queue_capacity) {
+  on_frame_ = [this](const VideoFrame& frame) {
+    counters_.Add(kFramesDecoded);
+    timestamps_.decode_end_ns = MonotonicNanos();
+    latency_.Record(FrameLatency::kDemux, timestamps_.arrival_ns,
+                    timestamps_.demux_ns);
+    latency_.Record(FrameLatency::kQueue, timestamps_.demux_ns,
+                    timestamps_.decode_start_ns);
+    latency_.Record(FrameLatency::kDecode, timestamps_.decode_start_ns,
+                    timestamps_.decode_end_ns);
+    if (sink_ == nullptr) {
+      latency_.Record(FrameLatency::kTotal, timestamps_.arrival_ns,
+                      timestamps_.decode_end_ns);
+      return;
+    }
+    VideoFrame stamped = frame;
+    stamped.timestamps = &timestamps_;
+    stamped.latency = &latency_;
+    sink_->OnFrame(stamped);
+  };
+}
+
+VideoPipeline::~VideoPipeline() {
+  Stop();
+}
+
+void VideoPipeline::SetKeyframeRequestHandler(std::function<void()> handler) {
+  keyframe_handler_ = std::move(handler);
+}
+
+void VideoPipeline::Start() {
+  if (running_.exchange(true)) {
+    return;
+  }
+  polled_ = false;
+  pool_ = nullptr;
+  thread_ = std::thread(&VideoPipeline::Run, this);
+}
+
+void VideoPipeline::StartPolled() {
+  if (running_.exchange(true)) {
+    return;
+  }
+  polled_ = true;
+  pool_ = nullptr;
+}
+
+void VideoPipeline::StartOnPool(WorkerPool* pool) {
+  if (running_.exchange(true)) {
+    return;
+  }
+  polled_ = false;
+  pool_ = pool;
+  Log(LogLevel::kInfo, "[VIDEO] decoding on the shared pool (%s)",
+      decoder_->name());
+}
+
+void VideoPipeline::Stop() {
+  if (!running_.exchange(false)) {
+    return;
+  }
+  if (pool_ != nullptr) {
+    // A running Drain() stops after its current access unit.
+    std::unique_lock<std::mutex> lock(drain_mutex_);
+    drain_cv_.wait(lock, [this] { return drains_ == 0; });
+    return;
+  }
+  if (!polled_) {
+    queue_.Wake();
+    thread_.join();
+  }
+}
+
+void VideoPipeline::Reset() {
+  reset_requested_.store(true, std::memory_order_release);
+  waiting_for_idr_.store(true, std::memory_order_release);
+  queue_.Wake();
+  if (pool_ != nullptr) {
+    ScheduleDrain();
+  }
+}
+
+void VideoPipeline::RequestKeyframe() {
+  counters_.Add(kKeyframeRequests);
+  if (keyframe_handler_) {
+    keyframe_handler_();
+  }
+}
+
+void VideoPipeline::Push(Message message) {
+  counters_.Add(kFramesReceived);
+  counters_.Add(kBytesReceived, message.payload.size());
+  if (message.payload.size() <= kVideoDataHeaderSize) {
+    return;
+  }
+
+  const BitstreamAnalyzer::Result analyzed = analyzer_.Analyze(
+      message.payload.data() + kVideoDataHeaderSize,
+      message.payload.size() - kVideoDataHeaderSize, message.arrival_ns);
+  if (analyzed.idr) {
+    gap_keyframe_requested_ = false;
+  } else if (analyzed.missing > 0) {
+    TraceInstant("video.frame_num_gap", analyzed.missing);
+    Log(LogLevel::kWarning, "[VIDEO] frame_num gap, %u access units lost",
+        analyzed.missing);
+    if (keyframe_on_gap_ && !gap_keyframe_requested_) {
+      gap_keyframe_requested_ = true;
+      RequestKeyframe();
+    }
+  }
+
+  if (waiting_for_idr_.load(std::memory_order_acquire)) {
+    if (!ContainsIdr(message.payload.data() + kVideoDataHeaderSize,
+                     message.payload.size() - kVideoDataHeaderSize)) {
+      counters_.Add(kFramesDropped);
+      return;
+    }
+    waiting_for_idr_.store(false, std::memory_order_release);
+  }
+
+  if (polled_) {
+    if (reset_requested_.exchange(false, std::memory_order_acq_rel)) {
+      decoder_->Reset();
+      counters_.Add(kDecoderResets);
+      consecutive_errors_ = 0;
+    }
+    // Arrival is on the replay's clock; time from here instead.
+    const int64_t now = MonotonicNanos();
+    Decode(message, now, now);
+    return;
+  }
+  if (!queue_.TryPush(message)) {
+    counters_.Add(kFramesDropped);
+    TraceInstant("video.queue_full");
+    Log(LogLevel::kWarning, "[VIDEO] decode queue full, waiting for IDR");
+    waiting_for_idr_.store(true, std::memory_order_release);
+    RequestKeyframe();
+  } else if (pool_ != nullptr) {
+    ScheduleDrain();
+  }
+  if (recorder_ != nullptr || TraceEnabled()) {
+    const uint64_t depth = queue_.size();
+    TraceCounter("video.queue_depth", depth);
+    if (recorder_ != nullptr) {
+      recorder_->Record(FlightRecorder::Kind::kQueueDepth,
+                        FlightRecorder::kVideoQueue, depth);
+    }
+  }
+}
+
+void VideoPipeline::Run() {
+  SetCurrentThreadName("carlink-video");
+  Log(LogLevel::kInfo, "[VIDEO] decoder thread started (%s)",
+      decoder_->name());
+
+  Message message;
+  while (running_.load(std::memory_order_acquire)) {
+    HandleReset();
+    if (!queue_.WaitPop(&message, std::chrono::milliseconds(100))) {
+      continue;
+    }
+
+    Decode(message, message.arrival_ns, message.demux_ns);
+    message = Message();
+  }
+
+  Log(LogLevel::kInfo, "[VIDEO] decoder thread stopped");
+}
+
+void VideoPipeline::HandleReset() {
+  if (!reset_requested_.exchange(false, std::memory_order_acq_rel)) {
+    return;
+  }
+  Message message;
+  while (queue_.TryPop(&message)) {
+    counters_.Add(kFramesDropped);
+  }
+  decoder_->Reset();
+  counters_.Add(kDecoderResets);
+  consecutive_errors_ = 0;
+}
+
+void VideoPipeline::ScheduleDrain() {
+  if (drain_scheduled_.exchange(true)) {
+    return;
+  }
+  {
+    // Checked under the lock Stop() waits with, so nothing is posted once
+    // it returned.
+    std::lock_guard<std::mutex> lock(drain_mutex_);
+    if (!running_.load(std::memory_order_acquire)) {
+      drain_scheduled_.store(false);
+      return;
+    }
+    drains_++;
+  }
+  pool_->Post(WorkerPool::kRealTime, [this] { Drain(); });
+}
+
+void VideoPipeline::Drain() {
+  Message message;
+  for (int i = 0; i < kDrainBatch && running_.load(std::memory_order_acquire);
+       i++) {
+    HandleReset();
+    if (!queue_.TryPop(&message)) {
+      break;
+    }
+    Decode(message, message.arrival_ns, message.demux_ns);
+    message = Message();
+  }
+  drain_scheduled_.store(false);
+  // Pushes since the last TryPop() saw a drain pending and posted none;
+  // the fence pairs with the one in PacketRing::TryPush().
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (running_.load(std::memory_order_acquire) &&
+      (queue_.size() > 0 ||
+       reset_requested_.load(std::memory_order_acquire))) {
+    ScheduleDrain();
+  }
+  // Last: Stop() may return and the pipeline go away once this is 0.
+  std::lock_guard<std::mutex> lock(drain_mutex_);
+  if (--drains_ == 0) {
+    drain_cv_.notify_all();
+  }
+}
+
+void VideoPipeline::Decode(const Message& message, int64_t arrival_ns,
+                           int64_t demux_ns) {
+  timestamps_ = FrameTimestamps();
+  timestamps_.arrival_ns = arrival_ns;
+  timestamps_.demux_ns = demux_ns;
+  timestamps_.decode_start_ns = MonotonicNanos();
+  const bool ok = decoder_->Decode(
+      message.payload.data() + kVideoDataHeaderSize,
+      message.payload.size() - kVideoDataHeaderSize, on_frame_);
+  if (TraceEnabled()) {
+    TraceComplete("video.decode", timestamps_.decode_start_ns,
+                  MonotonicNanos(), message.payload.size());
+  }
+  if (arrival_ns > 0) {
+    const uint64_t latency = MonotonicNanos() - arrival_ns;
+    counters_.Add(kLatencySamples);
+    counters_.Add(kLatencyNsTotal, latency);
+    // Single writer, so no compare-exchange needed.
+    if (latency > latency_ns_max_.load(std::memory_order_relaxed)) {
+      latency_ns_max_.store(latency, std::memory_order_relaxed);
+    }
+  }
+
+  if (ok) {
+    consecutive_errors_ = 0;
+    return;
+  }
+  counters_.Add(kDecodeErrors);
+  ++consecutive_errors_;
+  if (recorder_ != nullptr) {
+    recorder_->RecordCounter(FlightRecorder::kDecodeErrors,
+                             counters_.Get(kDecodeErrors));
+    if (consecutive_errors_ == 1) {
+      recorder_->DumpAsync("DecoderError");
+    }
+  }
+  if (consecutive_errors_ >= kMaxConsecutiveErrors) {
+    Log(LogLevel::kWarning, "[VIDEO] %d decode errors, resetting decoder",
+        consecutive_errors_);
+    decoder_->Reset();
+    counters_.Add(kDecoderResets);
+    consecutive_errors_ = 0;
+    waiting_for_idr_.store(true, std::memory_order_release);
+    RequestKeyframe();
+  }
+}
+
+VideoPipeline::Stats VideoPipeline::stats() const {
+  uint64_t counters[kCounterCount];
+  counters_.Snapshot(counters);
+  Stats stats;
+  stats.frames_received = counters[kFramesReceived];
+  stats.frames_decoded = counters[kFramesDecoded];
+  stats.frames_dropped = counters[kFramesDropped];
+  stats.decode_errors = counters[kDecodeErrors];
+  stats.decoder_resets = counters[kDecoderResets];
+  stats.bytes_received = counters[kBytesReceived];
+  stats.keyframe_requests = counters[kKeyframeRequests];
+  stats.queue_depth = queue_.size();
+  stats.queue_capacity = queue_.capacity();
+  stats.latency_samples = counters[kLatencySamples];
+  stats.latency_ns_total = counters[kLatencyNsTotal];
+  stats.latency_ns_max = latency_ns_max_.load(std::memory_order_relaxed);
+  stats.frame_latency = latency_.stats();
+  stats.bitstream = analyzer_.stats();
+  return stats;
+}
+
+}  // namespace carlink
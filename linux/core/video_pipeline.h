@@ -0,0 +1,173 @@
+#ifndef CARLINK_CORE_VIDEO_PIPELINE_H_
+#define CARLINK_CORE_VIDEO_PIPELINE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "core/bitstream_analyzer.h"
+#include "core/demuxer.h"
+#include "core/flight_recorder.h"
+#include "core/frame_latency.h"
+#include "core/packet_ring.h"
+#include "core/sharded_counters.h"
+#include "core/video_decoder.h"
+#include "core/worker_pool.h"
+
+namespace carlink {
+
+// Receives decoded pictures on the decoder thread.
+class FrameSink {
+ public:
+  virtual ~FrameSink() = default;
+  virtual void OnFrame(const VideoFrame& frame) = 0;
+};
+
+// Queues VideoData messages from the USB thread and decodes them on a
+// dedicated thread, so a slow decode never stalls the bulk-IN loop.
+//
+// When the queue overflows, or the decoder fails repeatedly, the pipeline
+// drops access units until the next IDR and asks the phone for one.
+//
+// A polled pipeline (StartPolled()) has no thread and decodes inside
+// Push(), so a replay sees the same drops every run; its latency is then
+// the decode time alone.
+//
+// A pooled pipeline (StartOnPool()) has no thread either: it decodes on a
+// WorkerPool shared with other sessions, in its real-time lane, one access
+// unit at a time and in order, a few per task so other sessions get their
+// turn.
+class VideoPipeline {
+ public:
+  struct Stats {
+    uint64_t frames_received = 0;
+    uint64_t frames_decoded = 0;
+    uint64_t frames_dropped = 0;
+    uint64_t decode_errors = 0;
+    uint64_t decoder_resets = 0;
+    uint64_t bytes_received = 0;
+    uint64_t keyframe_requests = 0;
+    uint64_t queue_depth = 0;
+    uint64_t queue_capacity = 0;
+    // USB arrival to decoded and handed to the sink, per access unit.
+    uint64_t latency_samples = 0;
+    uint64_t latency_ns_total = 0;
+    uint64_t latency_ns_max = 0;
+    // Per-stage latency from USB arrival to the sink, including the
+    // stages the sink records itself.
+    FrameLatency::Stats frame_latency;
+    // What arrived, before any drops.
+    BitstreamAnalyzer::Stats bitstream;
+  };
+
+  VideoPipeline(std::unique_ptr<VideoDecoder> decoder, FrameSink* sink,
+                size_t queue_capacity = 32);
+  ~VideoPipeline();
+
+  VideoPipeline(const VideoPipeline&) = delete;
+  VideoPipeline& operator=(const VideoPipeline&) = delete;
+
+  // Called when the pipeline wants an IDR; sends Command::kFrame.
+  void SetKeyframeRequestHandler(std::function<void()> handler);
+  // Records queue depths and decode errors, and dumps on the first error
+  // of a run. Call before starting; may be null.
+  void set_flight_recorder(FlightRecorder* recorder) { recorder_ = recorder; }
+  // Ask for an IDR when frame_num shows access units were lost upstream,
+  // once until the IDR arrives. On by default; the decoder conceals the
+  // damage in the meantime.
+  void set_keyframe_on_frame_num_gap(bool enabled) {
+    keyframe_on_gap_ = enabled;
+  }
+
+  void Start();
+  void StartPolled();
+  // |pool| must outlive the pipeline's Stop().
+  void StartOnPool(WorkerPool* pool);
+  void Stop();
+
+  // USB thread. Takes ownership of a VideoData message.
+  void Push(Message message);
+
+  // Any thread. Drops queued access units and resets the decoder before the
+  // next one (resetH264Renderer).
+  void Reset();
+
+  const char* decoder_name() const { return decoder_->name(); }
+
+  Stats stats() const;
+  const FrameLatency& frame_latency() const { return latency_; }
+
+ private:
+  static constexpr int kMaxConsecutiveErrors = 3;
+  // Access units a pool task decodes before yielding.
+  static constexpr int kDrainBatch = 4;
+
+  void Run();
+  // Decoder thread, or a pool task: resets the decoder if asked to.
+  void HandleReset();
+  // Posts a Drain() unless one is pending. Any thread.
+  void ScheduleDrain();
+  void Drain();
+  // Decoder thread, or Push() when polled. The stamps are MonotonicNanos()
+  // times latency is measured from.
+  void Decode(const Message& message, int64_t arrival_ns, int64_t demux_ns);
+  void RequestKeyframe();
+
+  std::unique_ptr<VideoDecoder> decoder_;
+  FrameSink* sink_;
+  PacketRing<Message> queue_;
+  std::function<void()> keyframe_handler_;
+  FlightRecorder* recorder_ = nullptr;
+  bool keyframe_on_gap_ = true;
+
+  std::thread thread_;
+  std::atomic<bool> running_{false};
+  bool polled_ = false;
+  WorkerPool* pool_ = nullptr;
+  // A Drain() is posted or running; only one at a time.
+  std::atomic<bool> drain_scheduled_{false};
+  // Drain() tasks posted and not finished, for Stop() to wait on.
+  std::mutex drain_mutex_;
+  std::condition_variable drain_cv_;
+  int drains_ = 0;
+  std::atomic<bool> reset_requested_{false};
+
+  // Set when access units must be dropped until the next IDR; cleared by
+  // the USB thread when one arrives.
+  std::atomic<bool> waiting_for_idr_{true};
+
+  // Decoder thread, or the pool task draining the queue.
+  int consecutive_errors_ = 0;
+  VideoDecoder::FrameCallback on_frame_;
+  // Of the access unit being decoded.
+  FrameTimestamps timestamps_;
+
+  // USB thread, or Push() when polled.
+  BitstreamAnalyzer analyzer_;
+  bool gap_keyframe_requested_ = false;
+
+  // Bumped from the USB and decoder threads.
+  enum Counter {
+    kFramesReceived,
+    kFramesDecoded,
+    kFramesDropped,
+    kDecodeErrors,
+    kDecoderResets,
+    kBytesReceived,
+    kKeyframeRequests,
+    kLatencySamples,
+    kLatencyNsTotal,
+    kCounterCount,
+  };
+  ShardedCounters counters_{kCounterCount};
+  std::atomic<uint64_t> latency_ns_max_{0};
+  FrameLatency latency_;
+};
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_VIDEO_PIPELINE_H_
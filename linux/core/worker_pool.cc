@@ -0,0 +1,228 @@
+#include "core/worker_pool.h"
+
+#include <algorithm>
+
+#include "core/clock.h"
+#include "core/thread_stats.h"
+
+namespace carlink {
+
+namespace {
+
+// The pool and worker the calling thread belongs to, so tasks posted from a
+// task stay on their worker's deque.
+thread_local const WorkerPool* tls_pool = nullptr;
+thread_local size_t tls_worker = 0;
+
+}  // namespace
+
+const char* WorkerPool::LaneName(Lane lane) {
+  switch (lane) {
+    case kRealTime:
+      return "realtime";
+    case kBackground:
+      return "background";
+    default:
+      return "?";
+  }
+}
+
+WorkerPool::WorkerPool(int threads) : start_ns_(MonotonicNanos()) {
+  if (threads <= 0) {
+    threads = static_cast<int>(std::thread::hardware_concurrency());
+  }
+  if (threads <= 0) {
+    threads = 1;
+  }
+  for (int i = 0; i < threads; i++) {
+    workers_.emplace_back(new Worker());
+  }
+  // Only once every deque exists, since workers steal from all of them.
+  for (size_t i = 0; i < workers_.size(); i++) {
+    workers_[i]->thread = std::thread(&WorkerPool::Run, this, i);
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    stopping_.store(true);
+  }
+  sleep_cv_.notify_all();
+  for (std::unique_ptr<Worker>& worker : workers_) {
+    worker->thread.join();
+  }
+}
+
+void WorkerPool::Post(Lane lane, std::function<void()> task) {
+  const size_t index =
+      tls_pool == this
+          ? tls_worker
+          : next_worker_.fetch_add(1, std::memory_order_relaxed) %
+                workers_.size();
+  Worker& worker = *workers_[index];
+  {
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    worker.lanes[lane].push_back(Task{std::move(task), MonotonicNanos()});
+  }
+  LaneCounters& counters = lanes_[lane];
+  counters.posted.fetch_add(1, std::memory_order_relaxed);
+  // Pairs with the sleeper count in Run(): either the worker going to sleep
+  // sees the task, or this sees it and wakes one.
+  counters.queued.fetch_add(1, std::memory_order_seq_cst);
+  if (sleepers_.load(std::memory_order_seq_cst) > 0) {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    sleep_cv_.notify_one();
+  }
+}
+
+void WorkerPool::ParallelFor(Lane lane, int count,
+                             const std::function<void(int)>& body) {
+  if (count <= 1) {
+    if (count == 1) {
+      body(0);
+    }
+    return;
+  }
+  // Helpers that start after the caller finished find nothing left to
+  // claim and never touch |body|; the state outlives them.
+  struct State {
+    std::atomic<int> next{0};
+    std::atomic<int> done{0};
+    int count = 0;
+    const std::function<void(int)>* body = nullptr;
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    void Work() {
+      int i;
+      while ((i = next.fetch_add(1, std::memory_order_relaxed)) < count) {
+        (*body)(i);
+        if (done.fetch_add(1, std::memory_order_acq_rel) + 1 == count) {
+          std::lock_guard<std::mutex> lock(mutex);
+          cv.notify_all();
+        }
+      }
+    }
+  };
+  auto state = std::make_shared<State>();
+  state->count = count;
+  state->body = &body;
+  const int helpers = std::min(count - 1, threads());
+  for (int i = 0; i < helpers; i++) {
+    Post(lane, [state] { state->Work(); });
+  }
+  state->Work();
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->cv.wait(lock, [&state, count] {
+    return state->done.load(std::memory_order_acquire) == count;
+  });
+}
+
+bool WorkerPool::Take(size_t index, Lane lane, Task* task, bool* stolen) {
+  LaneCounters& counters = lanes_[lane];
+  for (size_t k = 0; k < workers_.size(); k++) {
+    Worker& worker = *workers_[(index + k) % workers_.size()];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    std::deque<Task>& queue = worker.lanes[lane];
+    if (queue.empty()) {
+      continue;
+    }
+    // Oldest first from its own deque, for fairness between the sessions
+    // sharing it; the other end when stealing.
+    if (k == 0) {
+      *task = std::move(queue.front());
+      queue.pop_front();
+    } else {
+      *task = std::move(queue.back());
+      queue.pop_back();
+    }
+    counters.queued.fetch_sub(1, std::memory_order_relaxed);
+    *stolen = k != 0;
+    return true;
+  }
+  return false;
+}
+
+void WorkerPool::Run(size_t index) {
+  SetCurrentThreadName("carlink-work");
+  tls_pool = this;
+  tls_worker = index;
+  auto any_queued = [this] {
+    for (const LaneCounters& counters : lanes_) {
+      if (counters.queued.load(std::memory_order_seq_cst) > 0) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  while (true) {
+    Task task;
+    bool stolen = false;
+    int lane = 0;
+    for (; lane < kLaneCount; lane++) {
+      if (lanes_[lane].queued.load(std::memory_order_acquire) > 0 &&
+          Take(index, static_cast<Lane>(lane), &task, &stolen)) {
+        break;
+      }
+    }
+
+    if (lane < kLaneCount) {
+      LaneCounters& counters = lanes_[lane];
+      const int64_t start = MonotonicNanos();
+      const uint64_t wait = start - task.posted_ns;
+      counters.wait_ns.fetch_add(wait, std::memory_order_relaxed);
+      uint64_t max = counters.wait_max_ns.load(std::memory_order_relaxed);
+      while (wait > max && !counters.wait_max_ns.compare_exchange_weak(
+                               max, wait, std::memory_order_relaxed)) {
+      }
+      task.run();
+      task.run = nullptr;
+      counters.busy_ns.fetch_add(MonotonicNanos() - start,
+                                 std::memory_order_relaxed);
+      counters.run.fetch_add(1, std::memory_order_relaxed);
+      if (stolen) {
+        counters.stolen.fetch_add(1, std::memory_order_relaxed);
+      }
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    sleepers_.fetch_add(1, std::memory_order_seq_cst);
+    sleep_cv_.wait(lock, [this, &any_queued] {
+      return stopping_.load() || any_queued();
+    });
+    sleepers_.fetch_sub(1, std::memory_order_relaxed);
+    // Queued tasks still run when stopping.
+    if (stopping_.load() && !any_queued()) {
+      return;
+    }
+  }
+}
+
+WorkerPool::Stats WorkerPool::stats() const {
+  Stats stats;
+  stats.threads = static_cast<uint32_t>(workers_.size());
+  stats.elapsed_ns = MonotonicNanos() - start_ns_;
+  for (int i = 0; i < kLaneCount; i++) {
+    const LaneCounters& counters = lanes_[i];
+    LaneStats& lane = stats.lanes[i];
+    lane.tasks_posted = counters.posted.load(std::memory_order_relaxed);
+    lane.tasks_run = counters.run.load(std::memory_order_relaxed);
+    lane.tasks_stolen = counters.stolen.load(std::memory_order_relaxed);
+    lane.queue_depth = std::max<int64_t>(
+        0, counters.queued.load(std::memory_order_relaxed));
+    lane.busy_ns = counters.busy_ns.load(std::memory_order_relaxed);
+    lane.wait_ns = counters.wait_ns.load(std::memory_order_relaxed);
+    lane.wait_max_ns = counters.wait_max_ns.load(std::memory_order_relaxed);
+    if (stats.elapsed_ns > 0) {
+      lane.utilization = static_cast<double>(lane.busy_ns) /
+                         (static_cast<double>(stats.elapsed_ns) *
+                          stats.threads);
+    }
+  }
+  return stats;
+}
+
+}  // namespace carlink
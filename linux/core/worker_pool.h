@@ -0,0 +1,122 @@
+#ifndef CARLINK_CORE_WORKER_POOL_H_
+#define CARLINK_CORE_WORKER_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace carlink {
+
+// The process's CPU budget for parallel media work: a fixed set of threads,
+// sized once at startup, that every stage posts to instead of starting
+// threads of its own, so the small core counts of head units are never
+// oversubscribed. Decoding for several sessions, YUV conversion bands,
+// capture compression, capture analysis and album cover decoding all run
+// here.
+//
+// Each worker has a deque per lane. Tasks posted from a worker go to its
+// own deque, others are spread round-robin; a worker runs its own tasks
+// oldest first and, when it has none, steals the newest of another's.
+// Real-time tasks always run before background ones, though a background
+// task that already started is not interrupted.
+class WorkerPool {
+ public:
+  enum Lane {
+    // Video: decoding and conversion a frame waits for.
+    kRealTime,
+    // Anything that may wait for a frame, e.g. compression and covers.
+    kBackground,
+    kLaneCount,
+  };
+  static const char* LaneName(Lane lane);
+
+  struct LaneStats {
+    uint64_t tasks_posted = 0;
+    uint64_t tasks_run = 0;
+    // Run by another worker than the one they were queued on.
+    uint64_t tasks_stolen = 0;
+    uint64_t queue_depth = 0;
+    // Summed over the threads: time spent running this lane's tasks.
+    uint64_t busy_ns = 0;
+    // From Post() to the task starting.
+    uint64_t wait_ns = 0;
+    uint64_t wait_max_ns = 0;
+    // busy_ns as a share of every thread's time since construction.
+    double utilization = 0;
+  };
+
+  struct Stats {
+    uint32_t threads = 0;
+    uint64_t elapsed_ns = 0;
+    LaneStats lanes[kLaneCount];
+  };
+
+  // |threads| 0 for one per CPU.
+  explicit WorkerPool(int threads = 0);
+  // Runs what is still queued, then joins the threads.
+  ~WorkerPool();
+
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+
+  // Any thread.
+  void Post(Lane lane, std::function<void()> task);
+
+  // Runs |body| for 0 to |count| - 1 across the pool and returns once all
+  // are done. The calling thread takes its share, so this may be called
+  // from a pool task.
+  void ParallelFor(Lane lane, int count, const std::function<void(int)>& body);
+
+  int threads() const { return static_cast<int>(workers_.size()); }
+  Stats stats() const;
+
+ private:
+  struct Task {
+    std::function<void()> run;
+    int64_t posted_ns = 0;
+  };
+
+  struct Worker {
+    std::mutex mutex;
+    std::deque<Task> lanes[kLaneCount];
+    std::thread thread;
+  };
+
+  // Lane counters, each on its own cache line.
+  struct alignas(64) LaneCounters {
+    std::atomic<uint64_t> posted{0};
+    std::atomic<uint64_t> run{0};
+    std::atomic<uint64_t> stolen{0};
+    std::atomic<uint64_t> busy_ns{0};
+    std::atomic<uint64_t> wait_ns{0};
+    std::atomic<uint64_t> wait_max_ns{0};
+    // Posted and not yet taken, for workers to skip empty lanes.
+    std::atomic<int64_t> queued{0};
+  };
+
+  void Run(size_t index);
+  // Takes the next task of |lane| for worker |index|, from its own deque or
+  // another's. Sets |stolen| for the latter.
+  bool Take(size_t index, Lane lane, Task* task, bool* stolen);
+
+  const int64_t start_ns_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::atomic<uint32_t> next_worker_{0};
+  LaneCounters lanes_[kLaneCount];
+
+  // Idle workers sleep here.
+  std::mutex sleep_mutex_;
+  std::condition_variable sleep_cv_;
+  std::atomic<int> sleepers_{0};
+  std::atomic<bool> stopping_{false};
+};
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_WORKER_POOL_H_
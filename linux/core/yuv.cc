@@ -0,0 +1,19 @@
+#include "core/yuv.h"
+
+#include "core/simd.h"
+
+namespace carlink {
+
+void I420ToRgbaRows(const VideoFrame& frame, uint8_t* dst, size_t dst_stride,
+                    int row_begin, int row_end) {
+  const SimdKernels& kernels = Simd();
+  for (int row = row_begin; row < row_end; row++) {
+    kernels.i420_to_rgba_row(
+        frame.y + static_cast<size_t>(row) * frame.y_stride,
+        frame.u + static_cast<size_t>(row / 2) * frame.uv_stride,
+        frame.v + static_cast<size_t>(row / 2) * frame.uv_stride,
+        dst + static_cast<size_t>(row) * dst_stride, frame.width);
+  }
+}
+
+}  // namespace carlink
@@ -0,0 +1,24 @@
+#ifndef CARLINK_CORE_YUV_H_
+#define CARLINK_CORE_YUV_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "core/video_decoder.h"
+
+namespace carlink {
+
+// Converts rows [row_begin, row_end) of an I420 frame to RGBA (BT.601,
+// limited range), writing |dst_stride| bytes per row. row_begin must be
+// even so chroma rows line up; bands can be converted independently.
+void I420ToRgbaRows(const VideoFrame& frame, uint8_t* dst, size_t dst_stride,
+                    int row_begin, int row_end);
+
+inline void I420ToRgba(const VideoFrame& frame, uint8_t* dst,
+                       size_t dst_stride) {
+  I420ToRgbaRows(frame, dst, dst_stride, 0, frame.height);
+}
+
+}  // namespace carlink
+
+#endif  // CARLINK_CORE_YUV_H_
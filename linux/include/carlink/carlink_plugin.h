@@ -21,6 +21,15 @@ FLUTTER_PLUGIN_EXPORT GType carlink_plugin_get_type();
 FLUTTER_PLUGIN_EXPORT void carlink_plugin_register_with_registrar(
     FlPluginRegistrar* registrar);
 
+// Starts connecting to the dongle on a thread of its own, before the
+// Flutter engine boots: finds it, opens and claims it, starts reading and
+// sends the init messages. Dart's Carlink.start() then attaches to that
+// session instead of connecting again, provided it asks for the same video
+// settings; zero keeps the default (1920x720, 60 fps, 160 dpi). Call at most
+// once, on the main thread, before the plugin is registered.
+FLUTTER_PLUGIN_EXPORT void carlink_plugin_connect_early(int width, int height,
+                                                        int fps, int dpi);
+
 G_END_DECLS
 
 #endif  // FLUTTER_PLUGIN_CARLINK_PLUGIN_H_
@@ -0,0 +1,112 @@
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <vector>
+
+#include "album_cover_cache.h"
+
+namespace carlink {
+namespace test {
+
+namespace {
+
+// Encodes a solid |width| x |height| JPEG.
+std::vector<uint8_t> MakeJpeg(int width, int height, guint32 color) {
+  g_autoptr(GdkPixbuf) pixbuf =
+      gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, width, height);
+  gdk_pixbuf_fill(pixbuf, color);
+  gchar* buffer = nullptr;
+  gsize size = 0;
+  EXPECT_TRUE(gdk_pixbuf_save_to_buffer(pixbuf, &buffer, &size, "jpeg",
+                                        nullptr, nullptr));
+  std::vector<uint8_t> jpeg(buffer, buffer + size);
+  g_free(buffer);
+  return jpeg;
+}
+
+// Pumps the main context until |cache| has decoded |id|.
+std::shared_ptr<const AlbumCover> WaitForCover(AlbumCoverCache& cache,
+                                               uint64_t id) {
+  for (int i = 0; i < 1000; i++) {
+    std::shared_ptr<const AlbumCover> cover = cache.Lookup(id);
+    if (cover) {
+      return cover;
+    }
+    g_main_context_iteration(nullptr, TRUE);
+  }
+  return nullptr;
+}
+
+}  // namespace
+
+TEST(AlbumCoverCache, DecodesOncePerBlob) {
+  int ready = 0;
+  AlbumCoverCache cache(4, [&](std::shared_ptr<const AlbumCover>) { ready++; });
+  cache.SetDisplaySize(200, 200);
+
+  std::vector<uint8_t> first = MakeJpeg(64, 64, 0xff0000ff);
+  std::vector<uint8_t> second = MakeJpeg(64, 64, 0x00ff00ff);
+
+  uint64_t first_id = cache.Submit(first.data(), first.size());
+  ASSERT_NE(WaitForCover(cache, first_id), nullptr);
+  uint64_t second_id = cache.Submit(second.data(), second.size());
+  ASSERT_NE(WaitForCover(cache, second_id), nullptr);
+  EXPECT_NE(first_id, second_id);
+
+  // Skipping back and forth between tracks hits the cache.
+  EXPECT_EQ(cache.Submit(first.data(), first.size()), first_id);
+  EXPECT_EQ(cache.Submit(second.data(), second.size()), second_id);
+  EXPECT_NE(cache.Lookup(first_id), nullptr);
+  EXPECT_EQ(cache.decode_count(), 2u);
+  EXPECT_EQ(ready, 2);
+}
+
+TEST(AlbumCoverCache, ScalesToDisplaySize) {
+  AlbumCoverCache cache(4, nullptr);
+  cache.SetDisplaySize(100, 100);
+
+  std::vector<uint8_t> jpeg = MakeJpeg(400, 200, 0x336699ff);
+  std::shared_ptr<const AlbumCover> cover =
+      WaitForCover(cache, cache.Submit(jpeg.data(), jpeg.size()));
+  ASSERT_NE(cover, nullptr);
+  EXPECT_EQ(cover->width, 100u);
+  EXPECT_EQ(cover->height, 50u);
+  EXPECT_EQ(cover->rgba.size(), 100u * 50u * 4u);
+  EXPECT_EQ(cover->rgba[3], 0xff);
+}
+
+TEST(AlbumCoverCache, EvictsLeastRecentlyUsed) {
+  AlbumCoverCache cache(2, nullptr);
+  cache.SetDisplaySize(64, 64);
+
+  std::vector<uint8_t> a = MakeJpeg(16, 16, 0xff0000ff);
+  std::vector<uint8_t> b = MakeJpeg(16, 16, 0x00ff00ff);
+  std::vector<uint8_t> c = MakeJpeg(16, 16, 0x0000ffff);
+
+  uint64_t a_id = cache.Submit(a.data(), a.size());
+  uint64_t b_id = cache.Submit(b.data(), b.size());
+  ASSERT_NE(WaitForCover(cache, b_id), nullptr);
+  ASSERT_NE(WaitForCover(cache, a_id), nullptr);
+
+  // |b| is now the least recently used and makes room for |c|.
+  uint64_t c_id = cache.Submit(c.data(), c.size());
+  ASSERT_NE(WaitForCover(cache, c_id), nullptr);
+  EXPECT_EQ(cache.size(), 2u);
+  EXPECT_NE(cache.Lookup(a_id), nullptr);
+  EXPECT_EQ(cache.Lookup(b_id), nullptr);
+}
+
+TEST(AlbumCoverCache, IgnoresUndecodableBlobs) {
+  AlbumCoverCache cache(2, nullptr);
+  const uint8_t garbage[] = {0xde, 0xad, 0xbe, 0xef};
+  uint64_t id = cache.Submit(garbage, sizeof(garbage));
+  for (int i = 0; i < 100 && cache.size() > 0; i++) {
+    g_main_context_iteration(nullptr, TRUE);
+  }
+  EXPECT_EQ(cache.Lookup(id), nullptr);
+  EXPECT_EQ(cache.size(), 0u);
+}
+
+}  // namespace test
+}  // namespace carlink
@@ -0,0 +1,333 @@
+#include "core/async.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "core/async_connection.h"
+#include "core/buffer_pool.h"
+#include "core/simulated_dongle.h"
+
+namespace carlink {
+namespace test {
+
+namespace {
+
+bool WaitFor(const std::function<bool()>& done) {
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (!done()) {
+    if (std::chrono::steady_clock::now() > deadline) {
+      return false;
+    }
+    std::this_thread::yield();
+  }
+  return true;
+}
+
+Task<void> Signal(Task<void> task, std::atomic<bool>* done) {
+  co_await task;
+  done->store(true);
+}
+
+// Runs |task| on |loop| to completion and destroys it there.
+void RunOn(EventLoop* loop, Task<void> task) {
+  std::atomic<bool> done{false};
+  Task<void> root = Signal(std::move(task), &done);
+  loop->Post([&root] { root.Start(); });
+  ASSERT_TRUE(WaitFor([&done] { return done.load(); }));
+  std::atomic<bool> destroyed{false};
+  loop->Post([&root, &destroyed] {
+    root.reset();
+    destroyed = true;
+  });
+  ASSERT_TRUE(WaitFor([&destroyed] { return destroyed.load(); }));
+}
+
+Task<int> Square(int value) {
+  co_return value * value;
+}
+
+Task<int> SumOfSquares(int count) {
+  int sum = 0;
+  for (int i = 0; i < count; i++) {
+    sum += co_await Square(i);
+  }
+  co_return sum;
+}
+
+// Completes writes on a thread of its own, like libusb's event thread.
+class AsyncTransport : public Transport {
+ public:
+  const char* name() const override { return "async"; }
+  int Read(uint8_t* data, size_t length, int timeout_ms) override {
+    return 0;
+  }
+  int Write(const uint8_t* data, size_t length, int timeout_ms) override {
+    return static_cast<int>(length);
+  }
+  void WriteAsync(const uint8_t* data, size_t length, int timeout_ms,
+                  WriteCallback done, void* context) override {
+    writes++;
+    io_.Post([length, done, context] {
+      done(context, static_cast<int>(length));
+    });
+  }
+  void Close() override {}
+
+  std::atomic<int> writes{0};
+
+ private:
+  EventLoop io_;
+};
+
+// Takes every write and never answers.
+class SilentTransport : public Transport {
+ public:
+  const char* name() const override { return "silent"; }
+  int Read(uint8_t* data, size_t length, int timeout_ms) override {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                 [this] { return closed_; });
+    return closed_ ? -1 : 0;
+  }
+  int Write(const uint8_t* data, size_t length, int timeout_ms) override {
+    return static_cast<int>(length);
+  }
+  void Close() override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    cv_.notify_all();
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool closed_ = false;
+};
+
+Message MakeMessage(MessageType type) {
+  Message message;
+  message.header.type = static_cast<uint32_t>(type);
+  message.arrival_ns = MonotonicNanos();
+  return message;
+}
+
+}  // namespace
+
+TEST(Async, TasksChainWithoutTheLoop) {
+  EventLoop loop;
+  int sum = 0;
+  RunOn(&loop, [](int* sum) -> Task<void> {
+    *sum = co_await SumOfSquares(10);
+  }(&sum));
+  EXPECT_EQ(sum, 285);
+}
+
+TEST(Async, FramesAreRecycled) {
+  EventLoop loop;
+  auto round = [&loop] {
+    RunOn(&loop, []() -> Task<void> {
+      co_await SumOfSquares(4);
+    }());
+  };
+  round();
+  const FrameArena::Stats before = FrameArena::stats();
+  for (int i = 0; i < 50; i++) {
+    round();
+  }
+  const FrameArena::Stats after = FrameArena::stats();
+  EXPECT_EQ(after.allocations - before.allocations, 50u * 7);
+  EXPECT_EQ(after.heap_allocations, before.heap_allocations);
+  EXPECT_EQ(after.in_use, before.in_use);
+}
+
+TEST(Async, SleepsOnTheLoopsTimers) {
+  EventLoop loop;
+  int64_t slept_ns = 0;
+  bool on_loop = false;
+  RunOn(&loop, [](EventLoop* loop, int64_t* slept_ns,
+                  bool* on_loop) -> Task<void> {
+    const int64_t start = MonotonicNanos();
+    for (int i = 0; i < 5; i++) {
+      co_await SleepFor(loop, 2000000);
+    }
+    *slept_ns = MonotonicNanos() - start;
+    *on_loop = loop->InLoopThread();
+  }(&loop, &slept_ns, &on_loop));
+  EXPECT_GE(slept_ns, 10000000);
+  EXPECT_TRUE(on_loop);
+  EXPECT_EQ(loop.stats().timers_run, 5u);
+}
+
+TEST(Async, WritesResumeOnTheLoop) {
+  EventLoop loop;
+  AsyncTransport transport;
+  const EncodedMessage message = EncodeHeartBeat();
+  int total = 0;
+  bool on_loop = true;
+  RunOn(&loop, [](EventLoop* loop, Transport* transport,
+                  const EncodedMessage* message, int* total,
+                  bool* on_loop) -> Task<void> {
+    for (int i = 0; i < 20; i++) {
+      *total += co_await AsyncWrite(loop, transport, *message, 100);
+      *on_loop = *on_loop && loop->InLoopThread();
+    }
+  }(&loop, &transport, &message, &total, &on_loop));
+  EXPECT_EQ(transport.writes.load(), 20);
+  EXPECT_EQ(total, 20 * static_cast<int>(message.size()));
+  EXPECT_TRUE(on_loop);
+}
+
+TEST(Async, InboxHandsMessagesToTheWaiter) {
+  EventLoop loop;
+  std::atomic<int> seen{0};
+  Inbox inbox(&loop, [&seen](const Message&) { seen++; });
+  bool got_plugged = false;
+  bool timed_out = false;
+  bool got_kept = false;
+  RunOn(&loop, [](Inbox* inbox, bool* got_plugged, bool* timed_out,
+                  bool* got_kept) -> Task<void> {
+    // Arrives while the coroutine waits.
+    std::thread([inbox] {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      inbox->Push(MakeMessage(MessageType::kBoxSettings));
+      inbox->Push(MakeMessage(MessageType::kPlugged));
+    }).detach();
+    *got_plugged =
+        (co_await Inbox::Next(inbox, MessageType::kPlugged, 1000)).has_value();
+    *timed_out =
+        !(co_await Inbox::Next(inbox, MessageType::kPhase, 10)).has_value();
+    // BoxSettings came before anyone asked for it, and was kept.
+    *got_kept = (co_await Inbox::Next(inbox, MessageType::kBoxSettings, 0))
+                    .has_value();
+  }(&inbox, &got_plugged, &timed_out, &got_kept));
+  EXPECT_TRUE(got_plugged);
+  EXPECT_TRUE(timed_out);
+  EXPECT_TRUE(got_kept);
+  EXPECT_EQ(seen.load(), 2);
+}
+
+TEST(Async, FailedInboxWakesTheWaiter) {
+  EventLoop loop;
+  Inbox inbox(&loop, [](const Message&) {});
+  bool got = true;
+  RunOn(&loop, [](Inbox* inbox, bool* got) -> Task<void> {
+    inbox->Fail("USBReadError");
+    *got = (co_await Inbox::Next(inbox, MessageType::kOpen, -1)).has_value();
+  }(&inbox, &got));
+  EXPECT_FALSE(got);
+  EXPECT_TRUE(inbox.failed());
+  EXPECT_EQ(inbox.error(), "USBReadError");
+}
+
+TEST(AsyncConnection, HandshakesAndReconnects) {
+  EventLoop loop;
+  std::mutex mutex;
+  SimulatedDongle* dongle = nullptr;
+  int opens = 0;
+  AsyncConnectionOptions options;
+  options.heartbeat_interval_ms = 20;
+  options.heartbeat_grace_ms = 2000;
+  options.backoff_initial_ms = 5;
+  options.open = [&]() -> std::unique_ptr<Transport> {
+    std::lock_guard<std::mutex> lock(mutex);
+    // No dongle for the first two attempts.
+    if (++opens <= 2) {
+      return nullptr;
+    }
+    SimulatedDongle::Options dongle_options;
+    dongle_options.audio = false;
+    std::unique_ptr<SimulatedDongle> transport(
+        new SimulatedDongle(dongle_options));
+    dongle = transport.get();
+    return transport;
+  };
+  std::atomic<int> opened{0};
+  AsyncConnection connection(&loop, options, nullptr,
+                             [&opened](const Message& message) {
+                               if (message.header.type ==
+                                   static_cast<uint32_t>(MessageType::kOpen)) {
+                                 opened++;
+                               }
+                             });
+  connection.Start();
+  ASSERT_TRUE(WaitFor([&connection] {
+    return connection.state() == AsyncConnection::State::kPlugged &&
+           connection.stats().heartbeats >= 3;
+  }));
+  AsyncConnection::Stats stats = connection.stats();
+  EXPECT_EQ(stats.attempts, 3u);
+  EXPECT_EQ(stats.handshakes, 1u);
+  EXPECT_EQ(opened.load(), 1);
+
+  // Pull the dongle: the read loop fails and the connection starts over.
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    dongle->Close();
+  }
+  ASSERT_TRUE(WaitFor([&connection] {
+    return connection.stats().handshakes == 2 &&
+           connection.state() == AsyncConnection::State::kPlugged;
+  }));
+  stats = connection.stats();
+  EXPECT_EQ(stats.link_failures, 1u);
+  EXPECT_EQ(stats.attempts, 4u);
+
+  connection.Stop();
+  EXPECT_EQ(connection.state(), AsyncConnection::State::kStopped);
+}
+
+TEST(AsyncConnection, RetriesAHandshakeNobodyAnswers) {
+  EventLoop loop;
+  std::vector<AsyncConnection::State> states;
+  AsyncConnectionOptions options;
+  options.handshake_timeout_ms = 10;
+  options.backoff_initial_ms = 1;
+  options.backoff_max_ms = 4;
+  options.open = [] { return std::unique_ptr<Transport>(new SilentTransport()); };
+  AsyncConnection connection(
+      &loop, options,
+      [&states](AsyncConnection::State state) { states.push_back(state); },
+      nullptr);
+  connection.Start();
+  ASSERT_TRUE(WaitFor(
+      [&connection] { return connection.stats().handshake_failures >= 3; }));
+  // Stops wherever the coroutines are suspended.
+  connection.Stop();
+  EXPECT_EQ(connection.stats().handshakes, 0u);
+  ASSERT_GE(states.size(), 4u);
+  EXPECT_EQ(states[0], AsyncConnection::State::kConnecting);
+  EXPECT_EQ(states[1], AsyncConnection::State::kHandshaking);
+  EXPECT_EQ(states[2], AsyncConnection::State::kBackoff);
+  EXPECT_EQ(states.back(), AsyncConnection::State::kStopped);
+  EXPECT_EQ(FrameArena::stats().in_use, 0u);
+}
+
+TEST(AsyncConnection, StopsWhileWaitingForOpened) {
+  EventLoop loop;
+  AsyncConnectionOptions options;
+  options.handshake_timeout_ms = 60000;
+  options.open = [] { return std::unique_ptr<Transport>(new SilentTransport()); };
+  AsyncConnection connection(&loop, options, nullptr, nullptr);
+  connection.Start();
+  ASSERT_TRUE(WaitFor([&connection] {
+    return connection.state() == AsyncConnection::State::kHandshaking;
+  }));
+  // Past the init writes, parked in Inbox::Next for Opened.
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  connection.Stop();
+  EXPECT_EQ(connection.state(), AsyncConnection::State::kStopped);
+  EXPECT_EQ(connection.stats().handshake_failures, 0u);
+  EXPECT_EQ(FrameArena::stats().in_use, 0u);
+}
+
+}  // namespace test
+}  // namespace carlink
@@ -0,0 +1,78 @@
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "core/audio.h"
+#include "core/protocol.h"
+
+namespace carlink {
+namespace test {
+
+TEST(Audio, ParsesPcmAndCommands) {
+  std::vector<uint8_t> payload(kAudioDataHeaderSize + 8, 0);
+  WriteU32(payload.data(), 4);
+  WriteU32(payload.data() + 8, 1);
+
+  AudioPacket packet;
+  ASSERT_TRUE(ParseAudioPacket(payload.data(), payload.size(), &packet));
+  EXPECT_EQ(packet.decode_type, 4u);
+  EXPECT_EQ(packet.audio_type, 1u);
+  EXPECT_EQ(packet.command, AudioCommand::kNone);
+  EXPECT_EQ(packet.sample_count, 4u);
+
+  payload.resize(kAudioDataHeaderSize + 1);
+  payload.back() = 6;
+  ASSERT_TRUE(ParseAudioPacket(payload.data(), payload.size(), &packet));
+  EXPECT_EQ(packet.command, AudioCommand::kNaviStart);
+  EXPECT_EQ(packet.sample_count, 0u);
+}
+
+TEST(Audio, ResamplesToStereoOutputRate) {
+  AudioFormat format;
+  ASSERT_TRUE(AudioFormatForDecodeType(5, &format));
+  EXPECT_EQ(format.sample_rate, 16000u);
+  EXPECT_EQ(format.channels, 1u);
+
+  Resampler resampler(48000);
+  resampler.Configure(format);
+  std::vector<int16_t> input(1600, 1000);
+  std::vector<int16_t> output;
+  resampler.Process(input.data(), input.size(), &output);
+
+  // 100 ms in, ~100 ms of 48 kHz stereo out.
+  EXPECT_NEAR(static_cast<double>(output.size()), 4800.0 * 2, 8);
+  EXPECT_EQ(output[output.size() / 2], 1000);
+}
+
+TEST(Audio, ResamplesTheSameWhateverThePacketSize) {
+  const AudioFormat format = {44100, 2};
+  std::vector<int16_t> input(2 * 44100);
+  for (size_t i = 0; i < input.size(); i++) {
+    input[i] = static_cast<int16_t>((i * 7919) % 65536 - 32768);
+  }
+
+  Resampler whole(48000);
+  whole.Configure(format);
+  std::vector<int16_t> expected;
+  whole.Process(input.data(), input.size() / 2, &expected);
+
+  Resampler packets(48000);
+  packets.Configure(format);
+  std::vector<int16_t> actual;
+  for (size_t frame = 0; frame < input.size() / 2; frame += 441) {
+    packets.Process(input.data() + frame * 2, 441, &actual);
+  }
+  EXPECT_EQ(actual, expected);
+}
+
+TEST(Audio, MixSaturates) {
+  std::vector<int16_t> dst = {30000, -30000, 100};
+  const std::vector<int16_t> src = {10000, -10000, 100};
+  MixSamples(dst.data(), src.data(), dst.size(), 256);
+  EXPECT_EQ(dst[0], 32767);
+  EXPECT_EQ(dst[1], -32768);
+  EXPECT_EQ(dst[2], 200);
+}
+
+}  // namespace test
+}  // namespace carlink
@@ -0,0 +1,127 @@
+#include "core/bitstream_analyzer.h"
+
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include "core/nal_scanner.h"
+#include "core/pcm_h264.h"
+
+namespace carlink {
+namespace test {
+
+namespace {
+
+constexpr int64_t kFrameNs = 16666667;
+
+// |count| access units of a 32x32 stream, an IDR every |gop|.
+std::vector<std::vector<uint8_t>> EncodeStream(int count, int gop) {
+  std::vector<uint8_t> planes(32 * 32 * 3 / 2, 128);
+  VideoFrame frame;
+  frame.width = 32;
+  frame.height = 32;
+  frame.y = planes.data();
+  frame.u = planes.data() + 32 * 32;
+  frame.v = frame.u + 16 * 16;
+  frame.y_stride = 32;
+  frame.uv_stride = 16;
+  PcmH264Encoder encoder(32, 32);
+  std::vector<std::vector<uint8_t>> units(count);
+  for (int i = 0; i < count; i++) {
+    encoder.Encode(frame, i % gop == 0, &units[i]);
+  }
+  return units;
+}
+
+}  // namespace
+
+TEST(BitstreamAnalyzer, TracksGopsAndFrameSizes) {
+  const std::vector<std::vector<uint8_t>> units = EncodeStream(70, 30);
+  BitstreamAnalyzer analyzer;
+  int64_t now = 1000000000;
+  for (const std::vector<uint8_t>& unit : units) {
+    const BitstreamAnalyzer::Result result =
+        analyzer.Analyze(unit.data(), unit.size(), now);
+    EXPECT_TRUE(result.parsed);
+    EXPECT_EQ(result.missing, 0u);
+    now += kFrameNs;
+  }
+
+  const BitstreamAnalyzer::Stats stats = analyzer.stats();
+  EXPECT_EQ(stats.access_units, 70u);
+  EXPECT_EQ(stats.idr_frames, 3u);
+  EXPECT_EQ(stats.i_frames, 67u);
+  EXPECT_EQ(stats.unparsed, 0u);
+  EXPECT_EQ(stats.profile, 66u);
+  EXPECT_EQ(stats.width, 32u);
+  EXPECT_EQ(stats.height, 32u);
+  EXPECT_EQ(stats.gop_length, 30u);
+  EXPECT_EQ(stats.gop_length_max, 30u);
+  EXPECT_EQ(stats.frames_since_idr, 10u);
+  EXPECT_EQ(stats.frame_num_gaps, 0u);
+  // About 60 units a second.
+  const uint64_t expected_bps = units[1].size() * 8 * 60;
+  EXPECT_NEAR(static_cast<double>(stats.bitrate_bps), expected_bps,
+              expected_bps * 0.05);
+  EXPECT_GE(stats.bitrate_peak_bps, stats.bitrate_bps);
+  EXPECT_NEAR(static_cast<double>(stats.frame_size_p50), units[1].size(),
+              units[1].size() * 0.07);
+  EXPECT_EQ(stats.idr_size_max, units[0].size());
+}
+
+TEST(BitstreamAnalyzer, FrameNumGapsMeanLostUnits) {
+  const std::vector<std::vector<uint8_t>> units = EncodeStream(20, 100);
+  BitstreamAnalyzer analyzer;
+  uint32_t missing = 0;
+  for (size_t i = 0; i < units.size(); i++) {
+    // Units 5-7 never arrive; frame_num wraps at 16 in between.
+    if (i >= 5 && i <= 7) {
+      continue;
+    }
+    const BitstreamAnalyzer::Result result = analyzer.Analyze(
+        units[i].data(), units[i].size(), 1000000000 + i * kFrameNs);
+    missing += result.missing;
+    if (i == 8) {
+      EXPECT_EQ(result.missing, 3u);
+    }
+  }
+  EXPECT_EQ(missing, 3u);
+  const BitstreamAnalyzer::Stats stats = analyzer.stats();
+  EXPECT_EQ(stats.frame_num_gaps, 1u);
+  EXPECT_EQ(stats.frames_missing, 3u);
+}
+
+TEST(BitstreamAnalyzer, ParsesAPhoneStream) {
+  std::ifstream file(CARLINK_TEST_VIDEO, std::ios::binary);
+  const std::vector<uint8_t> stream((std::istreambuf_iterator<char>(file)),
+                                    std::istreambuf_iterator<char>());
+  ASSERT_FALSE(stream.empty());
+  BitstreamAnalyzer analyzer;
+  int64_t now = 1000000000;
+  for (const AccessUnitRange& unit :
+       SplitAccessUnits(stream.data(), stream.size())) {
+    analyzer.Analyze(stream.data() + unit.offset, unit.size, now);
+    now += kFrameNs;
+  }
+  const BitstreamAnalyzer::Stats stats = analyzer.stats();
+  EXPECT_GT(stats.access_units, 0u);
+  EXPECT_GE(stats.idr_frames, 1u);
+  EXPECT_GT(stats.width, 0u);
+  EXPECT_GT(stats.height, 0u);
+  EXPECT_EQ(stats.frame_num_gaps, 0u);
+  EXPECT_EQ(stats.unparsed, 0u);
+}
+
+TEST(BitstreamAnalyzer, IgnoresUnitsBeforeTheFirstSps) {
+  const std::vector<std::vector<uint8_t>> units = EncodeStream(3, 100);
+  BitstreamAnalyzer analyzer;
+  EXPECT_FALSE(analyzer.Analyze(units[1].data(), units[1].size(), 1).parsed);
+  const uint8_t garbage[] = {0, 0, 1, 0x65, 0xff};
+  EXPECT_FALSE(analyzer.Analyze(garbage, sizeof(garbage), 2).parsed);
+  EXPECT_EQ(analyzer.stats().unparsed, 2u);
+}
+
+}  // namespace test
+}  // namespace carlink
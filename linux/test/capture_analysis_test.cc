@@ -0,0 +1,159 @@
+#include "core/capture_analysis.h"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "core/audio.h"
+#include "core/capture_writer.h"
+#include "core/clock.h"
+#include "core/nal_scanner.h"
+#include "core/protocol.h"
+
+namespace carlink {
+namespace test {
+
+namespace {
+
+constexpr int64_t kMs = 1000000;
+
+std::vector<uint8_t> VideoPayload(uint8_t nal_type, size_t size) {
+  std::vector<uint8_t> payload(size, 0x42);
+  const uint8_t nal[] = {0, 0, 0, 1, nal_type, 0x88};
+  std::fill(payload.begin(), payload.begin() + kVideoDataHeaderSize, 0);
+  std::copy(nal, nal + sizeof(nal), payload.begin() + kVideoDataHeaderSize);
+  return payload;
+}
+
+std::vector<uint8_t> AudioPayload(uint32_t decode_type, uint32_t audio_type) {
+  std::vector<uint8_t> payload(kAudioDataHeaderSize + 64, 0);
+  payload[0] = decode_type;
+  payload[8] = audio_type;
+  return payload;
+}
+
+class CaptureAnalysisTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    path_ = std::string(testing::TempDir()) + "capture_analysis" +
+            std::to_string(getpid());
+  }
+  void TearDown() override { unlink(path_.c_str()); }
+
+  // 20 s at 10 fps: a GOP every 10 frames, a heartbeat every 2 s except
+  // for an 8 s gap from 6 s, 1.5 s without any inbound message from 12 s,
+  // and media audio switching from 44.1 kHz to 48 kHz at 15 s.
+  void WriteSession() {
+    CaptureWriter writer;
+    ASSERT_TRUE(writer.Open(path_));
+    const int64_t start = MonotonicNanos();
+    const std::vector<uint8_t> idr = VideoPayload(kNalIdr, 3020);
+    const std::vector<uint8_t> slice = VideoPayload(kNalSlice, 520);
+    const EncodedMessage heartbeat = EncodeHeartBeat();
+    int frame = 0;
+    for (int64_t ms = 0; ms < 20000; ms += 100) {
+      const int64_t now = start + ms * kMs;
+      if (ms % 2000 == 0 && (ms < 8000 || ms >= 13000)) {
+        writer.RecordEncoded(CaptureDirection::kOutbound, heartbeat.data(),
+                             heartbeat.size(), now);
+      }
+      if (ms > 12000 && ms < 13500) {
+        continue;
+      }
+      const std::vector<uint8_t>& video = frame++ % 10 == 0 ? idr : slice;
+      writer.Record(CaptureDirection::kInbound,
+                    static_cast<uint32_t>(MessageType::kVideoData),
+                    video.data(), video.size(), now);
+      const std::vector<uint8_t> audio =
+          AudioPayload(ms < 15000 ? 2 : 4, 1);
+      writer.Record(CaptureDirection::kInbound,
+                    static_cast<uint32_t>(MessageType::kAudioData),
+                    audio.data(), audio.size(), now + kMs);
+    }
+    writer.Close();
+  }
+
+  std::string path_;
+};
+
+}  // namespace
+
+TEST_F(CaptureAnalysisTest, ReportsSession) {
+  WriteSession();
+  CaptureReader reader;
+  ASSERT_TRUE(reader.Open(path_));
+  CaptureAnalysisOptions options;
+  options.threads = 1;
+  const CaptureAnalysis analysis = AnalyzeCapture(reader, options);
+
+  // 186 video frames, as many audio packets, 7 heartbeats.
+  EXPECT_EQ(analysis.messages, 186u * 2 + 7);
+  ASSERT_EQ(analysis.types.size(), 3u);
+  EXPECT_EQ(analysis.types[0].type,
+            static_cast<uint32_t>(MessageType::kVideoData));
+  EXPECT_EQ(analysis.types[0].inbound, 186u);
+  EXPECT_EQ(analysis.types[2].type,
+            static_cast<uint32_t>(MessageType::kHeartBeat));
+  EXPECT_EQ(analysis.types[2].outbound, 7u);
+
+  ASSERT_EQ(analysis.gop_lengths.size(), 18u);
+  for (uint32_t length : analysis.gop_lengths) {
+    EXPECT_EQ(length, 10u);
+  }
+  EXPECT_EQ(analysis.idr_frames.count, 19u);
+  EXPECT_EQ(analysis.idr_frames.max, 3000u);
+  EXPECT_EQ(analysis.p_frames.count, 167u);
+  EXPECT_EQ(analysis.p_frames.p50, 500u);
+  uint64_t video_bytes = 0;
+  for (uint64_t bytes : analysis.video_bytes_per_second) {
+    video_bytes += bytes;
+  }
+  EXPECT_EQ(video_bytes, 19u * 3000 + 167u * 500);
+
+  ASSERT_EQ(analysis.audio_format_changes.size(), 2u);
+  EXPECT_EQ(analysis.audio_format_changes[0].from_decode_type, 0u);
+  EXPECT_EQ(analysis.audio_format_changes[0].to_decode_type, 2u);
+  EXPECT_EQ(analysis.audio_format_changes[1].from_decode_type, 2u);
+  EXPECT_EQ(analysis.audio_format_changes[1].to_decode_type, 4u);
+
+  EXPECT_EQ(analysis.heartbeats, 7u);
+  ASSERT_EQ(analysis.heartbeat_gaps.size(), 1u);
+  EXPECT_EQ(analysis.heartbeat_gaps[0].length_ns, 8000 * kMs);
+  EXPECT_EQ(analysis.longest_heartbeat_gap.length_ns, 8000 * kMs);
+
+  // Last audio at 12.001 s, next video at 13.5 s.
+  EXPECT_EQ(analysis.longest_inbound_silence.length_ns, 1499 * kMs);
+}
+
+TEST_F(CaptureAnalysisTest, ChunksDoNotChangeTheResult) {
+  WriteSession();
+  CaptureReader reader;
+  ASSERT_TRUE(reader.Open(path_));
+  CaptureAnalysisOptions options;
+  options.threads = 1;
+  const CaptureAnalysis expected = AnalyzeCapture(reader, options);
+
+  for (int threads : {2, 3, 7, 64}) {
+    options.threads = threads;
+    const CaptureAnalysis analysis = AnalyzeCapture(reader, options);
+    EXPECT_EQ(analysis.messages, expected.messages) << threads;
+    EXPECT_EQ(analysis.video_bytes_per_second,
+              expected.video_bytes_per_second);
+    EXPECT_EQ(analysis.gop_lengths, expected.gop_lengths) << threads;
+    EXPECT_EQ(analysis.p_frames.p95, expected.p_frames.p95);
+    EXPECT_EQ(analysis.audio_format_changes.size(),
+              expected.audio_format_changes.size());
+    EXPECT_EQ(analysis.heartbeat_gaps.size(),
+              expected.heartbeat_gaps.size());
+    EXPECT_EQ(analysis.longest_heartbeat_gap.length_ns,
+              expected.longest_heartbeat_gap.length_ns);
+    EXPECT_EQ(analysis.longest_inbound_silence.length_ns,
+              expected.longest_inbound_silence.length_ns);
+  }
+}
+
+}  // namespace test
+}  // namespace carlink
@@ -0,0 +1,271 @@
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "core/capture_reader.h"
+#include "core/capture_writer.h"
+#include "core/clock.h"
+#include "core/nal_scanner.h"
+#include "core/protocol.h"
+
+namespace carlink {
+namespace test {
+
+namespace {
+
+std::string TempPath(const char* name) {
+  return std::string(testing::TempDir()) + name + std::to_string(getpid());
+}
+
+// VideoData payload: 20-byte header, then one NAL unit of |nal_type|.
+std::vector<uint8_t> VideoPayload(uint8_t nal_type, size_t size) {
+  std::vector<uint8_t> payload(size, 0x42);
+  const uint8_t nal[] = {0, 0, 0, 1, nal_type, 0x88};
+  std::fill(payload.begin(), payload.begin() + kVideoDataHeaderSize, 0);
+  std::copy(nal, nal + sizeof(nal), payload.begin() + kVideoDataHeaderSize);
+  return payload;
+}
+
+// Records a GOP of one IDR and four P frames every 100 ms of capture time,
+// interleaved with heartbeats going out.
+void WriteSession(CaptureWriter& writer, int64_t start_ns, int gops) {
+  const std::vector<uint8_t> idr = VideoPayload(kNalIdr, 5000);
+  const std::vector<uint8_t> slice = VideoPayload(kNalSlice, 700);
+  const EncodedMessage heartbeat = EncodeHeartBeat();
+  int64_t now = start_ns;
+  for (int gop = 0; gop < gops; gop++) {
+    for (int frame = 0; frame < 5; frame++) {
+      const std::vector<uint8_t>& payload = frame == 0 ? idr : slice;
+      writer.Record(CaptureDirection::kInbound,
+                    static_cast<uint32_t>(MessageType::kVideoData),
+                    payload.data(), payload.size(), now);
+      now += 20000000;
+    }
+    writer.RecordEncoded(CaptureDirection::kOutbound, heartbeat.data(),
+                         heartbeat.size(), now);
+  }
+}
+
+}  // namespace
+
+TEST(Capture, RoundTripsThroughIndex) {
+  const std::string path = TempPath("capture_round_trip");
+  CaptureWriter writer;
+  ASSERT_TRUE(writer.Open(path));
+  WriteSession(writer, MonotonicNanos(), 10);
+  writer.Close();
+  const CaptureWriter::Stats stats = writer.stats();
+  EXPECT_EQ(stats.messages, 60u);
+  EXPECT_EQ(stats.keyframes, 10u);
+  EXPECT_EQ(stats.dropped_messages, 0u);
+
+  CaptureReader reader;
+  ASSERT_TRUE(reader.Open(path));
+  EXPECT_TRUE(reader.indexed());
+  ASSERT_EQ(reader.message_count(), 60u);
+  ASSERT_EQ(reader.keyframe_count(), 10u);
+
+  const CaptureRecord first = reader.record(0);
+  EXPECT_EQ(first.type, static_cast<uint32_t>(MessageType::kVideoData));
+  EXPECT_EQ(first.direction, CaptureDirection::kInbound);
+  EXPECT_TRUE(first.flags & kCaptureKeyframe);
+  EXPECT_EQ(first.length, 5000u);
+  EXPECT_EQ(first.payload[kVideoDataHeaderSize + 4], kNalIdr);
+
+  const CaptureRecord heartbeat = reader.record(5);
+  EXPECT_EQ(heartbeat.type, static_cast<uint32_t>(MessageType::kHeartBeat));
+  EXPECT_EQ(heartbeat.direction, CaptureDirection::kOutbound);
+  EXPECT_EQ(heartbeat.length, 0u);
+
+  for (size_t i = 0; i < reader.keyframe_count(); i++) {
+    EXPECT_EQ(reader.keyframe(i), i * 6);
+  }
+  unlink(path.c_str());
+}
+
+TEST(Capture, EmptyCaptureIsIndexed) {
+  const std::string path = TempPath("capture_empty");
+  CaptureWriter writer;
+  ASSERT_TRUE(writer.Open(path));
+  writer.Close();
+
+  CaptureReader reader;
+  ASSERT_TRUE(reader.Open(path));
+  EXPECT_TRUE(reader.indexed());
+  EXPECT_EQ(reader.message_count(), 0u);
+  EXPECT_EQ(reader.SeekKeyframe(0), 0u);
+  unlink(path.c_str());
+}
+
+TEST(Capture, SeeksToKeyframe) {
+  const std::string path = TempPath("capture_seek");
+  CaptureWriter writer;
+  ASSERT_TRUE(writer.Open(path));
+  WriteSession(writer, MonotonicNanos(), 10);
+  writer.Close();
+
+  CaptureReader reader;
+  ASSERT_TRUE(reader.Open(path));
+  const int64_t base = reader.record(0).timestamp_ns;
+  // GOP n starts at base + n * 100 ms.
+  EXPECT_EQ(reader.SeekKeyframe(base - 1), 0u);
+  EXPECT_EQ(reader.SeekKeyframe(base), 0u);
+  EXPECT_EQ(reader.SeekKeyframe(base + 250000000), 12u);
+  EXPECT_EQ(reader.SeekKeyframe(base + 300000000), 18u);
+  EXPECT_EQ(reader.SeekKeyframe(base + 60000000000), 54u);
+  unlink(path.c_str());
+}
+
+TEST(Capture, ScansWithoutIndex) {
+  const std::string path = TempPath("capture_truncated");
+  CaptureWriter writer;
+  ASSERT_TRUE(writer.Open(path));
+  WriteSession(writer, MonotonicNanos(), 4);
+  writer.Close();
+
+  // Drop the index and footer and cut the last record short, as if the
+  // recorder had crashed.
+  CaptureReader full;
+  ASSERT_TRUE(full.Open(path));
+  const uint64_t cut = full.offset(23) + 10;
+  ASSERT_EQ(truncate(path.c_str(), cut), 0);
+
+  CaptureReader reader;
+  ASSERT_TRUE(reader.Open(path));
+  EXPECT_FALSE(reader.indexed());
+  EXPECT_EQ(reader.message_count(), 23u);
+  EXPECT_EQ(reader.keyframe_count(), 4u);
+  EXPECT_EQ(reader.record(18).length, 5000u);
+  unlink(path.c_str());
+}
+
+TEST(Capture, DropsWholeMessagesWhenBuffersAreFull) {
+  const std::string path = TempPath("capture_drop");
+  CaptureWriter::Options options;
+  options.file.buffer_size = 4096;
+  options.file.buffer_count = 2;
+  CaptureWriter writer(options);
+  ASSERT_TRUE(writer.Open(path));
+  // Larger than every block together.
+  const std::vector<uint8_t> huge = VideoPayload(kNalSlice, 10000);
+  writer.Record(CaptureDirection::kInbound,
+                static_cast<uint32_t>(MessageType::kVideoData), huge.data(),
+                huge.size(), MonotonicNanos());
+  const std::vector<uint8_t> small = VideoPayload(kNalSlice, 100);
+  writer.Record(CaptureDirection::kInbound,
+                static_cast<uint32_t>(MessageType::kVideoData), small.data(),
+                small.size(), MonotonicNanos());
+  writer.Close();
+  EXPECT_EQ(writer.stats().dropped_messages, 1u);
+
+  CaptureReader reader;
+  ASSERT_TRUE(reader.Open(path));
+  ASSERT_EQ(reader.message_count(), 1u);
+  EXPECT_EQ(reader.record(0).length, 100u);
+  unlink(path.c_str());
+}
+
+CaptureWriter::Options CompressedOptions() {
+  CaptureWriter::Options options;
+  options.compress = true;
+  // Small blocks, so a short session spans several.
+  options.block_size = 8192;
+  options.compression_threads = 3;
+  // Enough for the whole session, so nothing is dropped however slowly
+  // the workers get scheduled.
+  options.max_pending_blocks = 64;
+  return options;
+}
+
+TEST(Capture, CompressedRoundTrip) {
+  const std::string path = TempPath("capture_compressed");
+  CaptureWriter writer(CompressedOptions());
+  ASSERT_TRUE(writer.Open(path));
+  WriteSession(writer, MonotonicNanos(), 20);
+  writer.Close();
+  const CaptureWriter::Stats stats = writer.stats();
+  EXPECT_EQ(stats.messages, 120u);
+  EXPECT_EQ(stats.dropped_messages, 0u);
+  EXPECT_GT(stats.blocks, 1u);
+  EXPECT_LT(stats.stored_bytes, stats.bytes);
+
+  CaptureReader reader;
+  ASSERT_TRUE(reader.Open(path));
+  EXPECT_TRUE(reader.indexed());
+  EXPECT_TRUE(reader.compressed());
+  EXPECT_EQ(reader.block_count(), stats.blocks);
+  ASSERT_EQ(reader.message_count(), 120u);
+  ASSERT_EQ(reader.keyframe_count(), 20u);
+
+  // Out of order, so blocks are decompressed again.
+  CaptureReader::BlockCache cache;
+  for (size_t i = reader.message_count(); i-- > 0;) {
+    const CaptureRecord record = reader.record(i, &cache);
+    if (i % 6 == 5) {
+      EXPECT_EQ(record.type, static_cast<uint32_t>(MessageType::kHeartBeat));
+      EXPECT_EQ(record.length, 0u);
+    } else {
+      ASSERT_EQ(record.length, i % 6 == 0 ? 5000u : 700u);
+      EXPECT_EQ(record.payload[kVideoDataHeaderSize + 4],
+                i % 6 == 0 ? kNalIdr : kNalSlice);
+      EXPECT_EQ(record.payload[record.length - 1], 0x42);
+    }
+  }
+  for (size_t i = 0; i < reader.keyframe_count(); i++) {
+    EXPECT_EQ(reader.keyframe(i), i * 6);
+  }
+  unlink(path.c_str());
+}
+
+TEST(Capture, CompressedSeeksToKeyframe) {
+  const std::string path = TempPath("capture_compressed_seek");
+  CaptureWriter writer(CompressedOptions());
+  ASSERT_TRUE(writer.Open(path));
+  WriteSession(writer, MonotonicNanos(), 10);
+  writer.Close();
+
+  CaptureReader reader;
+  ASSERT_TRUE(reader.Open(path));
+  const int64_t base = reader.record(0).timestamp_ns;
+  EXPECT_EQ(reader.SeekKeyframe(base + 250000000), 12u);
+  EXPECT_EQ(reader.SeekKeyframe(base + 60000000000), 54u);
+  EXPECT_TRUE(reader.record(54).flags & kCaptureKeyframe);
+  unlink(path.c_str());
+}
+
+TEST(Capture, CompressedScansWithoutIndex) {
+  const std::string path = TempPath("capture_compressed_truncated");
+  CaptureWriter writer(CompressedOptions());
+  ASSERT_TRUE(writer.Open(path));
+  WriteSession(writer, MonotonicNanos(), 20);
+  writer.Close();
+
+  CaptureReader full;
+  ASSERT_TRUE(full.Open(path));
+  ASSERT_GT(full.block_count(), 2u);
+  // Cut into the last block: only whole blocks survive.
+  struct stat info;
+  ASSERT_EQ(stat(path.c_str(), &info), 0);
+  const size_t whole = full.message_count();
+  CaptureReader::BlockCache cache;
+  ASSERT_EQ(truncate(path.c_str(), info.st_size / 2), 0);
+
+  CaptureReader reader;
+  ASSERT_TRUE(reader.Open(path));
+  EXPECT_FALSE(reader.indexed());
+  EXPECT_GT(reader.message_count(), 0u);
+  EXPECT_LT(reader.message_count(), whole);
+  for (size_t i = 0; i < reader.message_count(); i++) {
+    EXPECT_EQ(reader.record(i, &cache).length,
+              i % 6 == 5 ? 0u : i % 6 == 0 ? 5000u : 700u);
+  }
+  unlink(path.c_str());
+}
+
+}  // namespace test
+}  // namespace carlink
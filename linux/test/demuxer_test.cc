@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "core/demuxer.h"
+
+namespace carlink {
+namespace test {
+
+namespace {
+
+std::vector<uint8_t> MakeStream() {
+  std::vector<uint8_t> stream;
+  for (uint32_t i = 0; i < 4; i++) {
+    std::vector<uint8_t> payload(i * 100, static_cast<uint8_t>(i));
+    EncodedMessage message =
+        EncodeMessage(MessageType::kVideoData, payload.data(), payload.size());
+    stream.insert(stream.end(), message.begin(), message.end());
+  }
+  return stream;
+}
+
+struct Collector {
+  std::vector<Message> messages;
+  Demuxer::MessageCallback callback() {
+    return [this](Message message) { messages.push_back(std::move(message)); };
+  }
+};
+
+}  // namespace
+
+TEST(Demuxer, SplitsAnyChunking) {
+  const std::vector<uint8_t> stream = MakeStream();
+  for (size_t chunk : {1u, 7u, 16u, 333u, 100000u}) {
+    Collector collector;
+    Demuxer demuxer(BufferPool::Create(), collector.callback());
+    for (size_t offset = 0; offset < stream.size(); offset += chunk) {
+      const size_t length = std::min(chunk, stream.size() - offset);
+      demuxer.Feed(stream.data() + offset, length, 0);
+    }
+    ASSERT_EQ(collector.messages.size(), 4u) << "chunk " << chunk;
+    for (uint32_t i = 0; i < 4; i++) {
+      EXPECT_EQ(collector.messages[i].payload.size(), i * 100);
+    }
+    EXPECT_EQ(demuxer.stats().resyncs, 0u);
+  }
+}
+
+TEST(Demuxer, ResyncsAfterGarbage) {
+  std::vector<uint8_t> stream = MakeStream();
+  std::vector<uint8_t> garbage = {0x12, 0xaa, 0x55, 0x34, 0x00, 0xaa};
+  stream.insert(stream.begin() + kHeaderSize, garbage.begin(),
+                garbage.end());
+
+  Collector collector;
+  Demuxer demuxer(BufferPool::Create(), collector.callback());
+  demuxer.Feed(stream.data(), stream.size(), 0);
+
+  ASSERT_EQ(collector.messages.size(), 4u);
+  EXPECT_EQ(collector.messages.back().payload.size(), 300u);
+  EXPECT_EQ(demuxer.stats().resyncs, 1u);
+  EXPECT_EQ(demuxer.stats().skipped_bytes, garbage.size());
+}
+
+TEST(Demuxer, StampsOnTheGivenClock) {
+  const std::vector<uint8_t> stream = MakeStream();
+  VirtualClock clock(5000);
+  Collector collector;
+  Demuxer demuxer(BufferPool::Create(), collector.callback(), &clock);
+  demuxer.Feed(stream.data(), stream.size(), 4000);
+
+  ASSERT_EQ(collector.messages.size(), 4u);
+  EXPECT_EQ(collector.messages[0].arrival_ns, 4000);
+  EXPECT_EQ(collector.messages[0].demux_ns, 5000);
+}
+
+}  // namespace test
+}  // namespace carlink
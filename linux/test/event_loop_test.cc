@@ -0,0 +1,139 @@
+#include "core/event_loop.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "core/clock.h"
+
+namespace carlink {
+namespace test {
+
+namespace {
+
+bool WaitFor(const std::function<bool()>& done) {
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (!done()) {
+    if (std::chrono::steady_clock::now() > deadline) {
+      return false;
+    }
+    std::this_thread::yield();
+  }
+  return true;
+}
+
+// Appends its id to a shared list when run.
+struct Recorder : EventLoop::Event {
+  int id = 0;
+  std::mutex* mutex = nullptr;
+  std::vector<int>* order = nullptr;
+
+  static void Record(EventLoop::Event* event) {
+    Recorder* self = static_cast<Recorder*>(event);
+    std::lock_guard<std::mutex> lock(*self->mutex);
+    self->order->push_back(self->id);
+  }
+};
+
+}  // namespace
+
+TEST(EventLoop, RunsPostedWorkInOrderOnItsThread) {
+  EventLoop loop;
+  std::mutex mutex;
+  std::vector<int> order;
+  std::atomic<bool> on_loop{true};
+  for (int i = 0; i < 100; i++) {
+    loop.Post([&, i] {
+      on_loop = on_loop && loop.InLoopThread();
+      std::lock_guard<std::mutex> lock(mutex);
+      order.push_back(i);
+    });
+  }
+  ASSERT_TRUE(WaitFor([&] {
+    std::lock_guard<std::mutex> lock(mutex);
+    return order.size() == 100;
+  }));
+  EXPECT_TRUE(on_loop);
+  EXPECT_FALSE(loop.InLoopThread());
+  for (int i = 0; i < 100; i++) {
+    EXPECT_EQ(order[i], i);
+  }
+}
+
+TEST(EventLoop, TimersFireInDueOrderAndCancel) {
+  EventLoop loop;
+  std::mutex mutex;
+  std::vector<int> order;
+  Recorder timers[4];
+  for (int i = 0; i < 4; i++) {
+    timers[i].run = &Recorder::Record;
+    timers[i].id = i;
+    timers[i].mutex = &mutex;
+    timers[i].order = &order;
+  }
+  const int64_t now = MonotonicNanos();
+  loop.PostAt(&timers[0], now + 30000000);
+  loop.PostAt(&timers[1], now + 10000000);
+  loop.PostAt(&timers[2], now + 20000000);
+  loop.PostAt(&timers[3], now + 15000000);
+  EXPECT_TRUE(loop.Cancel(&timers[3]));
+  EXPECT_FALSE(loop.Cancel(&timers[3]));
+
+  ASSERT_TRUE(WaitFor([&] {
+    std::lock_guard<std::mutex> lock(mutex);
+    return order.size() == 3;
+  }));
+  EXPECT_GE(MonotonicNanos() - now, 30000000);
+  EXPECT_EQ(order, (std::vector<int>{1, 2, 0}));
+  EXPECT_EQ(loop.stats().timers_run, 3u);
+}
+
+TEST(EventLoop, RepostingAQueuedEventRunsItOnce) {
+  EventLoop loop;
+  std::mutex mutex;
+  std::vector<int> order;
+  Recorder event;
+  event.run = &Recorder::Record;
+  event.mutex = &mutex;
+  event.order = &order;
+  // Hold the loop up so every post lands while the event is queued.
+  std::atomic<bool> release{false};
+  loop.Post([&release] {
+    while (!release) {
+      std::this_thread::yield();
+    }
+  });
+  for (int i = 0; i < 5; i++) {
+    loop.Post(&event);
+  }
+  std::atomic<bool> drained{false};
+  loop.Post([&drained] { drained = true; });
+  release = true;
+  ASSERT_TRUE(WaitFor([&drained] { return drained.load(); }));
+  EXPECT_EQ(order.size(), 1u);
+}
+
+TEST(EventLoop, StopDropsQueuedWork) {
+  std::atomic<int> runs{0};
+  EventLoop loop;
+  EventLoop::Event timer;
+  timer.run = [](EventLoop::Event*) { FAIL() << "timer ran after Stop"; };
+  loop.PostAt(&timer, MonotonicNanos() + 60000000000);
+  loop.Post([&runs] { runs++; });
+  ASSERT_TRUE(WaitFor([&runs] { return runs.load() == 1; }));
+  loop.Stop();
+  EXPECT_FALSE(timer.queued);
+  // One-off tasks posted now are freed, not run.
+  loop.Post([&runs] { runs++; });
+  loop.Stop();
+  EXPECT_EQ(runs.load(), 1);
+}
+
+}  // namespace test
+}  // namespace carlink
@@ -0,0 +1,188 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "core/file_log_sink.h"
+#include "core/file_writer.h"
+
+namespace carlink {
+namespace test {
+
+namespace {
+
+std::string TempPath(const char* name) {
+  return std::string(testing::TempDir()) + name + std::to_string(getpid());
+}
+
+std::vector<uint8_t> ReadFile(const std::string& path) {
+  std::vector<uint8_t> contents;
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    return contents;
+  }
+  uint8_t chunk[4096];
+  size_t read;
+  while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    contents.insert(contents.end(), chunk, chunk + read);
+  }
+  fclose(file);
+  return contents;
+}
+
+// Appends runs of varying length, some spanning buffers, and returns what
+// the file should contain.
+std::vector<uint8_t> AppendPattern(FileWriter& writer) {
+  std::vector<uint8_t> expected;
+  uint8_t value = 0;
+  for (size_t length = 1; length < 20000; length = length * 3 + 7) {
+    std::vector<uint8_t> run(length);
+    for (uint8_t& byte : run) {
+      byte = value++;
+    }
+    EXPECT_TRUE(writer.Append(run.data(), run.size(),
+                              FileWriter::Overflow::kWait));
+    expected.insert(expected.end(), run.begin(), run.end());
+  }
+  return expected;
+}
+
+class FileWriterBackendTest
+    : public testing::TestWithParam<FileWriter::Backend> {};
+
+}  // namespace
+
+TEST_P(FileWriterBackendTest, WritesEverythingInOrder) {
+  const std::string path = TempPath("file_writer");
+  FileWriter::Options options;
+  options.buffer_size = 8192;
+  options.buffer_count = 4;
+  options.max_in_flight = 2;
+  options.backend = GetParam();
+  FileWriter writer(options);
+  ASSERT_TRUE(writer.Open(path));
+  if (GetParam() == FileWriter::Backend::kThreads) {
+    EXPECT_STREQ(writer.backend_name(), "threads");
+  }
+
+  std::vector<uint8_t> expected = AppendPattern(writer);
+  EXPECT_EQ(writer.position(), expected.size());
+  // A flush in the middle leaves a partial buffer behind.
+  writer.Flush();
+  EXPECT_EQ(ReadFile(path), expected);
+  const std::vector<uint8_t> more = AppendPattern(writer);
+  expected.insert(expected.end(), more.begin(), more.end());
+  writer.Close();
+
+  EXPECT_EQ(ReadFile(path), expected);
+  const FileWriter::Stats stats = writer.stats();
+  EXPECT_EQ(stats.bytes, expected.size());
+  EXPECT_EQ(stats.errors, 0u);
+  EXPECT_LE(stats.max_in_flight, 2u);
+  EXPECT_GT(stats.latency_max_ns, 0u);
+  EXPECT_LE(stats.latency_p50_ns, stats.latency_max_ns);
+  unlink(path.c_str());
+}
+
+TEST_P(FileWriterBackendTest, DirectFallsBackForUnalignedTail) {
+  const std::string path = TempPath("file_writer_direct");
+  FileWriter::Options options;
+  options.buffer_size = 8192;
+  options.direct = true;
+  options.backend = GetParam();
+  FileWriter writer(options);
+  ASSERT_TRUE(writer.Open(path));
+  const std::vector<uint8_t> expected = AppendPattern(writer);
+  writer.Close();
+  EXPECT_EQ(ReadFile(path), expected);
+  EXPECT_EQ(writer.stats().errors, 0u);
+  unlink(path.c_str());
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends, FileWriterBackendTest,
+                         testing::Values(FileWriter::Backend::kIoUring,
+                                         FileWriter::Backend::kThreads));
+
+TEST(FileWriter, ConcurrentAppendsStayWhole) {
+  const std::string path = TempPath("file_writer_concurrent");
+  FileWriter::Options options;
+  options.buffer_size = 4096;
+  options.buffer_count = 4;
+  FileWriter writer(options);
+  ASSERT_TRUE(writer.Open(path));
+
+  // Each record is 64 copies of its writer's letter.
+  std::vector<std::thread> threads;
+  for (char letter = 'a'; letter < 'e'; letter++) {
+    threads.emplace_back([&writer, letter] {
+      std::vector<uint8_t> record(64, letter);
+      for (int i = 0; i < 500; i++) {
+        writer.Append(record.data(), record.size(),
+                      FileWriter::Overflow::kWait);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  writer.Close();
+
+  const std::vector<uint8_t> contents = ReadFile(path);
+  ASSERT_EQ(contents.size(), 4u * 500 * 64);
+  for (size_t offset = 0; offset < contents.size(); offset += 64) {
+    for (size_t i = 1; i < 64; i++) {
+      ASSERT_EQ(contents[offset + i], contents[offset]) << offset;
+    }
+  }
+  unlink(path.c_str());
+}
+
+TEST(FileWriter, DropsAppendsLargerThanFreeSpace) {
+  const std::string path = TempPath("file_writer_drop");
+  FileWriter::Options options;
+  options.buffer_size = 1024;
+  options.buffer_count = 2;
+  FileWriter writer(options);
+  ASSERT_TRUE(writer.Open(path));
+
+  std::vector<uint8_t> large(4096, 1);
+  EXPECT_FALSE(
+      writer.Append(large.data(), large.size(), FileWriter::Overflow::kDrop));
+  std::vector<uint8_t> small(100, 2);
+  EXPECT_TRUE(
+      writer.Append(small.data(), small.size(), FileWriter::Overflow::kDrop));
+  // kWait streams through the buffers whatever the size.
+  EXPECT_TRUE(
+      writer.Append(large.data(), large.size(), FileWriter::Overflow::kWait));
+  writer.Close();
+
+  const FileWriter::Stats stats = writer.stats();
+  EXPECT_EQ(stats.dropped_appends, 1u);
+  EXPECT_EQ(stats.dropped_bytes, 4096u);
+  EXPECT_EQ(ReadFile(path).size(), 4196u);
+  unlink(path.c_str());
+}
+
+TEST(FileLogSink, WritesTimestampedLines) {
+  const std::string path = TempPath("file_log_sink");
+  FileLogSink sink;
+  ASSERT_TRUE(sink.Open(path));
+  sink.Write(LogLevel::kInfo, "first");
+  sink.Write(LogLevel::kError, "second");
+  sink.Close();
+
+  const std::vector<uint8_t> contents = ReadFile(path);
+  const std::string text(contents.begin(), contents.end());
+  // "YYYY-MM-DD HH:MM:SS.mmm I first\n"
+  ASSERT_EQ(text.size(), 2 * 24 + strlen("I first\nE second\n"));
+  EXPECT_EQ(text.substr(24, 8), "I first\n");
+  EXPECT_EQ(text.substr(56), "E second\n");
+  unlink(path.c_str());
+}
+
+}  // namespace test
+}  // namespace carlink
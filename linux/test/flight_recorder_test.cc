@@ -0,0 +1,188 @@
+#include "core/flight_recorder.h"
+
+#include <dirent.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "core/protocol.h"
+
+namespace carlink {
+namespace test {
+
+namespace {
+
+constexpr int64_t kMs = 1000000;
+
+}  // namespace
+
+TEST(FlightRecorder, KeepsTheWindowInOrder) {
+  VirtualClock clock;
+  FlightRecorder::Options options;
+  options.capacity = 8;
+  FlightRecorder recorder(options, &clock);
+  for (uint64_t i = 0; i < 12; i++) {
+    recorder.Record(FlightRecorder::Kind::kTransfer, 0, i);
+    clock.AdvanceTo(clock.Now() + 10 * kMs);
+  }
+
+  // The ring holds the last 8.
+  std::vector<FlightRecorder::Event> events = recorder.Events(1000 * kMs);
+  ASSERT_EQ(events.size(), 8u);
+  EXPECT_EQ(events.front().value, 4u);
+  EXPECT_EQ(events.back().value, 11u);
+  // Only what happened in the last 35 ms.
+  events = recorder.Events(35 * kMs);
+  ASSERT_EQ(events.size(), 3u);
+  EXPECT_EQ(events.front().value, 9u);
+}
+
+TEST(FlightRecorder, RoundsCapacityUpToAPowerOfTwo) {
+  VirtualClock clock;
+  FlightRecorder::Options options;
+  options.capacity = 3;
+  FlightRecorder recorder(options, &clock);
+  for (uint64_t i = 0; i < 6; i++) {
+    recorder.Record(FlightRecorder::Kind::kTransfer, 0, i);
+  }
+  std::vector<FlightRecorder::Event> events = recorder.Events(1000 * kMs);
+  ASSERT_EQ(events.size(), 4u);
+  EXPECT_EQ(events[0].value, 2u);
+  EXPECT_EQ(events[3].value, 5u);
+
+  options.capacity = 0;
+  FlightRecorder empty(options, &clock);
+  empty.Record(FlightRecorder::Kind::kTransfer, 0, 7);
+  events = empty.Events(1000 * kMs);
+  ASSERT_EQ(events.size(), 1u);
+  EXPECT_EQ(events[0].value, 7u);
+}
+
+TEST(FlightRecorder, RecordsOutboundHeaders) {
+  FlightRecorder recorder;
+  const EncodedMessage message = EncodeHeartBeat();
+  recorder.RecordOutbound(message.data(), message.size());
+  const uint8_t garbage[kHeaderSize] = {};
+  recorder.RecordOutbound(garbage, sizeof(garbage));
+
+  const std::vector<FlightRecorder::Event> events =
+      recorder.Events(1000 * kMs);
+  ASSERT_EQ(events.size(), 1u);
+  EXPECT_EQ(events[0].kind, FlightRecorder::Kind::kOutbound);
+  EXPECT_EQ(events[0].id, static_cast<uint32_t>(MessageType::kHeartBeat));
+  EXPECT_EQ(events[0].value, 0u);
+}
+
+TEST(FlightRecorder, CounterSnapshotsOncePerSecond) {
+  VirtualClock clock;
+  FlightRecorder recorder(&clock);
+  EXPECT_TRUE(recorder.CounterSnapshotDue());
+  EXPECT_FALSE(recorder.CounterSnapshotDue());
+  clock.AdvanceTo(clock.Now() + 999 * kMs);
+  EXPECT_FALSE(recorder.CounterSnapshotDue());
+  clock.AdvanceTo(clock.Now() + 1 * kMs);
+  EXPECT_TRUE(recorder.CounterSnapshotDue());
+}
+
+TEST(FlightRecorder, DumpsAndRateLimits) {
+  VirtualClock clock;
+  FlightRecorder::Options options;
+  options.window_ms = 1000;
+  options.min_dump_interval_ms = 5000;
+  FlightRecorder recorder(options, &clock);
+  EXPECT_EQ(recorder.Dump("NoDirectory"), "");
+
+  const std::string dir =
+      testing::TempDir() + "flight" + std::to_string(getpid());
+  recorder.set_directory(dir);
+  recorder.Record(FlightRecorder::Kind::kInbound,
+                  static_cast<uint32_t>(MessageType::kOpen), 28);
+  clock.AdvanceTo(clock.Now() + 2000 * kMs);
+  recorder.Record(FlightRecorder::Kind::kInbound,
+                  static_cast<uint32_t>(MessageType::kVideoData), 4096);
+  recorder.RecordCounter(FlightRecorder::kDecodeErrors, 3);
+  clock.AdvanceTo(clock.Now() + 500 * kMs);
+
+  const std::string path = recorder.Dump("ReadingLoopError USBReadError -4");
+  ASSERT_NE(path, "");
+  EXPECT_NE(path.find("-ReadingLoopError.txt"), std::string::npos);
+  std::ifstream file(path);
+  std::stringstream contents;
+  contents << file.rdbuf();
+  const std::string dump = contents.str();
+  EXPECT_EQ(dump.find("# carlink flight recorder: ReadingLoopError "
+                      "USBReadError -4 at "),
+            0u);
+  EXPECT_NE(dump.find("\n-500.000 in VideoData 4096\n"), std::string::npos);
+  EXPECT_NE(dump.find("\n-500.000 counter decode_errors 3\n"),
+            std::string::npos);
+  // Older than the window.
+  EXPECT_EQ(dump.find(" Open "), std::string::npos);
+
+  clock.AdvanceTo(clock.Now() + 1000 * kMs);
+  EXPECT_EQ(recorder.Dump("DecoderError"), "");
+  EXPECT_EQ(recorder.dumps(), 1u);
+  unlink(path.c_str());
+  rmdir(dir.c_str());
+}
+
+TEST(FlightRecorder, DumpsAsynchronously) {
+  const std::string dir =
+      testing::TempDir() + "flight-async" + std::to_string(getpid());
+  {
+    FlightRecorder::Options options;
+    options.directory = dir;
+    FlightRecorder recorder(options, nullptr);
+    recorder.Record(FlightRecorder::Kind::kTransfer, 0, 512);
+    recorder.DumpAsync("DecoderError");
+    // Pending or rate limited: either way no second file.
+    recorder.DumpAsync("DecoderError");
+    // The destructor finishes a pending dump.
+  }
+  std::vector<std::string> dumps;
+  DIR* listing = opendir(dir.c_str());
+  ASSERT_NE(listing, nullptr);
+  while (dirent* entry = readdir(listing)) {
+    if (entry->d_name[0] != '.') {
+      dumps.push_back(dir + "/" + entry->d_name);
+    }
+  }
+  closedir(listing);
+  ASSERT_EQ(dumps.size(), 1u);
+  EXPECT_NE(dumps[0].find("-DecoderError.txt"), std::string::npos);
+  unlink(dumps[0].c_str());
+  rmdir(dir.c_str());
+}
+
+TEST(FlightRecorder, ConcurrentWritersNeverTear) {
+  FlightRecorder::Options options;
+  options.capacity = 1024;
+  FlightRecorder recorder(options, nullptr);
+  std::vector<std::thread> writers;
+  for (uint32_t id = 0; id < 4; id++) {
+    writers.emplace_back([&recorder, id] {
+      for (uint64_t i = 0; i < 20000; i++) {
+        // value mirrors id so a torn slot would show.
+        recorder.Record(FlightRecorder::Kind::kQueueDepth, id, id * 1000003);
+      }
+    });
+  }
+  for (int i = 0; i < 50; i++) {
+    for (const FlightRecorder::Event& event : recorder.Events(60000 * kMs)) {
+      ASSERT_EQ(event.value, event.id * 1000003u);
+    }
+    std::this_thread::yield();
+  }
+  for (std::thread& writer : writers) {
+    writer.join();
+  }
+  EXPECT_EQ(recorder.Events(60000 * kMs).size(), 1024u);
+}
+
+}  // namespace test
+}  // namespace carlink
@@ -0,0 +1,142 @@
+#include "core/frame_latency.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "core/clock.h"
+#include "core/protocol.h"
+#include "core/rgba_frame_buffer.h"
+#include "core/video_pipeline.h"
+
+namespace carlink {
+namespace test {
+
+namespace {
+
+constexpr int64_t kMs = 1000000;
+
+// Produces a 16x16 grey picture for every access unit, after |decode_ms|.
+class FakeDecoder : public VideoDecoder {
+ public:
+  explicit FakeDecoder(int decode_ms) : decode_ms_(decode_ms) {}
+
+  const char* name() const override { return "fake"; }
+  bool Decode(const uint8_t* data, size_t length,
+              const FrameCallback& on_frame) override {
+    std::this_thread::sleep_for(std::chrono::milliseconds(decode_ms_));
+    VideoFrame frame;
+    frame.width = 16;
+    frame.height = 16;
+    frame.y = plane_;
+    frame.u = plane_;
+    frame.v = plane_;
+    frame.y_stride = 16;
+    frame.uv_stride = 8;
+    on_frame(frame);
+    return true;
+  }
+  void Reset() override {}
+
+ private:
+  const int decode_ms_;
+  uint8_t plane_[256] = {};
+};
+
+Message IdrMessage(int64_t arrival_ns, int64_t demux_ns) {
+  const uint8_t idr[] = {0, 0, 0, 1, 0x65, 0x88, 0x84};
+  std::vector<uint8_t> payload(kVideoDataHeaderSize, 0);
+  payload.insert(payload.end(), idr, idr + sizeof(idr));
+  Message message;
+  message.header.type = static_cast<uint32_t>(MessageType::kVideoData);
+  message.header.length = payload.size();
+  message.payload = BufferPool::Create()->Acquire(payload.size());
+  std::copy(payload.begin(), payload.end(), message.payload.data());
+  message.arrival_ns = arrival_ns;
+  message.demux_ns = demux_ns;
+  return message;
+}
+
+}  // namespace
+
+TEST(FrameLatency, IgnoresUnsetStamps) {
+  FrameLatency latency;
+  latency.Record(FrameLatency::kDecode, 0, 5 * kMs);
+  latency.Record(FrameLatency::kDecode, 5 * kMs, 0);
+  latency.Record(FrameLatency::kDecode, 5 * kMs, 7 * kMs);
+  const FrameLatency::Stats stats = latency.stats();
+  EXPECT_EQ(stats.stages[FrameLatency::kDecode].count, 1u);
+  EXPECT_EQ(stats.stages[FrameLatency::kDecode].max_ns,
+            static_cast<uint64_t>(2 * kMs));
+  EXPECT_EQ(stats.stages[FrameLatency::kQueue].count, 0u);
+}
+
+TEST(FrameLatency, StagesFromArrivalToPresent) {
+  RgbaFrameBuffer frames;
+  VideoPipeline pipeline(std::unique_ptr<VideoDecoder>(new FakeDecoder(2)),
+                         &frames);
+  pipeline.Start();
+
+  constexpr int kFrames = 5;
+  for (int i = 0; i < kFrames; i++) {
+    // Arrived 3 ms before the demuxer got to it.
+    const int64_t now = MonotonicNanos();
+    pipeline.Push(IdrMessage(now - 3 * kMs, now));
+    // Present every frame before the next one arrives.
+    const auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (frames.frames_published() < static_cast<uint64_t>(i + 1) &&
+           std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ASSERT_NE(frames.AcquireLatest(), nullptr);
+  }
+  pipeline.Stop();
+
+  const FrameLatency::Stats stats = pipeline.stats().frame_latency;
+  for (int stage = 0; stage < FrameLatency::kStageCount; stage++) {
+    EXPECT_EQ(stats.stages[stage].count, static_cast<uint64_t>(kFrames))
+        << FrameLatency::StageName(static_cast<FrameLatency::Stage>(stage));
+  }
+  // Within the histogram's ~6% bucket precision.
+  EXPECT_GE(stats.stages[FrameLatency::kDemux].p50_ns,
+            static_cast<uint64_t>(2800000));
+  EXPECT_LT(stats.stages[FrameLatency::kDemux].p50_ns,
+            static_cast<uint64_t>(3200000));
+  EXPECT_GE(stats.stages[FrameLatency::kDecode].p50_ns,
+            static_cast<uint64_t>(1800000));
+  EXPECT_GE(stats.stages[FrameLatency::kTotal].p50_ns,
+            static_cast<uint64_t>(4700000));
+  EXPECT_GE(stats.stages[FrameLatency::kTotal].max_ns,
+            stats.stages[FrameLatency::kDecode].max_ns);
+}
+
+TEST(FrameLatency, UnpresentedFramesOnlyCountUpToPublish) {
+  RgbaFrameBuffer frames;
+  VideoPipeline pipeline(std::unique_ptr<VideoDecoder>(new FakeDecoder(0)),
+                         &frames);
+  pipeline.Start();
+  for (int i = 0; i < 3; i++) {
+    const int64_t now = MonotonicNanos();
+    pipeline.Push(IdrMessage(now, now));
+  }
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (frames.frames_published() < 3 &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  ASSERT_NE(frames.AcquireLatest(), nullptr);
+  pipeline.Stop();
+
+  const FrameLatency::Stats stats = pipeline.stats().frame_latency;
+  EXPECT_EQ(stats.stages[FrameLatency::kPublish].count, 3u);
+  // Only the newest frame was picked up.
+  EXPECT_EQ(stats.stages[FrameLatency::kPresent].count, 1u);
+  EXPECT_EQ(stats.stages[FrameLatency::kTotal].count, 1u);
+}
+
+}  // namespace test
+}  // namespace carlink
@@ -0,0 +1,126 @@
+#include "core/glass_to_glass.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <vector>
+
+#include "core/input.h"
+#include "core/pcm_h264.h"
+#include "core/yuv.h"
+
+namespace carlink {
+namespace test {
+
+namespace {
+
+constexpr int kWidth = 480;
+constexpr int kHeight = 32;
+
+// Decodes |unit| like the pipeline does, into what the presenter sees.
+RgbaFrame Present(VideoDecoder* decoder, const std::vector<uint8_t>& unit,
+                  uint64_t sequence) {
+  RgbaFrame rgba;
+  rgba.sequence = sequence;
+  EXPECT_TRUE(decoder->Decode(unit.data(), unit.size(),
+                              [&rgba](const VideoFrame& frame) {
+                                rgba.width = frame.width;
+                                rgba.height = frame.height;
+                                rgba.pixels.resize(frame.width *
+                                                   frame.height * 4);
+                                I420ToRgba(frame, rgba.pixels.data(),
+                                           frame.width * 4);
+                              }));
+  return rgba;
+}
+
+Message TouchDown(uint16_t id) {
+  const EncodedMessage encoded = EncodeTouch(
+      TouchAction::kDown, GlassToGlassProbe::TouchX(id), 0.5f);
+  Message message;
+  message.header.type = static_cast<uint32_t>(MessageType::kTouch);
+  message.payload =
+      BufferPool::Create()->Acquire(encoded.size() - kHeaderSize);
+  memcpy(message.payload.data(), encoded.data() + kHeaderSize,
+         message.payload.size());
+  return message;
+}
+
+}  // namespace
+
+TEST(GlassToGlass, PatternSurvivesColourConversion) {
+  std::vector<uint8_t> y(kWidth * kHeight, 96);
+  std::vector<uint8_t> uv(kWidth * kHeight / 2, 128);
+  VideoFrame frame;
+  frame.width = kWidth;
+  frame.height = kHeight;
+  frame.y = y.data();
+  frame.u = uv.data();
+  frame.v = uv.data() + uv.size() / 2;
+  frame.y_stride = kWidth;
+  frame.uv_stride = kWidth / 2;
+
+  RgbaFrame rgba;
+  rgba.width = kWidth;
+  rgba.height = kHeight;
+  rgba.pixels.resize(kWidth * kHeight * 4);
+  CounterPattern read;
+  for (uint32_t counter : {0u, 1u, 0x5a5a5a5au, 0xffffffffu}) {
+    CounterPattern pattern;
+    pattern.counter = counter;
+    pattern.touch_id = static_cast<uint16_t>(counter * 7);
+    DrawCounterPattern(pattern, y.data(), kWidth);
+    I420ToRgba(frame, rgba.pixels.data(), kWidth * 4);
+    ASSERT_TRUE(ReadCounterPattern(rgba, &read));
+    EXPECT_EQ(read.counter, pattern.counter);
+    EXPECT_EQ(read.touch_id, pattern.touch_id);
+  }
+
+  // One flipped cell fails the checksum.
+  for (int row = 0; row < 8; row++) {
+    y[row * kWidth + 100] ^= 0xff;
+  }
+  I420ToRgba(frame, rgba.pixels.data(), kWidth * 4);
+  EXPECT_FALSE(ReadCounterPattern(rgba, &read));
+}
+
+TEST(GlassToGlass, CountsLatencyDropsAndTouches) {
+  VirtualClock clock;
+  CounterPatternSource source(kWidth, kHeight, &clock);
+  GlassToGlassProbe probe(&source);
+  std::unique_ptr<VideoDecoder> decoder = CreatePcmH264Decoder();
+  std::vector<uint8_t> unit;
+
+  // Frame 0, presented 5 ms after it was sent.
+  source.NextAccessUnit(true, &unit);
+  clock.AdvanceTo(clock.Now() + 5000000);
+  RgbaFrame shown = Present(decoder.get(), unit, 1);
+  probe.OnPresented(shown, clock.Now());
+  // A refresh without a new frame.
+  probe.OnPresented(shown, clock.Now() + 16000000);
+
+  // Frames 1 and 2 are overwritten before the presenter picks up 3, which
+  // echoes touch 42.
+  probe.OnTouchSent(42, clock.Now());
+  source.OnHostMessage(TouchDown(42));
+  for (int i = 0; i < 3; i++) {
+    unit.clear();
+    source.NextAccessUnit(false, &unit);
+    Present(decoder.get(), unit, 0);
+  }
+  clock.AdvanceTo(clock.Now() + 20000000);
+  probe.OnPresented(Present(decoder.get(), unit, 2), clock.Now());
+
+  const GlassToGlassProbe::Stats stats = probe.stats();
+  EXPECT_EQ(source.frames(), 4u);
+  EXPECT_EQ(stats.presented, 2u);
+  EXPECT_EQ(stats.dropped, 2u);
+  EXPECT_EQ(stats.unreadable, 0u);
+  EXPECT_EQ(stats.touches_seen, 1u);
+  EXPECT_EQ(probe.latency().count(), 2u);
+  EXPECT_EQ(probe.touch_latency().count(), 1u);
+  EXPECT_GE(probe.touch_latency().max(), 20000000u);
+}
+
+}  // namespace test
+}  // namespace carlink
@@ -0,0 +1,64 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <memory>
+
+#include "core/histogram.h"
+
+namespace carlink {
+namespace test {
+
+TEST(Histogram, BucketsCoverTheRange) {
+  for (uint64_t value : {uint64_t{0}, uint64_t{15}, uint64_t{16},
+                         uint64_t{1000}, uint64_t{123456789},
+                         UINT64_MAX}) {
+    const size_t index = Histogram::BucketIndex(value);
+    ASSERT_LT(index, Histogram::kBucketCount);
+    EXPECT_LE(Histogram::BucketLowerBound(index), value);
+    if (index + 1 < Histogram::kBucketCount) {
+      EXPECT_GT(Histogram::BucketLowerBound(index + 1), value);
+    }
+  }
+}
+
+TEST(Histogram, PercentilesWithinBucketPrecision) {
+  Histogram histogram;
+  EXPECT_EQ(histogram.Percentile(50), 0u);
+  for (uint64_t value = 1; value <= 10000; value++) {
+    histogram.Record(value * 1000);
+  }
+  EXPECT_EQ(histogram.count(), 10000u);
+  EXPECT_EQ(histogram.max(), 10000000u);
+  EXPECT_NEAR(histogram.Percentile(50), 5000000.0, 5000000 * 0.07);
+  EXPECT_NEAR(histogram.Percentile(99), 9900000.0, 9900000 * 0.07);
+  EXPECT_LE(histogram.Percentile(100), histogram.max());
+
+  histogram.Reset();
+  EXPECT_EQ(histogram.count(), 0u);
+}
+
+TEST(Histogram, PercentilesBetweenSnapshots) {
+  Histogram histogram;
+  auto before = std::make_unique<Histogram::Snapshot>();
+  auto after = std::make_unique<Histogram::Snapshot>();
+  for (int i = 0; i < 1000; i++) {
+    histogram.Record(1000);
+  }
+  histogram.TakeSnapshot(before.get());
+  EXPECT_EQ(before->count, 1000u);
+  // Only the interval's values count.
+  for (int i = 0; i < 100; i++) {
+    histogram.Record(50000);
+  }
+  histogram.TakeSnapshot(after.get());
+  EXPECT_NEAR(after->PercentileSince(*before, 50), 50000.0, 50000 * 0.07);
+  EXPECT_EQ(after->PercentileSince(*after, 50), 0u);
+
+  histogram.Reset();
+  histogram.Record(2000);
+  histogram.TakeSnapshot(after.get());
+  EXPECT_NEAR(after->PercentileSince(*before, 99), 2000.0, 2000 * 0.07);
+}
+
+}  // namespace test
+}  // namespace carlink
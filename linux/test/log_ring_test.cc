@@ -0,0 +1,154 @@
+#include "core/log_ring.h"
+
+#include <gtest/gtest.h>
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace carlink {
+namespace test {
+
+namespace {
+
+// Collects what a LogRing delivers.
+class Collector {
+ public:
+  LogBatchSink sink() {
+    return [this](const std::vector<LogRecord>& batch) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      batches_++;
+      records_.insert(records_.end(), batch.begin(), batch.end());
+    };
+  }
+
+  std::vector<LogRecord> records() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return records_;
+  }
+  int batches() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return batches_;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::vector<LogRecord> records_;
+  int batches_ = 0;
+};
+
+LogRing::Options Unlimited() {
+  LogRing::Options options;
+  for (uint32_t& limit : options.max_per_second) {
+    limit = 0;
+  }
+  return options;
+}
+
+}  // namespace
+
+TEST(FormatLogArgs, MatchesPrintf) {
+  const std::string str = "str";
+  const LogArg args[] = {LogArg(-42), LogArg(static_cast<size_t>(7)),
+                         LogArg(255u), LogArg(2.5), LogArg("text"),
+                         LogArg(str)};
+  EXPECT_EQ(FormatLogArgs("%d %zu %04x %.2f [%-6s] %s 100%%", args, 6),
+            "-42 7 00ff 2.50 [text  ] str 100%");
+  // Missing or mismatched arguments.
+  EXPECT_EQ(FormatLogArgs("%s %d %d", args, 2), "<?> 7 <?>");
+}
+
+TEST(LogRing, DeliversDeferredAndFormattedLinesInOrder) {
+  Collector collector;
+  LogRing ring(collector.sink(), Unlimited());
+  SetLogRing(&ring);
+  std::string transient = "AudioData";
+  LogDeferred(LogLevel::kInfo, "[RECV] %s, length: %zu", transient,
+              static_cast<size_t>(1024));
+  // Copied at the call, not at the flush.
+  transient = "overwritten";
+  Log(LogLevel::kWarning, "[TEST] %d%%", 50);
+  std::thread worker([] { Log(LogLevel::kError, "[TEST] from a thread"); });
+  worker.join();
+  SetLogRing(nullptr);
+  ring.Flush();
+
+  const std::vector<LogRecord> records = collector.records();
+  ASSERT_EQ(records.size(), 3u);
+  EXPECT_EQ(records[0].line, "[RECV] AudioData, length: 1024");
+  EXPECT_EQ(records[0].level, LogLevel::kInfo);
+  EXPECT_EQ(records[1].line, "[TEST] 50%");
+  EXPECT_EQ(records[2].line, "[TEST] from a thread");
+  EXPECT_NE(records[2].tid, records[0].tid);
+  EXPECT_LE(records[0].timestamp_ns, records[2].timestamp_ns);
+  EXPECT_EQ(collector.batches(), 1);
+  EXPECT_EQ(ring.stats().records, 3u);
+}
+
+TEST(LogRing, FlusherDeliversInBackground) {
+  Collector collector;
+  LogRing::Options options = Unlimited();
+  options.flush_interval_ms = 10;
+  LogRing ring(collector.sink(), options);
+  ring.Start();
+  SetLogRing(&ring);
+  for (int i = 0; i < 10; i++) {
+    LogDeferred(LogLevel::kInfo, "line %d", i);
+  }
+  SetLogRing(nullptr);
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (collector.records().size() < 10 &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  EXPECT_EQ(collector.records().size(), 10u);
+  ring.Stop();
+}
+
+TEST(LogRing, DropsWhenFullAndReportsIt) {
+  Collector collector;
+  LogRing::Options options = Unlimited();
+  options.records_per_thread = 8;
+  LogRing ring(collector.sink(), options);
+  SetLogRing(&ring);
+  for (int i = 0; i < 20; i++) {
+    Log(LogLevel::kInfo, "line %d", i);
+  }
+  SetLogRing(nullptr);
+  ring.Flush();
+
+  const LogRing::Stats stats = ring.stats();
+  EXPECT_EQ(stats.records, 8u);
+  EXPECT_EQ(stats.dropped_full, 12u);
+  const std::vector<LogRecord> records = collector.records();
+  ASSERT_EQ(records.size(), 9u);
+  EXPECT_EQ(records[7].line, "line 7");
+  EXPECT_EQ(records[8].level, LogLevel::kWarning);
+  EXPECT_EQ(records[8].line,
+            "[LOG] dropped 12 lines (12 ring full, 0 rate limited)");
+}
+
+TEST(LogRing, RateLimitsEachLevel) {
+  Collector collector;
+  LogRing::Options options = Unlimited();
+  options.max_per_second[static_cast<int>(LogLevel::kDebug)] = 5;
+  LogRing ring(collector.sink(), options);
+  SetLogRing(&ring);
+  for (int i = 0; i < 50; i++) {
+    LogDeferred(LogLevel::kDebug, "debug %d", i);
+  }
+  Log(LogLevel::kError, "still logged");
+  SetLogRing(nullptr);
+  ring.Flush();
+
+  // A second boundary mid-loop may admit one more window.
+  const LogRing::Stats stats = ring.stats();
+  EXPECT_GE(stats.dropped_rate_limited, 40u);
+  EXPECT_EQ(stats.records + stats.dropped_rate_limited, 51u);
+  EXPECT_EQ(collector.records().back().line.find("[LOG] dropped"), 0u);
+}
+
+}  // namespace test
+}  // namespace carlink
@@ -0,0 +1,96 @@
+#include "core/lz4.h"
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+namespace carlink {
+namespace test {
+
+namespace {
+
+std::vector<uint8_t> RoundTrip(const std::vector<uint8_t>& input,
+                               size_t* compressed_size = nullptr) {
+  std::vector<uint8_t> compressed(Lz4CompressBound(input.size()));
+  const size_t size = Lz4Compress(input.data(), input.size(),
+                                  compressed.data());
+  EXPECT_LE(size, compressed.size());
+  if (compressed_size != nullptr) {
+    *compressed_size = size;
+  }
+  std::vector<uint8_t> output(input.size() + 1);
+  const int64_t decoded =
+      Lz4Decompress(compressed.data(), size, output.data(), output.size());
+  EXPECT_EQ(decoded, static_cast<int64_t>(input.size()));
+  output.resize(decoded < 0 ? 0 : decoded);
+  return output;
+}
+
+}  // namespace
+
+TEST(Lz4, RoundTripsSmallInputs) {
+  for (size_t size = 0; size <= 20; size++) {
+    std::vector<uint8_t> input(size);
+    for (size_t i = 0; i < size; i++) {
+      input[i] = i % 3;
+    }
+    EXPECT_EQ(RoundTrip(input), input) << size;
+  }
+}
+
+TEST(Lz4, RoundTripsRandomData) {
+  std::mt19937 random(7);
+  std::vector<uint8_t> input(100000);
+  for (uint8_t& byte : input) {
+    byte = random();
+  }
+  size_t compressed_size = 0;
+  EXPECT_EQ(RoundTrip(input, &compressed_size), input);
+  EXPECT_LE(compressed_size, Lz4CompressBound(input.size()));
+}
+
+TEST(Lz4, CompressesRepetitiveData) {
+  std::vector<uint8_t> input(200000);
+  for (size_t i = 0; i < input.size(); i++) {
+    input[i] = "carlink video frame "[i % 20];
+  }
+  size_t compressed_size = 0;
+  EXPECT_EQ(RoundTrip(input, &compressed_size), input);
+  EXPECT_LT(compressed_size, input.size() / 50);
+}
+
+TEST(Lz4, RoundTripsOverlappingMatches) {
+  // Runs copy from one or two bytes back.
+  std::vector<uint8_t> input(5000, 0);
+  for (size_t i = 1000; i < 3000; i++) {
+    input[i] = i % 2 ? 0xab : 0xcd;
+  }
+  EXPECT_EQ(RoundTrip(input), input);
+}
+
+TEST(Lz4, RejectsMalformedBlocks) {
+  std::vector<uint8_t> input(4096);
+  for (size_t i = 0; i < input.size(); i++) {
+    input[i] = i % 100;
+  }
+  std::vector<uint8_t> compressed(Lz4CompressBound(input.size()));
+  const size_t size =
+      Lz4Compress(input.data(), input.size(), compressed.data());
+  std::vector<uint8_t> output(input.size());
+
+  // Too small for the output.
+  EXPECT_EQ(Lz4Decompress(compressed.data(), size, output.data(), 100), -1);
+  // Cut short.
+  EXPECT_EQ(Lz4Decompress(compressed.data(), size / 2, output.data(),
+                          output.size()),
+            -1);
+  // A match reaching before the start of the output.
+  const uint8_t bad_offset[] = {0x14, 'a', 0xff, 0x00, 0x00};
+  EXPECT_EQ(Lz4Decompress(bad_offset, sizeof(bad_offset), output.data(),
+                          output.size()),
+            -1);
+}
+
+}  // namespace test
+}  // namespace carlink
@@ -0,0 +1,39 @@
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "core/nal_scanner.h"
+
+namespace carlink {
+namespace test {
+
+TEST(NalScanner, SplitsAnnexB) {
+  const std::vector<uint8_t> stream = {
+      0, 0, 0, 1, 0x67, 1, 2, 3,     // SPS, 4-byte start code
+      0, 0, 1, 0x68, 4,              // PPS
+      0, 0, 0, 1, 0x65, 5, 6, 0, 0,  // IDR with trailing zeros
+  };
+
+  NalScanner scanner(stream.data(), stream.size());
+  NalUnit unit;
+  ASSERT_TRUE(scanner.Next(&unit));
+  EXPECT_EQ(unit.type, kNalSps);
+  EXPECT_EQ(unit.size, 4u);
+  ASSERT_TRUE(scanner.Next(&unit));
+  EXPECT_EQ(unit.type, kNalPps);
+  EXPECT_EQ(unit.size, 2u);
+  ASSERT_TRUE(scanner.Next(&unit));
+  EXPECT_EQ(unit.type, kNalIdr);
+  EXPECT_EQ(unit.size, 3u);
+  EXPECT_FALSE(scanner.Next(&unit));
+
+  EXPECT_TRUE(ContainsIdr(stream.data(), stream.size()));
+}
+
+TEST(NalScanner, NoIdrInPSlices) {
+  const std::vector<uint8_t> stream = {0, 0, 1, 0x41, 0x9a, 0, 0, 1, 0x41, 1};
+  EXPECT_FALSE(ContainsIdr(stream.data(), stream.size()));
+}
+
+}  // namespace test
+}  // namespace carlink
@@ -0,0 +1,51 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <thread>
+
+#include "core/packet_ring.h"
+
+namespace carlink {
+namespace test {
+
+TEST(PacketRing, RoundsCapacityAndRejectsWhenFull) {
+  PacketRing<int> ring(3);
+  EXPECT_EQ(ring.capacity(), 4u);
+  for (int i = 0; i < 4; i++) {
+    ASSERT_TRUE(ring.TryPush(i));
+  }
+  int extra = 4;
+  EXPECT_FALSE(ring.TryPush(extra));
+
+  int value = -1;
+  ASSERT_TRUE(ring.TryPop(&value));
+  EXPECT_EQ(value, 0);
+  EXPECT_EQ(ring.size(), 3u);
+}
+
+TEST(PacketRing, HandsItemsAcrossThreadsInOrder) {
+  constexpr int kCount = 100000;
+  PacketRing<int> ring(64);
+
+  std::thread producer([&ring] {
+    for (int i = 0; i < kCount; i++) {
+      int item = i;
+      while (!ring.TryPush(item)) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  int expected = 0;
+  while (expected < kCount) {
+    int value;
+    if (ring.WaitPop(&value, std::chrono::milliseconds(100))) {
+      ASSERT_EQ(value, expected);
+      expected++;
+    }
+  }
+  producer.join();
+}
+
+}  // namespace test
+}  // namespace carlink
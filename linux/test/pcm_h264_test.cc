@@ -0,0 +1,110 @@
+#include "core/pcm_h264.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <vector>
+
+#include "core/h264_bitstream.h"
+#include "core/nal_scanner.h"
+
+namespace carlink {
+namespace test {
+
+TEST(H264Bitstream, ExpGolombRoundTrips) {
+  BitWriter writer;
+  for (uint32_t value : {0u, 1u, 2u, 7u, 255u, 65535u}) {
+    writer.WriteUe(value);
+  }
+  for (int32_t value : {0, 1, -1, 17, -300}) {
+    writer.WriteSe(value);
+  }
+  writer.WriteTrailingBits();
+
+  BitReader reader(writer.data().data(), writer.data().size());
+  for (uint32_t value : {0u, 1u, 2u, 7u, 255u, 65535u}) {
+    EXPECT_EQ(reader.ReadUe(), value);
+  }
+  for (int32_t value : {0, 1, -1, 17, -300}) {
+    EXPECT_EQ(reader.ReadSe(), value);
+  }
+  EXPECT_FALSE(reader.overrun());
+  reader.ReadBits(reader.bits_left() + 1);
+  EXPECT_TRUE(reader.overrun());
+}
+
+TEST(H264Bitstream, EscapesStartCodes) {
+  const std::vector<uint8_t> rbsp = {0, 0, 0, 0, 0, 1, 0, 0, 2, 0, 0, 3, 0x80};
+  std::vector<uint8_t> nal;
+  AppendNalUnit(0x65, rbsp, &nal);
+
+  // Nothing in the payload looks like a start code.
+  NalScanner scanner(nal.data(), nal.size());
+  NalUnit unit;
+  ASSERT_TRUE(scanner.Next(&unit));
+  EXPECT_EQ(unit.type, kNalIdr);
+  EXPECT_FALSE(scanner.Next(&unit));
+  EXPECT_EQ(UnescapeRbsp(unit.data + 1, unit.size - 1), rbsp);
+}
+
+TEST(PcmH264, DecodesWhatItEncodes) {
+  constexpr int kWidth = 48;
+  constexpr int kHeight = 32;
+  std::vector<uint8_t> y(kWidth * kHeight);
+  std::vector<uint8_t> u(kWidth * kHeight / 4);
+  std::vector<uint8_t> v(kWidth * kHeight / 4);
+  VideoFrame frame;
+  frame.width = kWidth;
+  frame.height = kHeight;
+  frame.y = y.data();
+  frame.u = u.data();
+  frame.v = v.data();
+  frame.y_stride = kWidth;
+  frame.uv_stride = kWidth / 2;
+
+  PcmH264Encoder encoder(kWidth, kHeight);
+  std::unique_ptr<VideoDecoder> decoder = CreatePcmH264Decoder();
+  for (int i = 0; i < 3; i++) {
+    // Zeros included, to exercise emulation prevention.
+    for (size_t j = 0; j < y.size(); j++) {
+      y[j] = static_cast<uint8_t>(j * (i + 1) % 7 == 0 ? 0 : j + i);
+    }
+    for (size_t j = 0; j < u.size(); j++) {
+      u[j] = static_cast<uint8_t>(j + 3 * i);
+      v[j] = static_cast<uint8_t>(255 - j);
+    }
+    std::vector<uint8_t> unit;
+    encoder.Encode(frame, false, &unit);
+    EXPECT_EQ(ContainsIdr(unit.data(), unit.size()), i == 0);
+
+    int frames = 0;
+    ASSERT_TRUE(decoder->Decode(
+        unit.data(), unit.size(), [&](const VideoFrame& decoded) {
+          frames++;
+          ASSERT_EQ(decoded.width, kWidth);
+          ASSERT_EQ(decoded.height, kHeight);
+          for (int row = 0; row < kHeight; row++) {
+            ASSERT_EQ(memcmp(decoded.y + row * decoded.y_stride,
+                             &y[row * kWidth], kWidth),
+                      0);
+          }
+          for (int row = 0; row < kHeight / 2; row++) {
+            ASSERT_EQ(memcmp(decoded.u + row * decoded.uv_stride,
+                             &u[row * kWidth / 2], kWidth / 2),
+                      0);
+            ASSERT_EQ(memcmp(decoded.v + row * decoded.uv_stride,
+                             &v[row * kWidth / 2], kWidth / 2),
+                      0);
+          }
+        }));
+    EXPECT_EQ(frames, 1);
+  }
+
+  // A stream it did not write is an error, not a crash.
+  const std::vector<uint8_t> garbage = {0, 0, 0, 1, 0x67, 0x64, 0, 0x1f};
+  EXPECT_FALSE(decoder->Decode(garbage.data(), garbage.size(),
+                               [](const VideoFrame&) {}));
+}
+
+}  // namespace test
+}  // namespace carlink
@@ -0,0 +1,67 @@
+#include <gtest/gtest.h>
+
+#include "core/input.h"
+#include "core/protocol.h"
+
+namespace carlink {
+namespace test {
+
+TEST(Protocol, HeaderRoundTrips) {
+  uint8_t bytes[kHeaderSize];
+  EncodeHeader(static_cast<uint32_t>(MessageType::kVideoData), 1234, bytes);
+
+  MessageHeader header;
+  ASSERT_EQ(DecodeHeader(bytes, &header), HeaderStatus::kOk);
+  EXPECT_EQ(header.length, 1234u);
+  EXPECT_EQ(header.type, static_cast<uint32_t>(MessageType::kVideoData));
+}
+
+TEST(Protocol, RejectsCorruptHeaders) {
+  uint8_t bytes[kHeaderSize];
+  MessageHeader header;
+
+  EncodeHeader(static_cast<uint32_t>(MessageType::kCommand), 4, bytes);
+  bytes[0] ^= 0xff;
+  EXPECT_EQ(DecodeHeader(bytes, &header), HeaderStatus::kBadMagic);
+
+  EncodeHeader(static_cast<uint32_t>(MessageType::kCommand), 4, bytes);
+  bytes[12] ^= 0x01;
+  EXPECT_EQ(DecodeHeader(bytes, &header), HeaderStatus::kBadTypeCheck);
+
+  EncodeHeader(static_cast<uint32_t>(MessageType::kCommand),
+               kMaxPayloadSize + 1, bytes);
+  EXPECT_EQ(DecodeHeader(bytes, &header), HeaderStatus::kBadLength);
+}
+
+TEST(Protocol, EncodesCommands) {
+  EncodedMessage message = EncodeCommand(Command::kFrame);
+  ASSERT_EQ(message.size(), kHeaderSize + 4);
+  EXPECT_EQ(ReadU32(message.data() + 4), 4u);
+  EXPECT_EQ(ReadU32(message.data() + 8),
+            static_cast<uint32_t>(MessageType::kCommand));
+  EXPECT_EQ(ReadU32(message.data() + kHeaderSize), 12u);
+}
+
+TEST(Protocol, InitMessagesFollowDongleStart) {
+  DongleConfig config;
+  std::vector<EncodedMessage> messages = BuildInitMessages(config, 0);
+  ASSERT_GE(messages.size(), 12u);
+  EXPECT_EQ(ReadU32(messages[0].data() + 8),
+            static_cast<uint32_t>(MessageType::kSendFile));
+  EXPECT_EQ(ReadU32(messages[1].data() + 8),
+            static_cast<uint32_t>(MessageType::kOpen));
+  EXPECT_EQ(ReadU32(messages[1].data() + kHeaderSize), config.width);
+  EXPECT_EQ(ReadU32(messages.back().data() + kHeaderSize),
+            static_cast<uint32_t>(Command::kAudioTransferOn));
+}
+
+TEST(Protocol, ClampsTouchCoordinates) {
+  EncodedMessage message = EncodeTouch(TouchAction::kDown, 0.5f, 1.5f);
+  ASSERT_EQ(message.size(), kHeaderSize + 16);
+  EXPECT_EQ(ReadU32(message.data() + kHeaderSize), 14u);
+  EXPECT_EQ(ReadU32(message.data() + kHeaderSize + 4), 5000u);
+  EXPECT_EQ(ReadU32(message.data() + kHeaderSize + 8), 10000u);
+}
+
+}  // namespace test
+}  // namespace carlink
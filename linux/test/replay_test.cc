@@ -0,0 +1,216 @@
+#include "core/replay.h"
+
+#include <dirent.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "core/audio.h"
+#include "core/audio_sink.h"
+#include "core/capture_writer.h"
+#include "core/clock.h"
+#include "core/nal_scanner.h"
+#include "core/protocol.h"
+
+namespace carlink {
+namespace test {
+
+namespace {
+
+constexpr int64_t kMs = 1000000;
+
+class RecordingListener : public SessionListener {
+ public:
+  void OnError(const std::string& error) override { errors.push_back(error); }
+  std::vector<std::string> errors;
+};
+
+std::vector<uint8_t> ReadFile(const char* path) {
+  std::vector<uint8_t> contents;
+  FILE* file = fopen(path, "rb");
+  if (file == nullptr) {
+    return contents;
+  }
+  uint8_t chunk[65536];
+  size_t read;
+  while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    contents.insert(contents.end(), chunk, chunk + read);
+  }
+  fclose(file);
+  return contents;
+}
+
+struct ReplayResult {
+  Session::Stats session;
+  SimulatedDongle::Stats dongle;
+  std::vector<std::string> errors;
+  int64_t virtual_ns = 0;
+};
+
+class ReplayTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    path_ = std::string(testing::TempDir()) + "replay" +
+            std::to_string(getpid());
+  }
+  void TearDown() override { unlink(path_.c_str()); }
+
+  // 30 fps of the sample video and 20 ms audio packets for |seconds|, with
+  // the audio 200 ms late once and |silence_ms| without any message after
+  // the first second.
+  void WriteCapture(int seconds, int silence_ms) {
+    const std::vector<uint8_t> video = ReadFile(CARLINK_TEST_VIDEO);
+    const std::vector<AccessUnitRange> units =
+        SplitAccessUnits(video.data(), video.size());
+    ASSERT_FALSE(units.empty());
+
+    CaptureWriter writer;
+    ASSERT_TRUE(writer.Open(path_));
+    const int64_t start = MonotonicNanos();
+    auto record = [&](MessageType type, const std::vector<uint8_t>& payload,
+                      int64_t ms) {
+      int64_t at = ms;
+      if (ms >= 1000) {
+        at += silence_ms;
+      }
+      writer.Record(CaptureDirection::kInbound, static_cast<uint32_t>(type),
+                    payload.data(), payload.size(), start + at * kMs);
+    };
+
+    std::vector<uint8_t> audio(kAudioDataHeaderSize + 960 * 4, 0);
+    audio[0] = 4;  // 48 kHz stereo.
+    audio[8] = 1;
+    size_t unit = 0;
+    for (int64_t ms = 0; ms < seconds * 1000; ms++) {
+      if (ms * 30 % 1000 < 30) {
+        std::vector<uint8_t> payload(kVideoDataHeaderSize, 0);
+        payload.insert(payload.end(), video.begin() + units[unit].offset,
+                       video.begin() + units[unit].offset + units[unit].size);
+        unit = (unit + 1) % units.size();
+        record(MessageType::kVideoData, payload, ms);
+      }
+      // One 200 ms hiccup at 500 ms: ten packets arrive late, at once.
+      if (ms % 20 == 0 && (ms < 500 || ms >= 700)) {
+        for (int i = 0; i < (ms == 700 ? 11 : 1); i++) {
+          record(MessageType::kAudioData, audio, ms);
+        }
+      }
+    }
+    writer.Close();
+  }
+
+  ReplayResult Replay(const std::string& flight_dir = std::string()) {
+    ReplayResult result;
+    VirtualClock clock;
+    SimulatedDongle::Options dongle_options;
+    dongle_options.replay_path = path_;
+    dongle_options.clock = &clock;
+    auto owned = std::make_unique<SimulatedDongle>(dongle_options);
+    EXPECT_TRUE(owned->ok());
+    SimulatedDongle* dongle = owned.get();
+
+    RecordingListener listener;
+    SessionOptions options;
+    options.clock = &clock;
+    options.polled = true;
+    options.flight_recorder_dir = flight_dir;
+    Session session(std::move(owned), options, CreateVideoDecoder(), nullptr,
+                    CreateNullAudioSink(false), &listener);
+    EXPECT_TRUE(session.Start());
+    const int64_t start = clock.Now();
+    RunVirtualTime(&session, dongle, &clock, 0);
+    result.virtual_ns = clock.Now() - start;
+    result.dongle = dongle->stats();
+    session.Stop();
+    result.session = session.stats();
+    result.errors = listener.errors;
+    return result;
+  }
+
+  std::string path_;
+};
+
+}  // namespace
+
+TEST_F(ReplayTest, RunsAreIdentical) {
+  WriteCapture(4, 0);
+  const ReplayResult first = Replay();
+  const ReplayResult second = Replay();
+
+  EXPECT_TRUE(first.errors.empty());
+  EXPECT_EQ(first.session.messages_in, 120u + 200u);
+  EXPECT_EQ(first.dongle.video_frames, 120u);
+  // The late audio drained the jitter buffer once.
+  EXPECT_GE(first.session.audio.underruns, 1u);
+
+  EXPECT_EQ(first.virtual_ns, second.virtual_ns);
+  EXPECT_EQ(first.session.messages_in, second.session.messages_in);
+  EXPECT_EQ(first.session.messages_out, second.session.messages_out);
+  EXPECT_EQ(first.session.heartbeats, second.session.heartbeats);
+  EXPECT_EQ(first.session.video.frames_received,
+            second.session.video.frames_received);
+  EXPECT_EQ(first.session.video.frames_dropped,
+            second.session.video.frames_dropped);
+  EXPECT_EQ(first.session.audio.frames_played,
+            second.session.audio.frames_played);
+  EXPECT_EQ(first.session.audio.underruns, second.session.audio.underruns);
+  EXPECT_EQ(first.session.audio.overflow_frames,
+            second.session.audio.overflow_frames);
+}
+
+TEST_F(ReplayTest, WatchdogPingsDuringSilence) {
+  WriteCapture(2, 3500);
+  const ReplayResult result = Replay();
+  EXPECT_TRUE(result.errors.empty());
+  // One ping once the silence passed 2 s, on the next 1 s tick.
+  EXPECT_EQ(result.session.heartbeats, 1u);
+  EXPECT_EQ(result.dongle.heartbeats, 1u);
+  EXPECT_EQ(result.session.messages_in, 60u + 100u);
+}
+
+TEST_F(ReplayTest, WatchdogTimesOutDeterministically) {
+  WriteCapture(2, 10000);
+  const ReplayResult result = Replay();
+  ASSERT_EQ(result.errors.size(), 1u);
+  EXPECT_EQ(result.errors[0], "HeartbeatTimeout");
+  // Pings 2, 4 and 6 s into the silence, dead on the last of those ticks.
+  EXPECT_EQ(result.session.heartbeats, 3u);
+  EXPECT_GE(result.virtual_ns, 7000 * kMs);
+  EXPECT_LT(result.virtual_ns, 8000 * kMs);
+  EXPECT_LT(result.session.messages_in, 160u);
+}
+
+TEST_F(ReplayTest, HeartbeatTimeoutDumpsFlightRecorder) {
+  WriteCapture(2, 10000);
+  const std::string dir = path_ + "-flight";
+  Replay(dir);
+
+  std::vector<std::string> dumps;
+  DIR* listing = opendir(dir.c_str());
+  ASSERT_NE(listing, nullptr);
+  while (dirent* entry = readdir(listing)) {
+    if (entry->d_name[0] != '.') {
+      dumps.push_back(dir + "/" + entry->d_name);
+    }
+  }
+  closedir(listing);
+  ASSERT_EQ(dumps.size(), 1u);
+  EXPECT_NE(dumps[0].find("-HeartbeatTimeout.txt"), std::string::npos);
+
+  const std::vector<uint8_t> bytes = ReadFile(dumps[0].c_str());
+  const std::string dump(bytes.begin(), bytes.end());
+  unlink(dumps[0].c_str());
+  rmdir(dir.c_str());
+  EXPECT_EQ(dump.find("# carlink flight recorder: HeartbeatTimeout"), 0u);
+  // The seconds before the silence, then the pings into it.
+  EXPECT_NE(dump.find(" in VideoData "), std::string::npos);
+  EXPECT_NE(dump.find(" transfer - "), std::string::npos);
+  EXPECT_NE(dump.find(" out HeartBeat 0\n"), std::string::npos);
+  EXPECT_NE(dump.find(" counter messages_in "), std::string::npos);
+}
+
+}  // namespace test
+}  // namespace carlink
@@ -0,0 +1,87 @@
+#include "core/sharded_counters.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace carlink {
+namespace test {
+
+TEST(ShardedCounters, SumsEveryThread) {
+  ShardedCounters counters(2);
+  counters.Add(0);
+  counters.Add(1, 10);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; i++) {
+    threads.emplace_back([&counters] {
+      for (int j = 0; j < 1000; j++) {
+        counters.Add(0);
+      }
+      counters.Add(1, 5);
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(counters.Get(0), 4001u);
+  EXPECT_EQ(counters.Get(1), 30u);
+  uint64_t values[2];
+  counters.Snapshot(values);
+  EXPECT_EQ(values[0], 4001u);
+  EXPECT_EQ(values[1], 30u);
+  // The exited threads were folded in; only this one keeps a copy.
+  EXPECT_EQ(counters.threads(), 1u);
+}
+
+TEST(ShardedCounters, KeepsSetsApartOnOneThread) {
+  ShardedCounters a(1);
+  ShardedCounters b(1);
+  for (int i = 0; i < 3; i++) {
+    a.Add(0);
+    b.Add(0, 2);
+  }
+  EXPECT_EQ(a.Get(0), 3u);
+  EXPECT_EQ(b.Get(0), 6u);
+
+  // A new set may reuse a destroyed one's address but not its values.
+  std::unique_ptr<ShardedCounters> c(new ShardedCounters(1));
+  c->Add(0, 7);
+  c.reset(new ShardedCounters(1));
+  EXPECT_EQ(c->Get(0), 0u);
+  c->Add(0);
+  EXPECT_EQ(c->Get(0), 1u);
+}
+
+TEST(ShardedCounters, ReadsNeverGoBackwards) {
+  ShardedCounters counters(1);
+  std::atomic<bool> running(true);
+  std::vector<std::thread> writers;
+  for (int i = 0; i < 3; i++) {
+    writers.emplace_back([&] {
+      while (running.load(std::memory_order_relaxed)) {
+        counters.Add(0);
+      }
+    });
+  }
+  uint64_t last = 0;
+  for (int i = 0; i < 1000; i++) {
+    const uint64_t value = counters.Get(0);
+    ASSERT_GE(value, last);
+    last = value;
+    if (i % 64 == 0) {
+      std::this_thread::yield();
+    }
+  }
+  running.store(false);
+  for (std::thread& writer : writers) {
+    writer.join();
+  }
+  EXPECT_GE(counters.Get(0), last);
+}
+
+}  // namespace test
+}  // namespace carlink
@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "core/simd.h"
+
+namespace carlink {
+namespace test {
+
+// Every vector variant this CPU runs, each compared with the scalar one.
+std::vector<const SimdKernels*> VectorKernels() {
+  std::vector<const SimdKernels*> kernels;
+  for (SimdLevel level : SupportedSimdLevels()) {
+    if (level != SimdLevel::kScalar) {
+      kernels.push_back(GetSimdKernels(level));
+    }
+  }
+  return kernels;
+}
+
+// Bytes drawn from |alphabet| so the patterns searched for are common.
+std::vector<uint8_t> RandomBytes(std::mt19937* random, size_t size,
+                                 const std::vector<uint8_t>& alphabet) {
+  std::vector<uint8_t> bytes(size);
+  for (uint8_t& byte : bytes) {
+    byte = alphabet[(*random)() % alphabet.size()];
+  }
+  return bytes;
+}
+
+TEST(Simd, ScalarIsAlwaysSupported) {
+  const std::vector<SimdLevel> levels = SupportedSimdLevels();
+  ASSERT_FALSE(levels.empty());
+  EXPECT_EQ(levels.front(), SimdLevel::kScalar);
+  for (SimdLevel level : levels) {
+    ASSERT_NE(GetSimdKernels(level), nullptr);
+    EXPECT_EQ(GetSimdKernels(level)->level, level);
+  }
+  if (getenv("CARLINK_SIMD") == nullptr) {
+    EXPECT_EQ(Simd().level, levels.back());
+  }
+}
+
+TEST(Simd, FindStartCodeMatchesScalar) {
+  const SimdKernels* scalar = ScalarKernels();
+  std::mt19937 random(1);
+  for (const SimdKernels* kernels : VectorKernels()) {
+    SCOPED_TRACE(SimdLevelName(kernels->level));
+    for (size_t size = 0; size < 200; size++) {
+      for (int round = 0; round < 20; round++) {
+        // Zeros dominate so most buffers hold a start code somewhere.
+        const std::vector<uint8_t> data =
+            RandomBytes(&random, size, {0, 0, 0, 0, 0, 0, 1, 0x65});
+        ASSERT_EQ(kernels->find_start_code(data.data(), size),
+                  scalar->find_start_code(data.data(), size));
+      }
+    }
+    std::vector<uint8_t> none(1000, 0);
+    EXPECT_EQ(kernels->find_start_code(none.data(), none.size()), 1000u);
+  }
+}
+
+TEST(Simd, FindMagicMatchesScalar) {
+  const SimdKernels* scalar = ScalarKernels();
+  std::mt19937 random(2);
+  for (const SimdKernels* kernels : VectorKernels()) {
+    SCOPED_TRACE(SimdLevelName(kernels->level));
+    for (size_t size = 0; size < 200; size++) {
+      for (int round = 0; round < 20; round++) {
+        const std::vector<uint8_t> data =
+            RandomBytes(&random, size, {0xaa, 0x55, 0xaa, 0x55, 0});
+        ASSERT_EQ(kernels->find_magic(data.data(), size),
+                  scalar->find_magic(data.data(), size));
+      }
+    }
+  }
+}
+
+TEST(Simd, I420ToRgbaRowMatchesScalar) {
+  const SimdKernels* scalar = ScalarKernels();
+  std::mt19937 random(3);
+  for (const SimdKernels* kernels : VectorKernels()) {
+    SCOPED_TRACE(SimdLevelName(kernels->level));
+    for (int width = 1; width < 100; width++) {
+      std::vector<uint8_t> y(width), u((width + 1) / 2), v((width + 1) / 2);
+      // Full range, so the clamps at both ends are hit too.
+      for (uint8_t& value : y) value = random();
+      for (uint8_t& value : u) value = random();
+      for (uint8_t& value : v) value = random();
+      std::vector<uint8_t> expected(width * 4), actual(width * 4);
+      scalar->i420_to_rgba_row(y.data(), u.data(), v.data(), expected.data(),
+                               width);
+      kernels->i420_to_rgba_row(y.data(), u.data(), v.data(), actual.data(),
+                                width);
+      ASSERT_EQ(actual, expected) << "width " << width;
+    }
+  }
+}
+
+TEST(Simd, ResampleStereoMatchesScalar) {
+  const SimdKernels* scalar = ScalarKernels();
+  std::mt19937 random(4);
+  // 8 kHz, 16 kHz, 44.1 kHz and 96 kHz to 48 kHz.
+  const uint32_t steps[] = {0x2aaa, 0x5555, 0xeb33, 0x20000};
+  for (const SimdKernels* kernels : VectorKernels()) {
+    SCOPED_TRACE(SimdLevelName(kernels->level));
+    for (size_t count = 1; count < 300; count += 7) {
+      std::vector<int16_t> frames(count * 2);
+      // Full scale: neighbours 65535 apart must not overflow.
+      for (int16_t& sample : frames) sample = random();
+      for (uint32_t step : steps) {
+        const uint32_t position = random() % (step + 1);
+        std::vector<int16_t> expected(count * 16 + 2);
+        std::vector<int16_t> actual(count * 16 + 2);
+        const size_t written = scalar->resample_stereo(
+            frames.data(), count, position, step, expected.data());
+        ASSERT_EQ(kernels->resample_stereo(frames.data(), count, position,
+                                           step, actual.data()),
+                  written);
+        ASSERT_EQ(actual, expected) << "count " << count << " step " << step;
+      }
+    }
+  }
+}
+
+TEST(Simd, MixSamplesMatchesScalar) {
+  const SimdKernels* scalar = ScalarKernels();
+  std::mt19937 random(5);
+  for (const SimdKernels* kernels : VectorKernels()) {
+    SCOPED_TRACE(SimdLevelName(kernels->level));
+    for (int gain : {0, 64, 256, 1024}) {
+      for (size_t count = 0; count < 70; count++) {
+        std::vector<int16_t> src(count), dst(count);
+        for (int16_t& sample : src) sample = random();
+        for (int16_t& sample : dst) sample = random();
+        std::vector<int16_t> expected = dst;
+        scalar->mix_samples(expected.data(), src.data(), count, gain);
+        kernels->mix_samples(dst.data(), src.data(), count, gain);
+        ASSERT_EQ(dst, expected) << "gain " << gain << " count " << count;
+      }
+    }
+  }
+}
+
+}  // namespace test
+}  // namespace carlink
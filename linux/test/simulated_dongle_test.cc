@@ -0,0 +1,169 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "core/audio.h"
+#include "core/demuxer.h"
+#include "core/nal_scanner.h"
+#include "core/protocol.h"
+#include "core/session.h"
+#include "core/simulated_dongle.h"
+
+namespace carlink {
+namespace test {
+
+namespace {
+
+SimulatedDongle::Options MaxRateOptions() {
+  SimulatedDongle::Options options;
+  options.video_path = CARLINK_TEST_VIDEO;
+  options.real_time = false;
+  return options;
+}
+
+// Reads from |dongle| until |count| messages were demuxed.
+std::vector<Message> ReadMessages(SimulatedDongle& dongle, size_t count) {
+  std::vector<Message> messages;
+  Demuxer demuxer(BufferPool::Create(), [&messages](Message message) {
+    messages.push_back(std::move(message));
+  });
+  std::vector<uint8_t> chunk(16384);
+  while (messages.size() < count) {
+    const int read = dongle.Read(chunk.data(), chunk.size(), 1000);
+    if (read <= 0) {
+      break;
+    }
+    demuxer.Feed(chunk.data(), read, 0);
+  }
+  EXPECT_EQ(demuxer.stats().resyncs, 0u);
+  return messages;
+}
+
+void SendOpen(SimulatedDongle& dongle) {
+  const EncodedMessage open = EncodeOpen(DongleConfig());
+  ASSERT_EQ(dongle.Write(open.data(), open.size(), 1000),
+            static_cast<int>(open.size()));
+}
+
+class RecordingListener : public SessionListener {
+ public:
+  void OnError(const std::string& error) override { errors++; }
+  std::atomic<int> errors{0};
+};
+
+}  // namespace
+
+TEST(SimulatedDongle, SplitsSampleVideo) {
+  SimulatedDongle dongle(MaxRateOptions());
+  ASSERT_TRUE(dongle.ok());
+  EXPECT_EQ(dongle.access_unit_count(), 272u);
+}
+
+TEST(SimulatedDongle, AnswersHandshake) {
+  SimulatedDongle dongle(MaxRateOptions());
+  SendOpen(dongle);
+
+  const std::vector<Message> messages = ReadMessages(dongle, 6);
+  ASSERT_EQ(messages.size(), 6u);
+  EXPECT_EQ(messages[0].header.type, static_cast<uint32_t>(MessageType::kOpen));
+  ASSERT_EQ(messages[0].payload.size(), 28u);
+  EXPECT_EQ(ReadU32(messages[0].payload.data()), 1920u);
+  EXPECT_EQ(messages[1].header.type,
+            static_cast<uint32_t>(MessageType::kBoxSettings));
+  EXPECT_EQ(messages[2].header.type,
+            static_cast<uint32_t>(MessageType::kPlugged));
+  EXPECT_EQ(ReadU32(messages[2].payload.data()), 3u);
+  EXPECT_EQ(messages[3].header.type,
+            static_cast<uint32_t>(MessageType::kPhase));
+
+  AudioPacket start;
+  ASSERT_TRUE(ParseAudioPacket(messages[4].payload.data(),
+                               messages[4].payload.size(), &start));
+  EXPECT_EQ(start.command, AudioCommand::kMediaStart);
+
+  // Media starts with the first access unit, an IDR with its parameter sets.
+  ASSERT_EQ(messages[5].header.type,
+            static_cast<uint32_t>(MessageType::kVideoData));
+  const std::vector<AccessUnitRange> units =
+      SplitAccessUnits(messages[5].payload.data() + kVideoDataHeaderSize,
+                       messages[5].payload.size() - kVideoDataHeaderSize);
+  ASSERT_EQ(units.size(), 1u);
+  EXPECT_TRUE(units[0].idr);
+}
+
+TEST(SimulatedDongle, EchoesHeartBeat) {
+  SimulatedDongle dongle(SimulatedDongle::Options{});
+  const EncodedMessage heartbeat = EncodeHeartBeat();
+  dongle.Write(heartbeat.data(), heartbeat.size(), 1000);
+
+  const std::vector<Message> messages = ReadMessages(dongle, 1);
+  ASSERT_EQ(messages.size(), 1u);
+  EXPECT_EQ(messages[0].header.type,
+            static_cast<uint32_t>(MessageType::kHeartBeat));
+  EXPECT_EQ(dongle.stats().heartbeats, 1u);
+}
+
+TEST(SimulatedDongle, KeyframeRequestSendsIdr) {
+  SimulatedDongle::Options options = MaxRateOptions();
+  options.audio = false;
+  SimulatedDongle dongle(options);
+  SendOpen(dongle);
+  // Handshake, the first IDR and a few P frames.
+  ReadMessages(dongle, 4 + 3);
+
+  const EncodedMessage request = EncodeCommand(Command::kFrame);
+  dongle.Write(request.data(), request.size(), 1000);
+  const std::vector<Message> messages = ReadMessages(dongle, 1);
+  ASSERT_EQ(messages.size(), 1u);
+  const std::vector<AccessUnitRange> units =
+      SplitAccessUnits(messages[0].payload.data() + kVideoDataHeaderSize,
+                       messages[0].payload.size() - kVideoDataHeaderSize);
+  ASSERT_EQ(units.size(), 1u);
+  EXPECT_TRUE(units[0].idr);
+  EXPECT_EQ(dongle.stats().keyframe_requests, 1u);
+}
+
+TEST(SimulatedDongle, RealTimePacing) {
+  SimulatedDongle::Options options;
+  options.audio_packet_ms = 10;
+  SimulatedDongle dongle(options);
+  SendOpen(dongle);
+  ReadMessages(dongle, 5);
+
+  const auto start = std::chrono::steady_clock::now();
+  ReadMessages(dongle, 10);
+  // Ten 10 ms packets, the first due immediately.
+  EXPECT_GE(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(80));
+}
+
+TEST(SimulatedDongle, DrivesSessionWithoutUsb) {
+  auto owned = std::make_unique<SimulatedDongle>(MaxRateOptions());
+  SimulatedDongle* dongle = owned.get();
+  RecordingListener listener;
+  Session session(std::move(owned), SessionOptions(), CreateVideoDecoder(),
+                  nullptr, nullptr, &listener);
+  ASSERT_TRUE(session.Start());
+
+  // Loops the 272 access unit sample more than once.
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (session.stats().video.frames_received < 600 &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  session.Stop();
+
+  const Session::Stats stats = session.stats();
+  EXPECT_GE(stats.video.frames_received, 600u);
+  EXPECT_EQ(stats.read.resyncs, 0u);
+  EXPECT_GT(dongle->stats().host_messages, 0u);
+  EXPECT_EQ(listener.errors.load(), 0);
+}
+
+}  // namespace test
+}  // namespace carlink
@@ -0,0 +1,106 @@
+#include "core/soak_monitor.h"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace carlink {
+namespace test {
+
+namespace {
+
+SoakThresholds ShortThresholds() {
+  SoakThresholds thresholds;
+  thresholds.warmup_samples = 2;
+  thresholds.window = 3;
+  return thresholds;
+}
+
+SoakSample Steady(int minute) {
+  SoakSample sample;
+  sample.elapsed_s = minute * 60;
+  sample.usage.rss_bytes = 100 << 20;
+  sample.usage.heap_in_use_bytes = 20 << 20;
+  sample.usage.open_fds = 12;
+  sample.latency_p99_ns = 20000000;
+  return sample;
+}
+
+}  // namespace
+
+TEST(SoakMonitor, ReadsProcessUsage) {
+  const ProcessUsage usage = ReadProcessUsage();
+  EXPECT_GT(usage.rss_bytes, 0u);
+  // stdin, stdout and stderr at least.
+  EXPECT_GE(usage.open_fds, 3u);
+}
+
+TEST(SoakMonitor, SteadyRunPasses) {
+  SoakMonitor monitor(ShortThresholds());
+  for (int minute = 0; minute < 20; minute++) {
+    SoakSample sample = Steady(minute);
+    // Warmup noise and a single slow minute are both ignored.
+    if (minute == 0) {
+      sample.usage.rss_bytes = 10 << 20;
+    }
+    if (minute == 12) {
+      sample.latency_p99_ns = 200000000;
+    }
+    ASSERT_TRUE(monitor.Add(sample));
+  }
+  EXPECT_NE(monitor.Summary().find("result: PASS"), std::string::npos);
+}
+
+TEST(SoakMonitor, FailsOnLeaksAndSlowdowns) {
+  SoakMonitor leak(ShortThresholds());
+  bool ok = true;
+  for (int minute = 0; minute < 60 && ok; minute++) {
+    SoakSample sample = Steady(minute);
+    sample.usage.rss_bytes += static_cast<uint64_t>(minute) * (4 << 20);
+    sample.usage.open_fds += minute / 4;
+    ok = leak.Add(sample);
+  }
+  EXPECT_FALSE(ok);
+  ASSERT_FALSE(leak.violations().empty());
+  EXPECT_EQ(leak.violations()[0].find("rss grew"), 0u);
+
+  SoakMonitor slow(ShortThresholds());
+  for (int minute = 0; minute < 20; minute++) {
+    SoakSample sample = Steady(minute);
+    if (minute >= 15) {
+      sample.latency_p99_ns = 40000000;
+    }
+    slow.Add(sample);
+  }
+  ASSERT_EQ(slow.violations().size(), 1u);
+  EXPECT_EQ(slow.violations()[0].find("latency p99"), 0u);
+  EXPECT_NE(slow.Summary().find("result: FAIL"), std::string::npos);
+}
+
+TEST(SoakMonitor, WritesEverySampleToCsv) {
+  const std::string path =
+      testing::TempDir() + "soak" + std::to_string(getpid()) + ".csv";
+  {
+    SoakMonitor monitor;
+    ASSERT_TRUE(monitor.OpenCsv(path));
+    monitor.Add(Steady(0));
+    monitor.Add(Steady(1));
+  }
+  std::ifstream file(path);
+  std::string line;
+  ASSERT_TRUE(std::getline(file, line));
+  EXPECT_EQ(line.find("elapsed_s,rss_kb,"), 0u);
+  std::vector<std::string> rows;
+  while (std::getline(file, line)) {
+    rows.push_back(line);
+  }
+  ASSERT_EQ(rows.size(), 2u);
+  EXPECT_EQ(rows[1].find("60,102400,20480,"), 0u);
+  unlink(path.c_str());
+}
+
+}  // namespace test
+}  // namespace carlink
@@ -0,0 +1,82 @@
+#include "core/thread_stats.h"
+
+#include <gtest/gtest.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "core/clock.h"
+
+namespace carlink {
+namespace test {
+
+namespace {
+
+const ThreadStats* Find(const std::vector<ThreadStats>& threads, int tid) {
+  for (const ThreadStats& thread : threads) {
+    if (thread.tid == tid) {
+      return &thread;
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace
+
+TEST(ThreadStats, NamesThreadsAndCutsLongNames) {
+  std::thread worker([] {
+    SetCurrentThreadName("carlink-a-very-long-name");
+    char name[16] = {};
+    pthread_getname_np(pthread_self(), name, sizeof(name));
+    EXPECT_STREQ(name, "carlink-a-very-");
+  });
+  worker.join();
+}
+
+TEST(ThreadStats, SamplesANamedBusyThread) {
+  std::atomic<int> tid(0);
+  std::atomic<bool> sampled(false);
+  std::thread worker([&] {
+    SetCurrentThreadName("stats-busy");
+    tid.store(static_cast<int>(syscall(SYS_gettid)));
+    // Burn about 50 ms of CPU, then wait to be sampled.
+    const int64_t until = MonotonicNanos() + 50000000;
+    volatile uint64_t spin = 0;
+    while (MonotonicNanos() < until) {
+      spin = spin + 1;
+    }
+    while (!sampled.load()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  });
+  ThreadStatsSampler sampler;
+  sampler.Sample();
+  while (tid.load() == 0) {
+    std::this_thread::yield();
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  const std::vector<ThreadStats> threads = sampler.Sample();
+  sampled.store(true);
+  worker.join();
+
+  const ThreadStats* busy = Find(threads, tid.load());
+  ASSERT_NE(busy, nullptr);
+  EXPECT_EQ(busy->name, "stats-busy");
+  // Clock tick resolution without schedstat.
+  EXPECT_GE(busy->cpu_ns, 10000000u);
+  EXPECT_GT(busy->cpu_percent, 0);
+  EXPECT_LE(busy->cpu_percent, 100.5);
+  EXPECT_GT(busy->voluntary_switches + busy->involuntary_switches, 0u);
+
+  const ThreadStats* self =
+      Find(threads, static_cast<int>(syscall(SYS_gettid)));
+  ASSERT_NE(self, nullptr);
+}
+
+}  // namespace test
+}  // namespace carlink
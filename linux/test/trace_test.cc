@@ -0,0 +1,161 @@
+#include "core/trace.h"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+namespace carlink {
+namespace test {
+
+namespace {
+
+std::string TempPath(const char* name) {
+  return testing::TempDir() + name + std::to_string(getpid()) + ".json";
+}
+
+std::string ReadFile(const std::string& path) {
+  std::ifstream file(path);
+  std::stringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+size_t CountOf(const std::string& haystack, const std::string& needle) {
+  size_t count = 0;
+  for (size_t at = haystack.find(needle); at != std::string::npos;
+       at = haystack.find(needle, at + needle.size())) {
+    count++;
+  }
+  return count;
+}
+
+}  // namespace
+
+TEST(Trace, RecordsNothingWhileStopped) {
+  StopTracing();
+  EXPECT_FALSE(TraceEnabled());
+  { TraceScope scope("trace_test.stopped"); }
+  TraceInstant("trace_test.stopped");
+  TraceCounter("trace_test.stopped", 1);
+
+  StartTracing();
+  StopTracing();
+  const std::string path = TempPath("trace_stopped");
+  ASSERT_TRUE(WriteChromeTrace(path));
+  EXPECT_EQ(ReadFile(path).find("trace_test.stopped"), std::string::npos);
+  unlink(path.c_str());
+}
+
+TEST(Trace, WritesEventsFromEveryThread) {
+  StartTracing();
+  { TraceScope scope("trace_test.main", 42); }
+  TraceCounter("trace_test.depth", 3);
+  std::thread worker([] {
+    for (int i = 0; i < 10; i++) {
+      TraceInstant("trace_test.worker", i);
+    }
+  });
+  worker.join();
+  StopTracing();
+
+  const std::string path = TempPath("trace_threads");
+  ASSERT_TRUE(WriteChromeTrace(path));
+  const std::string json = ReadFile(path);
+  unlink(path.c_str());
+
+  EXPECT_EQ(json.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["), 0u);
+  EXPECT_EQ(json.substr(json.size() - 4), "\n]}\n");
+  EXPECT_NE(json.find("\"name\":\"trace_test.main\",\"ph\":\"X\""),
+            std::string::npos);
+  EXPECT_NE(json.find("\"arg\":42"), std::string::npos);
+  EXPECT_NE(json.find("\"name\":\"trace_test.depth\",\"ph\":\"C\""),
+            std::string::npos);
+  EXPECT_NE(json.find("\"value\":3"), std::string::npos);
+  EXPECT_EQ(CountOf(json, "\"name\":\"trace_test.worker\""), 10u);
+  // The worker's buffer outlives it.
+  EXPECT_GE(CountOf(json, "\"name\":\"thread_name\""), 2u);
+}
+
+TEST(Trace, KeepsOnlyTheNewestEventsPerThread) {
+  StartTracing();
+  std::thread worker([] {
+    for (size_t i = 0; i < kTraceEventsPerThread + 100; i++) {
+      TraceInstant("trace_test.wrap", i);
+    }
+  });
+  worker.join();
+  StopTracing();
+
+  const std::string path = TempPath("trace_wrap");
+  ASSERT_TRUE(WriteChromeTrace(path));
+  const std::string json = ReadFile(path);
+  unlink(path.c_str());
+
+  EXPECT_EQ(CountOf(json, "\"name\":\"trace_test.wrap\""),
+            kTraceEventsPerThread);
+  EXPECT_EQ(json.find("\"arg\":99}"), std::string::npos);
+  EXPECT_NE(json.find("\"arg\":100}"), std::string::npos);
+}
+
+TEST(Trace, DropsTheSlotALiveThreadMayBeWriting) {
+  StartTracing();
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool written = false;
+  bool exported = false;
+  std::thread worker([&] {
+    for (size_t i = 0; i < kTraceEventsPerThread + 100; i++) {
+      TraceInstant("trace_test.live", i);
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    written = true;
+    cv.notify_all();
+    cv.wait(lock, [&] { return exported; });
+  });
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&] { return written; });
+  }
+
+  const std::string path = TempPath("trace_live");
+  ASSERT_TRUE(WriteChromeTrace(path));
+  const std::string json = ReadFile(path);
+  unlink(path.c_str());
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    exported = true;
+  }
+  cv.notify_all();
+  worker.join();
+  StopTracing();
+
+  // The oldest slot is the one the next event goes to.
+  EXPECT_EQ(CountOf(json, "\"name\":\"trace_test.live\""),
+            kTraceEventsPerThread - 1);
+  EXPECT_EQ(json.find("\"arg\":100}"), std::string::npos);
+  EXPECT_NE(json.find("\"arg\":101}"), std::string::npos);
+}
+
+TEST(Trace, FreesRingsOfExitedThreadsOnceExported) {
+  StartTracing();
+  std::thread worker([] { TraceInstant("trace_test.exited"); });
+  worker.join();
+
+  const std::string path = TempPath("trace_exited");
+  ASSERT_TRUE(WriteChromeTrace(path));
+  EXPECT_EQ(CountOf(ReadFile(path), "\"name\":\"trace_test.exited\""), 1u);
+  // The ring went with that export.
+  ASSERT_TRUE(WriteChromeTrace(path));
+  EXPECT_EQ(CountOf(ReadFile(path), "\"name\":\"trace_test.exited\""), 0u);
+  StopTracing();
+  unlink(path.c_str());
+}
+
+}  // namespace test
+}  // namespace carlink
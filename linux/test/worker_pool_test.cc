@@ -0,0 +1,219 @@
+#include "core/worker_pool.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "core/glass_to_glass.h"
+#include "core/pcm_h264.h"
+#include "core/rgba_frame_buffer.h"
+#include "core/session.h"
+#include "core/simulated_dongle.h"
+
+namespace carlink {
+namespace test {
+
+namespace {
+
+// Spins until |done| or a few seconds passed.
+bool WaitFor(const std::function<bool()>& done) {
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (!done()) {
+    if (std::chrono::steady_clock::now() > deadline) {
+      return false;
+    }
+    std::this_thread::yield();
+  }
+  return true;
+}
+
+}  // namespace
+
+TEST(WorkerPool, RunsEveryTask) {
+  std::atomic<int> runs{0};
+  {
+    WorkerPool pool(3);
+    EXPECT_EQ(pool.threads(), 3);
+    for (int i = 0; i < 1000; i++) {
+      pool.Post(i % 2 ? WorkerPool::kRealTime : WorkerPool::kBackground,
+                [&runs] { runs++; });
+    }
+    // The destructor runs what is still queued.
+  }
+  EXPECT_EQ(runs.load(), 1000);
+}
+
+TEST(WorkerPool, CountsTasksPerLane) {
+  WorkerPool pool(1);
+  std::atomic<int> runs{0};
+  for (int i = 0; i < 10; i++) {
+    pool.Post(i < 3 ? WorkerPool::kRealTime : WorkerPool::kBackground,
+              [&runs] { runs++; });
+  }
+  ASSERT_TRUE(WaitFor([&runs] { return runs.load() == 10; }));
+  const WorkerPool::Stats stats = pool.stats();
+  EXPECT_EQ(stats.threads, 1u);
+  EXPECT_EQ(stats.lanes[WorkerPool::kRealTime].tasks_posted, 3u);
+  EXPECT_EQ(stats.lanes[WorkerPool::kBackground].tasks_posted, 7u);
+  EXPECT_EQ(stats.lanes[WorkerPool::kBackground].queue_depth, 0u);
+}
+
+TEST(WorkerPool, RealTimeRunsAheadOfBackground) {
+  WorkerPool pool(1);
+  std::atomic<bool> release{false};
+  std::atomic<bool> started{false};
+  pool.Post(WorkerPool::kBackground, [&] {
+    started = true;
+    while (!release.load()) {
+      std::this_thread::yield();
+    }
+  });
+  ASSERT_TRUE(WaitFor([&started] { return started.load(); }));
+
+  std::mutex mutex;
+  std::vector<WorkerPool::Lane> order;
+  auto record = [&](WorkerPool::Lane lane) {
+    return [&mutex, &order, lane] {
+      std::lock_guard<std::mutex> lock(mutex);
+      order.push_back(lane);
+    };
+  };
+  for (int i = 0; i < 3; i++) {
+    pool.Post(WorkerPool::kBackground, record(WorkerPool::kBackground));
+  }
+  for (int i = 0; i < 3; i++) {
+    pool.Post(WorkerPool::kRealTime, record(WorkerPool::kRealTime));
+  }
+  release = true;
+  ASSERT_TRUE(WaitFor([&] {
+    std::lock_guard<std::mutex> lock(mutex);
+    return order.size() == 6;
+  }));
+  for (int i = 0; i < 6; i++) {
+    EXPECT_EQ(order[i],
+              i < 3 ? WorkerPool::kRealTime : WorkerPool::kBackground);
+  }
+}
+
+TEST(WorkerPool, IdleWorkersStealQueuedTasks) {
+  WorkerPool pool(2);
+  std::atomic<int> runs{0};
+  std::atomic<bool> stole{false};
+  pool.Post(WorkerPool::kBackground, [&] {
+    // Queued on this worker's own deque, which it is too busy to run.
+    for (int i = 0; i < 10; i++) {
+      pool.Post(WorkerPool::kBackground, [&runs] { runs++; });
+    }
+    stole = WaitFor([&runs] { return runs.load() == 10; });
+  });
+  ASSERT_TRUE(WaitFor([&runs] { return runs.load() == 10; }));
+  ASSERT_TRUE(WaitFor([&stole] { return stole.load(); }));
+  EXPECT_GE(pool.stats().lanes[WorkerPool::kBackground].tasks_stolen, 10u);
+}
+
+TEST(WorkerPool, ParallelForRunsEachIndexOnce) {
+  WorkerPool pool(3);
+  std::vector<std::atomic<int>> hits(100);
+  pool.ParallelFor(WorkerPool::kRealTime, 100, [&hits](int i) { hits[i]++; });
+  for (int i = 0; i < 100; i++) {
+    EXPECT_EQ(hits[i].load(), 1) << i;
+  }
+
+  // From a task of a single-thread pool: the caller does the work itself.
+  WorkerPool single(1);
+  std::atomic<int> sum{0};
+  std::atomic<bool> done{false};
+  single.Post(WorkerPool::kBackground, [&] {
+    single.ParallelFor(WorkerPool::kBackground, 10,
+                       [&sum](int i) { sum += i; });
+    done = true;
+  });
+  ASSERT_TRUE(WaitFor([&done] { return done.load(); }));
+  EXPECT_EQ(sum.load(), 45);
+}
+
+TEST(WorkerPool, FramesConvertInBands) {
+  constexpr int kWidth = 96;
+  constexpr int kHeight = 302;
+  std::vector<uint8_t> y(kWidth * kHeight);
+  std::vector<uint8_t> u(kWidth / 2 * (kHeight / 2));
+  std::vector<uint8_t> v(u.size());
+  for (size_t i = 0; i < y.size(); i++) {
+    y[i] = static_cast<uint8_t>(i * 7);
+  }
+  for (size_t i = 0; i < u.size(); i++) {
+    u[i] = static_cast<uint8_t>(i * 3);
+    v[i] = static_cast<uint8_t>(255 - i * 5);
+  }
+  VideoFrame frame;
+  frame.width = kWidth;
+  frame.height = kHeight;
+  frame.y = y.data();
+  frame.u = u.data();
+  frame.v = v.data();
+  frame.y_stride = kWidth;
+  frame.uv_stride = kWidth / 2;
+
+  WorkerPool pool(3);
+  RgbaFrameBuffer banded(nullptr, &pool);
+  RgbaFrameBuffer whole;
+  banded.OnFrame(frame);
+  whole.OnFrame(frame);
+  const RgbaFrame* expected = whole.AcquireLatest();
+  const RgbaFrame* actual = banded.AcquireLatest();
+  ASSERT_NE(actual, nullptr);
+  EXPECT_EQ(actual->pixels, expected->pixels);
+  EXPECT_GT(pool.stats().lanes[WorkerPool::kRealTime].tasks_posted, 0u);
+}
+
+// Two dongles, each with its own transport and decoder, decoding on one
+// thread between them.
+TEST(WorkerPool, SessionsShareOnePool) {
+  WorkerPool pool(1);
+  std::vector<std::unique_ptr<CounterPatternSource>> sources;
+  std::vector<std::unique_ptr<Session>> sessions;
+  for (int i = 0; i < 2; i++) {
+    sources.push_back(std::make_unique<CounterPatternSource>(64, 32));
+    SimulatedDongle::Options dongle_options;
+    dongle_options.video_source = sources.back().get();
+    dongle_options.real_time = false;
+    dongle_options.audio = false;
+    SessionOptions options;
+    options.worker_pool = &pool;
+    sessions.push_back(std::make_unique<Session>(
+        std::make_unique<SimulatedDongle>(dongle_options), options,
+        CreatePcmH264Decoder(), nullptr, nullptr, nullptr));
+    ASSERT_TRUE(sessions.back()->Start());
+  }
+
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  auto decoded = [&sessions](int i) {
+    return sessions[i]->stats().video.frames_decoded;
+  };
+  while ((decoded(0) < 100 || decoded(1) < 100) &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  for (std::unique_ptr<Session>& session : sessions) {
+    session->Stop();
+  }
+
+  EXPECT_GE(decoded(0), 100u);
+  EXPECT_GE(decoded(1), 100u);
+  // Nothing of a stopped session is left queued on the pool.
+  const WorkerPool::LaneStats video =
+      pool.stats().lanes[WorkerPool::kRealTime];
+  EXPECT_EQ(video.queue_depth, 0u);
+  EXPECT_GT(video.tasks_run, 0u);
+}
+
+}  // namespace test
+}  // namespace carlink
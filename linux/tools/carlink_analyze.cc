@@ -0,0 +1,227 @@
+// Summarises a capture file recorded by carlink_cli --record or the plugin's
+// startRecording: message counts, video bitrate and GOP structure, audio
+// format changes, heartbeat gaps and inbound silences. Meant for field
+// reports about stutter and disconnects.
+
+#include <getopt.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "core/audio.h"
+#include "core/capture_analysis.h"
+#include "core/capture_reader.h"
+#include "core/clock.h"
+#include "core/protocol.h"
+
+namespace {
+
+struct Options {
+  std::string path;
+  carlink::CaptureAnalysisOptions analysis;
+  bool timeline = false;
+  bool gops = false;
+  // Gaps and format changes listed before eliding the rest.
+  size_t max_listed = 20;
+};
+
+void PrintUsage(const char* argv0) {
+  fprintf(stderr,
+          "Usage: %s [options] CAPTURE\n"
+          "  -j, --threads N          scan with N threads (default one per "
+          "core)\n"
+          "      --heartbeat-gap MS   list heartbeat gaps over MS "
+          "(default 3000)\n"
+          "      --timeline           print the video bitrate of every "
+          "second\n"
+          "      --gops               print every GOP length\n"
+          "  -n, --max-listed N       list at most N gaps and format "
+          "changes (default 20)\n",
+          argv0);
+}
+
+bool ParseOptions(int argc, char** argv, Options* options) {
+  enum { kHeartbeatGap = 256, kTimeline, kGops };
+  static const struct option kLongOptions[] = {
+      {"threads", required_argument, nullptr, 'j'},
+      {"heartbeat-gap", required_argument, nullptr, kHeartbeatGap},
+      {"timeline", no_argument, nullptr, kTimeline},
+      {"gops", no_argument, nullptr, kGops},
+      {"max-listed", required_argument, nullptr, 'n'},
+      {"help", no_argument, nullptr, 'h'},
+      {nullptr, 0, nullptr, 0},
+  };
+
+  int option;
+  while ((option = getopt_long(argc, argv, "j:n:h", kLongOptions, nullptr)) !=
+         -1) {
+    switch (option) {
+      case 'j':
+        options->analysis.threads = atoi(optarg);
+        break;
+      case kHeartbeatGap:
+        options->analysis.heartbeat_gap_ns =
+            static_cast<int64_t>(atoi(optarg)) * 1000000;
+        break;
+      case kTimeline:
+        options->timeline = true;
+        break;
+      case kGops:
+        options->gops = true;
+        break;
+      case 'n':
+        options->max_listed = atoi(optarg);
+        break;
+      default:
+        return false;
+    }
+  }
+  if (optind + 1 != argc) {
+    return false;
+  }
+  options->path = argv[optind];
+  return true;
+}
+
+double Seconds(int64_t ns) {
+  return ns / 1e9;
+}
+
+void PrintFrameSizes(const char* name, const carlink::FrameSizeStats& stats) {
+  if (stats.count == 0) {
+    printf("  %s frames: none\n", name);
+    return;
+  }
+  printf("  %s frames: %llu, avg %llu B, min %u p50 %u p95 %u max %u\n", name,
+         static_cast<unsigned long long>(stats.count),
+         static_cast<unsigned long long>(stats.total_bytes / stats.count),
+         stats.min, stats.p50, stats.p95, stats.max);
+}
+
+void PrintAnalysis(const Options& options,
+                   const carlink::CaptureAnalysis& analysis) {
+  printf("%llu messages over %.1f s\n",
+         static_cast<unsigned long long>(analysis.messages),
+         Seconds(analysis.last_ns - analysis.first_ns));
+
+  printf("\nmessages by type (in / out):\n");
+  for (const carlink::MessageTypeCount& count : analysis.types) {
+    printf("  %-20s %10llu %10.1f MB | %8llu %8.1f KB\n",
+           carlink::MessageTypeName(count.type),
+           static_cast<unsigned long long>(count.inbound),
+           count.inbound_bytes / 1e6,
+           static_cast<unsigned long long>(count.outbound),
+           count.outbound_bytes / 1e3);
+  }
+
+  printf("\nvideo:\n");
+  const std::vector<uint64_t>& timeline = analysis.video_bytes_per_second;
+  if (!timeline.empty()) {
+    // The first and last seconds are usually partial.
+    const auto begin = timeline.size() > 2 ? timeline.begin() + 1
+                                           : timeline.begin();
+    const auto end = timeline.size() > 2 ? timeline.end() - 1
+                                         : timeline.end();
+    const auto minmax = std::minmax_element(begin, end);
+    uint64_t total = 0;
+    for (uint64_t bytes : timeline) {
+      total += bytes;
+    }
+    printf("  bitrate: avg %.2f Mbit/s, min %.2f, max %.2f (per second)\n",
+           total * 8 / 1e6 / timeline.size(), *minmax.first * 8 / 1e6,
+           *minmax.second * 8 / 1e6);
+  }
+  const std::vector<uint32_t>& gops = analysis.gop_lengths;
+  if (!gops.empty()) {
+    uint64_t total = 0;
+    for (uint32_t length : gops) {
+      total += length;
+    }
+    printf("  GOPs: %zu, frames min %u avg %.1f max %u\n", gops.size(),
+           *std::min_element(gops.begin(), gops.end()),
+           static_cast<double>(total) / gops.size(),
+           *std::max_element(gops.begin(), gops.end()));
+  }
+  PrintFrameSizes("I", analysis.idr_frames);
+  PrintFrameSizes("P", analysis.p_frames);
+  if (options.timeline) {
+    for (size_t i = 0; i < timeline.size(); i++) {
+      printf("    %6zu s %8.2f Mbit/s\n", i, timeline[i] * 8 / 1e6);
+    }
+  }
+  if (options.gops) {
+    for (size_t i = 0; i < gops.size(); i++) {
+      printf("    GOP %zu: %u frames\n", i, gops[i]);
+    }
+  }
+
+  printf("\naudio format changes: %zu\n",
+         analysis.audio_format_changes.size());
+  for (size_t i = 0; i < analysis.audio_format_changes.size(); i++) {
+    if (i == options.max_listed) {
+      printf("  ...\n");
+      break;
+    }
+    const carlink::AudioFormatChange& change =
+        analysis.audio_format_changes[i];
+    carlink::AudioFormat format;
+    carlink::AudioFormatForDecodeType(change.to_decode_type, &format);
+    printf("  %10.3f s  audio type %u: decode type %u -> %u (%u Hz, %u ch)\n",
+           Seconds(change.timestamp_ns), change.audio_type,
+           change.from_decode_type, change.to_decode_type,
+           format.sample_rate, format.channels);
+  }
+
+  printf("\nheartbeats: %llu, longest gap %.3f s at %.3f s\n",
+         static_cast<unsigned long long>(analysis.heartbeats),
+         Seconds(analysis.longest_heartbeat_gap.length_ns),
+         Seconds(analysis.longest_heartbeat_gap.start_ns));
+  printf("  gaps over %.1f s: %zu\n",
+         Seconds(options.analysis.heartbeat_gap_ns),
+         analysis.heartbeat_gaps.size());
+  for (size_t i = 0; i < analysis.heartbeat_gaps.size(); i++) {
+    if (i == options.max_listed) {
+      printf("  ...\n");
+      break;
+    }
+    printf("  %10.3f s  %.3f s\n",
+           Seconds(analysis.heartbeat_gaps[i].start_ns),
+           Seconds(analysis.heartbeat_gaps[i].length_ns));
+  }
+
+  printf("\nlongest inbound silence: %.3f s at %.3f s\n",
+         Seconds(analysis.longest_inbound_silence.length_ns),
+         Seconds(analysis.longest_inbound_silence.start_ns));
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    PrintUsage(argv[0]);
+    return 2;
+  }
+
+  carlink::CaptureReader reader;
+  if (!reader.Open(options.path)) {
+    return 1;
+  }
+  printf("%s: %.1f MB, %s%s, %zu messages, %zu keyframes\n",
+         options.path.c_str(), reader.size() / 1e6,
+         reader.indexed() ? "indexed" : "no index",
+         reader.compressed() ? ", compressed" : "", reader.message_count(),
+         reader.keyframe_count());
+
+  const int64_t start = carlink::MonotonicNanos();
+  const carlink::CaptureAnalysis analysis =
+      carlink::AnalyzeCapture(reader, options.analysis);
+  const int64_t elapsed = carlink::MonotonicNanos() - start;
+  printf("scanned in %.2f s (%.0f MB/s)\n\n", Seconds(elapsed),
+         reader.size() / 1e6 / std::max(Seconds(elapsed), 1e-9));
+
+  PrintAnalysis(options, analysis);
+  return 0;
+}
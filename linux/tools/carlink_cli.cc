@@ -0,0 +1,878 @@
+// Runs a dongle session without Flutter: opens the dongle, performs the
+// handshake, decodes video into a raw frame sink (or /dev/null), plays audio
+// and prints live throughput, latency and drop statistics.
+
+#include <getopt.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "core/audio_sink.h"
+#include "core/capture_writer.h"
+#include "core/clock.h"
+#include "core/file_log_sink.h"
+#include "core/log.h"
+#include "core/log_ring.h"
+#include "core/raw_frame_sink.h"
+#include "core/replay.h"
+#include "core/session.h"
+#include "core/simulated_dongle.h"
+#include "core/soak_monitor.h"
+#include "core/thread_stats.h"
+#include "core/trace.h"
+#include "core/usb_device.h"
+#include "core/video_decoder.h"
+#include "core/worker_pool.h"
+
+namespace {
+
+using carlink::LogLevel;
+
+// lib/carlink.dart: the dongle re-enumerates for 1-3 s after a reset.
+constexpr int kUsbWaitPeriodMs = 3000;
+// PhoneType.CarPlay and its frameInterval in DEFAULT_CONFIG.
+constexpr uint32_t kPhoneTypeCarPlay = 3;
+constexpr int kCarPlayFrameIntervalMs = 5000;
+// Carlink.start(): ask for wifi pairing if nothing plugged in by then.
+constexpr int kPairTimeoutMs = 15000;
+
+struct Options {
+  carlink::DongleConfig config;
+  std::string output = "/dev/null";
+  // Capture file for every message in both directions; empty to not record.
+  std::string record;
+  std::string log_file;
+  bool direct_io = false;
+  bool compress = false;
+  bool audio = true;
+  bool reset = true;
+  bool once = false;
+  bool verbose = false;
+  int duration_s = 0;
+  int interval_s = 1;
+  // Annex-B file for the simulated dongle; empty to use USB.
+  std::string simulate;
+  bool max_rate = false;
+  // Capture to replay against a virtual clock.
+  std::string replay;
+  // Chrome trace JSON of the whole run; empty to not trace.
+  std::string trace;
+  // Where sessions dump their flight recorder when they fail.
+  std::string flight_dir;
+  // Soak mode: hours to run while sampling resource usage and latency.
+  double soak_hours = 0;
+  std::string soak_csv = "soak.csv";
+  int soak_interval_s = 60;
+  carlink::SoakThresholds soak_thresholds;
+  // Independent sessions to run side by side, one dongle each.
+  int sessions = 1;
+  // Threads of the task pool every parallel stage shares: decoding with
+  // several sessions, capture compression. 0 for one per CPU.
+  int threads = 0;
+};
+
+// Sessions run side by side by --sessions, each reconnecting on its own.
+struct Rig {
+  std::mutex print_mutex;
+  std::atomic<uint64_t> frames_decoded{0};
+  std::atomic<uint64_t> frames_dropped{0};
+};
+
+// A soak run across reconnects.
+struct Soak {
+  explicit Soak(const carlink::SoakThresholds& thresholds)
+      : monitor(thresholds) {}
+
+  carlink::SoakMonitor monitor;
+  int64_t start_ns = 0;
+  int64_t interval_ns = 0;
+  int64_t last_sample_ns = 0;
+};
+
+std::atomic<bool> g_stop{false};
+
+void HandleSignal(int signal) {
+  g_stop.store(true);
+}
+
+void PrintUsage(const char* argv0) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  -o, --output PATH     write decoded I420 frames to PATH "
+          "(default /dev/null)\n"
+          "  -r, --record PATH     record all messages to a capture file\n"
+          "  -l, --log-file PATH   write log lines to PATH instead of stderr\n"
+          "      --direct-io       write the capture and log with O_DIRECT\n"
+          "      --compress        compress the capture with LZ4\n"
+          "  -W, --width N         projection width (default 1920)\n"
+          "  -H, --height N        projection height (default 720)\n"
+          "  -f, --fps N           projection frame rate (default 60)\n"
+          "  -d, --duration SEC    stop after SEC seconds\n"
+          "  -i, --interval SEC    stats interval (default 1)\n"
+          "      --no-audio        do not play audio\n"
+          "      --no-reset        skip the USB reset before opening\n"
+          "      --once            exit instead of reconnecting on errors\n"
+          "      --simulate FILE   use a simulated dongle streaming the "
+          "Annex-B FILE\n"
+          "      --max-rate        simulated media as fast as possible "
+          "instead of real time\n"
+          "      --replay FILE     replay a capture against a virtual clock, "
+          "deterministically\n"
+          "      --trace FILE      write a Chrome trace of the pipeline "
+          "threads to FILE\n"
+          "      --flight-dir DIR  dump the last 30 s of session history to "
+          "DIR on failure\n"
+          "      --soak HOURS      run HOURS, sampling memory, fds, queues and "
+          "latency, and\n"
+          "                        fail if they drift\n"
+          "      --soak-csv PATH   soak samples (default soak.csv)\n"
+          "      --soak-interval SEC  seconds between soak samples "
+          "(default 60)\n"
+          "      --max-rss-growth MB      soak limit (default 64)\n"
+          "      --max-heap-growth MB     soak limit (default 32)\n"
+          "      --max-fd-growth N        soak limit (default 8)\n"
+          "      --max-latency-growth PCT soak limit on p99 (default 50)\n"
+          "      --sessions N      drive N dongles (or simulated ones) side "
+          "by side\n"
+          "      --threads N       task pool threads for decoding (with "
+          "--sessions) and\n"
+          "                        compression (default one per CPU)\n"
+          "  -v, --verbose         log every inbound message\n",
+          argv0);
+}
+
+bool ParseOptions(int argc, char** argv, Options* options) {
+  enum { kNoAudio = 256, kNoReset, kOnce, kSimulate, kMaxRate,
+         kDirectIo, kCompress, kReplay, kTrace, kFlightDir, kSoak, kSoakCsv,
+         kSoakInterval, kMaxRssGrowth, kMaxHeapGrowth, kMaxFdGrowth,
+         kMaxLatencyGrowth, kSessions, kThreads };
+  static const struct option kLongOptions[] = {
+      {"output", required_argument, nullptr, 'o'},
+      {"record", required_argument, nullptr, 'r'},
+      {"log-file", required_argument, nullptr, 'l'},
+      {"direct-io", no_argument, nullptr, kDirectIo},
+      {"compress", no_argument, nullptr, kCompress},
+      {"width", required_argument, nullptr, 'W'},
+      {"height", required_argument, nullptr, 'H'},
+      {"fps", required_argument, nullptr, 'f'},
+      {"duration", required_argument, nullptr, 'd'},
+      {"interval", required_argument, nullptr, 'i'},
+      {"no-audio", no_argument, nullptr, kNoAudio},
+      {"no-reset", no_argument, nullptr, kNoReset},
+      {"once", no_argument, nullptr, kOnce},
+      {"simulate", required_argument, nullptr, kSimulate},
+      {"max-rate", no_argument, nullptr, kMaxRate},
+      {"replay", required_argument, nullptr, kReplay},
+      {"trace", required_argument, nullptr, kTrace},
+      {"flight-dir", required_argument, nullptr, kFlightDir},
+      {"soak", required_argument, nullptr, kSoak},
+      {"soak-csv", required_argument, nullptr, kSoakCsv},
+      {"soak-interval", required_argument, nullptr, kSoakInterval},
+      {"max-rss-growth", required_argument, nullptr, kMaxRssGrowth},
+      {"max-heap-growth", required_argument, nullptr, kMaxHeapGrowth},
+      {"max-fd-growth", required_argument, nullptr, kMaxFdGrowth},
+      {"max-latency-growth", required_argument, nullptr, kMaxLatencyGrowth},
+      {"sessions", required_argument, nullptr, kSessions},
+      {"threads", required_argument, nullptr, kThreads},
+      {"verbose", no_argument, nullptr, 'v'},
+      {"help", no_argument, nullptr, 'h'},
+      {nullptr, 0, nullptr, 0},
+  };
+
+  int option;
+  while ((option = getopt_long(argc, argv, "o:r:l:W:H:f:d:i:vh", kLongOptions,
+                               nullptr)) != -1) {
+    switch (option) {
+      case 'o':
+        options->output = optarg;
+        break;
+      case 'r':
+        options->record = optarg;
+        break;
+      case 'l':
+        options->log_file = optarg;
+        break;
+      case kDirectIo:
+        options->direct_io = true;
+        break;
+      case kCompress:
+        options->compress = true;
+        break;
+      case 'W':
+        options->config.width = atoi(optarg);
+        break;
+      case 'H':
+        options->config.height = atoi(optarg);
+        break;
+      case 'f':
+        options->config.fps = atoi(optarg);
+        break;
+      case 'd':
+        options->duration_s = atoi(optarg);
+        break;
+      case 'i':
+        options->interval_s = atoi(optarg) > 0 ? atoi(optarg) : 1;
+        break;
+      case kNoAudio:
+        options->audio = false;
+        break;
+      case kNoReset:
+        options->reset = false;
+        break;
+      case kOnce:
+        options->once = true;
+        break;
+      case kSimulate:
+        options->simulate = optarg;
+        break;
+      case kMaxRate:
+        options->max_rate = true;
+        break;
+      case kReplay:
+        options->replay = optarg;
+        break;
+      case kTrace:
+        options->trace = optarg;
+        break;
+      case kFlightDir:
+        options->flight_dir = optarg;
+        break;
+      case kSoak:
+        options->soak_hours = atof(optarg);
+        break;
+      case kSoakCsv:
+        options->soak_csv = optarg;
+        break;
+      case kSoakInterval:
+        options->soak_interval_s = atoi(optarg) > 0 ? atoi(optarg) : 60;
+        break;
+      case kMaxRssGrowth:
+        options->soak_thresholds.max_rss_growth_bytes =
+            static_cast<uint64_t>(atof(optarg) * (1 << 20));
+        break;
+      case kMaxHeapGrowth:
+        options->soak_thresholds.max_heap_growth_bytes =
+            static_cast<uint64_t>(atof(optarg) * (1 << 20));
+        break;
+      case kMaxFdGrowth:
+        options->soak_thresholds.max_fd_growth = atoi(optarg);
+        break;
+      case kMaxLatencyGrowth:
+        options->soak_thresholds.max_latency_growth = atof(optarg) / 100;
+        break;
+      case kSessions:
+        options->sessions = atoi(optarg) > 0 ? atoi(optarg) : 1;
+        break;
+      case kThreads:
+        options->threads = atoi(optarg);
+        break;
+      case 'v':
+        options->verbose = true;
+        break;
+      default:
+        return false;
+    }
+  }
+  // A replay runs on virtual time, which a capture cannot record.
+  // A replay answers nothing new worth recording, and a soak is real time.
+  // Side-by-side sessions would interleave one capture and one soak.
+  return optind == argc &&
+         (options->replay.empty() ||
+          (options->record.empty() && options->soak_hours == 0)) &&
+         (options->sessions == 1 ||
+          (options->replay.empty() && options->record.empty() &&
+           options->soak_hours == 0));
+}
+
+// Sleeps up to |ms|, returning early once a stop was requested.
+void SleepUnlessStopped(int ms) {
+  for (int slept = 0; slept < ms && !g_stop.load(); slept += 50) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+}
+
+// Mirrors Carlink.start(): open, reset, wait for the dongle to come back,
+// then open it for real.
+std::unique_ptr<carlink::UsbTransport> OpenDongle(bool reset) {
+  std::unique_ptr<carlink::UsbTransport> transport =
+      carlink::UsbTransport::OpenDongle();
+  if (!transport || !reset) {
+    return transport;
+  }
+  transport->device()->Reset();
+  transport.reset();
+  carlink::Log(LogLevel::kInfo, "Reset device, finding again...");
+  SleepUnlessStopped(kUsbWaitPeriodMs);
+  return g_stop.load() ? nullptr : carlink::UsbTransport::OpenDongle();
+}
+
+std::unique_ptr<carlink::Transport> OpenTransport(const Options& options) {
+  if (options.simulate.empty()) {
+    return OpenDongle(options.reset);
+  }
+  carlink::SimulatedDongle::Options simulated;
+  simulated.video_path = options.simulate;
+  simulated.real_time = !options.max_rate;
+  auto dongle = std::make_unique<carlink::SimulatedDongle>(simulated);
+  return dongle->ok() ? std::move(dongle) : nullptr;
+}
+
+class CliListener : public carlink::SessionListener {
+ public:
+  explicit CliListener(bool verbose) : verbose_(verbose) {}
+
+  void OnMessage(const carlink::Message& message) override {
+    const auto type = static_cast<carlink::MessageType>(message.header.type);
+    if (type == carlink::MessageType::kPlugged &&
+        message.payload.size() >= 4) {
+      phone_type_.store(carlink::ReadU32(message.payload.data()));
+      plugged_.store(true);
+    } else if (type == carlink::MessageType::kUnplugged) {
+      // Carlink restarts the whole session when the phone goes away.
+      plugged_.store(false);
+      OnError("Unplugged");
+    }
+    if (verbose_ || type == carlink::MessageType::kPlugged ||
+        type == carlink::MessageType::kUnplugged ||
+        type == carlink::MessageType::kPhase) {
+      // Every message with -v: format it off the read loop.
+      carlink::LogDeferred(LogLevel::kInfo, "[RECV] %s, length: %zu",
+                           carlink::MessageTypeName(message.header.type),
+                           message.payload.size());
+    }
+  }
+
+  void OnError(const std::string& error) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    error_ = error;
+    failed_.store(true);
+  }
+
+  bool failed() const { return failed_.load(); }
+  bool plugged() const { return plugged_.load(); }
+  uint32_t phone_type() const { return phone_type_.load(); }
+
+  std::string error() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return error_;
+  }
+
+ private:
+  const bool verbose_;
+  std::atomic<bool> failed_{false};
+  std::atomic<bool> plugged_{false};
+  std::atomic<uint32_t> phone_type_{0};
+  std::mutex mutex_;
+  std::string error_;
+};
+
+double Rate(uint64_t current, uint64_t previous, double seconds) {
+  return seconds > 0 ? (current - previous) / seconds : 0;
+}
+
+void PrintStats(const char* label, const carlink::Session::Stats& current,
+                const carlink::Session::Stats& previous, double seconds,
+                const carlink::RawFrameSink& sink) {
+  const carlink::VideoPipeline::Stats& video = current.video;
+  const uint64_t latency_samples =
+      video.latency_samples - previous.video.latency_samples;
+  const double latency_ms =
+      latency_samples > 0
+          ? (video.latency_ns_total - previous.video.latency_ns_total) /
+                1e6 / latency_samples
+          : 0;
+
+  printf(
+      "%sin %6.2f MB/s %5.0f msg/s | video %5.1f fps in, %5.1f decoded, "
+      "dropped %llu, queue %llu, latency avg %.2f ms max %.2f ms | "
+      "audio underruns %llu overflow %llu | out %.0f msg/s, "
+      "send failures %llu | written %llu frames | buffers %llu out\n",
+      label, Rate(current.bytes_in, previous.bytes_in, seconds) / 1e6,
+      Rate(current.messages_in, previous.messages_in, seconds),
+      Rate(video.frames_received, previous.video.frames_received, seconds),
+      Rate(video.frames_decoded, previous.video.frames_decoded, seconds),
+      static_cast<unsigned long long>(video.frames_dropped),
+      static_cast<unsigned long long>(video.queue_depth), latency_ms,
+      video.latency_ns_max / 1e6,
+      static_cast<unsigned long long>(current.audio.underruns),
+      static_cast<unsigned long long>(current.audio.overflow_frames),
+      Rate(current.messages_out, previous.messages_out, seconds),
+      static_cast<unsigned long long>(current.send_failures),
+      static_cast<unsigned long long>(sink.frames_written()),
+      static_cast<unsigned long long>(current.pool.outstanding));
+  fflush(stdout);
+}
+
+// Which thread used the CPU over the session, and how long it waited for
+// one.
+void PrintThreadStats(const std::vector<carlink::ThreadStats>& threads) {
+  printf("%-18s %7s %8s %6s %13s %11s %11s\n", "threads:", "tid", "cpu ms",
+         "cpu %", "run delay ms", "voluntary", "involuntary");
+  for (const carlink::ThreadStats& thread : threads) {
+    printf("  %-16s %7d %8.1f %6.1f %13.1f %11llu %11llu\n",
+           thread.name.c_str(), thread.tid, thread.cpu_ns / 1e6,
+           thread.cpu_percent, thread.run_delay_ns / 1e6,
+           static_cast<unsigned long long>(thread.voluntary_switches),
+           static_cast<unsigned long long>(thread.involuntary_switches));
+  }
+}
+
+// Where decoded frames spent their time, from USB arrival to the sink.
+void PrintFrameLatency(const carlink::FrameLatency::Stats& stats) {
+  if (stats.stages[carlink::FrameLatency::kDecode].count == 0) {
+    return;
+  }
+  printf("frame latency (ms):       count      p50      p99    p99.9      max\n");
+  for (int i = 0; i < carlink::FrameLatency::kStageCount; i++) {
+    const carlink::FrameLatency::StageStats& stage = stats.stages[i];
+    if (stage.count == 0) {
+      continue;
+    }
+    printf("  %-18s %10llu %8.3f %8.3f %8.3f %8.3f\n",
+           carlink::FrameLatency::StageName(
+               static_cast<carlink::FrameLatency::Stage>(i)),
+           static_cast<unsigned long long>(stage.count), stage.p50_ns / 1e6,
+           stage.p99_ns / 1e6, stage.p999_ns / 1e6, stage.max_ns / 1e6);
+  }
+}
+
+// What the phone sent: SPS, frame types, GOPs, bitrate and frame_num gaps.
+void PrintBitstream(const carlink::BitstreamAnalyzer::Stats& stats) {
+  if (stats.access_units == 0) {
+    return;
+  }
+  printf("bitstream: %ux%u profile %u level %u | %llu access units: "
+         "%llu IDR, %llu I, %llu P, %llu B, %llu unparsed | gop %llu "
+         "(max %llu) | %.2f Mbit/s (peak %.2f) | IDR p50 %.1f KB max "
+         "%.1f KB, other p50 %.1f KB p99 %.1f KB max %.1f KB | "
+         "frame_num gaps %llu (%llu units)\n",
+         stats.width, stats.height, stats.profile, stats.level,
+         static_cast<unsigned long long>(stats.access_units),
+         static_cast<unsigned long long>(stats.idr_frames),
+         static_cast<unsigned long long>(stats.i_frames),
+         static_cast<unsigned long long>(stats.p_frames),
+         static_cast<unsigned long long>(stats.b_frames),
+         static_cast<unsigned long long>(stats.unparsed),
+         static_cast<unsigned long long>(stats.gop_length),
+         static_cast<unsigned long long>(stats.gop_length_max),
+         stats.bitrate_bps / 1e6, stats.bitrate_peak_bps / 1e6,
+         stats.idr_size_p50 / 1e3, stats.idr_size_max / 1e3,
+         stats.frame_size_p50 / 1e3, stats.frame_size_p99 / 1e3,
+         stats.frame_size_max / 1e3,
+         static_cast<unsigned long long>(stats.frame_num_gaps),
+         static_cast<unsigned long long>(stats.frames_missing));
+}
+
+// Runs one session until it fails, the duration elapses or a signal
+// arrives. Returns false if the session failed. Decodes on |pool|. With a
+// |rig| it is session |index| of several and labels its output.
+bool RunSession(const Options& options, int64_t deadline_ns,
+                carlink::WorkerPool* pool, carlink::CaptureWriter* capture,
+                Soak* soak, Rig* rig, int index) {
+  std::unique_ptr<carlink::Transport> transport = OpenTransport(options);
+  if (!transport) {
+    carlink::Log(LogLevel::kError, "no dongle found");
+    return false;
+  }
+
+  char label[16] = "";
+  std::string output = options.output;
+  if (rig != nullptr) {
+    snprintf(label, sizeof(label), "[%d] ", index);
+    if (output != "/dev/null") {
+      output += "." + std::to_string(index);
+    }
+  }
+  carlink::RawFrameSink sink;
+  if (!sink.Open(output)) {
+    return false;
+  }
+
+  CliListener listener(options.verbose);
+  carlink::SessionOptions session_options;
+  session_options.flight_recorder_dir = options.flight_dir;
+  session_options.config = options.config;
+  session_options.worker_pool = pool;
+  carlink::Session session(
+      std::move(transport), session_options, carlink::CreateVideoDecoder(),
+      &sink, options.audio ? carlink::CreateAudioSink() : nullptr, &listener);
+  carlink::Log(LogLevel::kInfo, "video decoder: %s",
+               session.video().decoder_name());
+  if (session.audio() != nullptr) {
+    carlink::Log(LogLevel::kInfo, "audio sink: %s",
+                 session.audio()->sink_name());
+  }
+  session.set_capture(capture);
+  carlink::ThreadStatsSampler thread_stats;
+  thread_stats.Sample();
+  if (!session.Start()) {
+    return false;
+  }
+  if (soak != nullptr) {
+    soak->monitor.BeginSession(&session);
+  }
+
+  const int64_t interval_ns =
+      static_cast<int64_t>(options.interval_s) * 1000000000;
+  const int64_t started_ns = carlink::MonotonicNanos();
+  int64_t last_print_ns = started_ns;
+  int64_t last_frame_request_ns = started_ns;
+  bool pair_requested = false;
+  carlink::Session::Stats previous = session.stats();
+
+  while (!g_stop.load() && !listener.failed() &&
+         (deadline_ns == 0 || carlink::MonotonicNanos() < deadline_ns)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    const int64_t now = carlink::MonotonicNanos();
+
+    // Carlink._handleDongleMessage: CarPlay wants periodic frame requests.
+    if (listener.plugged() && listener.phone_type() == kPhoneTypeCarPlay &&
+        now - last_frame_request_ns >=
+            int64_t{kCarPlayFrameIntervalMs} * 1000000) {
+      last_frame_request_ns = now;
+      session.Send(carlink::EncodeCommand(carlink::Command::kFrame));
+    }
+    if (!pair_requested && !listener.plugged() &&
+        now - started_ns >= int64_t{kPairTimeoutMs} * 1000000) {
+      pair_requested = true;
+      session.Send(carlink::EncodeCommand(carlink::Command::kWifiPair));
+    }
+
+    if (now - last_print_ns >= interval_ns) {
+      const carlink::Session::Stats current = session.stats();
+      std::unique_lock<std::mutex> lock;
+      if (rig != nullptr) {
+        lock = std::unique_lock<std::mutex>(rig->print_mutex);
+      }
+      PrintStats(label, current, previous, (now - last_print_ns) / 1e9, sink);
+      previous = current;
+      last_print_ns = now;
+    }
+    if (soak != nullptr && now - soak->last_sample_ns >= soak->interval_ns) {
+      soak->last_sample_ns = now;
+      if (!soak->monitor.Sample(&session,
+                                (now - soak->start_ns) / 1e9)) {
+        // No point driving on for hours once it drifted.
+        g_stop.store(true);
+      }
+    }
+  }
+
+  // While the pipeline threads are still there.
+  const std::vector<carlink::ThreadStats> threads = thread_stats.Sample();
+  session.Stop();
+  const carlink::Session::Stats stats = session.stats();
+  if (rig != nullptr) {
+    // The rig prints the threads of all sessions once they are done.
+    rig->frames_decoded += stats.video.frames_decoded;
+    rig->frames_dropped += stats.video.frames_dropped;
+    std::lock_guard<std::mutex> lock(rig->print_mutex);
+    printf("session %d:\n", index);
+    PrintFrameLatency(stats.video.frame_latency);
+    PrintBitstream(stats.video.bitstream);
+  } else {
+    PrintFrameLatency(stats.video.frame_latency);
+    PrintBitstream(stats.video.bitstream);
+    PrintThreadStats(threads);
+  }
+  if (listener.failed()) {
+    carlink::Log(LogLevel::kError, "%ssession failed: %s", label,
+                 listener.error().c_str());
+    return false;
+  }
+  return true;
+}
+
+// Replays a capture through a polled session on a virtual clock, as fast as
+// the CPU allows, and prints the totals. Two runs of the same capture see
+// the same arrivals, timers and drops; only decode times differ.
+int RunReplay(const Options& options) {
+  carlink::VirtualClock clock;
+  carlink::SimulatedDongle::Options simulated;
+  simulated.replay_path = options.replay;
+  simulated.clock = &clock;
+  auto owned = std::make_unique<carlink::SimulatedDongle>(simulated);
+  if (!owned->ok()) {
+    return 1;
+  }
+  carlink::SimulatedDongle* dongle = owned.get();
+
+  carlink::RawFrameSink sink;
+  if (!sink.Open(options.output)) {
+    return 1;
+  }
+  CliListener listener(options.verbose);
+  carlink::SessionOptions session_options;
+  session_options.flight_recorder_dir = options.flight_dir;
+  session_options.config = options.config;
+  session_options.clock = &clock;
+  session_options.polled = true;
+  carlink::Session session(
+      std::move(owned), session_options, carlink::CreateVideoDecoder(),
+      &sink, options.audio ? carlink::CreateNullAudioSink(false) : nullptr,
+      &listener);
+  if (!session.Start()) {
+    return 1;
+  }
+  const carlink::Session::Stats initial = session.stats();
+  const int64_t virtual_start_ns = clock.Now();
+  const int64_t start_ns = carlink::MonotonicNanos();
+  const int64_t end_ns =
+      options.duration_s > 0
+          ? virtual_start_ns + int64_t{options.duration_s} * 1000000000
+          : 0;
+  carlink::RunVirtualTime(&session, dongle, &clock, end_ns, &g_stop);
+  const double elapsed_s = (carlink::MonotonicNanos() - start_ns) / 1e9;
+  const double virtual_s = (clock.Now() - virtual_start_ns) / 1e9;
+  session.Stop();
+
+  const carlink::Session::Stats stats = session.stats();
+  PrintStats("", stats, initial, virtual_s, sink);
+  PrintFrameLatency(stats.video.frame_latency);
+  PrintBitstream(stats.video.bitstream);
+  printf("replay: %.1f s of capture in %.2f s | %llu messages, "
+         "%llu heartbeats sent | video %llu frames, %llu dropped, "
+         "%llu keyframe requests | audio %llu frames played, %llu underruns, "
+         "%llu overflow frames%s%s\n",
+         virtual_s, elapsed_s,
+         static_cast<unsigned long long>(stats.messages_in),
+         static_cast<unsigned long long>(stats.heartbeats),
+         static_cast<unsigned long long>(stats.video.frames_received),
+         static_cast<unsigned long long>(stats.video.frames_dropped),
+         static_cast<unsigned long long>(stats.video.keyframe_requests),
+         static_cast<unsigned long long>(stats.audio.frames_played),
+         static_cast<unsigned long long>(stats.audio.underruns),
+         static_cast<unsigned long long>(stats.audio.overflow_frames),
+         listener.failed() ? " | failed: " : "",
+         listener.failed() ? listener.error().c_str() : "");
+  return listener.failed() ? 1 : 0;
+}
+
+// Reconnects like Carlink.restart() until stopped; returns the exit status.
+int RunSessions(const Options& options, int64_t deadline_ns,
+                carlink::WorkerPool* pool, carlink::CaptureWriter* capture,
+                Soak* soak, Rig* rig, int index) {
+  while (true) {
+    const bool ok =
+        RunSession(options, deadline_ns, pool, capture, soak, rig, index);
+    if (g_stop.load() ||
+        (deadline_ns != 0 && carlink::MonotonicNanos() >= deadline_ns)) {
+      return 0;
+    }
+    if (options.once) {
+      return ok ? 0 : 1;
+    }
+    // Carlink.restart().
+    carlink::Log(LogLevel::kInfo, "restarting in 2s");
+    SleepUnlessStopped(2000);
+    if (g_stop.load()) {
+      return 0;
+    }
+  }
+}
+
+// Runs --sessions side by side, decoding on |pool|, and prints what they
+// decoded together.
+int RunRig(const Options& options, int64_t deadline_ns,
+           carlink::WorkerPool* pool) {
+  Rig rig;
+  carlink::ThreadStatsSampler thread_stats;
+  thread_stats.Sample();
+  const int64_t start_ns = carlink::MonotonicNanos();
+  std::vector<int> statuses(options.sessions);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < options.sessions; i++) {
+    threads.emplace_back([&, i] {
+      statuses[i] =
+          RunSessions(options, deadline_ns, pool, nullptr, nullptr, &rig, i);
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  const double seconds = (carlink::MonotonicNanos() - start_ns) / 1e9;
+  // The sessions' own threads have exited; this shows the shared pool.
+  PrintThreadStats(thread_stats.Sample());
+  printf("%d sessions, %d pool threads: %.1f fps decoded, %llu dropped\n",
+         options.sessions, pool->threads(),
+         seconds > 0 ? rig.frames_decoded.load() / seconds : 0.0,
+         static_cast<unsigned long long>(rig.frames_dropped.load()));
+  int status = 0;
+  for (int s : statuses) {
+    status = std::max(status, s);
+  }
+  return status;
+}
+
+void PrintWriterStats(const char* name,
+                      const carlink::FileWriter::Stats& stats) {
+  printf("%s: %llu writes, %.1f MB, %llu errors, %llu dropped | "
+         "write latency p50 %.2f ms p99 %.2f ms p99.9 %.2f ms max %.2f ms | "
+         "backpressure %llu waits, %.1f ms\n",
+         name, static_cast<unsigned long long>(stats.writes),
+         stats.bytes / 1e6, static_cast<unsigned long long>(stats.errors),
+         static_cast<unsigned long long>(stats.dropped_appends),
+         stats.latency_p50_ns / 1e6, stats.latency_p99_ns / 1e6,
+         stats.latency_p999_ns / 1e6, stats.latency_max_ns / 1e6,
+         static_cast<unsigned long long>(stats.backpressure_waits),
+         stats.backpressure_ns / 1e6);
+}
+
+// Per lane, so background work crowding out video shows.
+void PrintWorkerPool(const carlink::WorkerPool::Stats& stats) {
+  printf("task pool: %u threads\n", stats.threads);
+  for (int i = 0; i < carlink::WorkerPool::kLaneCount; i++) {
+    const carlink::WorkerPool::LaneStats& lane = stats.lanes[i];
+    printf("  %-10s %8llu tasks, %llu stolen | busy %5.1f%% | wait avg "
+           "%.3f ms max %.3f ms\n",
+           carlink::WorkerPool::LaneName(
+               static_cast<carlink::WorkerPool::Lane>(i)),
+           static_cast<unsigned long long>(lane.tasks_run),
+           static_cast<unsigned long long>(lane.tasks_stolen),
+           lane.utilization * 100,
+           lane.tasks_run > 0 ? lane.wait_ns / 1e6 / lane.tasks_run : 0.0,
+           lane.wait_max_ns / 1e6);
+  }
+}
+
+void PrintCaptureStats(const carlink::CaptureWriter::Stats& stats) {
+  printf("capture: %llu messages, %llu keyframes, %.1f MB, %llu dropped\n",
+         static_cast<unsigned long long>(stats.messages),
+         static_cast<unsigned long long>(stats.keyframes), stats.bytes / 1e6,
+         static_cast<unsigned long long>(stats.dropped_messages));
+  if (stats.blocks > 0) {
+    // Throughput per compression thread.
+    printf("compression: %llu blocks, %.1f MB stored, ratio %.2f, "
+           "%.0f MB/s\n",
+           static_cast<unsigned long long>(stats.blocks),
+           stats.stored_bytes / 1e6,
+           static_cast<double>(stats.bytes) / stats.stored_bytes,
+           stats.compress_ns > 0 ? stats.bytes * 1e3 / stats.compress_ns
+                                 : 0.0);
+  }
+  PrintWriterStats("capture", stats.file);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    PrintUsage(argv[0]);
+    return 2;
+  }
+
+  struct sigaction action = {};
+  action.sa_handler = HandleSignal;
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+
+  int64_t deadline_ns =
+      options.duration_s > 0
+          ? carlink::MonotonicNanos() +
+                static_cast<int64_t>(options.duration_s) * 1000000000
+          : 0;
+
+  std::unique_ptr<Soak> soak;
+  if (options.soak_hours > 0) {
+    soak = std::make_unique<Soak>(options.soak_thresholds);
+    if (!soak->monitor.OpenCsv(options.soak_csv)) {
+      return 1;
+    }
+    soak->start_ns = carlink::MonotonicNanos();
+    soak->last_sample_ns = soak->start_ns;
+    soak->interval_ns = int64_t{options.soak_interval_s} * 1000000000;
+    if (deadline_ns == 0) {
+      deadline_ns = soak->start_ns +
+                    static_cast<int64_t>(options.soak_hours * 3600e9);
+    }
+  }
+
+  carlink::FileWriter::Options file_options;
+  file_options.direct = options.direct_io;
+  carlink::FileLogSink log_file(file_options);
+  // Pipeline threads only copy lines into the ring; its flusher writes them.
+  carlink::LogRing log_ring(log_file.batch_sink());
+  if (!options.log_file.empty()) {
+    if (!log_file.Open(options.log_file)) {
+      return 1;
+    }
+    log_ring.Start();
+    carlink::SetLogRing(&log_ring);
+  }
+
+  // The CPU budget of every parallel stage, fixed for the run.
+  carlink::WorkerPool workers(options.threads);
+
+  // One capture across reconnects.
+  carlink::CaptureWriter::Options capture_options;
+  capture_options.file = file_options;
+  capture_options.compress = options.compress;
+  capture_options.pool = &workers;
+  carlink::CaptureWriter capture(capture_options);
+  if (!options.record.empty() && !capture.Open(options.record)) {
+    carlink::SetLogRing(nullptr);
+    return 1;
+  }
+
+  if (!options.trace.empty()) {
+    carlink::StartTracing();
+  }
+  int status = 0;
+  if (!options.replay.empty()) {
+    status = RunReplay(options);
+  } else if (options.sessions > 1) {
+    status = RunRig(options, deadline_ns, &workers);
+  } else {
+    status = RunSessions(options, deadline_ns, &workers, &capture, soak.get(),
+                         nullptr, -1);
+  }
+  if (!options.trace.empty()) {
+    carlink::StopTracing();
+    carlink::WriteChromeTrace(options.trace);
+  }
+
+  if (capture.is_open()) {
+    capture.Close();
+    PrintCaptureStats(capture.stats());
+  }
+  const carlink::WorkerPool::Stats work = workers.stats();
+  if (work.lanes[carlink::WorkerPool::kRealTime].tasks_run +
+          work.lanes[carlink::WorkerPool::kBackground].tasks_run >
+      0) {
+    PrintWorkerPool(work);
+  }
+  if (!options.log_file.empty()) {
+    carlink::SetLogRing(nullptr);
+    log_ring.Stop();
+    log_file.Close();
+    PrintWriterStats("log", log_file.stats());
+    const carlink::LogRing::Stats ring = log_ring.stats();
+    printf("log ring: %llu lines in %llu batches, %llu dropped (%llu rate "
+           "limited)\n",
+           static_cast<unsigned long long>(ring.records),
+           static_cast<unsigned long long>(ring.batches),
+           static_cast<unsigned long long>(ring.dropped_full +
+                                           ring.dropped_rate_limited),
+           static_cast<unsigned long long>(ring.dropped_rate_limited));
+  }
+  if (soak) {
+    printf("%s", soak->monitor.Summary().c_str());
+    printf("soak samples: %s\n", options.soak_csv.c_str());
+    if (soak->monitor.failed()) {
+      status = 1;
+    }
+  }
+  return status;
+}
+
@@ -0,0 +1,207 @@
+// Measures glass-to-glass latency without hardware: a simulated dongle
+// streams frames carrying a frame counter, the session decodes them into
+// the same triple buffer the Flutter texture reads, and a presenter thread
+// reads the counter back from every frame it shows. Touches sent to the
+// dongle are echoed into the picture, giving input-to-display latency.
+
+#include <getopt.h>
+#include <signal.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "core/clock.h"
+#include "core/glass_to_glass.h"
+#include "core/input.h"
+#include "core/pcm_h264.h"
+#include "core/rgba_frame_buffer.h"
+#include "core/session.h"
+#include "core/simulated_dongle.h"
+#include "core/video_decoder.h"
+
+namespace {
+
+struct Options {
+  int duration_s = 10;
+  int width = 800;
+  int height = 480;
+  int fps = 60;
+  // Presenter refresh rate.
+  int refresh_hz = 60;
+  // Between touches; 0 for none.
+  int touch_interval_ms = 250;
+};
+
+std::atomic<bool> g_stop{false};
+
+void HandleSignal(int) { g_stop.store(true); }
+
+void PrintUsage(const char* argv0) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  -d, --duration S         run for S seconds (default 10)\n"
+          "      --size WxH           stream size, multiples of 16 and at "
+          "least 480 wide\n"
+          "                           (default 800x480)\n"
+          "      --fps N              stream frame rate (default 60)\n"
+          "      --refresh N          presenter refresh rate (default 60)\n"
+          "      --touch-interval MS  send a touch every MS, 0 for none "
+          "(default 250)\n",
+          argv0);
+}
+
+bool ParseOptions(int argc, char** argv, Options* options) {
+  enum { kSize = 256, kFps, kRefresh, kTouchInterval };
+  static const struct option kLongOptions[] = {
+      {"duration", required_argument, nullptr, 'd'},
+      {"size", required_argument, nullptr, kSize},
+      {"fps", required_argument, nullptr, kFps},
+      {"refresh", required_argument, nullptr, kRefresh},
+      {"touch-interval", required_argument, nullptr, kTouchInterval},
+      {"help", no_argument, nullptr, 'h'},
+      {nullptr, 0, nullptr, 0},
+  };
+
+  int option;
+  while ((option = getopt_long(argc, argv, "d:h", kLongOptions, nullptr)) !=
+         -1) {
+    switch (option) {
+      case 'd':
+        options->duration_s = atoi(optarg);
+        break;
+      case kSize:
+        if (sscanf(optarg, "%dx%d", &options->width, &options->height) != 2) {
+          return false;
+        }
+        break;
+      case kFps:
+        options->fps = atoi(optarg);
+        break;
+      case kRefresh:
+        options->refresh_hz = atoi(optarg);
+        break;
+      case kTouchInterval:
+        options->touch_interval_ms = atoi(optarg);
+        break;
+      default:
+        return false;
+    }
+  }
+  return optind == argc && options->duration_s > 0 && options->fps > 0 &&
+         options->refresh_hz > 0 && options->touch_interval_ms >= 0 &&
+         options->width >= carlink::kCounterPatternMinWidth &&
+         options->width % 16 == 0 && options->height >= 16 &&
+         options->height % 16 == 0;
+}
+
+double Ms(uint64_t ns) { return ns / 1e6; }
+
+void PrintHistogram(const char* name, const carlink::Histogram& histogram) {
+  printf("%-18s %6llu samples | p50 %7.2f ms | p99 %7.2f ms | max %7.2f ms\n",
+         name, static_cast<unsigned long long>(histogram.count()),
+         Ms(histogram.Percentile(50)), Ms(histogram.Percentile(99)),
+         Ms(histogram.max()));
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    PrintUsage(argv[0]);
+    return 2;
+  }
+  signal(SIGINT, HandleSignal);
+  signal(SIGTERM, HandleSignal);
+
+  carlink::CounterPatternSource source(options.width, options.height);
+  carlink::GlassToGlassProbe probe(&source);
+
+  carlink::SimulatedDongle::Options simulated;
+  simulated.video_source = &source;
+  simulated.audio = false;
+  auto dongle = std::make_unique<carlink::SimulatedDongle>(simulated);
+
+  // The counter stream is plain H.264, but without FFmpeg only the PCM
+  // decoder produces pictures.
+  std::unique_ptr<carlink::VideoDecoder> decoder =
+      carlink::CreateVideoDecoder();
+  if (std::string(decoder->name()) == "null") {
+    decoder = carlink::CreatePcmH264Decoder();
+  }
+  printf("%dx%d at %d fps, presenting at %d Hz, decoder %s\n", options.width,
+         options.height, options.fps, options.refresh_hz, decoder->name());
+
+  carlink::RgbaFrameBuffer frames;
+  carlink::SessionOptions session_options;
+  session_options.config.width = options.width;
+  session_options.config.height = options.height;
+  session_options.config.fps = options.fps;
+  carlink::SessionListener listener;
+  carlink::Session session(std::move(dongle), session_options,
+                           std::move(decoder), &frames, nullptr, &listener);
+  if (!session.Start()) {
+    return 1;
+  }
+
+  // Stands in for the raster thread: picks up the newest frame once per
+  // refresh, like the Flutter texture.
+  std::atomic<bool> presenting{true};
+  std::thread presenter([&frames, &probe, &presenting, &options] {
+    const auto period = std::chrono::nanoseconds(1000000000 /
+                                                 options.refresh_hz);
+    auto next = std::chrono::steady_clock::now();
+    while (presenting.load()) {
+      const carlink::RgbaFrame* frame = frames.AcquireLatest();
+      if (frame != nullptr) {
+        probe.OnPresented(*frame, carlink::MonotonicNanos());
+      }
+      next += period;
+      std::this_thread::sleep_until(next);
+    }
+  });
+
+  const int64_t end_ns =
+      carlink::MonotonicNanos() + int64_t{options.duration_s} * 1000000000;
+  uint16_t touch_id = 0;
+  while (!g_stop.load() && !session.failed() &&
+         carlink::MonotonicNanos() < end_ns) {
+    if (options.touch_interval_ms == 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      continue;
+    }
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds(options.touch_interval_ms));
+    touch_id = touch_id % 9999 + 1;
+    const float x = carlink::GlassToGlassProbe::TouchX(touch_id);
+    // Before sending, so the echo can never beat the stamp.
+    probe.OnTouchSent(touch_id, carlink::MonotonicNanos());
+    session.Send(carlink::EncodeTouch(carlink::TouchAction::kDown, x, 0.5f));
+    session.Send(carlink::EncodeTouch(carlink::TouchAction::kUp, x, 0.5f));
+  }
+
+  presenting.store(false);
+  presenter.join();
+  const carlink::Session::Stats stats = session.stats();
+  session.Stop();
+
+  const carlink::GlassToGlassProbe::Stats probe_stats = probe.stats();
+  printf("sent %u frames | decoded %llu | presented %llu | dropped %llu | "
+         "unreadable %llu\n",
+         source.frames(),
+         static_cast<unsigned long long>(stats.video.frames_decoded),
+         static_cast<unsigned long long>(probe_stats.presented),
+         static_cast<unsigned long long>(probe_stats.dropped),
+         static_cast<unsigned long long>(probe_stats.unreadable));
+  PrintHistogram("glass-to-glass", probe.latency());
+  printf("touches sent %llu | echoed %llu\n",
+         static_cast<unsigned long long>(probe_stats.touches_sent),
+         static_cast<unsigned long long>(probe_stats.touches_seen));
+  PrintHistogram("touch-to-display", probe.touch_latency());
+  return session.failed() ? 1 : 0;
+}
@@ -0,0 +1,364 @@
+#include "usb_bridge.h"
+
+#include <time.h>
+
+#include "core/audio.h"
+#include "core/clock.h"
+#include "core/log.h"
+#include "core/trace.h"
+
+namespace carlink {
+
+namespace {
+
+// Per init message, Dart's write timeout.
+constexpr unsigned int kConnectWriteTimeoutMs = 1000;
+
+// MediaData's media type for an encoded album cover image.
+constexpr uint32_t kMediaTypeAlbumCover = 3;
+
+}  // namespace
+
+UsbBridge::UsbBridge(MessageCallback on_message, ErrorCallback on_error,
+                     std::function<void()> on_frame, WorkerPool* workers)
+    : on_message_(std::move(on_message)),
+      on_error_(std::move(on_error)),
+      pool_(BufferPool::Create()),
+      frames_(std::make_shared<RgbaFrameBuffer>(std::move(on_frame),
+                                                workers)),
+      video_(CreateVideoDecoder(), frames_.get()),
+      audio_(CreateAudioSink()) {
+  video_.SetKeyframeRequestHandler([this] { RequestKeyframe(); });
+  video_.set_flight_recorder(&flight_recorder_);
+}
+
+UsbBridge::~UsbBridge() {
+  Close();
+}
+
+bool UsbBridge::Open(const std::string& identifier) {
+  Close();
+  std::unique_ptr<UsbDevice> device = UsbDevice::Open(identifier);
+  if (!device) {
+    return false;
+  }
+  device_ = std::move(device);
+  return true;
+}
+
+void UsbBridge::Close() {
+  StopReadingLoop();
+  device_.reset();
+  configuration_ = UsbConfigurationInfo();
+  endpoint_out_ = -1;
+}
+
+bool UsbBridge::Reset() {
+  return device_ && device_->Reset();
+}
+
+bool UsbBridge::GetConfiguration(int index,
+                                 UsbConfigurationInfo* configuration) {
+  if (!device_ || !device_->GetConfiguration(index, configuration)) {
+    return false;
+  }
+  configuration_ = *configuration;
+  return true;
+}
+
+bool UsbBridge::SetConfiguration(int id) {
+  return device_ && device_->SetConfiguration(id);
+}
+
+bool UsbBridge::ClaimInterface(int id, int alternate_setting) {
+  if (!device_ || !device_->ClaimInterface(id, alternate_setting)) {
+    return false;
+  }
+  for (const UsbInterfaceInfo& interface : configuration_.interfaces) {
+    if (interface.id != id || interface.alternate_setting != alternate_setting) {
+      continue;
+    }
+    for (const UsbEndpointInfo& endpoint : interface.endpoints) {
+      if (endpoint.direction == 0x00) {
+        endpoint_out_ = endpoint.address();
+        break;
+      }
+    }
+  }
+  return true;
+}
+
+bool UsbBridge::ReleaseInterface(int id) {
+  return device_ && device_->ReleaseInterface(id);
+}
+
+bool UsbBridge::StartReadingLoop(uint8_t endpoint, int timeout_ms) {
+  if (!device_ || (read_loop_ && read_loop_->running())) {
+    return false;
+  }
+  StopReadingLoop();
+
+  streaming_notified_ = false;
+  video_.Start();
+  if (!audio_.Start()) {
+    Log(LogLevel::kWarning, "[AUDIO] %s sink failed to open",
+        audio_.sink_name());
+  }
+
+  transport_.reset(new UsbTransport(device_, endpoint, 0));
+  read_loop_.reset(new ReadLoop(
+      transport_.get(), pool_,
+      [this](Message message) { OnMessage(std::move(message)); },
+      [this](const std::string& error) {
+        RecordCounters();
+        flight_recorder_.DumpAsync("ReadingLoopError " + error);
+        on_error_(error);
+      }));
+  read_loop_->set_flight_recorder(&flight_recorder_);
+  read_loop_->Start(timeout_ms);
+  return true;
+}
+
+bool UsbBridge::ConnectDongle(const DongleConfig& config, int timeout_ms,
+                              Connection* connection) {
+  for (const UsbDeviceInfo& info : UsbDevice::List()) {
+    if (!IsKnownDongle(info.vendor_id, info.product_id) ||
+        !Open(info.identifier)) {
+      continue;
+    }
+    UsbConfigurationInfo configuration;
+    if (!GetConfiguration(0, &configuration) ||
+        configuration.interfaces.empty() ||
+        !SetConfiguration(configuration.id)) {
+      Close();
+      continue;
+    }
+    const UsbInterfaceInfo& interface = configuration.interfaces.front();
+    int endpoint_in = -1;
+    for (const UsbEndpointInfo& endpoint : interface.endpoints) {
+      if (endpoint.direction == 0x80) {
+        endpoint_in = endpoint.address();
+        break;
+      }
+    }
+    if (!ClaimInterface(interface.id, interface.alternate_setting) ||
+        endpoint_in < 0 || endpoint_out_ < 0 ||
+        !StartReadingLoop(endpoint_in, timeout_ms)) {
+      Close();
+      continue;
+    }
+
+    connection->device = info;
+    connection->configuration = configuration;
+    connection->endpoint_in = static_cast<uint8_t>(endpoint_in);
+    connection->endpoint_out = static_cast<uint8_t>(endpoint_out_);
+    connection->open = EncodeOpen(config);
+    for (const EncodedMessage& message :
+         BuildInitMessages(config, time(nullptr))) {
+      const int length = static_cast<int>(message.size());
+      if (Write(device_, connection->endpoint_out, message.data(), length,
+                kConnectWriteTimeoutMs) != length) {
+        Log(LogLevel::kWarning, "[USB] handshake with %s failed",
+            info.identifier.c_str());
+        Close();
+        return false;
+      }
+    }
+    Log(LogLevel::kInfo, "[USB] connected to dongle %04x:%04x at %s",
+        info.vendor_id, info.product_id, info.identifier.c_str());
+    return true;
+  }
+  return false;
+}
+
+void UsbBridge::StopReadingLoop() {
+  if (read_loop_) {
+    read_loop_->Stop();
+    read_loop_.reset();
+  }
+  transport_.reset();
+  video_.Stop();
+  audio_.Stop();
+}
+
+int UsbBridge::Write(const std::shared_ptr<UsbDevice>& device,
+                     uint8_t endpoint, const uint8_t* data, int length,
+                     unsigned int timeout_ms) {
+  TraceScope trace("usb.transfer_out", length);
+  int written;
+  {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    // libusb takes a non-const buffer for both directions.
+    written = device->BulkTransfer(endpoint, const_cast<uint8_t*>(data),
+                                   length, timeout_ms);
+  }
+  RecordWrite(data, length, written);
+  return written;
+}
+
+bool UsbBridge::WriteAsync(const std::shared_ptr<UsbDevice>& device,
+                           uint8_t endpoint, const uint8_t* data, int length,
+                           unsigned int timeout_ms,
+                           UsbDevice::TransferCallback done, void* context) {
+  PendingWrite* pending = new PendingWrite{this, data, length, done, context};
+  bool submitted;
+  {
+    // Submitted under the same lock as Write(), so a message split into
+    // several URBs never interleaves with another.
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    submitted = device->SubmitBulkTransfer(
+        endpoint, const_cast<uint8_t*>(data), length, timeout_ms,
+        &UsbBridge::OnWriteDone, pending);
+  }
+  if (!submitted) {
+    counters_.Add(kWriteFailures);
+    delete pending;
+  }
+  return submitted;
+}
+
+void UsbBridge::OnWriteDone(void* context, int written) {
+  std::unique_ptr<PendingWrite> pending(static_cast<PendingWrite*>(context));
+  pending->bridge->RecordWrite(pending->data, pending->length, written);
+  pending->done(pending->context, written);
+}
+
+void UsbBridge::RecordWrite(const uint8_t* data, int length, int written) {
+  if (written != length) {
+    counters_.Add(kWriteFailures);
+    return;
+  }
+  counters_.Add(kTransfersOut);
+  counters_.Add(kBytesOut, length);
+  MessageHeader header;
+  if (length >= static_cast<int>(kHeaderSize) &&
+      DecodeHeader(data, &header) == HeaderStatus::kOk) {
+    switch (static_cast<MessageType>(header.type)) {
+      case MessageType::kTouch:
+        counters_.Add(kTouchEvents);
+        break;
+      case MessageType::kMultiTouch:
+        counters_.Add(kMultiTouchEvents);
+        break;
+      case MessageType::kAudioData:
+        counters_.Add(kMicrophonePackets);
+        break;
+      default:
+        break;
+    }
+  }
+  flight_recorder_.RecordOutbound(data, length);
+  capture_.RecordEncoded(CaptureDirection::kOutbound, data, length,
+                         MonotonicNanos());
+}
+
+UsbBridge::Stats UsbBridge::stats() const {
+  uint64_t counters[kCounterCount];
+  counters_.Snapshot(counters);
+  Stats stats;
+  if (read_loop_) {
+    stats.read = read_loop_->stats();
+  }
+  stats.transfers_out = counters[kTransfersOut];
+  stats.bytes_out = counters[kBytesOut];
+  stats.write_failures = counters[kWriteFailures];
+  stats.touch_events = counters[kTouchEvents];
+  stats.multi_touch_events = counters[kMultiTouchEvents];
+  stats.microphone_packets = counters[kMicrophonePackets];
+  stats.video = video_.stats();
+  stats.audio = audio_.stats();
+  stats.pool = pool_->stats();
+  stats.frames_published = frames_->frames_published();
+  return stats;
+}
+
+FlightRecorder* UsbBridge::PrepareFlightRecorderDump() {
+  RecordCounters();
+  return &flight_recorder_;
+}
+
+void UsbBridge::RecordCounters() {
+  if (read_loop_) {
+    const ReadLoop::Stats read = read_loop_->stats();
+    flight_recorder_.RecordCounter(FlightRecorder::kMessagesIn,
+                                   read.messages);
+    flight_recorder_.RecordCounter(FlightRecorder::kBytesIn, read.bytes);
+    flight_recorder_.RecordCounter(FlightRecorder::kResyncs, read.resyncs);
+  }
+  const VideoPipeline::Stats video = video_.stats();
+  flight_recorder_.RecordCounter(FlightRecorder::kFramesDecoded,
+                                 video.frames_decoded);
+  flight_recorder_.RecordCounter(FlightRecorder::kFramesDropped,
+                                 video.frames_dropped);
+  flight_recorder_.RecordCounter(FlightRecorder::kDecodeErrors,
+                                 video.decode_errors);
+  const AudioEngine::Stats audio = audio_.stats();
+  flight_recorder_.RecordCounter(FlightRecorder::kAudioUnderruns,
+                                 audio.underruns);
+  flight_recorder_.RecordCounter(FlightRecorder::kAudioOverflowFrames,
+                                 audio.overflow_frames);
+}
+
+void UsbBridge::ResetVideo() {
+  video_.Reset();
+}
+
+bool UsbBridge::StartRecording(const std::string& path) {
+  return capture_.Open(path);
+}
+
+void UsbBridge::StopRecording() {
+  capture_.Close();
+}
+
+void UsbBridge::RequestKeyframe() {
+  std::shared_ptr<UsbDevice> device = device_;
+  const int endpoint = endpoint_out_;
+  if (!device || endpoint < 0) {
+    return;
+  }
+  const EncodedMessage message = EncodeCommand(Command::kFrame);
+  Write(device, endpoint, message.data(), message.size(), 1000);
+}
+
+void UsbBridge::OnMessage(Message message) {
+  const uint32_t type = message.header.type;
+  flight_recorder_.Record(FlightRecorder::Kind::kInbound, type,
+                          message.payload.size());
+  if (flight_recorder_.CounterSnapshotDue()) {
+    RecordCounters();
+  }
+  capture_.Record(CaptureDirection::kInbound, type, message.payload.data(),
+                  message.payload.size(), message.arrival_ns);
+
+  if (type == static_cast<uint32_t>(MessageType::kVideoData)) {
+    video_.Push(std::move(message));
+    // Like the Android plugin, tell Dart once that video is streaming.
+    if (!streaming_notified_) {
+      streaming_notified_ = true;
+      on_message_(type, {});
+    }
+    return;
+  }
+
+  const uint8_t* payload = message.payload.data();
+  size_t length = message.payload.size();
+  if (type == static_cast<uint32_t>(MessageType::kAudioData)) {
+    AudioPacket packet;
+    if (ParseAudioPacket(payload, length, &packet) &&
+        packet.sample_count > 0) {
+      audio_.Push(packet);
+      length = kAudioDataHeaderSize;
+    }
+  }
+  if (type == static_cast<uint32_t>(MessageType::kMediaData) &&
+      on_album_cover_ && length > 4 &&
+      ReadU32(payload) == kMediaTypeAlbumCover) {
+    // Decoded and cached natively; Dart shows the album cover texture.
+    on_album_cover_(std::vector<uint8_t>(payload + 4, payload + length));
+    return;
+  }
+  on_message_(type, std::vector<uint8_t>(payload, payload + length));
+}
+
+}  // namespace carlink
@@ -0,0 +1,201 @@
+#ifndef FLUTTER_PLUGIN_CARLINK_USB_BRIDGE_H_
+#define FLUTTER_PLUGIN_CARLINK_USB_BRIDGE_H_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "core/audio_engine.h"
+#include "core/buffer_pool.h"
+#include "core/capture_writer.h"
+#include "core/flight_recorder.h"
+#include "core/protocol.h"
+#include "core/read_loop.h"
+#include "core/rgba_frame_buffer.h"
+#include "core/sharded_counters.h"
+#include "core/usb_device.h"
+#include "core/video_pipeline.h"
+#include "core/worker_pool.h"
+
+namespace carlink {
+
+// Backs the USB half of the "carlink" method channel with the core
+// library. Dart still drives the protocol (handshake, heartbeat, UI), while
+// the read loop, H.264 decoding and PCM playout stay native: VideoData and
+// PCM AudioData never cross the channel.
+//
+// Methods are called on the main thread unless noted otherwise.
+class UsbBridge {
+ public:
+  // Read thread. |data| is the full payload, except for VideoData (empty,
+  // once when streaming starts) and PCM AudioData (the 12-byte prefix).
+  using MessageCallback =
+      std::function<void(uint32_t type, std::vector<uint8_t> data)>;
+  // Read thread.
+  using ErrorCallback = std::function<void(const std::string& error)>;
+  // Read thread. The encoded image of a MediaData album cover, which then
+  // does not reach the MessageCallback.
+  using AlbumCoverCallback = std::function<void(std::vector<uint8_t> image)>;
+
+  // What ConnectDongle() opened, for Dart to pick up.
+  struct Connection {
+    UsbDeviceInfo device;
+    UsbConfigurationInfo configuration;
+    uint8_t endpoint_in = 0;
+    uint8_t endpoint_out = 0;
+    // The Open message of the handshake, to compare with Dart's.
+    EncodedMessage open;
+  };
+
+  // Everything getStats reports, read in one go.
+  struct Stats {
+    // Bulk-IN and demuxing; zero while the read loop is stopped.
+    ReadLoop::Stats read;
+    // Bulk-OUT transfers from Dart.
+    uint64_t transfers_out = 0;
+    uint64_t bytes_out = 0;
+    uint64_t write_failures = 0;
+    // Input among them.
+    uint64_t touch_events = 0;
+    uint64_t multi_touch_events = 0;
+    uint64_t microphone_packets = 0;
+    VideoPipeline::Stats video;
+    AudioEngine::Stats audio;
+    BufferPool::Stats pool;
+    uint64_t frames_published = 0;
+  };
+
+  // |on_frame| runs on the decoder thread after each converted frame.
+  // Frames are converted in bands on |workers|, if given; not owned.
+  UsbBridge(MessageCallback on_message, ErrorCallback on_error,
+            std::function<void()> on_frame, WorkerPool* workers = nullptr);
+  ~UsbBridge();
+
+  UsbBridge(const UsbBridge&) = delete;
+  UsbBridge& operator=(const UsbBridge&) = delete;
+
+  // Call before the read loop first starts.
+  void set_album_cover_handler(AlbumCoverCallback on_album_cover) {
+    on_album_cover_ = std::move(on_album_cover);
+  }
+
+  bool Open(const std::string& identifier);
+  void Close();
+  bool Reset();
+
+  bool GetConfiguration(int index, UsbConfigurationInfo* configuration);
+  bool SetConfiguration(int id);
+  bool ClaimInterface(int id, int alternate_setting);
+  bool ReleaseInterface(int id);
+
+  bool StartReadingLoop(uint8_t endpoint, int timeout_ms);
+  void StopReadingLoop();
+  bool reading() const { return read_loop_ && read_loop_->running(); }
+
+  // What Dart does to bring up the dongle, without Dart: finds it, opens it,
+  // claims its first interface, starts the read loop on the IN endpoint and
+  // sends the init messages for |config|. Blocks; may run on any one thread
+  // as long as no other method is called meanwhile. False, with the device
+  // closed, if there was no dongle or the handshake could not be sent.
+  bool ConnectDongle(const DongleConfig& config, int timeout_ms,
+                     Connection* connection);
+
+  // The device for bulk transfers on a worker thread, or nullptr when
+  // closed. Holding it keeps the handle valid across a concurrent Close().
+  std::shared_ptr<UsbDevice> device() const { return device_; }
+
+  // Any thread. Serialises OUT transfers so messages never interleave.
+  int Write(const std::shared_ptr<UsbDevice>& device, uint8_t endpoint,
+            const uint8_t* data, int length, unsigned int timeout_ms);
+
+  // Any thread. Write() without waiting: submits the transfer, in order
+  // with the others, and returns. |done| gets what Write() would have
+  // returned, on the device's event thread; |data| must stay valid until
+  // then. False, without calling |done|, if it could not be submitted.
+  bool WriteAsync(const std::shared_ptr<UsbDevice>& device, uint8_t endpoint,
+                  const uint8_t* data, int length, unsigned int timeout_ms,
+                  UsbDevice::TransferCallback done, void* context);
+
+  // resetH264Renderer.
+  void ResetVideo();
+
+  // startRecording/stopRecording: captures every message in both
+  // directions to |path| (see core/capture_format.h).
+  bool StartRecording(const std::string& path);
+  void StopRecording();
+
+  const std::shared_ptr<RgbaFrameBuffer>& frames() const { return frames_; }
+
+  // getStats. Video stats include the latency stages recorded by the
+  // texture.
+  Stats stats() const;
+
+  // Where the flight recorder dumps on a read loop or decoder error.
+  void set_flight_recorder_dir(const std::string& directory) {
+    flight_recorder_.set_directory(directory);
+  }
+  // dumpFlightRecorder, for the HeartbeatTimeout Dart detects: records the
+  // counters and returns the recorder, whose Dump() does the file I/O off
+  // the main thread. Valid as long as the bridge.
+  FlightRecorder* PrepareFlightRecorderDump();
+
+ private:
+  // An OUT transfer in flight from WriteAsync().
+  struct PendingWrite {
+    UsbBridge* bridge;
+    const uint8_t* data;
+    int length;
+    UsbDevice::TransferCallback done;
+    void* context;
+  };
+  static void OnWriteDone(void* context, int written);
+
+  void OnMessage(Message message);
+  void RequestKeyframe();
+  // Counts, records and captures a finished OUT transfer.
+  void RecordWrite(const uint8_t* data, int length, int written);
+  // Snapshots the counters into the flight recorder.
+  void RecordCounters();
+
+  MessageCallback on_message_;
+  ErrorCallback on_error_;
+  AlbumCoverCallback on_album_cover_;
+
+  std::shared_ptr<UsbDevice> device_;
+  UsbConfigurationInfo configuration_;
+  // OUT endpoint of the claimed interface, for keyframe requests.
+  int endpoint_out_ = -1;
+  std::mutex write_mutex_;
+
+  // Write() runs on GLib worker threads, WriteAsync() completes on the
+  // device's event thread.
+  enum Counter {
+    kTransfersOut,
+    kBytesOut,
+    kWriteFailures,
+    kTouchEvents,
+    kMultiTouchEvents,
+    kMicrophonePackets,
+    kCounterCount,
+  };
+  ShardedCounters counters_{kCounterCount};
+
+  FlightRecorder flight_recorder_;
+  std::shared_ptr<BufferPool> pool_;
+  std::shared_ptr<RgbaFrameBuffer> frames_;
+  VideoPipeline video_;
+  AudioEngine audio_;
+  std::unique_ptr<UsbTransport> transport_;
+  std::unique_ptr<ReadLoop> read_loop_;
+  CaptureWriter capture_;
+
+  // Read thread only.
+  bool streaming_notified_ = false;
+};
+
+}  // namespace carlink
+
+#endif  // FLUTTER_PLUGIN_CARLINK_USB_BRIDGE_H_
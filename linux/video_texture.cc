@@ -0,0 +1,68 @@
+#include "video_texture.h"
+
+struct _CarlinkVideoTexture {
+  FlPixelBufferTexture parent_instance;
+  std::shared_ptr<carlink::RgbaFrameBuffer>* frames;
+  // Held across AcquireLatest(), whose frames point into the bridge's
+  // video pipeline; |detached| once that may be gone.
+  GMutex mutex;
+  gboolean detached;
+};
+
+G_DEFINE_TYPE(CarlinkVideoTexture, carlink_video_texture,
+              fl_pixel_buffer_texture_get_type())
+
+// Runs on the raster thread. The frame buffer hands out the newest frame
+// without blocking the decoder.
+static gboolean carlink_video_texture_copy_pixels(FlPixelBufferTexture* texture,
+                                                  const uint8_t** out_buffer,
+                                                  uint32_t* width,
+                                                  uint32_t* height,
+                                                  GError** error) {
+  CarlinkVideoTexture* self = CARLINK_VIDEO_TEXTURE(texture);
+  g_mutex_lock(&self->mutex);
+  const carlink::RgbaFrame* frame =
+      self->detached ? nullptr : (*self->frames)->AcquireLatest();
+  g_mutex_unlock(&self->mutex);
+  if (frame == nullptr) {
+    g_set_error(error, g_quark_from_static_string("carlink"), 0,
+                "no video frame");
+    return FALSE;
+  }
+  *out_buffer = frame->pixels.data();
+  *width = frame->width;
+  *height = frame->height;
+  return TRUE;
+}
+
+static void carlink_video_texture_finalize(GObject* object) {
+  CarlinkVideoTexture* self = CARLINK_VIDEO_TEXTURE(object);
+  delete self->frames;
+  g_mutex_clear(&self->mutex);
+  G_OBJECT_CLASS(carlink_video_texture_parent_class)->finalize(object);
+}
+
+static void carlink_video_texture_class_init(CarlinkVideoTextureClass* klass) {
+  G_OBJECT_CLASS(klass)->finalize = carlink_video_texture_finalize;
+  FL_PIXEL_BUFFER_TEXTURE_CLASS(klass)->copy_pixels =
+      carlink_video_texture_copy_pixels;
+}
+
+static void carlink_video_texture_init(CarlinkVideoTexture* self) {
+  g_mutex_init(&self->mutex);
+}
+
+CarlinkVideoTexture* carlink_video_texture_new(
+    std::shared_ptr<carlink::RgbaFrameBuffer> frames) {
+  CarlinkVideoTexture* self = CARLINK_VIDEO_TEXTURE(
+      g_object_new(carlink_video_texture_get_type(), nullptr));
+  self->frames = new std::shared_ptr<carlink::RgbaFrameBuffer>(
+      std::move(frames));
+  return self;
+}
+
+void carlink_video_texture_detach(CarlinkVideoTexture* self) {
+  g_mutex_lock(&self->mutex);
+  self->detached = TRUE;
+  g_mutex_unlock(&self->mutex);
+}
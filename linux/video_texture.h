@@ -0,0 +1,21 @@
+#ifndef FLUTTER_PLUGIN_CARLINK_VIDEO_TEXTURE_H_
+#define FLUTTER_PLUGIN_CARLINK_VIDEO_TEXTURE_H_
+
+#include <flutter_linux/flutter_linux.h>
+
+#include <memory>
+
+#include "core/rgba_frame_buffer.h"
+
+G_DECLARE_FINAL_TYPE(CarlinkVideoTexture, carlink_video_texture, CARLINK,
+                     VIDEO_TEXTURE, FlPixelBufferTexture)
+
+// Pixel buffer texture presenting the newest decoded frame in |frames|.
+CarlinkVideoTexture* carlink_video_texture_new(
+    std::shared_ptr<carlink::RgbaFrameBuffer> frames);
+
+// Stops presenting new frames; once it returns the raster thread no longer
+// touches the bridge's video pipeline, which may then go away.
+void carlink_video_texture_detach(CarlinkVideoTexture* self);
+
+#endif  // FLUTTER_PLUGIN_CARLINK_VIDEO_TEXTURE_H_